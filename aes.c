@@ -7,6 +7,12 @@
  */
 
 #include "aes.h"
+#include "aesni.h"
+#include "bitslice.h"
+#include "vperm.h"
+#include "vaes.h"
+#include <pthread.h>
+#include <string.h>
 
 /** The starting index of fourth word */
 #define FOURTH_START 15
@@ -32,6 +38,60 @@
 /** The index for the fourth row of a square */
 #define FOURTH_ROW 3
 
+/** Number of entries in each round table, one per byte value. */
+#define TABLE_SIZE 256
+
+/** Mask selecting the low byte of a word. */
+#define BYTE_MASK 0xFF
+
+/** Reads four bytes as a big-endian word. */
+#define GET_WORD( p ) ( ( ( uint32_t ) ( p )[ 0 ] << 24 ) | \
+                        ( ( uint32_t ) ( p )[ 1 ] << 16 ) | \
+                        ( ( uint32_t ) ( p )[ 2 ] << 8 ) | \
+                        ( ( uint32_t ) ( p )[ 3 ] ) )
+
+/** Writes a word as four big-endian bytes. */
+#define PUT_WORD( p, w ) { \
+        ( p )[ 0 ] = ( byte ) ( ( w ) >> 24 ); \
+        ( p )[ 1 ] = ( byte ) ( ( w ) >> 16 ); \
+        ( p )[ 2 ] = ( byte ) ( ( w ) >> 8 ); \
+        ( p )[ 3 ] = ( byte ) ( w ); \
+}
+
+/** Rotates a word right by one byte. */
+#define ROTATE_BYTE( w ) ( ( ( w ) >> 8 ) | ( ( w ) << 24 ) )
+
+/** Number of blocks the interleaved table rounds keep in flight. */
+#define TABLE_LANES 4
+
+/**
+        Builds the encryption and decryption tables exactly once, even when
+        the first keys are set up on several threads at the same time.
+ */
+static pthread_once_t tablesOnce = PTHREAD_ONCE_INIT;
+
+/** Picks the best backend exactly once, for the same reason. */
+static pthread_once_t bestOnce = PTHREAD_ONCE_INIT;
+
+/** The fastest backend this processor supports, once bestOnce has run. */
+static AesBackend best = AES_BACKEND_REFERENCE;
+
+/**
+        Encryption round tables. Te0[ x ] is the mixColumns product of the
+        column ( S[ x ], 0, 0, 0 ); Te1 through Te3 are the same words rotated
+        for the other three rows.
+ */
+static uint32_t Te0[ TABLE_SIZE ];
+static uint32_t Te1[ TABLE_SIZE ];
+static uint32_t Te2[ TABLE_SIZE ];
+static uint32_t Te3[ TABLE_SIZE ];
+
+/** Decryption round tables, built the same way from invSubstBox. */
+static uint32_t Td0[ TABLE_SIZE ];
+static uint32_t Td1[ TABLE_SIZE ];
+static uint32_t Td2[ TABLE_SIZE ];
+static uint32_t Td3[ TABLE_SIZE ];
+
 /**
         Return the sBox substitution value for a given byte value.
 
@@ -606,17 +666,467 @@ void unMixColumns( byte square[ BLOCK_ROWS ][ BLOCK_COLS ] )
         }
 }
 
-void encryptBlock( byte data[ BLOCK_SIZE ], byte key[ BLOCK_SIZE ] )
+/**
+        This function fills in the Te and Td round tables from the sBox and
+        the mixColumns coefficients. It is run through tablesOnce.
+ */
+static void buildTables( void )
+{
+        int x = 0;
+        for ( x = 0; x < TABLE_SIZE; x++ ) {
+                // Column ( 2s, s, s, 3s ) from the first row of mixMatrix
+                byte s = substBox( x );
+                uint32_t word = ( ( uint32_t ) fieldMul( s, 0x02 ) << 24 ) |
+                                ( ( uint32_t ) s << 16 ) |
+                                ( ( uint32_t ) s << 8 ) |
+                                fieldMul( s, 0x03 );
+                Te0[ x ] = word;
+                Te1[ x ] = ROTATE_BYTE( Te0[ x ] );
+                Te2[ x ] = ROTATE_BYTE( Te1[ x ] );
+                Te3[ x ] = ROTATE_BYTE( Te2[ x ] );
+
+                // Column ( 14s, 9s, 13s, 11s ) from the first row of
+                // invMixMatrix
+                s = invSubstBox( x );
+                word = ( ( uint32_t ) fieldMul( s, 0x0E ) << 24 ) |
+                        ( ( uint32_t ) fieldMul( s, 0x09 ) << 16 ) |
+                        ( ( uint32_t ) fieldMul( s, 0x0D ) << 8 ) |
+                        fieldMul( s, 0x0B );
+                Td0[ x ] = word;
+                Td1[ x ] = ROTATE_BYTE( Td0[ x ] );
+                Td2[ x ] = ROTATE_BYTE( Td1[ x ] );
+                Td3[ x ] = ROTATE_BYTE( Td2[ x ] );
+        }
+}
+
+/**
+        This function applies unMixColumns to one column word. Feeding the
+        sBox output into the Td tables cancels their built-in invSubstBox.
+
+        @param word The column to transform
+        @return The transformed column
+ */
+static uint32_t unMixWord( uint32_t word )
+{
+        return Td0[ substBox( word >> 24 ) ] ^
+                Td1[ substBox( ( word >> 16 ) & BYTE_MASK ) ] ^
+                Td2[ substBox( ( word >> 8 ) & BYTE_MASK ) ] ^
+                Td3[ substBox( word & BYTE_MASK ) ];
+}
+
+bool aesBackendAvailable( AesBackend backend )
+{
+        switch ( backend ) {
+                case AES_BACKEND_REFERENCE:
+                case AES_BACKEND_TTABLE:
+                case AES_BACKEND_BITSLICE:
+                        return true;
+
+                case AES_BACKEND_AESNI:
+                        return aesniAvailable();
+
+                case AES_BACKEND_VPERM:
+                        return vpermAvailable();
+
+                case AES_BACKEND_VAES:
+                        return vaesAvailable();
+
+                default:
+                        return false;
+        }
+}
+
+/**
+        This function picks the fastest available backend into best. It is
+        run through bestOnce.
+ */
+static void chooseBest( void )
+{
+        // Backends from fastest to slowest
+        static const AesBackend preference[] = {
+                AES_BACKEND_VAES, AES_BACKEND_AESNI, AES_BACKEND_VPERM,
+                AES_BACKEND_TTABLE
+        };
+
+        int i = 0;
+        int count = sizeof( preference ) / sizeof( preference[ 0 ] );
+        for ( i = 0; i < count; i++ ) {
+                if ( aesBackendAvailable( preference[ i ] ) ) {
+                        best = preference[ i ];
+                        return;
+                }
+        }
+}
+
+AesBackend aesBestBackend( void )
+{
+        pthread_once( &bestOnce, chooseBest );
+        return best;
+}
+
+char const *aesBackendName( AesBackend backend )
+{
+        switch ( backend ) {
+                case AES_BACKEND_REFERENCE:
+                        return "reference";
+
+                case AES_BACKEND_TTABLE:
+                        return "ttable";
+
+                case AES_BACKEND_AESNI:
+                        return "aesni";
+
+                case AES_BACKEND_BITSLICE:
+                        return "bitslice";
+
+                case AES_BACKEND_VPERM:
+                        return "vperm";
+
+                case AES_BACKEND_VAES:
+                        return "vaes";
+
+                default:
+                        return "unknown";
+        }
+}
+
+bool aesInitKeyWithBackend( AesContext *ctx, byte const key[ BLOCK_SIZE ],
+                                AesBackend backend )
+{
+        if ( !aesBackendAvailable( backend ) ) {
+                return false;
+        }
+
+        // Runs the key schedule in hardware when the backend has it
+        ctx->backend = backend;
+        bool hardware = backend == AES_BACKEND_AESNI ||
+                backend == AES_BACKEND_VAES;
+        if ( hardware ) {
+                aesniExpandKey( ctx, key );
+        } else {
+                generateSubkeys( ctx->subkey, key );
+        }
+
+        // Packs the subkeys into column words for the table rounds
+        pthread_once( &tablesOnce, buildTables );
+        int r = 0;
+        int c = 0;
+        for ( r = 0; r < ROUNDS + 1; r++ ) {
+                for ( c = 0; c < BLOCK_COLS; c++ ) {
+                        ctx->encKey[ r * BLOCK_COLS + c ] =
+                                GET_WORD( ctx->subkey[ r ] + c * WORD_SIZE );
+                }
+        }
+
+        // Decryption uses the subkeys backwards, with the inner ones passed
+        // through unMixColumns so the rounds can use the Td tables directly
+        for ( r = 0; r < ROUNDS + 1; r++ ) {
+                for ( c = 0; c < BLOCK_COLS; c++ ) {
+                        uint32_t word =
+                                ctx->encKey[ ( ROUNDS - r ) * BLOCK_COLS + c ];
+                        if ( r != 0 && r != ROUNDS ) {
+                                word = unMixWord( word );
+                        }
+
+                        ctx->decKey[ r * BLOCK_COLS + c ] = word;
+                }
+        }
+
+        // The hardware key schedule already laid these out with AESIMC
+        if ( !hardware ) {
+                for ( r = 0; r < KEY_WORDS; r++ ) {
+                        PUT_WORD( ctx->decSubkey[ r / BLOCK_COLS ] +
+                                ( r % BLOCK_COLS ) * WORD_SIZE,
+                                ctx->decKey[ r ] );
+                }
+        }
+
+        // Every context gets bit plane subkeys for bulk encryption
+        bitsliceExpandKey( ctx );
+
+        return true;
+}
+
+void aesInitKey( AesContext *ctx, byte const key[ BLOCK_SIZE ] )
+{
+        aesInitKeyWithBackend( ctx, key, aesBestBackend() );
+}
+
+/**
+        This function encrypts one block with the table rounds. The state is
+        held as four big-endian column words; each round is 16 table lookups
+        and exclusive ors with the round key.
+
+        @param ctx The expanded key to encrypt with
+        @param data The block of data to encrypt
+ */
+static void tableEncrypt( AesContext const *ctx, byte data[ BLOCK_SIZE ] )
+{
+        uint32_t const *rk = ctx->encKey;
+
+        // Adds First Subkey
+        uint32_t s0 = GET_WORD( data ) ^ rk[ 0 ];
+        uint32_t s1 = GET_WORD( data + 4 ) ^ rk[ 1 ];
+        uint32_t s2 = GET_WORD( data + 8 ) ^ rk[ 2 ];
+        uint32_t s3 = GET_WORD( data + 12 ) ^ rk[ 3 ];
+        uint32_t t0, t1, t2, t3;
+
+        // Rounds 1 through 9 use the fused tables
+        int i = 0;
+        for ( i = 1; i < ROUNDS; i++ ) {
+                rk += BLOCK_COLS;
+                t0 = Te0[ s0 >> 24 ] ^ Te1[ ( s1 >> 16 ) & BYTE_MASK ] ^
+                        Te2[ ( s2 >> 8 ) & BYTE_MASK ] ^
+                        Te3[ s3 & BYTE_MASK ] ^ rk[ 0 ];
+                t1 = Te0[ s1 >> 24 ] ^ Te1[ ( s2 >> 16 ) & BYTE_MASK ] ^
+                        Te2[ ( s3 >> 8 ) & BYTE_MASK ] ^
+                        Te3[ s0 & BYTE_MASK ] ^ rk[ 1 ];
+                t2 = Te0[ s2 >> 24 ] ^ Te1[ ( s3 >> 16 ) & BYTE_MASK ] ^
+                        Te2[ ( s0 >> 8 ) & BYTE_MASK ] ^
+                        Te3[ s1 & BYTE_MASK ] ^ rk[ 2 ];
+                t3 = Te0[ s3 >> 24 ] ^ Te1[ ( s0 >> 16 ) & BYTE_MASK ] ^
+                        Te2[ ( s1 >> 8 ) & BYTE_MASK ] ^
+                        Te3[ s2 & BYTE_MASK ] ^ rk[ 3 ];
+                s0 = t0;
+                s1 = t1;
+                s2 = t2;
+                s3 = t3;
+        }
+
+        // The last round has no mixColumns, so it uses the plain sBox
+        rk += BLOCK_COLS;
+        t0 = ( ( uint32_t ) substBox( s0 >> 24 ) << 24 ) ^
+                ( ( uint32_t ) substBox( ( s1 >> 16 ) & BYTE_MASK ) << 16 ) ^
+                ( ( uint32_t ) substBox( ( s2 >> 8 ) & BYTE_MASK ) << 8 ) ^
+                substBox( s3 & BYTE_MASK ) ^ rk[ 0 ];
+        t1 = ( ( uint32_t ) substBox( s1 >> 24 ) << 24 ) ^
+                ( ( uint32_t ) substBox( ( s2 >> 16 ) & BYTE_MASK ) << 16 ) ^
+                ( ( uint32_t ) substBox( ( s3 >> 8 ) & BYTE_MASK ) << 8 ) ^
+                substBox( s0 & BYTE_MASK ) ^ rk[ 1 ];
+        t2 = ( ( uint32_t ) substBox( s2 >> 24 ) << 24 ) ^
+                ( ( uint32_t ) substBox( ( s3 >> 16 ) & BYTE_MASK ) << 16 ) ^
+                ( ( uint32_t ) substBox( ( s0 >> 8 ) & BYTE_MASK ) << 8 ) ^
+                substBox( s1 & BYTE_MASK ) ^ rk[ 2 ];
+        t3 = ( ( uint32_t ) substBox( s3 >> 24 ) << 24 ) ^
+                ( ( uint32_t ) substBox( ( s0 >> 16 ) & BYTE_MASK ) << 16 ) ^
+                ( ( uint32_t ) substBox( ( s1 >> 8 ) & BYTE_MASK ) << 8 ) ^
+                substBox( s2 & BYTE_MASK ) ^ rk[ 3 ];
+
+        PUT_WORD( data, t0 );
+        PUT_WORD( data + 4, t1 );
+        PUT_WORD( data + 8, t2 );
+        PUT_WORD( data + 12, t3 );
+}
+
+/**
+        This function decrypts one block with the table rounds, using the
+        reversed, unMixColumns-adjusted subkeys in decKey.
+
+        @param ctx The expanded key to decrypt with
+        @param data The block of data to decrypt
+ */
+static void tableDecrypt( AesContext const *ctx, byte data[ BLOCK_SIZE ] )
+{
+        uint32_t const *rk = ctx->decKey;
+
+        // Adds Last Subkey
+        uint32_t s0 = GET_WORD( data ) ^ rk[ 0 ];
+        uint32_t s1 = GET_WORD( data + 4 ) ^ rk[ 1 ];
+        uint32_t s2 = GET_WORD( data + 8 ) ^ rk[ 2 ];
+        uint32_t s3 = GET_WORD( data + 12 ) ^ rk[ 3 ];
+        uint32_t t0, t1, t2, t3;
+
+        // Inner rounds walk the rows the opposite way from encryption
+        int i = 0;
+        for ( i = 1; i < ROUNDS; i++ ) {
+                rk += BLOCK_COLS;
+                t0 = Td0[ s0 >> 24 ] ^ Td1[ ( s3 >> 16 ) & BYTE_MASK ] ^
+                        Td2[ ( s2 >> 8 ) & BYTE_MASK ] ^
+                        Td3[ s1 & BYTE_MASK ] ^ rk[ 0 ];
+                t1 = Td0[ s1 >> 24 ] ^ Td1[ ( s0 >> 16 ) & BYTE_MASK ] ^
+                        Td2[ ( s3 >> 8 ) & BYTE_MASK ] ^
+                        Td3[ s2 & BYTE_MASK ] ^ rk[ 1 ];
+                t2 = Td0[ s2 >> 24 ] ^ Td1[ ( s1 >> 16 ) & BYTE_MASK ] ^
+                        Td2[ ( s0 >> 8 ) & BYTE_MASK ] ^
+                        Td3[ s3 & BYTE_MASK ] ^ rk[ 2 ];
+                t3 = Td0[ s3 >> 24 ] ^ Td1[ ( s2 >> 16 ) & BYTE_MASK ] ^
+                        Td2[ ( s1 >> 8 ) & BYTE_MASK ] ^
+                        Td3[ s0 & BYTE_MASK ] ^ rk[ 3 ];
+                s0 = t0;
+                s1 = t1;
+                s2 = t2;
+                s3 = t3;
+        }
+
+        // The last round has no unMixColumns, so it uses invSubstBox
+        rk += BLOCK_COLS;
+        t0 = ( ( uint32_t ) invSubstBox( s0 >> 24 ) << 24 ) ^
+                ( ( uint32_t ) invSubstBox( ( s3 >> 16 ) & BYTE_MASK ) << 16 ) ^
+                ( ( uint32_t ) invSubstBox( ( s2 >> 8 ) & BYTE_MASK ) << 8 ) ^
+                invSubstBox( s1 & BYTE_MASK ) ^ rk[ 0 ];
+        t1 = ( ( uint32_t ) invSubstBox( s1 >> 24 ) << 24 ) ^
+                ( ( uint32_t ) invSubstBox( ( s0 >> 16 ) & BYTE_MASK ) << 16 ) ^
+                ( ( uint32_t ) invSubstBox( ( s3 >> 8 ) & BYTE_MASK ) << 8 ) ^
+                invSubstBox( s2 & BYTE_MASK ) ^ rk[ 1 ];
+        t2 = ( ( uint32_t ) invSubstBox( s2 >> 24 ) << 24 ) ^
+                ( ( uint32_t ) invSubstBox( ( s1 >> 16 ) & BYTE_MASK ) << 16 ) ^
+                ( ( uint32_t ) invSubstBox( ( s0 >> 8 ) & BYTE_MASK ) << 8 ) ^
+                invSubstBox( s3 & BYTE_MASK ) ^ rk[ 2 ];
+        t3 = ( ( uint32_t ) invSubstBox( s3 >> 24 ) << 24 ) ^
+                ( ( uint32_t ) invSubstBox( ( s2 >> 16 ) & BYTE_MASK ) << 16 ) ^
+                ( ( uint32_t ) invSubstBox( ( s1 >> 8 ) & BYTE_MASK ) << 8 ) ^
+                invSubstBox( s0 & BYTE_MASK ) ^ rk[ 3 ];
+
+        PUT_WORD( data, t0 );
+        PUT_WORD( data + 4, t1 );
+        PUT_WORD( data + 8, t2 );
+        PUT_WORD( data + 12, t3 );
+}
+
+/** One output column of an inner table round, from columns a through d. */
+#define TABLE_COLUMN( T, s, a, b, c, d ) ( T##0[ ( s )[ a ] >> 24 ] ^ \
+                T##1[ ( ( s )[ b ] >> 16 ) & BYTE_MASK ] ^ \
+                T##2[ ( ( s )[ c ] >> 8 ) & BYTE_MASK ] ^ \
+                T##3[ ( s )[ d ] & BYTE_MASK ] )
+
+/** One output column of the last round, which uses the plain box. */
+#define LAST_COLUMN( box, s, a, b, c, d ) ( \
+                ( ( uint32_t ) box( ( s )[ a ] >> 24 ) << 24 ) ^ \
+                ( ( uint32_t ) box( ( ( s )[ b ] >> 16 ) & BYTE_MASK ) << 16 ) ^ \
+                ( ( uint32_t ) box( ( ( s )[ c ] >> 8 ) & BYTE_MASK ) << 8 ) ^ \
+                box( ( s )[ d ] & BYTE_MASK ) )
+
+/**
+        One round of one lane. COLUMN is TABLE_COLUMN or LAST_COLUMN, and
+        b, c and d give the columns feeding rows 1 to 3 of output column 0.
+ */
+#define LANE_ROUND( COLUMN, T, s, b, c, d ) { \
+        uint32_t t0_ = COLUMN( T, s, 0, b, c, d ) ^ rk[ 0 ]; \
+        uint32_t t1_ = COLUMN( T, s, 1, ( b + 1 ) % BLOCK_COLS, \
+                ( c + 1 ) % BLOCK_COLS, ( d + 1 ) % BLOCK_COLS ) ^ rk[ 1 ]; \
+        uint32_t t2_ = COLUMN( T, s, 2, ( b + 2 ) % BLOCK_COLS, \
+                ( c + 2 ) % BLOCK_COLS, ( d + 2 ) % BLOCK_COLS ) ^ rk[ 2 ]; \
+        uint32_t t3_ = COLUMN( T, s, 3, ( b + 3 ) % BLOCK_COLS, \
+                ( c + 3 ) % BLOCK_COLS, ( d + 3 ) % BLOCK_COLS ) ^ rk[ 3 ]; \
+        ( s )[ 0 ] = t0_; \
+        ( s )[ 1 ] = t1_; \
+        ( s )[ 2 ] = t2_; \
+        ( s )[ 3 ] = t3_; \
+}
+
+/**
+        One round over every lane. The lanes are spelled out so the compiler
+        keeps the whole state in registers.
+ */
+#define ALL_LANES( COLUMN, T, b, c, d ) { \
+        LANE_ROUND( COLUMN, T, s[ 0 ], b, c, d ); \
+        LANE_ROUND( COLUMN, T, s[ 1 ], b, c, d ); \
+        LANE_ROUND( COLUMN, T, s[ 2 ], b, c, d ); \
+        LANE_ROUND( COLUMN, T, s[ 3 ], b, c, d ); \
+}
+
+/** Loads lane l, adding the first subkey. */
+#define LOAD_LANE( l ) { \
+        s[ l ][ 0 ] = GET_WORD( in + ( l ) * BLOCK_SIZE ) ^ rk[ 0 ]; \
+        s[ l ][ 1 ] = GET_WORD( in + ( l ) * BLOCK_SIZE + 4 ) ^ rk[ 1 ]; \
+        s[ l ][ 2 ] = GET_WORD( in + ( l ) * BLOCK_SIZE + 8 ) ^ rk[ 2 ]; \
+        s[ l ][ 3 ] = GET_WORD( in + ( l ) * BLOCK_SIZE + 12 ) ^ rk[ 3 ]; \
+}
+
+/** Stores lane l. */
+#define STORE_LANE( l ) { \
+        PUT_WORD( out + ( l ) * BLOCK_SIZE, s[ l ][ 0 ] ); \
+        PUT_WORD( out + ( l ) * BLOCK_SIZE + 4, s[ l ][ 1 ] ); \
+        PUT_WORD( out + ( l ) * BLOCK_SIZE + 8, s[ l ][ 2 ] ); \
+        PUT_WORD( out + ( l ) * BLOCK_SIZE + 12, s[ l ][ 3 ] ); \
+}
+
+/**
+        This function encrypts TABLE_LANES consecutive blocks with the table
+        rounds. Every round is done for all blocks before the next starts,
+        so the lookups of independent blocks overlap instead of each block
+        waiting on its own chain of loads.
+
+        @param ctx The expanded key to encrypt with
+        @param in The blocks to encrypt
+        @param out Where to store the encrypted blocks, possibly in
+ */
+static void tableEncryptLanes( AesContext const *ctx, byte const *in,
+                        byte *out )
+{
+        uint32_t const *rk = ctx->encKey;
+        uint32_t s[ TABLE_LANES ][ BLOCK_COLS ];
+
+        // Adds First Subkey
+        LOAD_LANE( 0 );
+        LOAD_LANE( 1 );
+        LOAD_LANE( 2 );
+        LOAD_LANE( 3 );
+
+        int i = 0;
+        for ( i = 1; i < ROUNDS; i++ ) {
+                rk += BLOCK_COLS;
+                ALL_LANES( TABLE_COLUMN, Te, 1, 2, 3 );
+        }
+
+        rk += BLOCK_COLS;
+        ALL_LANES( LAST_COLUMN, substBox, 1, 2, 3 );
+
+        STORE_LANE( 0 );
+        STORE_LANE( 1 );
+        STORE_LANE( 2 );
+        STORE_LANE( 3 );
+}
+
+/**
+        This function decrypts TABLE_LANES consecutive blocks with the table
+        rounds, interleaved the same way as tableEncryptLanes.
+
+        @param ctx The expanded key to decrypt with
+        @param in The blocks to decrypt
+        @param out Where to store the decrypted blocks, possibly in
+ */
+static void tableDecryptLanes( AesContext const *ctx, byte const *in,
+                        byte *out )
+{
+        uint32_t const *rk = ctx->decKey;
+        uint32_t s[ TABLE_LANES ][ BLOCK_COLS ];
+
+        // Adds Last Subkey
+        LOAD_LANE( 0 );
+        LOAD_LANE( 1 );
+        LOAD_LANE( 2 );
+        LOAD_LANE( 3 );
+
+        // Inner rounds walk the rows the opposite way from encryption
+        int i = 0;
+        for ( i = 1; i < ROUNDS; i++ ) {
+                rk += BLOCK_COLS;
+                ALL_LANES( TABLE_COLUMN, Td, 3, 2, 1 );
+        }
+
+        rk += BLOCK_COLS;
+        ALL_LANES( LAST_COLUMN, invSubstBox, 3, 2, 1 );
+
+        STORE_LANE( 0 );
+        STORE_LANE( 1 );
+        STORE_LANE( 2 );
+        STORE_LANE( 3 );
+}
+
+/**
+        This function encrypts one block with the byte-wise reference rounds.
+
+        @param ctx The expanded key to encrypt with
+        @param data The block of data to encrypt
+ */
+static void referenceEncrypt( AesContext const *ctx, byte data[ BLOCK_SIZE ] )
 {
         // Defines square for use
         byte square[ BLOCK_ROWS ][ BLOCK_COLS ];
 
-        // Generates Subkeys
-        byte subkey[ ROUNDS + 1 ][ BLOCK_SIZE ];
-        generateSubkeys( subkey, key );
-
         // Adds First Subkey
-        addSubkey( data, subkey[ 0 ] );
+        addSubkey( data, ctx->subkey[ 0 ] );
 
         // Starts rounds of encryption
         int i = 0;
@@ -642,25 +1152,27 @@ void encryptBlock( byte data[ BLOCK_SIZE ], byte key[ BLOCK_SIZE ] )
                 squareToBlock( data, square );
 
                 // Add Subkey
-                addSubkey( data, subkey[ i ] );
+                addSubkey( data, ctx->subkey[ i ] );
         }
 }
 
-void decryptBlock( byte data[ BLOCK_SIZE ], byte key[ BLOCK_SIZE ] )
+/**
+        This function decrypts one block with the byte-wise reference rounds.
+
+        @param ctx The expanded key to decrypt with
+        @param data The block of data to decrypt
+ */
+static void referenceDecrypt( AesContext const *ctx, byte data[ BLOCK_SIZE ] )
 {
         // Defines square for use
         byte square[ BLOCK_ROWS ][ BLOCK_COLS ];
 
-        // Generates Subkeys
-        byte subkey[ ROUNDS + 1 ][ BLOCK_SIZE ];
-        generateSubkeys( subkey, key );
-
         // Starts decryption
         int i = 0;
         int j = 0;
         for ( i = ROUNDS; i > 0; i-- ) {
                 // Add Subkey
-                addSubkey( data, subkey[ i ] );
+                addSubkey( data, ctx->subkey[ i ] );
 
                 // Block to Square Operation
                 blockToSquare( square, data );
@@ -683,5 +1195,165 @@ void decryptBlock( byte data[ BLOCK_SIZE ], byte key[ BLOCK_SIZE ] )
         }
 
         // After all Rounds completed
-        addSubkey( data, key );
+        addSubkey( data, ctx->subkey[ 0 ] );
+}
+
+void aesEncryptWithContext( AesContext const *ctx, byte data[ BLOCK_SIZE ] )
+{
+        switch ( ctx->backend ) {
+                case AES_BACKEND_TTABLE:
+                        tableEncrypt( ctx, data );
+                        break;
+
+                case AES_BACKEND_AESNI:
+                case AES_BACKEND_VAES:
+                        aesniEncrypt( ctx, data );
+                        break;
+
+                case AES_BACKEND_BITSLICE:
+                        bitsliceEncrypt( ctx, data, data, 1 );
+                        break;
+
+                case AES_BACKEND_VPERM:
+                        vpermEncrypt( ctx, data );
+                        break;
+
+                default:
+                        referenceEncrypt( ctx, data );
+                        break;
+        }
+}
+
+void aesDecryptWithContext( AesContext const *ctx, byte data[ BLOCK_SIZE ] )
+{
+        switch ( ctx->backend ) {
+                case AES_BACKEND_TTABLE:
+                        tableDecrypt( ctx, data );
+                        break;
+
+                case AES_BACKEND_AESNI:
+                case AES_BACKEND_VAES:
+                        aesniDecrypt( ctx, data );
+                        break;
+
+                case AES_BACKEND_BITSLICE:
+                        bitsliceDecrypt( ctx, data, data, 1 );
+                        break;
+
+                case AES_BACKEND_VPERM:
+                        vpermDecrypt( ctx, data );
+                        break;
+
+                default:
+                        referenceDecrypt( ctx, data );
+                        break;
+        }
+}
+
+void encryptBlock( byte data[ BLOCK_SIZE ], byte key[ BLOCK_SIZE ] )
+{
+        // Expands the key for this one block
+        AesContext ctx;
+        aesInitKey( &ctx, key );
+
+        aesEncryptWithContext( &ctx, data );
+}
+
+void decryptBlock( byte data[ BLOCK_SIZE ], byte key[ BLOCK_SIZE ] )
+{
+        // Expands the key for this one block
+        AesContext ctx;
+        aesInitKey( &ctx, key );
+
+        aesDecryptWithContext( &ctx, data );
+}
+
+/**
+        This function decides whether a bulk request should use the bitsliced
+        rounds: always for contexts bound to them, and for full groups on
+        contexts bound to the table backend, whose lookups leak timing.
+
+        @param ctx The context doing the work
+        @param count The number of blocks requested
+        @return True if the bitsliced rounds should be used
+ */
+static bool useBitslice( AesContext const *ctx, size_t count )
+{
+        return ctx->backend == AES_BACKEND_BITSLICE ||
+                ( ctx->backend == AES_BACKEND_TTABLE &&
+                  count >= BITSLICE_BLOCKS );
+}
+
+void aesEncryptBlocks( AesContext const *ctx, byte const *in, byte *out,
+                        size_t count )
+{
+        if ( ctx->backend == AES_BACKEND_VAES ) {
+                vaesEncryptBlocks( ctx, in, out, count );
+                return;
+        }
+
+        if ( ctx->backend == AES_BACKEND_AESNI ) {
+                aesniEncryptBlocks( ctx, in, out, count );
+                return;
+        }
+
+        if ( useBitslice( ctx, count ) ) {
+                bitsliceEncrypt( ctx, in, out, count );
+                return;
+        }
+
+        // Interleaves full runs of table lanes
+        size_t i = 0;
+        if ( ctx->backend == AES_BACKEND_TTABLE ) {
+                for ( ; i + TABLE_LANES <= count; i += TABLE_LANES ) {
+                        tableEncryptLanes( ctx, in + i * BLOCK_SIZE,
+                                        out + i * BLOCK_SIZE );
+                }
+        }
+
+        // The single-block rounds work in place, so the rest moves over first
+        if ( in != out ) {
+                memcpy( out + i * BLOCK_SIZE, in + i * BLOCK_SIZE,
+                        ( count - i ) * BLOCK_SIZE );
+        }
+
+        for ( ; i < count; i++ ) {
+                aesEncryptWithContext( ctx, out + i * BLOCK_SIZE );
+        }
+}
+
+void aesDecryptBlocks( AesContext const *ctx, byte const *in, byte *out,
+                        size_t count )
+{
+        if ( ctx->backend == AES_BACKEND_VAES ) {
+                vaesDecryptBlocks( ctx, in, out, count );
+                return;
+        }
+
+        if ( ctx->backend == AES_BACKEND_AESNI ) {
+                aesniDecryptBlocks( ctx, in, out, count );
+                return;
+        }
+
+        if ( useBitslice( ctx, count ) ) {
+                bitsliceDecrypt( ctx, in, out, count );
+                return;
+        }
+
+        size_t i = 0;
+        if ( ctx->backend == AES_BACKEND_TTABLE ) {
+                for ( ; i + TABLE_LANES <= count; i += TABLE_LANES ) {
+                        tableDecryptLanes( ctx, in + i * BLOCK_SIZE,
+                                        out + i * BLOCK_SIZE );
+                }
+        }
+
+        if ( in != out ) {
+                memcpy( out + i * BLOCK_SIZE, in + i * BLOCK_SIZE,
+                        ( count - i ) * BLOCK_SIZE );
+        }
+
+        for ( ; i < count; i++ ) {
+                aesDecryptWithContext( ctx, out + i * BLOCK_SIZE );
+        }
 }
@@ -14,6 +14,7 @@
 #include <stdbool.h>
 //#include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 
 /** Number of bytes in an AES key or an AES block. */
 #define BLOCK_SIZE 16
@@ -30,6 +31,87 @@
 /** Number of roudns for 128-bit AES. */
 #define ROUNDS 10
 
+/** Number of 32-bit column words in the whole expanded key. */
+#define KEY_WORDS ( BLOCK_COLS * ( ROUNDS + 1 ) )
+
+/** Number of blocks the bitsliced backend encrypts at once. */
+#define BITSLICE_BLOCKS 8
+
+/** Number of 64-bit words in one bit plane of BITSLICE_BLOCKS blocks. */
+#define PLANE_WORDS 2
+
+/** Round implementations a context can be bound to. */
+typedef enum {
+        /**
+                Byte-wise substBox, shiftRows and mixColumns, exactly as
+                the specification describes each step.
+         */
+        AES_BACKEND_REFERENCE,
+
+        /**
+                Four 256-entry 32-bit tables per direction fuse SubBytes,
+                ShiftRows and MixColumns into 16 lookups per round.
+         */
+        AES_BACKEND_TTABLE,
+
+        /**
+                The x86 AES-NI instructions, one AESENC or AESDEC per round.
+                Only available when CPUID reports support for them.
+         */
+        AES_BACKEND_AESNI,
+
+        /**
+                Constant-time boolean circuits over eight blocks stored as
+                bit planes. Single blocks are padded out to a full group.
+         */
+        AES_BACKEND_BITSLICE,
+
+        /**
+                Constant-time single-block rounds built from SSSE3 byte
+                shuffles, computing the sBox in a tower field. Only available
+                when CPUID reports SSSE3.
+         */
+        AES_BACKEND_VPERM,
+
+        /**
+                VAES on 512-bit registers, four blocks per round instruction
+                for bulk requests and AES-NI for single blocks. Only
+                available when CPUID reports VAES and AVX-512.
+         */
+        AES_BACKEND_VAES,
+
+        /** Number of backends; not a backend itself. */
+        AES_BACKEND_COUNT
+} AesBackend;
+
+/**
+        Expanded key state for one AES key. It is filled in once by aesInitKey
+        and can then encrypt or decrypt any number of blocks without running
+        the key schedule again.
+ */
+typedef struct {
+        /** Round implementation used with this key. */
+        AesBackend backend;
+
+        /** Subkeys for every round, subkey[ 0 ] being the original key. */
+        byte subkey[ ROUNDS + 1 ][ BLOCK_SIZE ];
+
+        /** Subkeys as big-endian column words, for the table rounds. */
+        uint32_t encKey[ KEY_WORDS ];
+
+        /**
+                Subkeys in reverse order with unMixColumns applied to the
+                inner rounds, as the table decryption rounds expect.
+         */
+        uint32_t decKey[ KEY_WORDS ];
+
+        /** The same decryption subkeys as decKey, laid out as bytes. */
+        byte decSubkey[ ROUNDS + 1 ][ BLOCK_SIZE ];
+
+        /** Subkeys spread over bit planes for the bitsliced rounds. */
+        uint64_t sliceKey[ ROUNDS + 1 ][ BBITS ][ PLANE_WORDS ];
+} AesContext;
+
 #endif
 
 /**
@@ -118,7 +200,9 @@ void unMixColumns( byte square[ BLOCK_ROWS ][ BLOCK_COLS ] );
 /**
         This function encrypts a 16-byte block of data using the given key.
         It generates 11 subkeys from key, adds the first subkey, then performs
-        the 10 rounds of operations needed to encrypt the block.
+        the 10 rounds of operations needed to encrypt the block. It is kept for
+        compatibility; code encrypting more than one block should expand the
+        key once with aesInitKey and use aesEncryptWithContext instead.
 
         @param data The block of data to encrypt
         @param key The key to generate subkeys from
@@ -128,9 +212,105 @@ void encryptBlock( byte data[ BLOCK_SIZE ], byte key[ BLOCK_SIZE ] );
 /**
         This function decrypts a 16-byte block of data using the given key.
         It generates the 11 subkeys from key, then performs the 10 rounds of
-        inverse operations, and then an addSubkey to decrypt the block.
+        inverse operations, and then an addSubkey to decrypt the block. Like
+        encryptBlock, it is a wrapper around aesDecryptWithContext.
 
         @param data The block of data to decrypt
         @param key The key to generate subkeys from
  */
 void decryptBlock( byte data[ BLOCK_SIZE ], byte key[ BLOCK_SIZE ] );
+
+/**
+        This function reports whether the given backend can run on this
+        machine. The reference and table backends are always available.
+
+        @param backend The backend to check
+        @return True if contexts can be bound to the backend
+ */
+bool aesBackendAvailable( AesBackend backend );
+
+/**
+        This function returns the fastest backend available on this machine.
+        The processor features are checked the first time it is called.
+
+        @return The backend aesInitKey binds new contexts to
+ */
+AesBackend aesBestBackend( void );
+
+/**
+        This function returns a short, human-readable name for a backend.
+
+        @param backend The backend to name
+        @return The name of the backend
+ */
+char const *aesBackendName( AesBackend backend );
+
+/**
+        This function expands the given key into ctx, generating the subkeys
+        for every round so they can be reused for each block. The context is
+        bound to the fastest backend available, see aesBestBackend.
+
+        @param ctx The context to fill in
+        @param key The key to generate subkeys from
+ */
+void aesInitKey( AesContext *ctx, byte const key[ BLOCK_SIZE ] );
+
+/**
+        This function expands the given key into ctx like aesInitKey, but
+        binds the context to the requested backend.
+
+        @param ctx The context to fill in
+        @param key The key to generate subkeys from
+        @param backend The round implementation to use
+        @return True if the backend is available and ctx was filled in
+ */
+bool aesInitKeyWithBackend( AesContext *ctx, byte const key[ BLOCK_SIZE ],
+                                AesBackend backend );
+
+/**
+        This function encrypts a 16-byte block of data in place using the
+        subkeys already expanded into ctx.
+
+        @param ctx The expanded key to encrypt with
+        @param data The block of data to encrypt
+ */
+void aesEncryptWithContext( AesContext const *ctx, byte data[ BLOCK_SIZE ] );
+
+/**
+        This function decrypts a 16-byte block of data in place using the
+        subkeys already expanded into ctx.
+
+        @param ctx The expanded key to decrypt with
+        @param data The block of data to decrypt
+ */
+void aesDecryptWithContext( AesContext const *ctx, byte data[ BLOCK_SIZE ] );
+
+/**
+        This function encrypts count consecutive blocks from in to out. The
+        two may be the same buffer but must not otherwise overlap. Several
+        blocks are kept in flight per round: eight or sixteen with the
+        hardware backends and four with the table rounds. Contexts bound to
+        the table backend, the default only without AES-NI or SSSE3, switch
+        to the constant-time bitsliced rounds once there are at least
+        BITSLICE_BLOCKS blocks to encrypt; vperm contexts keep their own
+        rounds, which are constant-time too and faster.
+
+        @param ctx The expanded key to encrypt with
+        @param in The blocks to encrypt, count * BLOCK_SIZE bytes
+        @param out Where to store the encrypted blocks
+        @param count The number of blocks in in
+ */
+void aesEncryptBlocks( AesContext const *ctx, byte const *in, byte *out,
+                        size_t count );
+
+/**
+        This function decrypts count consecutive blocks from in to out,
+        choosing rounds the same way as aesEncryptBlocks.
+
+        @param ctx The expanded key to decrypt with
+        @param in The blocks to decrypt, count * BLOCK_SIZE bytes
+        @param out Where to store the decrypted blocks
+        @param count The number of blocks in in
+ */
+void aesDecryptBlocks( AesContext const *ctx, byte const *in, byte *out,
+                        size_t count );
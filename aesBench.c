@@ -0,0 +1,931 @@
+/**
+        @file aesBench.c
+        @author James O Kocak (jokocak)
+
+        This file contains the main method for the aesBench program, which
+        times the field arithmetic, the round steps, the key schedule, the
+        block functions on every backend, each mode, and the encrypt and
+        decrypt programs themselves, over message sizes from one block up
+        to a gigabyte. Every measurement is warmed up and repeated, and its
+        median and 99th percentile are written to standard output as JSON,
+        so results from one release can be compared with the next. With
+        --counters, the processor's performance counters are read around
+        the samples as well, where the system allows it.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "aes.h"
+#include "field.h"
+#include "ctr.h"
+#include "cbc.h"
+#include "gcm.h"
+#include "xts.h"
+#include "siv.h"
+#include "drbg.h"
+#include "counters.h"
+#include "io.h"
+#include "options.h"
+#include <errno.h>
+#include <spawn.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#endif
+
+/** The variables of the environment, handed on to the programs timed. */
+extern char **environ;
+
+/** Smallest message size measured, one block. */
+#define SMALLEST_SIZE BLOCK_SIZE
+
+/** Factor between one message size and the next. */
+#define SIZE_STEP 4
+
+/** Largest message size measured unless --max-size says otherwise. */
+#define DEFAULT_MAX_SIZE ( ( uint64_t ) 1 << 30 )
+
+/**
+        Largest input file the encrypt and decrypt programs are timed on.
+        Past this their start-up cost is lost in the noise, and the three
+        scratch files would only take up disk space.
+ */
+#define CLI_MAX_SIZE ( ( uint64_t ) 1 << 28 )
+
+/** Number of bytes each fixed-size kernel works through per call. */
+#define FIXED_SIZE 4096
+
+/** Samples taken of each measurement unless --reps says otherwise. */
+#define DEFAULT_REPS 31
+
+/** Fewest samples taken when a measurement is cut short to save time. */
+#define MIN_REPS 5
+
+/** Nanoseconds a kernel runs before its samples are taken. */
+#define WARMUP_NS 20000000ULL
+
+/**
+        Shortest sample in nanoseconds. Calls are repeated within a sample
+        until it lasts this long, so the clocks' own cost doesn't count.
+ */
+#define SAMPLE_NS 100000ULL
+
+/**
+        Nanoseconds one measurement should take. Samples are dropped, down to
+        MIN_REPS, to stay within it, and once a single call takes longer the
+        larger sizes of that kernel are skipped.
+ */
+#define TIME_LIMIT_NS 1000000000ULL
+
+/** Nanoseconds in a second. */
+#define NS_PER_SECOND 1000000000ULL
+
+/** The percentile reported besides the median. */
+#define TAIL_PERCENT 99
+
+/** Longest path built for the scratch files and programs. */
+#define PATH_LIMIT 4096
+
+/** Byte the field multiplication kernel multiplies by. */
+#define MUL_CONSTANT 0x57
+
+/** Everything a kernel may need, set up once before the measurements. */
+typedef struct {
+        /** The key bytes. */
+        byte key[ SIV_KEY_SIZE ];
+
+        /** The IV or initial counter block. */
+        byte iv[ BLOCK_SIZE ];
+
+        /** The key expanded for the backend being measured. */
+        AesContext ctx;
+
+        /** The GCM key. */
+        GcmKey gcm;
+
+        /** The XTS key, with 4096-byte data units. */
+        XtsKey xts;
+
+        /** The CMAC key. */
+        CmacKey cmac;
+
+        /** The SIV key. */
+        SivKey siv;
+
+        /** The program and arguments the command kernel runs. */
+        char **command;
+} BenchState;
+
+/**
+        A kernel being measured: it works through size bytes of data once.
+
+        @param state The keys and command
+        @param data The bytes to work on, changed in place
+        @param size The number of bytes, a multiple of BLOCK_SIZE
+ */
+typedef void ( *Kernel )( BenchState *state, byte *data, size_t size );
+
+/** What a kernel is run with besides its message size. */
+typedef enum {
+        /** Nothing varies; the kernel is measured once per size. */
+        VARY_NONE,
+
+        /** The kernel is measured once for every available backend. */
+        VARY_BACKEND,
+
+        /** The kernel is measured once for every fieldMul strategy. */
+        VARY_STRATEGY
+} Variation;
+
+/** One kernel in the list of what is measured. */
+typedef struct {
+        /** The name results are reported under. */
+        char const *name;
+
+        /** The kernel. */
+        Kernel run;
+
+        /** Whether the kernel is measured over every size, or FIXED_SIZE. */
+        bool sweep;
+
+        /** What else the kernel is measured over. */
+        Variation vary;
+
+        /**
+                What results are reported as run with when nothing varies, or
+                NULL for the backend the key is bound to.
+         */
+        char const *variant;
+} Bench;
+
+/** The summary of one measurement. */
+typedef struct {
+        /** Number of samples taken. */
+        int reps;
+
+        /** Number of kernel calls in each sample. */
+        uint64_t calls;
+
+        /** Median time-stamp counter ticks per call. */
+        double cyclesMedian;
+
+        /** The TAIL_PERCENT percentile of ticks per call. */
+        double cyclesTail;
+
+        /** Median nanoseconds per call. */
+        double nsMedian;
+
+        /** The TAIL_PERCENT percentile of nanoseconds per call. */
+        double nsTail;
+
+        /** Whether the hardware counters ran during the samples. */
+        bool counted;
+
+        /** The counts per call, averaged over every sample. */
+        CounterValues counts;
+} Measurement;
+
+/** The command line, once parsed, and the totals kept across the run. */
+typedef struct {
+        /** Largest message size to measure. */
+        uint64_t maxSize;
+
+        /** Samples to take of each measurement. */
+        int reps;
+
+        /** Only kernels whose names contain this are measured, if not NULL. */
+        char const *filter;
+
+        /** The directory holding encrypt and decrypt. */
+        char const *binDir;
+
+        /** Whether hardware counters were asked for with --counters. */
+        bool useCounters;
+
+        /** Whether the counters are open and read around the samples. */
+        bool counting;
+
+        /** The counters, when counting. */
+        Counters counters;
+
+        /** Whether a result has been written, so the next needs a comma. */
+        bool written;
+
+        /** Ticks counted over every sample, for the counter frequency. */
+        uint64_t totalCycles;
+
+        /** Nanoseconds over every sample, for the counter frequency. */
+        uint64_t totalNs;
+} Run;
+
+/**
+        This function reads the time-stamp counter, fenced so it isn't
+        reordered around the kernel. Elsewhere it reads zero.
+
+        @return The counter
+ */
+static uint64_t readCycles( void )
+{
+#if defined( __x86_64__ ) || defined( __i386__ )
+        _mm_lfence();
+        uint64_t cycles = __rdtsc();
+        _mm_lfence();
+        return cycles;
+#else
+        return 0;
+#endif
+}
+
+/**
+        This function reads the monotonic clock.
+
+        @return Nanoseconds since some fixed point
+ */
+static uint64_t readNanos( void )
+{
+        struct timespec now;
+        clock_gettime( CLOCK_MONOTONIC, &now );
+        return ( uint64_t ) now.tv_sec * NS_PER_SECOND + now.tv_nsec;
+}
+
+/**
+        This kernel multiplies every byte by a constant in GF(2^8).
+ */
+static void benchFieldMul( BenchState *state, byte *data, size_t size )
+{
+        size_t i = 0;
+        for ( i = 0; i < size; i++ ) {
+                data[ i ] = fieldMul( data[ i ], MUL_CONSTANT );
+        }
+}
+
+/**
+        This kernel runs mixColumns over every block as a square.
+ */
+static void benchMixColumns( BenchState *state, byte *data, size_t size )
+{
+        size_t i = 0;
+        for ( i = 0; i < size; i += BLOCK_SIZE ) {
+                mixColumns( ( byte ( * )[ BLOCK_COLS ] ) ( data + i ) );
+        }
+}
+
+/**
+        This kernel expands every block as a key, feeding a byte of the last
+        subkey back so the expansions can't be skipped.
+ */
+static void benchGenerateSubkeys( BenchState *state, byte *data, size_t size )
+{
+        byte subkey[ ROUNDS + 1 ][ BLOCK_SIZE ];
+        size_t i = 0;
+        for ( i = 0; i < size; i += BLOCK_SIZE ) {
+                generateSubkeys( subkey, data + i );
+                data[ i ] ^= subkey[ ROUNDS ][ 0 ];
+        }
+}
+
+/**
+        This kernel expands every block as a key into a context bound to the
+        backend being measured.
+ */
+static void benchInitKey( BenchState *state, byte *data, size_t size )
+{
+        AesContext ctx;
+        size_t i = 0;
+        for ( i = 0; i < size; i += BLOCK_SIZE ) {
+                aesInitKeyWithBackend( &ctx, data + i, state->ctx.backend );
+                data[ i ] ^= ctx.subkey[ ROUNDS ][ 0 ];
+        }
+}
+
+/**
+        This kernel encrypts every block with encryptBlock, which expands
+        the key each time.
+ */
+static void benchEncryptBlock( BenchState *state, byte *data, size_t size )
+{
+        size_t i = 0;
+        for ( i = 0; i < size; i += BLOCK_SIZE ) {
+                encryptBlock( data + i, state->key );
+        }
+}
+
+/**
+        This kernel decrypts every block with decryptBlock.
+ */
+static void benchDecryptBlock( BenchState *state, byte *data, size_t size )
+{
+        size_t i = 0;
+        for ( i = 0; i < size; i += BLOCK_SIZE ) {
+                decryptBlock( data + i, state->key );
+        }
+}
+
+/**
+        This kernel encrypts the blocks one at a time with an expanded key.
+ */
+static void benchEncryptWithContext( BenchState *state, byte *data,
+                                        size_t size )
+{
+        size_t i = 0;
+        for ( i = 0; i < size; i += BLOCK_SIZE ) {
+                aesEncryptWithContext( &state->ctx, data + i );
+        }
+}
+
+/**
+        This kernel encrypts the blocks in one bulk call.
+ */
+static void benchEncryptBlocks( BenchState *state, byte *data, size_t size )
+{
+        aesEncryptBlocks( &state->ctx, data, data, size / BLOCK_SIZE );
+}
+
+/**
+        This kernel decrypts the blocks in one bulk call.
+ */
+static void benchDecryptBlocks( BenchState *state, byte *data, size_t size )
+{
+        aesDecryptBlocks( &state->ctx, data, data, size / BLOCK_SIZE );
+}
+
+/**
+        This kernel encrypts the data as one CTR message.
+ */
+static void benchCtr( BenchState *state, byte *data, size_t size )
+{
+        ctrCrypt( &state->ctx, state->iv, 0, data, data, size );
+}
+
+/**
+        This kernel encrypts the data as one GCM message.
+ */
+static void benchGcm( BenchState *state, byte *data, size_t size )
+{
+        byte tag[ GCM_TAG_SIZE ];
+        gcmEncrypt( &state->gcm, state->iv, NULL, 0, data, data, size, tag );
+}
+
+/**
+        This kernel encrypts the data as one CBC message.
+ */
+static void benchCbcEncrypt( BenchState *state, byte *data, size_t size )
+{
+        byte chain[ BLOCK_SIZE ];
+        memcpy( chain, state->iv, BLOCK_SIZE );
+        cbcEncrypt( &state->ctx, chain, data, data, size );
+}
+
+/**
+        This kernel decrypts the data as one CBC message.
+ */
+static void benchCbcDecrypt( BenchState *state, byte *data, size_t size )
+{
+        cbcDecrypt( &state->ctx, state->iv, data, data, size );
+}
+
+/**
+        This kernel encrypts the data with XTS from data unit zero.
+ */
+static void benchXts( BenchState *state, byte *data, size_t size )
+{
+        xtsEncrypt( &state->xts, 0, data, data, size );
+}
+
+/**
+        This kernel computes the CMAC of the data, folding it back into the
+        first block.
+ */
+static void benchCmac( BenchState *state, byte *data, size_t size )
+{
+        byte mac[ BLOCK_SIZE ];
+        cmac( &state->cmac, data, size, mac );
+        data[ 0 ] ^= mac[ 0 ];
+}
+
+/**
+        This kernel encrypts the data as one SIV message.
+ */
+static void benchSiv( BenchState *state, byte *data, size_t size )
+{
+        byte iv[ SIV_IV_SIZE ];
+        sivEncrypt( &state->siv, NULL, 0, data, data, size, iv );
+}
+
+/**
+        This kernel runs the state's command, whose input file holds size
+        bytes, and waits for it.
+ */
+static void benchCommand( BenchState *state, byte *data, size_t size )
+{
+        pid_t child;
+        int status;
+        if ( posix_spawn( &child, state->command[ 0 ], NULL, NULL,
+                          state->command, environ ) != 0 ||
+             waitpid( child, &status, 0 ) != child ||
+             !WIFEXITED( status ) || WEXITSTATUS( status ) != 0 ) {
+                fprintf( stderr, "Can't run %s\n", state->command[ 0 ] );
+                exit( EXIT_FAILURE );
+        }
+}
+
+/** Everything measured in process, in the order it is reported. */
+static Bench const benches[] = {
+        { "fieldMul", benchFieldMul, false, VARY_STRATEGY, NULL },
+        { "mixColumns", benchMixColumns, false, VARY_NONE, "reference" },
+        { "generateSubkeys", benchGenerateSubkeys, false, VARY_NONE,
+          "reference" },
+        { "aesInitKey", benchInitKey, false, VARY_BACKEND, NULL },
+        { "encryptBlock", benchEncryptBlock, false, VARY_NONE, NULL },
+        { "decryptBlock", benchDecryptBlock, false, VARY_NONE, NULL },
+        { "aesEncryptWithContext", benchEncryptWithContext, false,
+          VARY_BACKEND, NULL },
+        { "aesEncryptBlocks", benchEncryptBlocks, true, VARY_BACKEND, NULL },
+        { "aesDecryptBlocks", benchDecryptBlocks, true, VARY_BACKEND, NULL },
+        { "ctrCrypt", benchCtr, true, VARY_NONE, NULL },
+        { "gcmEncrypt", benchGcm, true, VARY_NONE, NULL },
+        { "cbcEncrypt", benchCbcEncrypt, true, VARY_NONE, NULL },
+        { "cbcDecrypt", benchCbcDecrypt, true, VARY_NONE, NULL },
+        { "xtsEncrypt", benchXts, true, VARY_NONE, NULL },
+        { "cmac", benchCmac, true, VARY_NONE, NULL },
+        { "sivEncrypt", benchSiv, true, VARY_NONE, NULL }
+};
+
+/** Names of the fieldMul strategies, indexed by FieldStrategy. */
+static char const *const strategyNames[] = { "bitwise", "logTable",
+                                              "fullTable" };
+
+/**
+        This function compares two doubles for qsort.
+
+        @param a The first double
+        @param b The second double
+        @return Negative, zero or positive as a is below, equal to or above b
+ */
+static int compareDoubles( void const *a, void const *b )
+{
+        double x = *( double const * ) a;
+        double y = *( double const * ) b;
+        return ( x > y ) - ( x < y );
+}
+
+/**
+        This function sorts values and returns the one at a percentile,
+        using the nearest rank.
+
+        @param values The values, which are sorted
+        @param count The number of values
+        @param percent The percentile, from 1 to 100
+        @return The value at that percentile
+ */
+static double percentile( double *values, int count, int percent )
+{
+        qsort( values, count, sizeof( double ), compareDoubles );
+        int rank = ( count * percent + 99 ) / 100;
+        return values[ rank > 0 ? rank - 1 : 0 ];
+}
+
+/**
+        This function measures one kernel at one size. The kernel first runs
+        for WARMUP_NS, doubling the calls per sample until a sample lasts
+        SAMPLE_NS, then the samples are taken.
+
+        @param run The run, whose totals are updated
+        @param kernel The kernel
+        @param state Its state
+        @param data The bytes it works on
+        @param size The number of bytes
+        @return The summary
+ */
+static Measurement measure( Run *run, Kernel kernel, BenchState *state,
+                                byte *data, size_t size )
+{
+        Measurement result;
+        uint64_t calls = 1;
+        uint64_t elapsed = 0;
+        uint64_t start = readNanos();
+        uint64_t k = 0;
+        for ( ;; ) {
+                uint64_t before = readNanos();
+                for ( k = 0; k < calls; k++ ) {
+                        kernel( state, data, size );
+                }
+
+                elapsed = readNanos() - before;
+                bool warm = readNanos() - start >= WARMUP_NS;
+                if ( elapsed >= TIME_LIMIT_NS ||
+                     ( warm && elapsed >= SAMPLE_NS ) ) {
+                        break;
+                }
+
+                if ( elapsed < SAMPLE_NS ) {
+                        calls *= 2;
+                }
+        }
+
+        // Long samples are taken fewer times so the measurement ends in time
+        int reps = run->reps;
+        uint64_t affordable = TIME_LIMIT_NS / ( elapsed > 0 ? elapsed : 1 );
+        if ( affordable < ( uint64_t ) reps ) {
+                reps = affordable > MIN_REPS ? ( int ) affordable : MIN_REPS;
+                reps = reps < run->reps ? reps : run->reps;
+        }
+
+        double *cycles = ( double * ) malloc( 2 * reps * sizeof( double ) );
+        if ( cycles == NULL ) {
+                fprintf( stderr, "Out of memory\n" );
+                exit( EXIT_FAILURE );
+        }
+
+        // The counters cover every sample, so they are averaged per call
+        double *nanos = cycles + reps;
+        if ( run->counting ) {
+                countersStart( &run->counters );
+        }
+
+        int r = 0;
+        for ( r = 0; r < reps; r++ ) {
+                uint64_t beforeNs = readNanos();
+                uint64_t beforeCycles = readCycles();
+                for ( k = 0; k < calls; k++ ) {
+                        kernel( state, data, size );
+                }
+
+                uint64_t spentCycles = readCycles() - beforeCycles;
+                uint64_t spentNs = readNanos() - beforeNs;
+                run->totalCycles += spentCycles;
+                run->totalNs += spentNs;
+                cycles[ r ] = ( double ) spentCycles / calls;
+                nanos[ r ] = ( double ) spentNs / calls;
+        }
+
+        result.counted = run->counting;
+        if ( run->counting ) {
+                countersStop( &run->counters, &result.counts );
+                int e = 0;
+                for ( e = 0; e < COUNTER_COUNT; e++ ) {
+                        result.counts.value[ e ] /= ( double ) reps * calls;
+                }
+        }
+
+        result.reps = reps;
+        result.calls = calls;
+        result.cyclesMedian = percentile( cycles, reps, 50 );
+        result.cyclesTail = percentile( cycles, reps, TAIL_PERCENT );
+        result.nsMedian = percentile( nanos, reps, 50 );
+        result.nsTail = percentile( nanos, reps, TAIL_PERCENT );
+        free( cycles );
+        return result;
+}
+
+/**
+        This function writes one result as a JSON object, and a line for
+        people to standard error.
+
+        @param run The run
+        @param name The kernel's name
+        @param variant The backend, strategy or mode it ran with
+        @param size The number of bytes per call
+        @param result The measurement
+ */
+static void report( Run *run, char const *name, char const *variant,
+                        size_t size, Measurement const *result )
+{
+        double perByte = result->cyclesMedian / size;
+        double gbPerSecond = size / result->nsMedian;
+        printf( "%s\n    { \"name\": \"%s\", \"variant\": \"%s\", "
+                "\"size\": %zu, \"reps\": %d, \"calls\": %llu, "
+                "\"cyclesMedian\": %.1f, \"cyclesP%d\": %.1f, "
+                "\"cyclesPerByte\": %.3f, \"nsMedian\": %.1f, "
+                "\"nsP%d\": %.1f, \"gbPerSecond\": %.3f",
+                run->written ? "," : "", name, variant, size, result->reps,
+                ( unsigned long long ) result->calls, result->cyclesMedian,
+                TAIL_PERCENT, result->cyclesTail, perByte, result->nsMedian,
+                TAIL_PERCENT, result->nsTail, gbPerSecond );
+        run->written = true;
+
+        // Counts are per block, and IPC needs both cycles and instructions
+        CounterValues const *counts = &result->counts;
+        bool hasIpc = result->counted && counts->counted[ COUNTER_CYCLES ] &&
+                counts->counted[ COUNTER_INSTRUCTIONS ] &&
+                counts->value[ COUNTER_CYCLES ] > 0;
+        double ipc = hasIpc ? counts->value[ COUNTER_INSTRUCTIONS ] /
+                counts->value[ COUNTER_CYCLES ] : 0;
+        if ( result->counted ) {
+                double blocks = ( double ) size / BLOCK_SIZE;
+                int e = 0;
+                for ( e = 0; e < COUNTER_COUNT; e++ ) {
+                        if ( counts->counted[ e ] ) {
+                                printf( ", \"%sPerBlock\": %.3f",
+                                        counterName( ( CounterEvent ) e ),
+                                        counts->value[ e ] / blocks );
+                        }
+                }
+
+                if ( hasIpc ) {
+                        printf( ", \"ipc\": %.3f", ipc );
+                }
+        }
+
+        printf( " }" );
+        fflush( stdout );
+
+        fprintf( stderr, "%-22s %-10s %11zu %10.2f c/B %8.3f GB/s", name,
+                        variant, size, perByte, gbPerSecond );
+        if ( hasIpc ) {
+                fprintf( stderr, " %6.2f IPC", ipc );
+        }
+
+        fprintf( stderr, "\n" );
+}
+
+/**
+        This function measures one kernel over its sizes: FIXED_SIZE, or one
+        block growing by SIZE_STEP up to the largest size, stopping once a
+        call takes longer than TIME_LIMIT_NS.
+
+        @param run The run
+        @param name The kernel's name
+        @param variant What it runs with
+        @param kernel The kernel
+        @param state Its state
+        @param data The buffer, holding at least maxSize and FIXED_SIZE bytes
+        @param sweep Whether to measure every size, or only FIXED_SIZE
+        @param maxSize The largest size
+ */
+static void measureSizes( Run *run, char const *name, char const *variant,
+                                Kernel kernel, BenchState *state, byte *data,
+                                bool sweep, uint64_t maxSize )
+{
+        if ( !sweep ) {
+                Measurement result = measure( run, kernel, state, data,
+                                                FIXED_SIZE );
+                report( run, name, variant, FIXED_SIZE, &result );
+                return;
+        }
+
+        uint64_t size = SMALLEST_SIZE;
+        while ( size <= maxSize ) {
+                Measurement result = measure( run, kernel, state, data, size );
+                report( run, name, variant, size, &result );
+                if ( result.nsMedian >= TIME_LIMIT_NS ) {
+                        break;
+                }
+
+                size *= SIZE_STEP;
+        }
+}
+
+/**
+        This function measures every in-process kernel whose name passes the
+        filter.
+
+        @param run The run
+        @param state The state, whose keys are filled in
+        @param data The buffer, holding at least maxSize bytes
+ */
+static void measureKernels( Run *run, BenchState *state, byte *data )
+{
+        int b = 0;
+        for ( b = 0; b < ( int ) ( sizeof( benches ) / sizeof( benches[ 0 ] ) );
+              b++ ) {
+                Bench const *bench = benches + b;
+                if ( run->filter != NULL &&
+                     strstr( bench->name, run->filter ) == NULL ) {
+                        continue;
+                }
+
+                if ( bench->vary == VARY_STRATEGY ) {
+                        FieldStrategy saved = fieldGetStrategy();
+                        int s = 0;
+                        for ( s = FIELD_BITWISE; s <= FIELD_FULL_TABLE; s++ ) {
+                                fieldSetStrategy( ( FieldStrategy ) s );
+                                measureSizes( run, bench->name,
+                                                strategyNames[ s ], bench->run,
+                                                state, data, bench->sweep,
+                                                run->maxSize );
+                        }
+
+                        fieldSetStrategy( saved );
+                } else if ( bench->vary == VARY_BACKEND ) {
+                        int backend = 0;
+                        for ( backend = 0; backend < AES_BACKEND_COUNT;
+                              backend++ ) {
+                                if ( aesInitKeyWithBackend( &state->ctx,
+                                        state->key, ( AesBackend ) backend ) ) {
+                                        measureSizes( run, bench->name,
+                                                aesBackendName( backend ),
+                                                bench->run, state, data,
+                                                bench->sweep, run->maxSize );
+                                }
+                        }
+
+                        aesInitKey( &state->ctx, state->key );
+                } else {
+                        char const *variant = bench->variant != NULL ?
+                                bench->variant :
+                                aesBackendName( state->ctx.backend );
+                        measureSizes( run, bench->name, variant,
+                                        bench->run, state, data, bench->sweep,
+                                        run->maxSize );
+                }
+        }
+}
+
+/**
+        This function times the encrypt and decrypt programs end to end on
+        scratch files in a temporary directory: ECB, CTR and GCM
+        encryption, and ECB decryption. Each run includes starting the
+        process, reading the key and the input, and writing the output.
+
+        @param run The run
+        @param state The state, whose key is written out
+        @param data The buffer, holding at least maxSize bytes
+ */
+static void measureCommands( Run *run, BenchState *state, byte *data )
+{
+        char encrypt[ PATH_LIMIT ];
+        char decrypt[ PATH_LIMIT ];
+        snprintf( encrypt, sizeof( encrypt ), "%s/encrypt", run->binDir );
+        snprintf( decrypt, sizeof( decrypt ), "%s/decrypt", run->binDir );
+        if ( access( encrypt, X_OK ) != 0 || access( decrypt, X_OK ) != 0 ) {
+                fprintf( stderr, "Skipping the programs, not found in %s\n",
+                                run->binDir );
+                return;
+        }
+
+        char const *tmp = getenv( "TMPDIR" );
+        char dir[ PATH_LIMIT / 2 ];
+        snprintf( dir, sizeof( dir ), "%s/aesBench.XXXXXX",
+                        tmp != NULL ? tmp : "/tmp" );
+        if ( mkdtemp( dir ) == NULL ) {
+                fprintf( stderr, "Can't create a directory in %s\n",
+                                tmp != NULL ? tmp : "/tmp" );
+                exit( EXIT_FAILURE );
+        }
+
+        char key[ PATH_LIMIT ], iv[ PATH_LIMIT ], nonce[ PATH_LIMIT ];
+        char plain[ PATH_LIMIT ], cipher[ PATH_LIMIT ], out[ PATH_LIMIT ];
+        snprintf( key, sizeof( key ), "%s/key.dat", dir );
+        snprintf( iv, sizeof( iv ), "%s/iv.dat", dir );
+        snprintf( nonce, sizeof( nonce ), "%s/nonce.dat", dir );
+        snprintf( plain, sizeof( plain ), "%s/plain.dat", dir );
+        snprintf( cipher, sizeof( cipher ), "%s/cipher.dat", dir );
+        snprintf( out, sizeof( out ), "%s/out.dat", dir );
+        writeBinaryFile( key, state->key, BLOCK_SIZE );
+        writeBinaryFile( iv, state->iv, BLOCK_SIZE );
+        writeBinaryFile( nonce, state->iv, GCM_IV_SIZE );
+
+        // Decryption is timed on ciphertext, so its input is made first
+        char *ecb[] = { encrypt, key, plain, out, NULL };
+        char *ctr[] = { encrypt, "--ctr", iv, key, plain, out, NULL };
+        char *gcm[] = { encrypt, "--gcm", nonce, key, plain, out, NULL };
+        char *makeCipher[] = { encrypt, key, plain, cipher, NULL };
+        char *ecbDecrypt[] = { decrypt, key, cipher, out, NULL };
+        struct {
+                char const *name;
+                char const *variant;
+                char **command;
+                char **prepare;
+        } const commands[] = {
+                { "encrypt", "ecb", ecb, NULL },
+                { "encrypt", "ctr", ctr, NULL },
+                { "encrypt", "gcm", gcm, NULL },
+                { "decrypt", "ecb", ecbDecrypt, makeCipher }
+        };
+
+        uint64_t maxSize = run->maxSize < CLI_MAX_SIZE ? run->maxSize :
+                CLI_MAX_SIZE;
+        int c = 0;
+        for ( c = 0; c < ( int ) ( sizeof( commands ) / sizeof( commands[ 0 ] ) );
+              c++ ) {
+                if ( run->filter != NULL &&
+                     strstr( commands[ c ].name, run->filter ) == NULL ) {
+                        continue;
+                }
+
+                uint64_t size = SMALLEST_SIZE;
+                while ( size <= maxSize ) {
+                        writeBinaryFile( plain, data, size );
+                        if ( commands[ c ].prepare != NULL ) {
+                                state->command = commands[ c ].prepare;
+                                benchCommand( state, data, size );
+                        }
+
+                        state->command = commands[ c ].command;
+                        Measurement result = measure( run, benchCommand, state,
+                                                        data, size );
+                        report( run, commands[ c ].name, commands[ c ].variant,
+                                        size, &result );
+                        if ( result.nsMedian >= TIME_LIMIT_NS ) {
+                                break;
+                        }
+
+                        size *= SIZE_STEP;
+                }
+        }
+
+        char const *files[] = { key, iv, nonce, plain, cipher, out };
+        int f = 0;
+        for ( f = 0; f < ( int ) ( sizeof( files ) / sizeof( files[ 0 ] ) ); f++ ) {
+                unlink( files[ f ] );
+        }
+
+        rmdir( dir );
+}
+
+/**
+        This main function parses the command line, sets up the keys and a
+        buffer of random data, and runs every measurement.
+
+        @param argc The number of arguments
+        @param argv An array of the arguments
+        @return Program Exit Status
+ */
+int main( int argc, char *argv[] )
+{
+        Run run;
+        memset( &run, 0, sizeof( run ) );
+        run.maxSize = DEFAULT_MAX_SIZE;
+        run.reps = DEFAULT_REPS;
+        run.binDir = ".";
+        bool ok = true;
+        int i = 0;
+        for ( i = 1; ok && i < argc; i++ ) {
+                if ( strcmp( argv[ i ], "--max-size" ) == 0 ) {
+                        ok = parseSize( argv[ ++i ], &run.maxSize ) &&
+                                run.maxSize >= BLOCK_SIZE &&
+                                run.maxSize <= SIZE_MAX;
+                } else if ( strcmp( argv[ i ], "--reps" ) == 0 ) {
+                        ok = parseCount( argv[ ++i ], &run.reps );
+                } else if ( strcmp( argv[ i ], "--filter" ) == 0 ) {
+                        run.filter = argv[ ++i ];
+                        ok = run.filter != NULL;
+                } else if ( strcmp( argv[ i ], "--counters" ) == 0 ) {
+                        run.useCounters = true;
+                } else if ( strcmp( argv[ i ], "--bin" ) == 0 ) {
+                        run.binDir = argv[ ++i ];
+                        ok = run.binDir != NULL;
+                } else {
+                        ok = false;
+                }
+        }
+
+        if ( !ok ) {
+                fprintf( stderr, "usage: aesBench [--max-size SIZE] "
+                                "[--reps N] [--filter NAME] [--counters] "
+                                "[--bin DIR]\n" );
+                exit( EXIT_FAILURE );
+        }
+
+        // The largest size is cut down to whole blocks
+        run.maxSize -= run.maxSize % BLOCK_SIZE;
+        size_t bufferSize = run.maxSize > FIXED_SIZE ? run.maxSize : FIXED_SIZE;
+        byte *data = allocateBuffer( bufferSize );
+        drbgRandom( drbgThread(), data, bufferSize );
+
+        BenchState state;
+        memset( &state, 0, sizeof( state ) );
+        drbgRandom( drbgThread(), state.key, sizeof( state.key ) );
+        drbgRandom( drbgThread(), state.iv, sizeof( state.iv ) );
+        aesInitKey( &state.ctx, state.key );
+        gcmInitKey( &state.gcm, state.key );
+        xtsInitKey( &state.xts, state.key, XTS_UNIT_4096 );
+        cmacInitKey( &state.cmac, state.key );
+        sivInitKey( &state.siv, state.key );
+
+        // Without counters, as in most containers, only the timing is kept
+        if ( run.useCounters ) {
+                run.counting = countersOpen( &run.counters );
+                if ( !run.counting ) {
+                        fprintf( stderr, "Hardware counters unavailable (%s); "
+                                        "timing only\n", strerror( errno ) );
+                }
+        }
+
+        printf( "{\n  \"maxSize\": %llu,\n  \"reps\": %d,\n"
+                "  \"bestBackend\": \"%s\",\n  \"counters\": %s,\n"
+                "  \"results\": [", ( unsigned long long ) run.maxSize,
+                run.reps, aesBackendName( aesBestBackend() ),
+                run.counting ? "true" : "false" );
+        measureKernels( &run, &state, data );
+
+        // The counters only follow this thread, not the programs it starts
+        bool counting = run.counting;
+        run.counting = false;
+        measureCommands( &run, &state, data );
+        if ( counting ) {
+                countersClose( &run.counters );
+        }
+
+        double ghz = run.totalNs > 0 ? ( double ) run.totalCycles /
+                run.totalNs : 0;
+        printf( "\n  ],\n  \"tscGHz\": %.3f\n}\n", ghz );
+        free( data );
+        return EXIT_SUCCESS;
+}
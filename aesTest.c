@@ -9,9 +9,16 @@
 #include <string.h>
 
 #include "aes.h"
+#include "ctr.h"
+#include "cbc.h"
+#include "drbg.h"
+#include "siv.h"
+#include "chunker.h"
+#include "gcm.h"
+#include "xts.h"
 
 /** Number of tests we should have, if they're all turned on. */
-#define EXPECTED_TOTAL 38
+#define EXPECTED_TOTAL 69
 
 /** Total number or tests we tried. */
 static int totalTests = 0;
@@ -320,6 +327,696 @@ int main()
     TestCase( memcmp( data, expected, BLOCK_SIZE ) == 0 );
   }
 
+  ////////////////////////////////////////////////////////////////////////
+  // Test aesInitKey(), aesEncryptWithContext() and aesDecryptWithContext()
+
+  {
+    // Same key as the generateSubkeys() test.
+    byte key[ BLOCK_SIZE ] = {
+      0xF7, 0x26, 0x4C, 0xC8, 0xDF, 0x90, 0xF1, 0xCA,
+      0xEE, 0x7A, 0xE1, 0x99, 0x11, 0xF7, 0x6B, 0xD1 };
+
+    AesContext ctx;
+    aesInitKey( &ctx, key );
+
+    // The context should hold exactly the subkeys generateSubkeys() makes.
+    byte subkey[ ROUNDS + 1 ][ BLOCK_SIZE ];
+    generateSubkeys( subkey, key );
+    TestCase( memcmp( ctx.subkey, subkey, sizeof( subkey ) ) == 0 );
+
+    // Encrypt a run of blocks both ways and compare every byte.
+    int encryptMismatches = 0;
+    int decryptMismatches = 0;
+    for ( int b = 0; b < 64; b++ ) {
+      byte viaKey[ BLOCK_SIZE ];
+      byte viaContext[ BLOCK_SIZE ];
+      for ( int i = 0; i < BLOCK_SIZE; i++ )
+        viaKey[ i ] = viaContext[ i ] = ( byte ) ( b * 37 + i * 11 );
+
+      encryptBlock( viaKey, key );
+      aesEncryptWithContext( &ctx, viaContext );
+      if ( memcmp( viaKey, viaContext, BLOCK_SIZE ) != 0 )
+        encryptMismatches += 1;
+
+      decryptBlock( viaKey, key );
+      aesDecryptWithContext( &ctx, viaContext );
+      if ( memcmp( viaKey, viaContext, BLOCK_SIZE ) != 0 )
+        decryptMismatches += 1;
+    }
+
+    TestCase( encryptMismatches == 0 );
+    TestCase( decryptMismatches == 0 );
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // Run the encryptBlock() and decryptBlock() vectors against every
+  // available backend, and compare each one with the reference backend
+
+  {
+    byte encryptKey[ BLOCK_SIZE ] = {
+      0x34, 0x27, 0x15, 0xA1, 0xDB, 0xF3, 0x3C, 0x72,
+      0x09, 0xBA, 0x87, 0x7D, 0xC2, 0x1F, 0x73, 0x1A };
+    byte plain[ BLOCK_SIZE ] = {
+      0x04, 0x52, 0xAA, 0x23, 0x71, 0xA7, 0xBF, 0xDB,
+      0x80, 0x01, 0xC5, 0x5D, 0xB4, 0x1F, 0x70, 0x82 };
+    byte cipher[ BLOCK_SIZE ] = {
+      0xFE, 0x4E, 0x2A, 0x42, 0xC9, 0x3F, 0xCF, 0xF1,
+      0x89, 0x9D, 0xC1, 0xB6, 0xA4, 0x53, 0x47, 0xFF };
+
+    byte decryptKey[ BLOCK_SIZE ] = {
+      0x5A, 0xC3, 0xFC, 0xC3, 0x4C, 0xD4, 0x60, 0xD7,
+      0xFE, 0x9B, 0x66, 0x83, 0xC7, 0xDC, 0xDE, 0x30 };
+    byte decryptIn[ BLOCK_SIZE ] = {
+      0xDE, 0xE9, 0x57, 0x0E, 0x94, 0x0B, 0xE0, 0xB2,
+      0x7B, 0x45, 0x82, 0x2C, 0xAA, 0x38, 0xA4, 0x7E };
+    byte decryptOut[ BLOCK_SIZE ] = {
+      0x12, 0x83, 0xE6, 0xB3, 0xA1, 0xA9, 0xFA, 0xC0,
+      0xCE, 0xFC, 0x08, 0x87, 0xDE, 0x96, 0x06, 0xC1 };
+
+    AesContext reference;
+    aesInitKeyWithBackend( &reference, encryptKey, AES_BACKEND_REFERENCE );
+
+    int tested = 0;
+    int initFailures = 0;
+    int subkeyFailures = 0;
+    int vectorFailures = 0;
+    int mismatches = 0;
+    for ( int b = 0; b < AES_BACKEND_COUNT; b++ ) {
+      AesContext ctx;
+      bool ok = aesInitKeyWithBackend( &ctx, encryptKey, b );
+      if ( ok != aesBackendAvailable( b ) )
+        initFailures += 1;
+      if ( !ok )
+        continue;
+      tested += 1;
+
+      // Every backend must agree on the key schedule.
+      if ( memcmp( ctx.subkey, reference.subkey, sizeof( ctx.subkey ) ) != 0 ||
+           memcmp( ctx.decSubkey, reference.decSubkey,
+                   sizeof( ctx.decSubkey ) ) != 0 )
+        subkeyFailures += 1;
+
+      byte data[ BLOCK_SIZE ];
+      memcpy( data, plain, BLOCK_SIZE );
+      aesEncryptWithContext( &ctx, data );
+      if ( memcmp( data, cipher, BLOCK_SIZE ) != 0 )
+        vectorFailures += 1;
+
+      AesContext dctx;
+      aesInitKeyWithBackend( &dctx, decryptKey, b );
+      memcpy( data, decryptIn, BLOCK_SIZE );
+      aesDecryptWithContext( &dctx, data );
+      if ( memcmp( data, decryptOut, BLOCK_SIZE ) != 0 )
+        vectorFailures += 1;
+
+      for ( int n = 0; n < 256; n++ ) {
+        byte viaReference[ BLOCK_SIZE ];
+        byte viaBackend[ BLOCK_SIZE ];
+        for ( int i = 0; i < BLOCK_SIZE; i++ )
+          viaReference[ i ] = viaBackend[ i ] = ( byte ) ( n ^ ( i * 29 ) );
+
+        aesEncryptWithContext( &reference, viaReference );
+        aesEncryptWithContext( &ctx, viaBackend );
+        if ( memcmp( viaReference, viaBackend, BLOCK_SIZE ) != 0 )
+          mismatches += 1;
+
+        aesDecryptWithContext( &reference, viaReference );
+        aesDecryptWithContext( &ctx, viaBackend );
+        if ( memcmp( viaReference, viaBackend, BLOCK_SIZE ) != 0 )
+          mismatches += 1;
+      }
+
+      if ( vectorFailures != 0 || mismatches != 0 )
+        printf( "**** Backend %s disagrees with the reference\n",
+                aesBackendName( b ) );
+    }
+
+    TestCase( initFailures == 0 );
+    TestCase( tested >= 2 );
+    TestCase( subkeyFailures == 0 );
+    TestCase( vectorFailures == 0 );
+    TestCase( mismatches == 0 );
+    TestCase( aesBackendAvailable( aesBestBackend() ) );
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // Test aesEncryptBlocks() and aesDecryptBlocks() on every backend, with
+  // counts below, at and above a full bitsliced group, both in place and
+  // into a separate buffer
+
+  {
+    byte key[ BLOCK_SIZE ] = {
+      0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6,
+      0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+    static const size_t counts[] = { 1, 4, 7, 8, 9, 16, 23, 64 };
+    int countTotal = sizeof( counts ) / sizeof( counts[ 0 ] );
+
+    AesContext reference;
+    aesInitKeyWithBackend( &reference, key, AES_BACKEND_REFERENCE );
+
+    byte plain[ 64 * BLOCK_SIZE ];
+    byte expected[ 64 * BLOCK_SIZE ];
+    byte data[ 64 * BLOCK_SIZE ];
+    byte copy[ 64 * BLOCK_SIZE ];
+    for ( int i = 0; i < (int) sizeof( plain ); i++ )
+      plain[ i ] = ( byte ) ( i * 7 + ( i >> 4 ) );
+    memcpy( expected, plain, sizeof( plain ) );
+    for ( int n = 0; n < 64; n++ )
+      aesEncryptWithContext( &reference, expected + n * BLOCK_SIZE );
+
+    int encryptMismatches = 0;
+    int decryptMismatches = 0;
+    int copyMismatches = 0;
+    for ( int b = 0; b < AES_BACKEND_COUNT; b++ ) {
+      AesContext ctx;
+      if ( !aesInitKeyWithBackend( &ctx, key, b ) )
+        continue;
+
+      for ( int c = 0; c < countTotal; c++ ) {
+        size_t bytes = counts[ c ] * BLOCK_SIZE;
+        memcpy( data, plain, bytes );
+        aesEncryptBlocks( &ctx, data, data, counts[ c ] );
+        if ( memcmp( data, expected, bytes ) != 0 )
+          encryptMismatches += 1;
+
+        aesDecryptBlocks( &ctx, data, data, counts[ c ] );
+        if ( memcmp( data, plain, bytes ) != 0 )
+          decryptMismatches += 1;
+
+        // Out of place, the input must be left alone
+        aesEncryptBlocks( &ctx, plain, copy, counts[ c ] );
+        if ( memcmp( copy, expected, bytes ) != 0 )
+          copyMismatches += 1;
+
+        aesDecryptBlocks( &ctx, copy, data, counts[ c ] );
+        if ( memcmp( data, plain, bytes ) != 0 ||
+             memcmp( copy, expected, bytes ) != 0 )
+          copyMismatches += 1;
+      }
+    }
+
+    TestCase( encryptMismatches == 0 );
+    TestCase( decryptMismatches == 0 );
+    TestCase( copyMismatches == 0 );
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // Test ctrCrypt() against the CTR-AES128 vectors from NIST SP 800-38A,
+  // starting at every offset, and across a counter that wraps around
+
+  {
+    byte key[ BLOCK_SIZE ] = {
+      0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6,
+      0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+    byte iv[ BLOCK_SIZE ] = {
+      0xF0, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7,
+      0xF8, 0xF9, 0xFA, 0xFB, 0xFC, 0xFD, 0xFE, 0xFF };
+    byte plain[ 4 * BLOCK_SIZE ] = {
+      0x6B, 0xC1, 0xBE, 0xE2, 0x2E, 0x40, 0x9F, 0x96,
+      0xE9, 0x3D, 0x7E, 0x11, 0x73, 0x93, 0x17, 0x2A,
+      0xAE, 0x2D, 0x8A, 0x57, 0x1E, 0x03, 0xAC, 0x9C,
+      0x9E, 0xB7, 0x6F, 0xAC, 0x45, 0xAF, 0x8E, 0x51,
+      0x30, 0xC8, 0x1C, 0x46, 0xA3, 0x5C, 0xE4, 0x11,
+      0xE5, 0xFB, 0xC1, 0x19, 0x1A, 0x0A, 0x52, 0xEF,
+      0xF6, 0x9F, 0x24, 0x45, 0xDF, 0x4F, 0x9B, 0x17,
+      0xAD, 0x2B, 0x41, 0x7B, 0xE6, 0x6C, 0x37, 0x10 };
+    byte cipher[ 4 * BLOCK_SIZE ] = {
+      0x87, 0x4D, 0x61, 0x91, 0xB6, 0x20, 0xE3, 0x26,
+      0x1B, 0xEF, 0x68, 0x64, 0x99, 0x0D, 0xB6, 0xCE,
+      0x98, 0x06, 0xF6, 0x6B, 0x79, 0x70, 0xFD, 0xFF,
+      0x86, 0x17, 0x18, 0x7B, 0xB9, 0xFF, 0xFD, 0xFF,
+      0x5A, 0xE4, 0xDF, 0x3E, 0xDB, 0xD5, 0xD3, 0x5E,
+      0x5B, 0x4F, 0x09, 0x02, 0x0D, 0xB0, 0x3E, 0xAB,
+      0x1E, 0x03, 0x1D, 0xDA, 0x2F, 0xBE, 0x03, 0xD1,
+      0x79, 0x21, 0x70, 0xA0, 0xF3, 0x00, 0x9C, 0xEE };
+
+    AesContext ctx;
+    aesInitKey( &ctx, key );
+    byte data[ 4 * BLOCK_SIZE ];
+    ctrCrypt( &ctx, iv, 0, plain, data, sizeof( plain ) );
+    TestCase( memcmp( data, cipher, sizeof( cipher ) ) == 0 );
+
+    // Every split point, with odd lengths on both sides
+    int splitFailures = 0;
+    byte advanced[ BLOCK_SIZE ];
+    memcpy( advanced, iv, BLOCK_SIZE );
+    ctrAdvance( advanced, 3 );
+    ctrCrypt( &ctx, advanced, 0, plain + 3 * BLOCK_SIZE, data, BLOCK_SIZE );
+    if ( memcmp( data, cipher + 3 * BLOCK_SIZE, BLOCK_SIZE ) != 0 )
+      splitFailures += 1;
+
+    for ( int at = 0; at <= (int) sizeof( plain ); at++ ) {
+      memcpy( data, cipher, sizeof( cipher ) );
+      ctrCrypt( &ctx, iv, at, data + at, data + at, sizeof( data ) - at );
+      ctrCrypt( &ctx, iv, 0, data, data, at );
+      if ( memcmp( data, plain, sizeof( plain ) ) != 0 )
+        splitFailures += 1;
+    }
+
+    TestCase( splitFailures == 0 );
+
+    // Two blocks before the counter wraps, the third block is at zero
+    byte last[ BLOCK_SIZE ];
+    memset( last, 0xFF, BLOCK_SIZE );
+    last[ BLOCK_SIZE - 1 ] = 0xFE;
+    byte zero[ BLOCK_SIZE ] = { 0 };
+    byte wrapped[ 3 * BLOCK_SIZE ] = { 0 };
+    byte expected[ 3 * BLOCK_SIZE ];
+    ctrCrypt( &ctx, last, 0, wrapped, wrapped, sizeof( wrapped ) );
+    memcpy( expected, last, BLOCK_SIZE );
+    memset( expected + BLOCK_SIZE, 0xFF, BLOCK_SIZE );
+    memcpy( expected + 2 * BLOCK_SIZE, zero, BLOCK_SIZE );
+    aesEncryptBlocks( &ctx, expected, expected, 3 );
+    TestCase( memcmp( wrapped, expected, sizeof( expected ) ) == 0 );
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // Test gcmEncrypt() and gcmDecrypt() against test cases 1, 2 and 4 of
+  // the GCM specification with every GHASH strategy, and check that a bad
+  // tag releases no plaintext
+
+  {
+    byte zeroKey[ BLOCK_SIZE ] = { 0 };
+    byte zeroIv[ GCM_IV_SIZE ] = { 0 };
+    byte zeroBlock[ BLOCK_SIZE ] = { 0 };
+    byte emptyTag[ GCM_TAG_SIZE ] = {
+      0x58, 0xE2, 0xFC, 0xCE, 0xFA, 0x7E, 0x30, 0x61,
+      0x36, 0x7F, 0x1D, 0x57, 0xA4, 0xE7, 0x45, 0x5A };
+    byte zeroCipher[ BLOCK_SIZE ] = {
+      0x03, 0x88, 0xDA, 0xCE, 0x60, 0xB6, 0xA3, 0x92,
+      0xF3, 0x28, 0xC2, 0xB9, 0x71, 0xB2, 0xFE, 0x78 };
+    byte zeroTag[ GCM_TAG_SIZE ] = {
+      0xAB, 0x6E, 0x47, 0xD4, 0x2C, 0xEC, 0x13, 0xBD,
+      0xF5, 0x3A, 0x67, 0xB2, 0x12, 0x57, 0xBD, 0xDF };
+
+    byte key[ BLOCK_SIZE ] = {
+      0xFE, 0xFF, 0xE9, 0x92, 0x86, 0x65, 0x73, 0x1C,
+      0x6D, 0x6A, 0x8F, 0x94, 0x67, 0x30, 0x83, 0x08 };
+    byte iv[ GCM_IV_SIZE ] = {
+      0xCA, 0xFE, 0xBA, 0xBE, 0xFA, 0xCE, 0xDB, 0xAD,
+      0xDE, 0xCA, 0xF8, 0x88 };
+    byte aad[ 20 ] = {
+      0xFE, 0xED, 0xFA, 0xCE, 0xDE, 0xAD, 0xBE, 0xEF,
+      0xFE, 0xED, 0xFA, 0xCE, 0xDE, 0xAD, 0xBE, 0xEF,
+      0xAB, 0xAD, 0xDA, 0xD2 };
+    byte plain[ 60 ] = {
+      0xD9, 0x31, 0x32, 0x25, 0xF8, 0x84, 0x06, 0xE5,
+      0xA5, 0x59, 0x09, 0xC5, 0xAF, 0xF5, 0x26, 0x9A,
+      0x86, 0xA7, 0xA9, 0x53, 0x15, 0x34, 0xF7, 0xDA,
+      0x2E, 0x4C, 0x30, 0x3D, 0x8A, 0x31, 0x8A, 0x72,
+      0x1C, 0x3C, 0x0C, 0x95, 0x95, 0x68, 0x09, 0x53,
+      0x2F, 0xCF, 0x0E, 0x24, 0x49, 0xA6, 0xB5, 0x25,
+      0xB1, 0x6A, 0xED, 0xF5, 0xAA, 0x0D, 0xE6, 0x57,
+      0xBA, 0x63, 0x7B, 0x39 };
+    byte cipher[ 60 ] = {
+      0x42, 0x83, 0x1E, 0xC2, 0x21, 0x77, 0x74, 0x24,
+      0x4B, 0x72, 0x21, 0xB7, 0x84, 0xD0, 0xD4, 0x9C,
+      0xE3, 0xAA, 0x21, 0x2F, 0x2C, 0x02, 0xA4, 0xE0,
+      0x35, 0xC1, 0x7E, 0x23, 0x29, 0xAC, 0xA1, 0x2E,
+      0x21, 0xD5, 0x14, 0xB2, 0x54, 0x66, 0x93, 0x1C,
+      0x7D, 0x8F, 0x6A, 0x5A, 0xAC, 0x84, 0xAA, 0x05,
+      0x1B, 0xA3, 0x0B, 0x39, 0x6A, 0x0A, 0xAC, 0x97,
+      0x3D, 0x58, 0xE0, 0x91 };
+    byte tag[ GCM_TAG_SIZE ] = {
+      0x5B, 0xC9, 0x4F, 0xBC, 0x32, 0x21, 0xA5, 0xDB,
+      0x94, 0xFA, 0xE9, 0x5A, 0xE7, 0x12, 0x1A, 0x47 };
+
+    int vectorFailures = 0;
+    int decryptFailures = 0;
+    int tamperFailures = 0;
+    int tested = 0;
+    for ( int s = 0; s < GHASH_STRATEGY_COUNT; s++ ) {
+      if ( !ghashStrategyAvailable( s ) )
+        continue;
+      tested += 1;
+
+      GcmKey zero;
+      GcmKey gcm;
+      byte h[ GHASH_BLOCK ];
+      gcmInitKey( &zero, zeroKey );
+      field128Store( h, zero.ghash.h );
+      ghashInitWithStrategy( &zero.ghash, h, s );
+      gcmInitKey( &gcm, key );
+      field128Store( h, gcm.ghash.h );
+      ghashInitWithStrategy( &gcm.ghash, h, s );
+
+      byte out[ 60 ];
+      byte outTag[ GCM_TAG_SIZE ];
+      gcmEncrypt( &zero, zeroIv, NULL, 0, NULL, out, 0, outTag );
+      if ( memcmp( outTag, emptyTag, GCM_TAG_SIZE ) != 0 )
+        vectorFailures += 1;
+
+      gcmEncrypt( &zero, zeroIv, NULL, 0, zeroBlock, out, BLOCK_SIZE,
+                  outTag );
+      if ( memcmp( out, zeroCipher, BLOCK_SIZE ) != 0 ||
+           memcmp( outTag, zeroTag, GCM_TAG_SIZE ) != 0 )
+        vectorFailures += 1;
+
+      gcmEncrypt( &gcm, iv, aad, sizeof( aad ), plain, out,
+                  sizeof( plain ), outTag );
+      if ( memcmp( out, cipher, sizeof( cipher ) ) != 0 ||
+           memcmp( outTag, tag, GCM_TAG_SIZE ) != 0 )
+        vectorFailures += 1;
+
+      if ( !gcmDecrypt( &gcm, iv, aad, sizeof( aad ), cipher, out,
+                        sizeof( cipher ), tag ) ||
+           memcmp( out, plain, sizeof( plain ) ) != 0 )
+        decryptFailures += 1;
+
+      // One flipped bit of ciphertext and nothing comes out
+      byte tampered[ 60 ];
+      memcpy( tampered, cipher, sizeof( cipher ) );
+      tampered[ 33 ] ^= 0x04;
+      if ( gcmDecrypt( &gcm, iv, aad, sizeof( aad ), tampered, out,
+                       sizeof( tampered ), tag ) ||
+           memcmp( out, zeroBlock, BLOCK_SIZE ) != 0 )
+        tamperFailures += 1;
+    }
+
+    TestCase( tested >= 3 );
+    TestCase( vectorFailures == 0 );
+    TestCase( decryptFailures == 0 );
+    TestCase( tamperFailures == 0 );
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // Test cbcEncrypt() and cbcDecrypt() against the CBC-AES128 vectors from
+  // NIST SP 800-38A, decrypting from the middle of the message, then check
+  // that cbcEncryptStreams() matches encrypting each message on its own
+
+  {
+    byte key[ BLOCK_SIZE ] = {
+      0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6,
+      0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+    byte iv[ BLOCK_SIZE ] = {
+      0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+      0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F };
+    byte plain[ 4 * BLOCK_SIZE ] = {
+      0x6B, 0xC1, 0xBE, 0xE2, 0x2E, 0x40, 0x9F, 0x96,
+      0xE9, 0x3D, 0x7E, 0x11, 0x73, 0x93, 0x17, 0x2A,
+      0xAE, 0x2D, 0x8A, 0x57, 0x1E, 0x03, 0xAC, 0x9C,
+      0x9E, 0xB7, 0x6F, 0xAC, 0x45, 0xAF, 0x8E, 0x51,
+      0x30, 0xC8, 0x1C, 0x46, 0xA3, 0x5C, 0xE4, 0x11,
+      0xE5, 0xFB, 0xC1, 0x19, 0x1A, 0x0A, 0x52, 0xEF,
+      0xF6, 0x9F, 0x24, 0x45, 0xDF, 0x4F, 0x9B, 0x17,
+      0xAD, 0x2B, 0x41, 0x7B, 0xE6, 0x6C, 0x37, 0x10 };
+    byte cipher[ 4 * BLOCK_SIZE ] = {
+      0x76, 0x49, 0xAB, 0xAC, 0x81, 0x19, 0xB2, 0x46,
+      0xCE, 0xE9, 0x8E, 0x9B, 0x12, 0xE9, 0x19, 0x7D,
+      0x50, 0x86, 0xCB, 0x9B, 0x50, 0x72, 0x19, 0xEE,
+      0x95, 0xDB, 0x11, 0x3A, 0x91, 0x76, 0x78, 0xB2,
+      0x73, 0xBE, 0xD6, 0xB8, 0xE3, 0xC1, 0x74, 0x3B,
+      0x71, 0x16, 0xE6, 0x9E, 0x22, 0x22, 0x95, 0x16,
+      0x3F, 0xF1, 0xCA, 0xA1, 0x68, 0x1F, 0xAC, 0x09,
+      0x12, 0x0E, 0xCA, 0x30, 0x75, 0x86, 0xE1, 0xA7 };
+
+    AesContext ctx;
+    aesInitKey( &ctx, key );
+    byte chain[ BLOCK_SIZE ];
+    memcpy( chain, iv, BLOCK_SIZE );
+    byte data[ 4 * BLOCK_SIZE ];
+    cbcEncrypt( &ctx, chain, plain, data, sizeof( data ) );
+    TestCase( memcmp( data, cipher, sizeof( data ) ) == 0 &&
+              memcmp( chain, cipher + 3 * BLOCK_SIZE, BLOCK_SIZE ) == 0 );
+
+    // In place, first the tail after one block, then the head
+    memcpy( data, cipher, sizeof( data ) );
+    cbcDecrypt( &ctx, cipher, data + BLOCK_SIZE, data + BLOCK_SIZE,
+                3 * BLOCK_SIZE );
+    cbcDecrypt( &ctx, iv, data, data, BLOCK_SIZE );
+    TestCase( memcmp( data, plain, sizeof( data ) ) == 0 );
+
+    // More messages than lanes, of different lengths, including empty
+    CbcStream streams[ CBC_LANES + 3 ];
+    byte text[ CBC_LANES + 3 ][ 2 * CBC_BATCH * BLOCK_SIZE ];
+    byte expect[ CBC_LANES + 3 ][ 2 * CBC_BATCH * BLOCK_SIZE ];
+    int s = 0;
+    for ( s = 0; s < CBC_LANES + 3; s++ ) {
+      size_t blocks = ( s * 37 ) % ( 2 * CBC_BATCH + 1 );
+      for ( int i = 0; i < (int) sizeof( text[ s ] ); i++ )
+        text[ s ][ i ] = ( byte ) ( i * 7 + s );
+      memcpy( streams[ s ].chain, iv, BLOCK_SIZE );
+      streams[ s ].chain[ 0 ] = ( byte ) s;
+      memcpy( chain, streams[ s ].chain, BLOCK_SIZE );
+      cbcEncrypt( &ctx, chain, text[ s ], expect[ s ], blocks * BLOCK_SIZE );
+      streams[ s ].in = text[ s ];
+      streams[ s ].out = text[ s ];
+      streams[ s ].blocks = blocks;
+    }
+
+    cbcEncryptStreams( &ctx, streams, CBC_LANES + 3 );
+    bool same = true;
+    for ( s = 0; s < CBC_LANES + 3; s++ )
+      if ( memcmp( text[ s ], expect[ s ],
+                   streams[ s ].blocks * BLOCK_SIZE ) != 0 )
+        same = false;
+    TestCase( same );
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // Test cmac() against RFC 4493 and sivEncrypt() against RFC 5297, then
+  // check that sivEncryptStreams() matches sivEncrypt() for messages of
+  // every awkward length and that a changed byte fails sivDecryptStreams()
+
+  {
+    byte key[ BLOCK_SIZE ] = {
+      0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6,
+      0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+    byte message[ 4 * BLOCK_SIZE ] = {
+      0x6B, 0xC1, 0xBE, 0xE2, 0x2E, 0x40, 0x9F, 0x96,
+      0xE9, 0x3D, 0x7E, 0x11, 0x73, 0x93, 0x17, 0x2A,
+      0xAE, 0x2D, 0x8A, 0x57, 0x1E, 0x03, 0xAC, 0x9C,
+      0x9E, 0xB7, 0x6F, 0xAC, 0x45, 0xAF, 0x8E, 0x51,
+      0x30, 0xC8, 0x1C, 0x46, 0xA3, 0x5C, 0xE4, 0x11,
+      0xE5, 0xFB, 0xC1, 0x19, 0x1A, 0x0A, 0x52, 0xEF,
+      0xF6, 0x9F, 0x24, 0x45, 0xDF, 0x4F, 0x9B, 0x17,
+      0xAD, 0x2B, 0x41, 0x7B, 0xE6, 0x6C, 0x37, 0x10 };
+    byte emptyMac[ BLOCK_SIZE ] = {
+      0xBB, 0x1D, 0x69, 0x29, 0xE9, 0x59, 0x37, 0x28,
+      0x7F, 0xA3, 0x7D, 0x12, 0x9B, 0x75, 0x67, 0x46 };
+    byte shortMac[ BLOCK_SIZE ] = {
+      0xDF, 0xA6, 0x67, 0x47, 0xDE, 0x9A, 0xE6, 0x30,
+      0x30, 0xCA, 0x32, 0x61, 0x14, 0x97, 0xC8, 0x27 };
+    byte fullMac[ BLOCK_SIZE ] = {
+      0x51, 0xF0, 0xBE, 0xBF, 0x7E, 0x3B, 0x9D, 0x92,
+      0xFC, 0x49, 0x74, 0x17, 0x79, 0x36, 0x3C, 0xFE };
+
+    CmacKey cmacKey;
+    cmacInitKey( &cmacKey, key );
+    byte mac[ BLOCK_SIZE ];
+    bool same = true;
+    cmac( &cmacKey, message, 0, mac );
+    same = same && memcmp( mac, emptyMac, BLOCK_SIZE ) == 0;
+    cmac( &cmacKey, message, 40, mac );
+    same = same && memcmp( mac, shortMac, BLOCK_SIZE ) == 0;
+    cmac( &cmacKey, message, sizeof( message ), mac );
+    same = same && memcmp( mac, fullMac, BLOCK_SIZE ) == 0;
+    TestCase( same );
+
+    // RFC 5297, appendix A.1
+    byte sivKeyBytes[ SIV_KEY_SIZE ] = {
+      0xFF, 0xFE, 0xFD, 0xFC, 0xFB, 0xFA, 0xF9, 0xF8,
+      0xF7, 0xF6, 0xF5, 0xF4, 0xF3, 0xF2, 0xF1, 0xF0,
+      0xF0, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7,
+      0xF8, 0xF9, 0xFA, 0xFB, 0xFC, 0xFD, 0xFE, 0xFF };
+    byte aad[ 24 ] = {
+      0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+      0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F,
+      0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27 };
+    byte plain[ 14 ] = {
+      0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88,
+      0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE };
+    byte iv[ SIV_IV_SIZE ] = {
+      0x85, 0x63, 0x2D, 0x07, 0xC6, 0xE8, 0xF3, 0x7F,
+      0x95, 0x0A, 0xCD, 0x32, 0x0A, 0x2E, 0xCC, 0x93 };
+    byte cipher[ 14 ] = {
+      0x40, 0xC0, 0x2B, 0x96, 0x90, 0xC4, 0xDC, 0x04,
+      0xDA, 0xEF, 0x7F, 0x6A, 0xFE, 0x5C };
+
+    SivKey sivKey;
+    sivInitKey( &sivKey, sivKeyBytes );
+    byte outIv[ SIV_IV_SIZE ];
+    byte data[ 14 ];
+    sivEncrypt( &sivKey, aad, sizeof( aad ), plain, data, sizeof( data ),
+                outIv );
+    same = memcmp( outIv, iv, SIV_IV_SIZE ) == 0 &&
+      memcmp( data, cipher, sizeof( data ) ) == 0;
+    same = same && sivDecrypt( &sivKey, aad, sizeof( aad ), data, data,
+                               sizeof( data ), iv ) &&
+      memcmp( data, plain, sizeof( data ) ) == 0;
+    TestCase( same );
+
+    // More messages than lanes, each its own length
+    SivMessage messages[ SIV_LANES + 5 ];
+    byte text[ SIV_LANES + 5 ][ 100 ];
+    byte sealed[ SIV_LANES + 5 ][ 100 ];
+    int m = 0;
+    for ( m = 0; m < SIV_LANES + 5; m++ ) {
+      for ( int i = 0; i < 100; i++ )
+        text[ m ][ i ] = ( byte ) ( i * 31 + m );
+      messages[ m ].in = text[ m ];
+      messages[ m ].out = sealed[ m ];
+      messages[ m ].length = ( m * 7 ) % 100;
+    }
+
+    sivEncryptStreams( &sivKey, messages, SIV_LANES + 5 );
+    same = true;
+    for ( m = 0; m < SIV_LANES + 5; m++ ) {
+      byte expect[ 100 ];
+      sivEncrypt( &sivKey, NULL, 0, text[ m ], expect, messages[ m ].length,
+                  outIv );
+      if ( memcmp( outIv, messages[ m ].iv, SIV_IV_SIZE ) != 0 ||
+           memcmp( expect, sealed[ m ], messages[ m ].length ) != 0 )
+        same = false;
+      messages[ m ].in = sealed[ m ];
+      messages[ m ].out = sealed[ m ];
+    }
+
+    sealed[ 3 ][ 0 ] ^= 1;
+    sivDecryptStreams( &sivKey, messages, SIV_LANES + 5 );
+    for ( m = 0; m < SIV_LANES + 5; m++ ) {
+      bool intact = m != 3 || messages[ m ].length == 0;
+      if ( messages[ m ].authentic != intact ||
+           ( intact && memcmp( sealed[ m ], text[ m ],
+                               messages[ m ].length ) != 0 ) )
+        same = false;
+    }
+
+    TestCase( same );
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // Test that chunkerNext() cuts on content: after bytes are inserted
+  // near the start, the cuts further on fall in the same places
+
+  {
+    size_t size = 16 * CHUNK_MAX;
+    byte *data = ( byte * ) malloc( size + 100 );
+    unsigned state = 12345;
+    for ( size_t i = 0; i < size + 100; i++ ) {
+      state = state * 1103515245 + 12345;
+      data[ i ] = ( byte ) ( state >> 16 );
+    }
+
+    // Cut points of the data, and of the data with 100 bytes in front
+    size_t cuts[ 2 ][ 16 * CHUNK_MAX / CHUNK_MIN + 1 ];
+    size_t counts[ 2 ] = { 0, 0 };
+    for ( int k = 0; k < 2; k++ ) {
+      byte const *start = data + ( k == 0 ? 100 : 0 );
+      size_t length = k == 0 ? size : size + 100;
+      size_t pos = 0, cut;
+      while ( ( cut = chunkerNext( start + pos, length - pos, true ) ) > 0 ) {
+        pos += cut;
+        cuts[ k ][ counts[ k ]++ ] = pos + ( k == 0 ? 100 : 0 );
+      }
+    }
+
+    // Past the first few chunks, every cut of one is a cut of the other
+    int shared = 0;
+    for ( size_t i = 0; i < counts[ 0 ]; i++ )
+      for ( size_t j = 0; j < counts[ 1 ]; j++ )
+        if ( cuts[ 0 ][ i ] == cuts[ 1 ][ j ] )
+          shared++;
+    TestCase( counts[ 0 ] > size / CHUNK_MAX && shared >= (int) counts[ 0 ] - 3 );
+    free( data );
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // Test xtsEncrypt() against vectors 1 and 2 of IEEE 1619, which use
+  // 32-byte data units, then check that one 512-byte unit in the middle
+  // of a buffer decrypts on its own
+
+  {
+    byte zeroKeys[ XTS_KEY_SIZE ] = { 0 };
+    byte zeroCipher[ 32 ] = {
+      0x91, 0x7C, 0xF6, 0x9E, 0xBD, 0x68, 0xB2, 0xEC,
+      0x9B, 0x9F, 0xE9, 0xA3, 0xEA, 0xDD, 0xA6, 0x92,
+      0xCD, 0x43, 0xD2, 0xF5, 0x95, 0x98, 0xED, 0x85,
+      0x8C, 0x02, 0xC2, 0x65, 0x2F, 0xBF, 0x92, 0x2E };
+    byte keys[ XTS_KEY_SIZE ];
+    memset( keys, 0x11, BLOCK_SIZE );
+    memset( keys + BLOCK_SIZE, 0x22, BLOCK_SIZE );
+    byte cipher[ 32 ] = {
+      0xC4, 0x54, 0x18, 0x5E, 0x6A, 0x16, 0x93, 0x6E,
+      0x39, 0x33, 0x40, 0x38, 0xAC, 0xEF, 0x83, 0x8B,
+      0xFB, 0x18, 0x6F, 0xFF, 0x74, 0x80, 0xAD, 0xC4,
+      0x28, 0x93, 0x82, 0xEC, 0xD6, 0xD3, 0x94, 0xF0 };
+
+    XtsKey key;
+    byte data[ 32 ] = { 0 };
+    xtsInitKey( &key, zeroKeys, sizeof( data ) );
+    xtsEncrypt( &key, 0, data, data, sizeof( data ) );
+    TestCase( memcmp( data, zeroCipher, sizeof( data ) ) == 0 );
+
+    memset( data, 0x44, sizeof( data ) );
+    xtsInitKey( &key, keys, sizeof( data ) );
+    xtsEncrypt( &key, 0x3333333333ULL * sizeof( data ), data, data,
+                sizeof( data ) );
+    TestCase( memcmp( data, cipher, sizeof( data ) ) == 0 );
+
+    byte plain[ 4 * XTS_UNIT_512 ];
+    byte whole[ 4 * XTS_UNIT_512 ];
+    byte one[ XTS_UNIT_512 ];
+    for ( int i = 0; i < (int) sizeof( plain ); i++ )
+      plain[ i ] = ( byte ) ( i * 13 + ( i >> 9 ) );
+    xtsInitKey( &key, keys, XTS_UNIT_512 );
+    xtsEncrypt( &key, 0, plain, whole, sizeof( plain ) );
+    xtsDecrypt( &key, 2 * XTS_UNIT_512, whole + 2 * XTS_UNIT_512, one,
+                XTS_UNIT_512 );
+    TestCase( memcmp( one, plain + 2 * XTS_UNIT_512, XTS_UNIT_512 ) == 0 &&
+              memcmp( whole, plain, XTS_UNIT_512 ) != 0 );
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // Test drbgGenerate() against OpenSSL's CTR-DRBG (AES-128, no
+  // derivation function): instantiate with a personalization string,
+  // generate 1000 bytes with additional input, then 1000 without, and
+  // check the start and end of the second output
+
+  {
+    byte entropy[ DRBG_SEED_SIZE ];
+    for ( int i = 0; i < DRBG_SEED_SIZE; i++ )
+      entropy[ i ] = ( byte ) ( i * 7 + 1 );
+    byte additional[ 20 ];
+    for ( int i = 0; i < (int) sizeof( additional ); i++ )
+      additional[ i ] = ( byte ) ( 0xA0 + i );
+    byte first[ 16 ] = {
+      0xA1, 0xE9, 0xF4, 0x1D, 0x49, 0x36, 0x81, 0x7D,
+      0xAC, 0xFE, 0x46, 0xF7, 0x4F, 0xE3, 0x73, 0x10 };
+    byte last[ 16 ] = {
+      0x52, 0xE4, 0xDE, 0x11, 0x72, 0x35, 0x16, 0x7C,
+      0x53, 0x06, 0xED, 0xF1, 0x26, 0xB4, 0xAB, 0xD2 };
+
+    Drbg drbg;
+    byte out[ 1000 ];
+    drbgInstantiate( &drbg, entropy, ( byte const * ) "pers!", 5 );
+    bool ok = drbgGenerate( &drbg, out, sizeof( out ), additional,
+                            sizeof( additional ) );
+    ok = ok && drbgGenerate( &drbg, out, sizeof( out ), NULL, 0 );
+    TestCase( ok && memcmp( out, first, sizeof( first ) ) == 0 &&
+              memcmp( out + sizeof( out ) - sizeof( last ), last,
+                      sizeof( last ) ) == 0 );
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // Test that drbgGenerate() refuses oversized requests and requests
+  // past the reseed interval, and that a reseed lets it go on
+
+  {
+    byte entropy[ DRBG_SEED_SIZE ] = { 0 };
+    byte out[ 32 ];
+    Drbg drbg;
+    drbgInstantiate( &drbg, entropy, NULL, 0 );
+    drbg.reseedInterval = 2;
+    bool ok = !drbgGenerate( &drbg, NULL, DRBG_MAX_REQUEST + 1, NULL, 0 );
+    ok = ok && drbgGenerate( &drbg, out, sizeof( out ), NULL, 0 );
+    ok = ok && drbgGenerate( &drbg, out, sizeof( out ), NULL, 0 );
+    ok = ok && !drbgGenerate( &drbg, out, sizeof( out ), NULL, 0 );
+    drbgReseed( &drbg, entropy, NULL, 0 );
+    ok = ok && drbgGenerate( &drbg, out, sizeof( out ), NULL, 0 );
+    TestCase( ok );
+  }
+
   // Once you move the #ifdef DISABLE_TESTS to here, you've enabled
   // all the tests.
 #ifdef DISABLE_TESTS
@@ -0,0 +1,137 @@
+/**
+        @file aesc.c
+        @author James O Kocak (jokocak)
+
+        This file contains the main method for aesc, the client for aesd. It
+        loads a key into the daemon, or sends it a whole file to encrypt or
+        decrypt in one request and writes out the result.
+ */
+
+#include "wire.h"
+#include "gcm.h"
+#include "io.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** Most arguments after the options: socket, command, ID and two files. */
+#define ARG_COUNT 5
+
+/**
+        This function prints the usage message and exits.
+ */
+static void usage( void )
+{
+        fprintf( stderr, "usage: aesc [options] <socket-path> encrypt|decrypt "
+                "<key-id> <input-file> <output-file>\n"
+                "       aesc <socket-path> load <key-id> <key-file>\n" );
+        exit( EXIT_FAILURE );
+}
+
+/**
+        This main function parses the command line, makes one request and
+        writes out its result.
+
+        @param argc The number of arguments
+        @param argv An array of the arguments
+        @return Program Exit Status
+ */
+int main( int argc, char *argv[] )
+{
+        // Sorts the arguments into options and the rest
+        char const *args[ ARG_COUNT ];
+        int argCount = 0;
+        char const *ivFile = NULL;
+        WireRequest request;
+        memset( &request, 0, sizeof( request ) );
+        request.mode = WIRE_ECB;
+        bool ok = true;
+        int i = 0;
+        for ( i = 1; ok && i < argc; i++ ) {
+                if ( strcmp( argv[ i ], "--ctr" ) == 0 ||
+                     strcmp( argv[ i ], "--gcm" ) == 0 ) {
+                        request.mode = argv[ i ][ 2 ] == 'c' ? WIRE_CTR :
+                                WIRE_GCM;
+                        ivFile = argv[ ++i ];
+                        ok = ivFile != NULL;
+                } else if ( strncmp( argv[ i ], "--", 2 ) == 0 ||
+                            argCount == ARG_COUNT ) {
+                        ok = false;
+                } else {
+                        args[ argCount++ ] = argv[ i ];
+                }
+        }
+
+        if ( !ok || argCount < ARG_COUNT - 1 ||
+             !wireParseKeyId( args[ 2 ], &request.keyId ) ) {
+                usage();
+        }
+
+        char const *command = args[ 1 ];
+        if ( strcmp( command, "load" ) == 0 && argCount == ARG_COUNT - 1 &&
+             ivFile == NULL ) {
+                request.op = WIRE_LOAD_KEY;
+        } else if ( strcmp( command, "encrypt" ) == 0 &&
+                    argCount == ARG_COUNT ) {
+                request.op = WIRE_ENCRYPT;
+        } else if ( strcmp( command, "decrypt" ) == 0 &&
+                    argCount == ARG_COUNT ) {
+                request.op = WIRE_DECRYPT;
+        } else {
+                usage();
+        }
+
+        if ( ivFile != NULL ) {
+                readIv( ivFile, request.iv, request.mode == WIRE_GCM ?
+                                GCM_IV_SIZE : BLOCK_SIZE );
+        }
+
+        size_t size;
+        byte *input = readBinaryFile( args[ 3 ], &size );
+        if ( request.op == WIRE_LOAD_KEY && size != BLOCK_SIZE ) {
+                fprintf( stderr, "Bad key file: %s\n", args[ 3 ] );
+                exit( EXIT_FAILURE );
+        }
+
+        if ( size > WIRE_MAX_PAYLOAD ) {
+                fprintf( stderr, "Input too large for one request: %s\n",
+                        args[ 3 ] );
+                exit( EXIT_FAILURE );
+        }
+
+        int fd = wireConnect( args[ 0 ] );
+        if ( fd < 0 ) {
+                fprintf( stderr, "Can't connect to socket: %s: %s\n", args[ 0 ],
+                        strerror( errno ) );
+                exit( EXIT_FAILURE );
+        }
+
+        request.length = size;
+        size_t capacity = size + GCM_TAG_SIZE;
+        byte *reply = ( byte * ) malloc( capacity );
+        WireResponse response;
+        if ( reply == NULL || !wireCall( fd, &request, input, &response, reply,
+                                         capacity ) ) {
+                fprintf( stderr, "No response from socket: %s\n", args[ 0 ] );
+                exit( EXIT_FAILURE );
+        }
+
+        close( fd );
+        memset( input, 0, size );
+        free( input );
+        if ( response.status != WIRE_OK ) {
+                fprintf( stderr, "%s: %s\n",
+                        wireStatusName( ( WireStatus ) response.status ),
+                        args[ 3 ] );
+                exit( EXIT_FAILURE );
+        }
+
+        if ( request.op != WIRE_LOAD_KEY ) {
+                writeBinaryFile( args[ 4 ], reply, response.length );
+        }
+
+        free( reply );
+        return EXIT_SUCCESS;
+}
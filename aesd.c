@@ -0,0 +1,1196 @@
+/**
+        @file aesd.c
+        @author James O Kocak (jokocak)
+
+        This file contains the main method for aesd, a daemon that keeps
+        expanded keys in memory and encrypts and decrypts for clients over a
+        Unix socket, so a request doesn't pay for starting a process,
+        reading a key file and running the key schedule. One thread runs an
+        epoll loop that accepts connections and reads and writes frames
+        without blocking. Requests of up to INLINE_LIMIT bytes are served on
+        that thread at once; larger ones go to a pool of workers, which hand
+        them back through an eventfd. A connection has one request in hand
+        at a time, so its responses come back in order.
+
+        A connection may also attach a shared ring, described in shm.h. Its
+        requests are taken when the client rings the ring's eventfd and are
+        served in place in the shared data area, the same way as requests
+        from the socket, and may complete in any order. GCM decryption is
+        the exception: the client can still write to the area, so the
+        payload is verified in a private copy and only plaintext whose tag
+        matched is written back.
+ */
+
+/** Exposes the socket, epoll, eventfd and signalfd calls under -std=c99. */
+#define _DEFAULT_SOURCE
+
+#include "wire.h"
+#include "shm.h"
+#include "keystore.h"
+#include "ctr.h"
+#include "gcm.h"
+#include "io.h"
+#include "options.h"
+#include "pool.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+/**
+        Largest payload served on the event loop's own thread. Below this,
+        handing a request to a worker and back costs more than the cipher.
+ */
+#define INLINE_LIMIT ( 16 << 10 )
+
+/** Most events taken from epoll at once. */
+#define MAX_EVENTS 64
+
+/**
+        What an epoll event points at, other than the daemon's own
+        descriptors. Connection and Attachment both start with one.
+ */
+typedef enum {
+        /** A Connection. */
+        SOURCE_CONNECTION,
+
+        /** An Attachment, whose submission eventfd was rung. */
+        SOURCE_RING
+} SourceKind;
+
+/** Where a connection is in its current request. */
+typedef enum {
+        /** Reading a request header. */
+        CONN_HEADER,
+
+        /** Reading a request's payload. */
+        CONN_PAYLOAD,
+
+        /** Waiting for a worker. */
+        CONN_BUSY,
+
+        /** Writing the response. */
+        CONN_REPLY
+} ConnState;
+
+/** One request, from a connection or a shared ring, and its outcome. */
+typedef struct Job {
+        /** The request header. */
+        WireRequest request;
+
+        /** The payload, transformed in place, with room for a GCM tag. */
+        byte *buffer;
+
+        /** Number of result bytes in buffer. */
+        size_t length;
+
+        /** The outcome. */
+        WireStatus status;
+
+        /** True if buffer is in a shared ring's data area. */
+        bool shared;
+
+        /** The connection the request came from, or NULL. */
+        struct Connection *conn;
+
+        /** The shared ring the request came from, or NULL. */
+        struct Attachment *attachment;
+
+        /** The next job in a queue. */
+        struct Job *next;
+} Job;
+
+/** A shared ring attached to a connection. */
+typedef struct Attachment {
+        /** SOURCE_RING. */
+        SourceKind kind;
+
+        /** The daemon's view of the ring. */
+        ShmRing ring;
+
+        /** The connection it belongs to, or NULL once that has closed. */
+        struct Connection *conn;
+
+        /** Number of its requests on the workers. */
+        uint32_t inFlight;
+
+        /** The next attachment waiting to be freed. */
+        struct Attachment *next;
+} Attachment;
+
+/** One client connection. */
+typedef struct Connection {
+        /** SOURCE_CONNECTION. */
+        SourceKind kind;
+
+        /** The socket. */
+        int fd;
+
+        /** Where the connection is in its current request. */
+        ConnState state;
+
+        /** The epoll events watched, or zero if it isn't registered. */
+        uint32_t events;
+
+        /** Bytes of the header or payload read, or of the response sent. */
+        size_t have;
+
+        /** The request header as read. */
+        byte header[ WIRE_REQUEST_SIZE ];
+
+        /** The current request. */
+        Job job;
+
+        /** The response header to send. */
+        byte reply[ WIRE_RESPONSE_SIZE ];
+
+        /** The payload, with room for a GCM tag. */
+        byte *buffer;
+
+        /** Number of bytes buffer can hold. */
+        size_t capacity;
+
+        /** Whether to close the connection once the response is sent. */
+        bool closing;
+
+        /** Descriptors passed with the current request's header. */
+        int fds[ WIRE_MAX_FDS ];
+
+        /** Number of descriptors in fds. */
+        int fdCount;
+
+        /** The connection's shared ring, or NULL. */
+        Attachment *attachment;
+} Connection;
+
+/** Everything the event loop and the workers share. */
+typedef struct {
+        /** The expanded keys. */
+        KeyStore keys;
+
+        /** The epoll instance. */
+        int epoll;
+
+        /** The listening socket. */
+        int listener;
+
+        /** The signalfd reporting SIGINT and SIGTERM. */
+        int signals;
+
+        /** The eventfd workers signal when they finish a request. */
+        int done;
+
+        /** Guards the queues and stopping. */
+        pthread_mutex_t lock;
+
+        /** Signalled when work is queued or the workers should stop. */
+        pthread_cond_t ready;
+
+        /** The first job waiting for a worker. */
+        Job *head;
+
+        /** The last job waiting for a worker. */
+        Job *tail;
+
+        /** Jobs the workers have served. */
+        Job *finished;
+
+        /** Whether the workers should stop. */
+        bool stopping;
+
+        /**
+                Attachments to free once the current batch of events is
+                handled, since a later event in it may still point at them.
+                Only the event loop uses this.
+         */
+        Attachment *retired;
+} Daemon;
+
+/**
+        This function changes the events epoll watches on a connection,
+        registering or removing it as needed.
+
+        @param daemon The daemon
+        @param conn The connection
+        @param events The events to watch, or zero for none
+ */
+static void watch( Daemon *daemon, Connection *conn, uint32_t events )
+{
+        if ( events == conn->events ) {
+                return;
+        }
+
+        struct epoll_event event;
+        event.events = events;
+        event.data.ptr = conn;
+        int op = conn->events == 0 ? EPOLL_CTL_ADD :
+                events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+        epoll_ctl( daemon->epoll, op, conn->fd, &event );
+        conn->events = events;
+}
+
+/**
+        This function closes any descriptors passed with a connection's
+        current request that weren't taken.
+
+        @param conn The connection
+ */
+static void dropFds( Connection *conn )
+{
+        int f = 0;
+        for ( f = 0; f < conn->fdCount; f++ ) {
+                close( conn->fds[ f ] );
+        }
+
+        conn->fdCount = 0;
+}
+
+/**
+        This function queues an attachment to be freed after the current
+        batch of events.
+
+        @param daemon The daemon
+        @param attachment The attachment, with nothing in flight
+ */
+static void retire( Daemon *daemon, Attachment *attachment )
+{
+        attachment->next = daemon->retired;
+        daemon->retired = attachment;
+}
+
+/**
+        This function closes a connection and frees it. Its shared ring
+        stops being watched, and goes once its last request is back from
+        the workers.
+
+        @param daemon The daemon
+        @param conn The connection
+ */
+static void closeConnection( Daemon *daemon, Connection *conn )
+{
+        Attachment *attachment = conn->attachment;
+        if ( attachment != NULL ) {
+                epoll_ctl( daemon->epoll, EPOLL_CTL_DEL,
+                                attachment->ring.submitFd, NULL );
+                attachment->conn = NULL;
+                if ( attachment->inFlight == 0 ) {
+                        retire( daemon, attachment );
+                }
+        }
+
+        dropFds( conn );
+        close( conn->fd );
+        free( conn->buffer );
+        free( conn );
+}
+
+/**
+        This function encrypts or decrypts a request's payload in place.
+
+        @param key The request's key
+        @param request The request header
+        @param buffer The payload, with room for a GCM tag after it
+        @param length The payload's length, replaced by the result's
+        @return The request's status
+ */
+static WireStatus transform( GcmKey const *key, WireRequest const *request,
+                        byte *buffer, size_t *length )
+{
+        bool encrypting = request->op == WIRE_ENCRYPT;
+        switch ( request->mode ) {
+        case WIRE_ECB:
+                if ( *length % BLOCK_SIZE != 0 ) {
+                        return WIRE_BAD_LENGTH;
+                }
+
+                if ( encrypting ) {
+                        aesEncryptBlocks( &key->ctx, buffer, buffer,
+                                        *length / BLOCK_SIZE );
+                } else {
+                        aesDecryptBlocks( &key->ctx, buffer, buffer,
+                                        *length / BLOCK_SIZE );
+                }
+
+                return WIRE_OK;
+        case WIRE_CTR:
+                ctrCrypt( &key->ctx, request->iv, 0, buffer, buffer, *length );
+                return WIRE_OK;
+        default:
+                if ( encrypting ) {
+                        gcmEncrypt( key, request->iv, NULL, 0, buffer, buffer,
+                                        *length, buffer + *length );
+                        *length += GCM_TAG_SIZE;
+                        return WIRE_OK;
+                }
+
+                if ( *length < GCM_TAG_SIZE ) {
+                        return WIRE_BAD_LENGTH;
+                }
+
+                *length -= GCM_TAG_SIZE;
+                return gcmDecrypt( key, request->iv, NULL, 0, buffer, buffer,
+                                *length, buffer + *length ) ?
+                        WIRE_OK : WIRE_AUTH_FAILED;
+        }
+}
+
+/**
+        This function decrypts and verifies a GCM payload in a shared ring's
+        data area. The client can still write there, so the payload is
+        copied out once, checked and decrypted privately, and the plaintext
+        copied back only if its tag matches; a payload that fails is left
+        as it was.
+
+        @param key The request's key
+        @param request The request header
+        @param buffer The payload and its tag, in the data area
+        @param length The payload's length, replaced by the result's
+        @return The request's status
+ */
+static WireStatus openShared( GcmKey const *key, WireRequest const *request,
+                        byte *buffer, size_t *length )
+{
+        byte *copy = ( byte * ) malloc( *length > 0 ? *length : 1 );
+        if ( copy == NULL ) {
+                return WIRE_TOO_LARGE;
+        }
+
+        memcpy( copy, buffer, *length );
+        WireStatus status = transform( key, request, copy, length );
+        if ( status == WIRE_OK ) {
+                memcpy( buffer, copy, *length );
+        }
+
+        free( copy );
+        return status;
+}
+
+/**
+        This function serves a request, leaving its outcome in the job. It
+        runs on the event loop or on a worker.
+
+        @param keys The expanded keys
+        @param job The job
+ */
+static void serve( KeyStore *keys, Job *job )
+{
+        WireRequest const *request = &job->request;
+        size_t length = request->length;
+        WireStatus status = WIRE_OK;
+        if ( request->op == WIRE_LOAD_KEY ) {
+                if ( length != BLOCK_SIZE ) {
+                        status = WIRE_BAD_LENGTH;
+                } else if ( !keystorePut( keys, request->keyId,
+                                          job->buffer ) ) {
+                        status = WIRE_KEYS_FULL;
+                }
+
+                memset( job->buffer, 0, length );
+                job->status = status;
+                job->length = 0;
+                return;
+        }
+
+        GcmKey const *key = keystoreAcquire( keys, request->keyId );
+        if ( key == NULL ) {
+                status = WIRE_UNKNOWN_KEY;
+        } else {
+                if ( job->shared && request->op == WIRE_DECRYPT &&
+                     request->mode == WIRE_GCM ) {
+                        status = openShared( key, request, job->buffer,
+                                        &length );
+                } else {
+                        status = transform( key, request, job->buffer,
+                                        &length );
+                }
+
+                keystoreRelease( key );
+        }
+
+        job->status = status;
+        job->length = status == WIRE_OK ? length : 0;
+}
+
+/**
+        This function sends as much of a connection's response as the
+        socket takes. Once it's all sent, the connection goes back to
+        reading, or is closed if it asked to be; otherwise epoll says when
+        to go on.
+
+        @param daemon The daemon
+        @param conn The connection
+ */
+static void sendReply( Daemon *daemon, Connection *conn )
+{
+        size_t length = conn->job.length;
+        size_t total = WIRE_RESPONSE_SIZE + length;
+        while ( conn->have < total ) {
+                struct iovec parts[ 2 ];
+                int count = 0;
+                if ( conn->have < WIRE_RESPONSE_SIZE ) {
+                        parts[ count ].iov_base = conn->reply + conn->have;
+                        parts[ count++ ].iov_len =
+                                WIRE_RESPONSE_SIZE - conn->have;
+                        parts[ count ].iov_base = conn->buffer;
+                        parts[ count++ ].iov_len = length;
+                } else {
+                        size_t at = conn->have - WIRE_RESPONSE_SIZE;
+                        parts[ count ].iov_base = conn->buffer + at;
+                        parts[ count++ ].iov_len = length - at;
+                }
+
+                struct msghdr message;
+                memset( &message, 0, sizeof( message ) );
+                message.msg_iov = parts;
+                message.msg_iovlen = count;
+                ssize_t sent = sendmsg( conn->fd, &message, MSG_NOSIGNAL );
+                if ( sent < 0 && errno == EINTR ) {
+                        continue;
+                }
+
+                if ( sent < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) ) {
+                        watch( daemon, conn, EPOLLOUT );
+                        return;
+                }
+
+                if ( sent < 0 ) {
+                        closeConnection( daemon, conn );
+                        return;
+                }
+
+                conn->have += sent;
+        }
+
+        if ( conn->closing ) {
+                closeConnection( daemon, conn );
+                return;
+        }
+
+        conn->state = CONN_HEADER;
+        conn->have = 0;
+        watch( daemon, conn, EPOLLIN );
+}
+
+/**
+        This function starts sending the response to a connection's current
+        request.
+
+        @param daemon The daemon
+        @param conn The connection
+ */
+static void startReply( Daemon *daemon, Connection *conn )
+{
+        WireResponse response = { conn->job.length, conn->job.request.tag,
+                                  conn->job.status };
+        wirePackResponse( conn->reply, &response );
+        conn->state = CONN_REPLY;
+        conn->have = 0;
+        sendReply( daemon, conn );
+}
+
+/**
+        This function turns down a request whose header can't be trusted
+        and closes the connection after saying why, since its payload can't
+        be skipped.
+
+        @param daemon The daemon
+        @param conn The connection
+        @param status The reason
+ */
+static void reject( Daemon *daemon, Connection *conn, WireStatus status )
+{
+        conn->job.status = status;
+        conn->job.length = 0;
+        conn->closing = true;
+        startReply( daemon, conn );
+}
+
+/**
+        This function hands a job to the workers.
+
+        @param daemon The daemon
+        @param job The job
+ */
+static void queueJob( Daemon *daemon, Job *job )
+{
+        job->next = NULL;
+        pthread_mutex_lock( &daemon->lock );
+        if ( daemon->tail == NULL ) {
+                daemon->head = job;
+        } else {
+                daemon->tail->next = job;
+        }
+
+        daemon->tail = job;
+        pthread_cond_signal( &daemon->ready );
+        pthread_mutex_unlock( &daemon->lock );
+}
+
+/**
+        This function maps the shared ring whose descriptors came with a
+        connection's current request, and starts watching its submission
+        eventfd.
+
+        @param daemon The daemon
+        @param conn The connection
+        @return The request's status
+ */
+static WireStatus attach( Daemon *daemon, Connection *conn )
+{
+        if ( conn->fdCount != SHM_FD_COUNT || conn->attachment != NULL ) {
+                return WIRE_BAD_RING;
+        }
+
+        Attachment *attachment = ( Attachment * ) calloc( 1,
+                        sizeof( Attachment ) );
+        if ( attachment == NULL ) {
+                return WIRE_BAD_RING;
+        }
+
+        // The ring owns the descriptors from here, even if it's refused
+        conn->fdCount = 0;
+        if ( !shmMap( &attachment->ring, conn->fds ) ) {
+                free( attachment );
+                return WIRE_BAD_RING;
+        }
+
+        attachment->kind = SOURCE_RING;
+        attachment->conn = conn;
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = attachment;
+        if ( epoll_ctl( daemon->epoll, EPOLL_CTL_ADD,
+                        attachment->ring.submitFd, &event ) != 0 ) {
+                shmClose( &attachment->ring );
+                free( attachment );
+                return WIRE_BAD_RING;
+        }
+
+        conn->attachment = attachment;
+        return WIRE_OK;
+}
+
+/**
+        This function serves a request whose payload has arrived: at once if
+        it's small, otherwise on a worker, not watching the socket until the
+        worker is done.
+
+        @param daemon The daemon
+        @param conn The connection
+ */
+static void dispatch( Daemon *daemon, Connection *conn )
+{
+        Job *job = &conn->job;
+        job->buffer = conn->buffer;
+        job->shared = false;
+        job->conn = conn;
+        if ( job->request.op == WIRE_ATTACH ) {
+                job->status = job->request.length == 0 ?
+                        attach( daemon, conn ) : WIRE_BAD_LENGTH;
+                job->length = 0;
+                dropFds( conn );
+                startReply( daemon, conn );
+                return;
+        }
+
+        dropFds( conn );
+        if ( job->request.length <= INLINE_LIMIT ) {
+                serve( &daemon->keys, job );
+                startReply( daemon, conn );
+                return;
+        }
+
+        conn->state = CONN_BUSY;
+        watch( daemon, conn, 0 );
+        queueJob( daemon, job );
+}
+
+/**
+        This function keeps the descriptors passed with a message, closing
+        any beyond WIRE_MAX_FDS.
+
+        @param conn The connection
+        @param message The message received
+ */
+static void takeFds( Connection *conn, struct msghdr *message )
+{
+        struct cmsghdr *part = NULL;
+        for ( part = CMSG_FIRSTHDR( message ); part != NULL;
+              part = CMSG_NXTHDR( message, part ) ) {
+                if ( part->cmsg_level != SOL_SOCKET ||
+                     part->cmsg_type != SCM_RIGHTS ) {
+                        continue;
+                }
+
+                int count = ( part->cmsg_len - CMSG_LEN( 0 ) ) / sizeof( int );
+                int *fds = ( int * ) CMSG_DATA( part );
+                int f = 0;
+                for ( f = 0; f < count; f++ ) {
+                        if ( conn->fdCount < WIRE_MAX_FDS ) {
+                                conn->fds[ conn->fdCount++ ] = fds[ f ];
+                        } else {
+                                close( fds[ f ] );
+                        }
+                }
+        }
+}
+
+/**
+        This function reads what a connection has sent, until the socket
+        runs dry or a request is complete. Headers are read with recvmsg,
+        in case descriptors come with them.
+
+        @param daemon The daemon
+        @param conn The connection
+ */
+static void receive( Daemon *daemon, Connection *conn )
+{
+        while ( true ) {
+                bool reading = conn->state == CONN_HEADER;
+                struct iovec part;
+                part.iov_base = reading ? conn->header + conn->have :
+                        conn->buffer + conn->have;
+                size_t wanted = reading ? WIRE_REQUEST_SIZE - conn->have :
+                        conn->job.request.length - conn->have;
+                part.iov_len = wanted;
+                union {
+                        struct cmsghdr align;
+                        char bytes[ CMSG_SPACE( WIRE_MAX_FDS *
+                                        sizeof( int ) ) ];
+                } control;
+                struct msghdr message;
+                memset( &message, 0, sizeof( message ) );
+                message.msg_iov = &part;
+                message.msg_iovlen = 1;
+                if ( reading ) {
+                        message.msg_control = control.bytes;
+                        message.msg_controllen = sizeof( control.bytes );
+                }
+
+                ssize_t got = recvmsg( conn->fd, &message,
+                                MSG_CMSG_CLOEXEC );
+                if ( got < 0 && errno == EINTR ) {
+                        continue;
+                }
+
+                if ( got < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) ) {
+                        return;
+                }
+
+                if ( got > 0 && reading ) {
+                        takeFds( conn, &message );
+                }
+
+                if ( got <= 0 ) {
+                        closeConnection( daemon, conn );
+                        return;
+                }
+
+                conn->have += got;
+                if ( ( size_t ) got < wanted ) {
+                        continue;
+                }
+
+                if ( !reading ) {
+                        dispatch( daemon, conn );
+                        return;
+                }
+
+                if ( !wireUnpackRequest( &conn->job.request, conn->header ) ) {
+                        reject( daemon, conn, WIRE_BAD_REQUEST );
+                        return;
+                }
+
+                if ( conn->job.request.length > WIRE_MAX_PAYLOAD ) {
+                        reject( daemon, conn, WIRE_TOO_LARGE );
+                        return;
+                }
+
+                size_t needed = conn->job.request.length + GCM_TAG_SIZE;
+                if ( needed > conn->capacity ) {
+                        free( conn->buffer );
+                        conn->buffer = allocateBuffer( needed );
+                        conn->capacity = needed;
+                }
+
+                conn->state = CONN_PAYLOAD;
+                conn->have = 0;
+                if ( conn->job.request.length == 0 ) {
+                        dispatch( daemon, conn );
+                        return;
+                }
+        }
+}
+
+/**
+        This function checks a request taken from a shared ring and points
+        its job at the payload in the data area.
+
+        @param ring The daemon's view of the ring
+        @param entry The request, already copied out of the ring
+        @param job The job to fill in
+        @return WIRE_OK, or why the request can't be served
+ */
+static WireStatus checkSubmission( ShmRing const *ring,
+                        ShmSubmission const *entry, Job *job )
+{
+        memset( &job->request, 0, sizeof( job->request ) );
+        job->request.length = entry->length;
+        job->request.tag = entry->tag;
+        job->request.keyId = entry->keyId;
+        job->request.op = entry->op;
+        job->request.mode = entry->mode;
+        memcpy( job->request.iv, entry->iv, BLOCK_SIZE );
+        job->length = 0;
+        if ( ( entry->op != WIRE_ENCRYPT && entry->op != WIRE_DECRYPT ) ||
+             entry->mode >= WIRE_MODE_COUNT ) {
+                return WIRE_BAD_REQUEST;
+        }
+
+        // GCM encryption writes its tag after the payload
+        uint64_t room = entry->length;
+        if ( entry->op == WIRE_ENCRYPT && entry->mode == WIRE_GCM ) {
+                room += GCM_TAG_SIZE;
+        }
+
+        if ( entry->offset > ring->dataSize ||
+             room > ring->dataSize - entry->offset ) {
+                return WIRE_BAD_LENGTH;
+        }
+
+        job->buffer = ring->data + entry->offset;
+        job->shared = true;
+        return WIRE_OK;
+}
+
+/**
+        This function publishes a finished ring job's completion.
+
+        @param attachment The ring
+        @param job The job
+ */
+static void completeRingJob( Attachment *attachment, Job const *job )
+{
+        ShmCompletion completion;
+        memset( &completion, 0, sizeof( completion ) );
+        completion.tag = job->request.tag;
+        completion.length = job->length;
+        completion.status = job->status;
+        shmComplete( &attachment->ring, &completion );
+}
+
+/**
+        This function takes every request waiting in a shared ring. Small
+        ones are served at once and large ones go to the workers. A request
+        is only taken while a completion slot is sure to be free for it, so
+        a client that stops reaping stalls only itself; it rings again once
+        it has made room.
+
+        @param daemon The daemon
+        @param attachment The ring
+ */
+static void drainRing( Daemon *daemon, Attachment *attachment )
+{
+        ShmRing *ring = &attachment->ring;
+        bool completed = false;
+        ShmSubmission entry;
+        while ( attachment->inFlight + shmUnreaped( ring ) < ring->entries &&
+                shmTake( ring, &entry ) ) {
+                Job local;
+                WireStatus status = checkSubmission( ring, &entry, &local );
+                if ( status == WIRE_OK && entry.length > INLINE_LIMIT ) {
+                        Job *job = ( Job * ) malloc( sizeof( Job ) );
+                        if ( job != NULL ) {
+                                *job = local;
+                                job->conn = NULL;
+                                job->attachment = attachment;
+                                attachment->inFlight++;
+                                queueJob( daemon, job );
+                                continue;
+                        }
+                }
+
+                if ( status == WIRE_OK ) {
+                        serve( &daemon->keys, &local );
+                } else {
+                        local.status = status;
+                }
+
+                completeRingJob( attachment, &local );
+                completed = true;
+        }
+
+        if ( completed ) {
+                shmSignal( ring );
+        }
+}
+
+/**
+        This function answers a ring of a connection whose client has rung
+        its submission eventfd.
+
+        @param daemon The daemon
+        @param attachment The ring
+ */
+static void ringRung( Daemon *daemon, Attachment *attachment )
+{
+        uint64_t count;
+        if ( read( attachment->ring.submitFd, &count, sizeof( count ) ) < 0 &&
+             errno != EAGAIN ) {
+                return;
+        }
+
+        if ( attachment->conn != NULL ) {
+                drainRing( daemon, attachment );
+        }
+}
+
+/**
+        This function accepts every connection waiting on the listener.
+
+        @param daemon The daemon
+ */
+static void acceptConnections( Daemon *daemon )
+{
+        while ( true ) {
+                int fd = accept( daemon->listener, NULL, NULL );
+                if ( fd < 0 && errno == EINTR ) {
+                        continue;
+                }
+
+                if ( fd < 0 ) {
+                        return;
+                }
+
+                fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+                fcntl( fd, F_SETFD, FD_CLOEXEC );
+                Connection *conn = ( Connection * ) calloc( 1,
+                                sizeof( Connection ) );
+                if ( conn == NULL ) {
+                        close( fd );
+                        return;
+                }
+
+                conn->kind = SOURCE_CONNECTION;
+                conn->fd = fd;
+                conn->state = CONN_HEADER;
+                watch( daemon, conn, EPOLLIN );
+        }
+}
+
+/**
+        This function hands back the jobs the workers have finished: a
+        connection's is sent as its response, and a ring's is published as
+        a completion, which may let the ring take more requests.
+
+        @param daemon The daemon
+ */
+static void collectFinished( Daemon *daemon )
+{
+        uint64_t count;
+        if ( read( daemon->done, &count, sizeof( count ) ) < 0 ) {
+                return;
+        }
+
+        pthread_mutex_lock( &daemon->lock );
+        Job *job = daemon->finished;
+        daemon->finished = NULL;
+        pthread_mutex_unlock( &daemon->lock );
+
+        while ( job != NULL ) {
+                Job *next = job->next;
+                Attachment *attachment = job->attachment;
+                if ( attachment == NULL ) {
+                        startReply( daemon, job->conn );
+                } else {
+                        attachment->inFlight--;
+                        if ( attachment->conn != NULL ) {
+                                completeRingJob( attachment, job );
+                                shmSignal( &attachment->ring );
+                                drainRing( daemon, attachment );
+                        } else if ( attachment->inFlight == 0 ) {
+                                retire( daemon, attachment );
+                        }
+
+                        free( job );
+                }
+
+                job = next;
+        }
+}
+
+/**
+        This function frees the attachments retired while handling the last
+        batch of events.
+
+        @param daemon The daemon
+ */
+static void freeRetired( Daemon *daemon )
+{
+        while ( daemon->retired != NULL ) {
+                Attachment *attachment = daemon->retired;
+                daemon->retired = attachment->next;
+                shmClose( &attachment->ring );
+                free( attachment );
+        }
+}
+
+/**
+        This function runs one worker: it serves queued jobs until the
+        daemon stops, handing each back to the event loop.
+
+        @param arg The daemon
+        @return NULL
+ */
+static void *workerMain( void *arg )
+{
+        Daemon *daemon = ( Daemon * ) arg;
+        uint64_t one = 1;
+        while ( true ) {
+                pthread_mutex_lock( &daemon->lock );
+                while ( !daemon->stopping && daemon->head == NULL ) {
+                        pthread_cond_wait( &daemon->ready, &daemon->lock );
+                }
+
+                if ( daemon->stopping ) {
+                        pthread_mutex_unlock( &daemon->lock );
+                        return NULL;
+                }
+
+                Job *job = daemon->head;
+                daemon->head = job->next;
+                if ( daemon->head == NULL ) {
+                        daemon->tail = NULL;
+                }
+
+                pthread_mutex_unlock( &daemon->lock );
+
+                serve( &daemon->keys, job );
+
+                pthread_mutex_lock( &daemon->lock );
+                job->next = daemon->finished;
+                daemon->finished = job;
+                pthread_mutex_unlock( &daemon->lock );
+                if ( write( daemon->done, &one, sizeof( one ) ) < 0 ) {
+                        perror( "eventfd" );
+                }
+        }
+}
+
+/**
+        This function loads a key named on the command line as ID=KEY-FILE.
+
+        @param keys The expanded keys
+        @param spec The ID and file name
+        @return False if the spec isn't an ID, an equals sign and a file
+ */
+static bool loadKeyFile( KeyStore *keys, char *spec )
+{
+        char *equals = strchr( spec, '=' );
+        uint32_t id = 0;
+        if ( equals == NULL ) {
+                return false;
+        }
+
+        *equals = '\0';
+        bool parsed = wireParseKeyId( spec, &id );
+        *equals = '=';
+        if ( !parsed ) {
+                return false;
+        }
+
+        char const *file = equals + 1;
+        size_t size;
+        byte *key = readBinaryFile( file, &size );
+        if ( size != BLOCK_SIZE ) {
+                fprintf( stderr, "Bad key file: %s\n", file );
+                exit( EXIT_FAILURE );
+        }
+
+        keystorePut( keys, id, key );
+        memset( key, 0, size );
+        free( key );
+        return true;
+}
+
+/**
+        This function opens the listening socket, replacing a socket left
+        behind by an earlier run but never any other kind of file. Only the
+        daemon's own user may connect.
+
+        @param path The socket's path
+        @return The listening socket
+ */
+static int openListener( char const *path )
+{
+        struct sockaddr_un address;
+        memset( &address, 0, sizeof( address ) );
+        address.sun_family = AF_UNIX;
+        struct stat status;
+        bool stale = lstat( path, &status ) == 0;
+        int fd = -1;
+        if ( strlen( path ) < sizeof( address.sun_path ) &&
+             ( !stale || S_ISSOCK( status.st_mode ) ) ) {
+                strcpy( address.sun_path, path );
+                if ( stale ) {
+                        unlink( path );
+                }
+
+                fd = socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK |
+                             SOCK_CLOEXEC, 0 );
+        }
+
+        mode_t mask = umask( S_IRWXG | S_IRWXO );
+        if ( fd < 0 || bind( fd, ( struct sockaddr * ) &address,
+                             sizeof( address ) ) != 0 ||
+             listen( fd, SOMAXCONN ) != 0 ) {
+                fprintf( stderr, "Can't listen on socket: %s\n", path );
+                exit( EXIT_FAILURE );
+        }
+
+        umask( mask );
+        return fd;
+}
+
+/**
+        This function registers one of the daemon's own descriptors with
+        epoll, tagged with the address of the field holding it.
+
+        @param daemon The daemon
+        @param field The field holding the descriptor
+ */
+static void watchOwn( Daemon *daemon, int *field )
+{
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = field;
+        epoll_ctl( daemon->epoll, EPOLL_CTL_ADD, *field, &event );
+}
+
+/**
+        This main function parses the command line, loads the keys and
+        serves requests until SIGINT or SIGTERM.
+
+        @param argc The number of arguments
+        @param argv An array of the arguments
+        @return Program Exit Status
+ */
+int main( int argc, char *argv[] )
+{
+        static Daemon daemon;
+        keystoreInit( &daemon.keys );
+
+        char const *path = NULL;
+        int jobs = 0;
+        bool ok = true;
+        int i = 0;
+        for ( i = 1; ok && i < argc; i++ ) {
+                if ( strcmp( argv[ i ], "-j" ) == 0 ||
+                     strcmp( argv[ i ], "--jobs" ) == 0 ) {
+                        ok = parseCount( argv[ ++i ], &jobs );
+                } else if ( strcmp( argv[ i ], "--key" ) == 0 ) {
+                        ok = argv[ ++i ] != NULL &&
+                                loadKeyFile( &daemon.keys, argv[ i ] );
+                } else if ( strncmp( argv[ i ], "--", 2 ) == 0 ||
+                            path != NULL ) {
+                        ok = false;
+                } else {
+                        path = argv[ i ];
+                }
+        }
+
+        if ( !ok || path == NULL ) {
+                fprintf( stderr, "usage: aesd [options] <socket-path>\n" );
+                exit( EXIT_FAILURE );
+        }
+
+        // The workers inherit the blocked signals, so only the signalfd
+        // sees them
+        sigset_t stopSignals;
+        sigemptyset( &stopSignals );
+        sigaddset( &stopSignals, SIGINT );
+        sigaddset( &stopSignals, SIGTERM );
+        pthread_sigmask( SIG_BLOCK, &stopSignals, NULL );
+
+        daemon.listener = openListener( path );
+        daemon.signals = signalfd( -1, &stopSignals, SFD_CLOEXEC );
+        daemon.done = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+        daemon.epoll = epoll_create1( EPOLL_CLOEXEC );
+        if ( daemon.signals < 0 || daemon.done < 0 || daemon.epoll < 0 ) {
+                perror( "aesd" );
+                unlink( path );
+                exit( EXIT_FAILURE );
+        }
+
+        watchOwn( &daemon, &daemon.listener );
+        watchOwn( &daemon, &daemon.signals );
+        watchOwn( &daemon, &daemon.done );
+
+        pthread_mutex_init( &daemon.lock, NULL );
+        pthread_cond_init( &daemon.ready, NULL );
+        int workers = jobs > 0 ? jobs : defaultThreadCount();
+        pthread_t *threads = ( pthread_t * ) malloc( workers *
+                        sizeof( pthread_t ) );
+        if ( threads == NULL ) {
+                fprintf( stderr, "Out of memory\n" );
+                exit( EXIT_FAILURE );
+        }
+
+        int w = 0;
+        for ( w = 0; w < workers; w++ ) {
+                pthread_create( &threads[ w ], NULL, workerMain, &daemon );
+        }
+
+        bool running = true;
+        while ( running ) {
+                struct epoll_event events[ MAX_EVENTS ];
+                int count = epoll_wait( daemon.epoll, events, MAX_EVENTS, -1 );
+                int e = 0;
+                for ( e = 0; e < count; e++ ) {
+                        void *source = events[ e ].data.ptr;
+                        if ( source == &daemon.listener ) {
+                                acceptConnections( &daemon );
+                        } else if ( source == &daemon.signals ) {
+                                running = false;
+                        } else if ( source == &daemon.done ) {
+                                collectFinished( &daemon );
+                        } else if ( *( SourceKind * ) source == SOURCE_RING ) {
+                                ringRung( &daemon, ( Attachment * ) source );
+                        } else {
+                                Connection *conn = ( Connection * ) source;
+                                if ( conn->state == CONN_REPLY ) {
+                                        sendReply( &daemon, conn );
+                                } else {
+                                        receive( &daemon, conn );
+                                }
+                        }
+                }
+
+                freeRetired( &daemon );
+        }
+
+        pthread_mutex_lock( &daemon.lock );
+        daemon.stopping = true;
+        pthread_cond_broadcast( &daemon.ready );
+        pthread_mutex_unlock( &daemon.lock );
+        for ( w = 0; w < workers; w++ ) {
+                pthread_join( threads[ w ], NULL );
+        }
+
+        free( threads );
+        close( daemon.listener );
+        unlink( path );
+        keystoreClose( &daemon.keys );
+        return EXIT_SUCCESS;
+}
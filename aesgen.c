@@ -0,0 +1,173 @@
+/**
+        @file aesgen.c
+        @author James O Kocak (jokocak)
+
+        This file contains the main method for the aesgen program, which
+        writes a given number of pseudorandom bytes from CTR_DRBG. The
+        output is cut into pieces generated on every processor.
+ */
+
+#include "io.h"
+#include "drbg.h"
+#include "options.h"
+#include "pool.h"
+#include <string.h>
+
+/** Number of file names and counts the command line needs. */
+#define ARG_COUNT 2
+
+/** Everything the threads of one run share. */
+typedef struct {
+        /** The output file. */
+        ChunkStream *output;
+
+        /** One piece buffer per thread. */
+        byte **buffers;
+
+        /** The seed for reproducible output, or NULL. */
+        byte const *seed;
+
+        /** Total number of bytes to write. */
+        uint64_t size;
+} GenJob;
+
+/**
+        This function fills one piece of the output. With a seed, the piece
+        gets its own instance, personalized with its number, so the output
+        doesn't depend on which thread makes which piece; without one, each
+        thread draws from its own instance.
+
+        @param job The job
+        @param piece The piece number
+        @param buffer Where to store the piece
+        @param length The number of bytes in the piece
+ */
+static void fillPiece( GenJob const *job, size_t piece, byte *buffer,
+                        size_t length )
+{
+        if ( job->seed == NULL ) {
+                drbgRandom( drbgThread(), buffer, length );
+                return;
+        }
+
+        uint64_t number = piece;
+        Drbg drbg;
+        drbgInstantiate( &drbg, job->seed, ( byte const * ) &number,
+                        sizeof( number ) );
+        drbgRandom( &drbg, buffer, length );
+}
+
+/**
+        This pool task makes one piece and writes it in place.
+
+        @param arg The GenJob
+        @param worker The thread number, selecting the buffer
+        @param piece The piece number
+ */
+static void genTask( void *arg, int worker, size_t piece )
+{
+        GenJob *job = ( GenJob * ) arg;
+        uint64_t offset = ( uint64_t ) piece * DEFAULT_CHUNK_SIZE;
+        size_t length = job->size - offset < DEFAULT_CHUNK_SIZE ?
+                ( size_t ) ( job->size - offset ) : DEFAULT_CHUNK_SIZE;
+        fillPiece( job, piece, job->buffers[ worker ], length );
+        writeChunkAt( job->output, job->buffers[ worker ], length,
+                        ( off_t ) offset );
+}
+
+/**
+        This main function parses the command line and writes the bytes.
+
+        @param argc The number of arguments
+        @param argv An array of the arguments
+        @return Program Exit Status
+ */
+int main( int argc, char *argv[] )
+{
+        // Sorts the arguments into options, the count and the file name
+        char const *args[ ARG_COUNT ];
+        int argCount = 0;
+        char const *seedFile = NULL;
+        int jobs = 0;
+        bool ok = true;
+        int i = 0;
+        for ( i = 1; ok && i < argc; i++ ) {
+                if ( strcmp( argv[ i ], "-j" ) == 0 ||
+                     strcmp( argv[ i ], "--jobs" ) == 0 ) {
+                        ok = parseCount( argv[ ++i ], &jobs );
+                } else if ( strcmp( argv[ i ], "--seed" ) == 0 ) {
+                        seedFile = argv[ ++i ];
+                        ok = seedFile != NULL;
+                } else if ( strncmp( argv[ i ], "--", 2 ) == 0 ||
+                            argCount == ARG_COUNT ) {
+                        ok = false;
+                } else {
+                        args[ argCount++ ] = argv[ i ];
+                }
+        }
+
+        uint64_t size = 0;
+        if ( !ok || argCount != ARG_COUNT || !parseSize( args[ 0 ], &size ) ) {
+                fprintf( stderr,
+                        "usage: aesgen [options] <byte-count> <output-file>\n" );
+                exit( EXIT_FAILURE );
+        }
+
+        byte seed[ DRBG_SEED_SIZE ];
+        if ( seedFile != NULL ) {
+                size_t seedSize;
+                byte *seedBytes = readBinaryFile( seedFile, &seedSize );
+                if ( seedSize != DRBG_SEED_SIZE ) {
+                        fprintf( stderr, "Bad seed file: %s\n", seedFile );
+                        exit( EXIT_FAILURE );
+                }
+
+                memcpy( seed, seedBytes, DRBG_SEED_SIZE );
+                free( seedBytes );
+        }
+
+        ChunkStream output;
+        openChunkWriter( &output, args[ 1 ] );
+        int threads = jobs > 0 ? jobs : defaultThreadCount();
+        size_t pieces = ( size_t ) ( ( size + DEFAULT_CHUNK_SIZE - 1 ) /
+                        DEFAULT_CHUNK_SIZE );
+        if ( ( size_t ) threads > pieces ) {
+                threads = pieces > 0 ? ( int ) pieces : 1;
+        }
+
+        GenJob job = { &output, NULL, seedFile != NULL ? seed : NULL, size };
+        job.buffers = ( byte ** ) malloc( threads * sizeof( byte * ) );
+        if ( job.buffers == NULL ) {
+                fprintf( stderr, "Out of memory\n" );
+                exit( EXIT_FAILURE );
+        }
+
+        int w = 0;
+        for ( w = 0; w < threads; w++ ) {
+                job.buffers[ w ] = allocateBuffer( DEFAULT_CHUNK_SIZE );
+        }
+
+        // Pipes and devices can't be written out of order
+        if ( output.regular ) {
+                runPool( pieces, threads, genTask, &job );
+        } else {
+                size_t piece = 0;
+                for ( piece = 0; piece < pieces; piece++ ) {
+                        uint64_t offset = ( uint64_t ) piece * DEFAULT_CHUNK_SIZE;
+                        size_t length = size - offset < DEFAULT_CHUNK_SIZE ?
+                                ( size_t ) ( size - offset ) :
+                                DEFAULT_CHUNK_SIZE;
+                        fillPiece( &job, piece, job.buffers[ 0 ], length );
+                        writeChunk( &output, job.buffers[ 0 ], length );
+                }
+        }
+
+        for ( w = 0; w < threads; w++ ) {
+                free( job.buffers[ w ] );
+        }
+
+        free( job.buffers );
+        closeChunkStream( &output );
+        memset( seed, 0, sizeof( seed ) );
+        return EXIT_SUCCESS;
+}
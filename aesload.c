@@ -0,0 +1,583 @@
+/**
+        @file aesload.c
+        @author James O Kocak (jokocak)
+
+        This file contains the main method for aesload, the load generator
+        for aesd. It loads a fresh random key into the daemon, sends it
+        requests from one or more connections, each on its own thread, and
+        reports the latency of each request. For comparison it then makes
+        the same number of calls the way a script would without the daemon,
+        running the encrypt program once per request, so the cost of a new
+        process, a key file and a key schedule per call can be seen beside
+        a request to keys already in memory. Every result is checked against
+        the cipher run in this process.
+
+        With --shm, the same requests are then made through shared rings,
+        one per connection, and the two transports are compared. The
+        payload is put in the ring's data area before each request's clock
+        starts, as a client producing its data there would have it.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "wire.h"
+#include "shm.h"
+#include "ctr.h"
+#include "gcm.h"
+#include "io.h"
+#include "options.h"
+#include <errno.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/** The variables of the environment, handed on to the programs run. */
+extern char **environ;
+
+/** Nanoseconds in a second. */
+#define NS_PER_SECOND 1000000000ULL
+
+/** Nanoseconds in a microsecond. */
+#define NS_PER_US 1000.0
+
+/** Bytes in a megabyte, for MB/s. */
+#define BYTES_PER_MB 1000000.0
+
+/** Longest path built for the scratch files. */
+#define PATH_LIMIT 4096
+
+/** Requests per connection unless -n says otherwise. */
+#define DEFAULT_COUNT 1000
+
+/** Bytes per request unless --size says otherwise. */
+#define DEFAULT_SIZE 4096
+
+/**
+        The key ID loaded unless --key-id says otherwise, at the top of the
+        range so it stays clear of keys the daemon was started with.
+ */
+#define DEFAULT_KEY_ID UINT32_MAX
+
+/** Entries in each shared ring; a connection has one request out at once. */
+#define RING_ENTRIES 1
+
+/** Names of the modes, indexed by WireMode. */
+static char const *const modeNames[ WIRE_MODE_COUNT ] = { "ecb", "ctr",
+                                                          "gcm" };
+
+/** Everything the connection threads share. */
+typedef struct {
+        /** The daemon's socket. */
+        char const *path;
+
+        /** The request every connection sends, bar its tag. */
+        WireRequest request;
+
+        /** The payload every request carries. */
+        byte const *payload;
+
+        /** What every response should hold. */
+        byte const *expected;
+
+        /** Number of bytes in expected. */
+        size_t expectedLength;
+
+        /** Requests per connection. */
+        int count;
+
+        /** Each request's latency in nanoseconds, count per connection. */
+        double *latencies;
+
+        /** Number of requests that failed or came back wrong. */
+        int failures;
+} Load;
+
+/** What one connection thread needs to know. */
+typedef struct {
+        /** The shared load. */
+        Load *load;
+
+        /** This connection's number. */
+        int number;
+
+        /** The thread. */
+        pthread_t thread;
+} Client;
+
+/**
+        This function reads the monotonic clock.
+
+        @return Nanoseconds since some fixed point
+ */
+static uint64_t readNanos( void )
+{
+        struct timespec now;
+        clock_gettime( CLOCK_MONOTONIC, &now );
+        return ( uint64_t ) now.tv_sec * NS_PER_SECOND + now.tv_nsec;
+}
+
+/**
+        This function compares two doubles for qsort.
+
+        @param a The first double
+        @param b The second double
+        @return Negative, zero or positive as a is below, equal to or above b
+ */
+static int compareDoubles( void const *a, void const *b )
+{
+        double x = *( double const * ) a;
+        double y = *( double const * ) b;
+        return ( x > y ) - ( x < y );
+}
+
+/**
+        This function returns the value at a percentile of sorted values,
+        using the nearest rank.
+
+        @param values The sorted values
+        @param count The number of values
+        @param percent The percentile, from 1 to 100
+        @return The value at that percentile
+ */
+static double percentile( double const *values, int count, int percent )
+{
+        int rank = ( count * percent + 99 ) / 100;
+        return values[ rank > 0 ? rank - 1 : 0 ];
+}
+
+/**
+        This function prints one line of results.
+
+        @param label What was measured
+        @param latencies Each call's latency in nanoseconds, which are sorted
+        @param count The number of calls
+        @param wallNs The time all the calls took together
+        @param size The payload bytes per call
+        @return The median latency in nanoseconds
+ */
+static double report( char const *label, double *latencies, int count,
+                        uint64_t wallNs, size_t size )
+{
+        qsort( latencies, count, sizeof( double ), compareDoubles );
+        double total = 0;
+        int i = 0;
+        for ( i = 0; i < count; i++ ) {
+                total += latencies[ i ];
+        }
+
+        double seconds = ( double ) wallNs / NS_PER_SECOND;
+        double median = percentile( latencies, count, 50 );
+        printf( "%-8s median %9.1f us, p99 %9.1f us, max %9.1f us, mean %9.1f "
+                "us, %9.0f requests/s, %8.1f MB/s\n", label,
+                median / NS_PER_US, percentile( latencies, count, 99 ) /
+                NS_PER_US, latencies[ count - 1 ] / NS_PER_US,
+                total / count / NS_PER_US, count / seconds,
+                count * ( double ) size / BYTES_PER_MB / seconds );
+        return median;
+}
+
+/**
+        This function runs one connection: it sends its requests one after
+        another, timing each and checking its result.
+
+        @param arg The Client
+        @return NULL
+ */
+static void *clientMain( void *arg )
+{
+        Client *client = ( Client * ) arg;
+        Load *load = client->load;
+        double *latencies = load->latencies + client->number * load->count;
+        byte *reply = allocateBuffer( load->expectedLength );
+        int failures = 0;
+        int fd = wireConnect( load->path );
+        WireRequest request = load->request;
+        int i = 0;
+        for ( i = 0; i < load->count; i++ ) {
+                request.tag = i;
+                WireResponse response;
+                uint64_t begin = readNanos();
+                if ( fd < 0 || !wireCall( fd, &request, load->payload,
+                                          &response, reply,
+                                          load->expectedLength ) ) {
+                        failures += load->count - i;
+                        break;
+                }
+
+                latencies[ i ] = readNanos() - begin;
+                if ( response.status != WIRE_OK || response.tag != request.tag ||
+                     response.length != load->expectedLength ||
+                     memcmp( reply, load->expected, response.length ) != 0 ) {
+                        failures++;
+                }
+        }
+
+        if ( fd >= 0 ) {
+                close( fd );
+        }
+
+        free( reply );
+        __atomic_fetch_add( &load->failures, failures, __ATOMIC_RELAXED );
+        return NULL;
+}
+
+/**
+        This function runs one connection through a shared ring: it makes
+        its requests one after another, timing each and checking its result
+        in place.
+
+        @param arg The Client
+        @return NULL
+ */
+static void *ringClientMain( void *arg )
+{
+        Client *client = ( Client * ) arg;
+        Load *load = client->load;
+        double *latencies = load->latencies + client->number * load->count;
+        int failures = 0;
+        int fd = wireConnect( load->path );
+        ShmRing ring;
+        if ( fd < 0 || !shmCreate( &ring, RING_ENTRIES,
+                                   load->expectedLength ) ) {
+                failures = load->count;
+        } else if ( shmAttach( &ring, fd ) != WIRE_OK ) {
+                failures = load->count;
+                shmClose( &ring );
+        }
+
+        ShmSubmission entry;
+        memset( &entry, 0, sizeof( entry ) );
+        entry.length = load->request.length;
+        entry.keyId = load->request.keyId;
+        entry.op = load->request.op;
+        entry.mode = load->request.mode;
+        memcpy( entry.iv, load->request.iv, BLOCK_SIZE );
+        int i = 0;
+        for ( i = 0; failures == 0 && i < load->count; i++ ) {
+                memcpy( ring.data, load->payload, load->request.length );
+                entry.tag = i;
+                ShmCompletion completion;
+                uint64_t begin = readNanos();
+                shmSubmit( &ring, &entry );
+                shmNotify( &ring );
+                while ( !shmReap( &ring, &completion ) ) {
+                        shmWait( &ring );
+                }
+
+                latencies[ i ] = readNanos() - begin;
+                if ( completion.status != WIRE_OK || completion.tag != i ||
+                     completion.length != load->expectedLength ||
+                     memcmp( ring.data, load->expected,
+                             completion.length ) != 0 ) {
+                        failures++;
+                }
+        }
+
+        if ( fd >= 0 ) {
+                shmClose( &ring );
+                close( fd );
+        }
+
+        __atomic_fetch_add( &load->failures, failures, __ATOMIC_RELAXED );
+        return NULL;
+}
+
+/**
+        This function runs every connection on its own thread and checks
+        that all their requests succeeded.
+
+        @param load The load
+        @param clients A Client for each connection
+        @param connections The number of connections
+        @param run The function each thread runs
+        @param label What the connections go through, for the report
+        @return The median latency in nanoseconds
+ */
+static double runClients( Load *load, Client *clients, int connections,
+                        void *( *run )( void * ), char const *label )
+{
+        load->failures = 0;
+        uint64_t start = readNanos();
+        int c = 0;
+        for ( c = 0; c < connections; c++ ) {
+                clients[ c ].load = load;
+                clients[ c ].number = c;
+                pthread_create( &clients[ c ].thread, NULL, run,
+                                &clients[ c ] );
+        }
+
+        for ( c = 0; c < connections; c++ ) {
+                pthread_join( clients[ c ].thread, NULL );
+        }
+
+        uint64_t wall = readNanos() - start;
+        int total = load->count * connections;
+        if ( load->failures > 0 ) {
+                fprintf( stderr, "%d of %d requests failed or came back wrong "
+                        "from %s: %s\n", load->failures, total, label,
+                        load->path );
+                exit( EXIT_FAILURE );
+        }
+
+        return report( label, load->latencies, total, wall,
+                        load->request.length );
+}
+
+/**
+        This function makes one request on its own connection, for setting
+        up the run.
+
+        @param path The daemon's socket
+        @param request The request
+        @param payload Its payload
+        @return The response's status, or -1 if there was no response
+ */
+static int callOnce( char const *path, WireRequest const *request,
+                        byte const *payload )
+{
+        int fd = wireConnect( path );
+        WireResponse response;
+        bool answered = fd >= 0 && wireCall( fd, request, payload, &response,
+                                             NULL, 0 );
+        if ( fd >= 0 ) {
+                close( fd );
+        }
+
+        return answered ? response.status : -1;
+}
+
+/**
+        This function times the same calls made by running the encrypt
+        program once per request on a scratch input file, one at a time.
+        It's skipped if the program isn't there.
+
+        @param load The load, whose request, payload and key are used
+        @param key The key
+        @param binDir Where the encrypt program is
+        @return The median latency in nanoseconds, or zero if skipped
+ */
+static double runProcesses( Load *load, byte const *key, char const *binDir )
+{
+        char encrypt[ PATH_LIMIT ];
+        snprintf( encrypt, sizeof( encrypt ), "%s/encrypt", binDir );
+        if ( access( encrypt, X_OK ) != 0 ) {
+                fprintf( stderr, "Skipping process per call, no encrypt in "
+                        "%s\n", binDir );
+                return 0;
+        }
+
+        char const *tmp = getenv( "TMPDIR" );
+        char dir[ PATH_LIMIT / 2 ];
+        snprintf( dir, sizeof( dir ), "%s/aesload.XXXXXX",
+                        tmp != NULL ? tmp : "/tmp" );
+        if ( mkdtemp( dir ) == NULL ) {
+                fprintf( stderr, "Can't create a directory in %s\n",
+                        tmp != NULL ? tmp : "/tmp" );
+                exit( EXIT_FAILURE );
+        }
+
+        char keyFile[ PATH_LIMIT ], ivFile[ PATH_LIMIT ];
+        char plain[ PATH_LIMIT ], out[ PATH_LIMIT ];
+        snprintf( keyFile, sizeof( keyFile ), "%s/key.dat", dir );
+        snprintf( ivFile, sizeof( ivFile ), "%s/iv.dat", dir );
+        snprintf( plain, sizeof( plain ), "%s/plain.dat", dir );
+        snprintf( out, sizeof( out ), "%s/out.dat", dir );
+        WireRequest const *request = &load->request;
+        writeBinaryFile( keyFile, key, BLOCK_SIZE );
+        writeBinaryFile( ivFile, request->iv, request->mode == WIRE_GCM ?
+                        GCM_IV_SIZE : BLOCK_SIZE );
+        writeBinaryFile( plain, load->payload, request->length );
+
+        char *ecb[] = { encrypt, keyFile, plain, out, NULL };
+        char *ctr[] = { encrypt, "--ctr", ivFile, keyFile, plain, out, NULL };
+        char *gcm[] = { encrypt, "--gcm", ivFile, keyFile, plain, out, NULL };
+        char **commands[ WIRE_MODE_COUNT ] = { ecb, ctr, gcm };
+        char **command = commands[ request->mode ];
+
+        double *latencies = load->latencies;
+        uint64_t start = readNanos();
+        int i = 0;
+        for ( i = 0; i < load->count; i++ ) {
+                pid_t child;
+                int status;
+                uint64_t begin = readNanos();
+                if ( posix_spawn( &child, command[ 0 ], NULL, NULL, command,
+                                  environ ) != 0 ||
+                     waitpid( child, &status, 0 ) != child ||
+                     !WIFEXITED( status ) || WEXITSTATUS( status ) != 0 ) {
+                        fprintf( stderr, "Can't run %s\n", encrypt );
+                        exit( EXIT_FAILURE );
+                }
+
+                latencies[ i ] = readNanos() - begin;
+        }
+
+        uint64_t wall = readNanos() - start;
+        size_t size;
+        byte *result = readBinaryFile( out, &size );
+        bool matched = size == load->expectedLength &&
+                memcmp( result, load->expected, size ) == 0;
+        free( result );
+
+        char const *files[] = { keyFile, ivFile, plain, out };
+        int f = 0;
+        for ( f = 0; f < ( int ) ( sizeof( files ) / sizeof( files[ 0 ] ) ); f++ ) {
+                unlink( files[ f ] );
+        }
+
+        rmdir( dir );
+        if ( !matched ) {
+                fprintf( stderr, "Wrong result from %s\n", encrypt );
+                exit( EXIT_FAILURE );
+        }
+
+        return report( "process", latencies, load->count, wall,
+                        request->length );
+}
+
+/**
+        This main function parses the command line, runs the load and
+        reports it.
+
+        @param argc The number of arguments
+        @param argv An array of the arguments
+        @return Program Exit Status
+ */
+int main( int argc, char *argv[] )
+{
+        Load load;
+        memset( &load, 0, sizeof( load ) );
+        load.request.op = WIRE_ENCRYPT;
+        load.request.mode = WIRE_CTR;
+        load.request.keyId = DEFAULT_KEY_ID;
+        load.count = DEFAULT_COUNT;
+        uint64_t size = DEFAULT_SIZE;
+        int connections = 1;
+        char const *binDir = ".";
+        bool compare = true;
+        bool shared = false;
+        bool ok = true;
+        int i = 0;
+        for ( i = 1; ok && i < argc; i++ ) {
+                if ( strcmp( argv[ i ], "-n" ) == 0 ) {
+                        ok = parseCount( argv[ ++i ], &load.count );
+                } else if ( strcmp( argv[ i ], "-c" ) == 0 ) {
+                        ok = parseCount( argv[ ++i ], &connections );
+                } else if ( strcmp( argv[ i ], "--size" ) == 0 ) {
+                        ok = parseSize( argv[ ++i ], &size ) &&
+                                size <= WIRE_MAX_PAYLOAD;
+                } else if ( strcmp( argv[ i ], "--mode" ) == 0 ) {
+                        char const *name = argv[ ++i ];
+                        int m = 0;
+                        ok = false;
+                        for ( m = 0; name != NULL && m < WIRE_MODE_COUNT; m++ ) {
+                                if ( strcmp( name, modeNames[ m ] ) == 0 ) {
+                                        load.request.mode = m;
+                                        ok = true;
+                                }
+                        }
+                } else if ( strcmp( argv[ i ], "--key-id" ) == 0 ) {
+                        ok = wireParseKeyId( argv[ ++i ],
+                                        &load.request.keyId );
+                } else if ( strcmp( argv[ i ], "--bin" ) == 0 ) {
+                        binDir = argv[ ++i ];
+                        ok = binDir != NULL;
+                } else if ( strcmp( argv[ i ], "--no-compare" ) == 0 ) {
+                        compare = false;
+                } else if ( strcmp( argv[ i ], "--shm" ) == 0 ) {
+                        shared = true;
+                } else if ( strncmp( argv[ i ], "--", 2 ) == 0 ||
+                            load.path != NULL ) {
+                        ok = false;
+                } else {
+                        load.path = argv[ i ];
+                }
+        }
+
+        if ( load.request.mode == WIRE_ECB ) {
+                size -= size % BLOCK_SIZE;
+        }
+
+        if ( !ok || load.path == NULL || load.count < 1 || connections < 1 ) {
+                fprintf( stderr, "usage: aesload [options] <socket-path>\n" );
+                exit( EXIT_FAILURE );
+        }
+
+        // A fresh key, IV and payload, with the answer worked out here
+        byte key[ BLOCK_SIZE ];
+        randomBytes( key, BLOCK_SIZE );
+        randomBytes( load.request.iv, BLOCK_SIZE );
+        load.request.length = size;
+        byte *payload = allocateBuffer( size + GCM_TAG_SIZE );
+        byte *expected = allocateBuffer( size + GCM_TAG_SIZE );
+        randomBytes( payload, size );
+        GcmKey *gcmKey = ( GcmKey * ) allocateBuffer( sizeof( GcmKey ) );
+        gcmInitKey( gcmKey, key );
+        load.expectedLength = size;
+        if ( load.request.mode == WIRE_ECB ) {
+                aesEncryptBlocks( &gcmKey->ctx, payload, expected,
+                                size / BLOCK_SIZE );
+        } else if ( load.request.mode == WIRE_CTR ) {
+                ctrCrypt( &gcmKey->ctx, load.request.iv, 0, payload, expected,
+                                size );
+        } else {
+                gcmEncrypt( gcmKey, load.request.iv, NULL, 0, payload,
+                                expected, size, expected + size );
+                load.expectedLength += GCM_TAG_SIZE;
+        }
+
+        free( gcmKey );
+        load.payload = payload;
+        load.expected = expected;
+
+        WireRequest loadKey = load.request;
+        loadKey.op = WIRE_LOAD_KEY;
+        loadKey.length = BLOCK_SIZE;
+        int status = callOnce( load.path, &loadKey, key );
+        if ( status != WIRE_OK ) {
+                fprintf( stderr, "Can't load a key into socket: %s: %s\n",
+                        load.path, status < 0 ? strerror( errno ) :
+                        wireStatusName( ( WireStatus ) status ) );
+                exit( EXIT_FAILURE );
+        }
+
+        printf( "%s, %llu-byte requests, %d per connection, %d connection%s\n",
+                modeNames[ load.request.mode ], ( unsigned long long ) size,
+                load.count, connections, connections == 1 ? "" : "s" );
+
+        int total = load.count * connections;
+        load.latencies = ( double * ) malloc( total * sizeof( double ) );
+        Client *clients = ( Client * ) malloc( connections * sizeof( Client ) );
+        if ( load.latencies == NULL || clients == NULL ) {
+                fprintf( stderr, "Out of memory\n" );
+                exit( EXIT_FAILURE );
+        }
+
+        double daemonMedian = runClients( &load, clients, connections,
+                        clientMain, "socket" );
+        if ( shared ) {
+                double ringMedian = runClients( &load, clients, connections,
+                                ringClientMain, "shm" );
+                printf( "shm is %.1fx faster than the socket at the median\n",
+                        daemonMedian / ringMedian );
+        }
+
+        if ( compare ) {
+                double processMedian = runProcesses( &load, key, binDir );
+                if ( processMedian > 0 ) {
+                        printf( "aesd is %.1fx faster than a process per "
+                                "call at the median\n",
+                                processMedian / daemonMedian );
+                }
+        }
+
+        memset( key, 0, sizeof( key ) );
+        free( clients );
+        free( load.latencies );
+        free( payload );
+        free( expected );
+        return EXIT_SUCCESS;
+}
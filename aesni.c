@@ -0,0 +1,288 @@
+/**
+        @file aesni.c
+        @author James O Kocak (jokocak)
+
+        This component implements AES with the AES-NI instruction set. It is
+        compiled on its own with -maes so the rest of the program can still
+        run on processors without these instructions.
+ */
+
+#include "aesni.h"
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+
+#include <cpuid.h>
+#include <pthread.h>
+#include <wmmintrin.h>
+
+/** CPUID leaf holding the basic feature flags. */
+#define FEATURE_LEAF 1
+
+/** Number of blocks kept in flight by the bulk rounds. */
+#define INTERLEAVE 8
+
+/** Runs the CPUID check exactly once, whichever thread asks first. */
+static pthread_once_t checkOnce = PTHREAD_ONCE_INIT;
+
+/** Cached result of the CPUID check. */
+static bool available = false;
+
+/**
+        This function runs the CPUID check into available. It is run
+        through checkOnce.
+ */
+static void check( void )
+{
+        unsigned int eax, ebx, ecx, edx;
+        available = __get_cpuid( FEATURE_LEAF, &eax, &ebx, &ecx, &edx ) &&
+                ( ecx & bit_AES ) && ( edx & bit_SSE2 );
+}
+
+bool aesniAvailable( void )
+{
+        pthread_once( &checkOnce, check );
+        return available;
+}
+
+/**
+        This function finishes one step of the key schedule. The assist value
+        holds the g function of the previous subkey's fourth word, which is
+        broadcast and folded into the running exclusive or of the four words.
+
+        @param key The previous subkey
+        @param assist The AESKEYGENASSIST result for the previous subkey
+        @return The next subkey
+ */
+static __m128i expandStep( __m128i key, __m128i assist )
+{
+        assist = _mm_shuffle_epi32( assist, 0xFF );
+        key = _mm_xor_si128( key, _mm_slli_si128( key, 4 ) );
+        key = _mm_xor_si128( key, _mm_slli_si128( key, 4 ) );
+        key = _mm_xor_si128( key, _mm_slli_si128( key, 4 ) );
+        return _mm_xor_si128( key, assist );
+}
+
+/** One key schedule step; the round constant must be an immediate. */
+#define EXPAND( i, rcon ) \
+        keys[ i ] = expandStep( keys[ i - 1 ], \
+                        _mm_aeskeygenassist_si128( keys[ i - 1 ], rcon ) )
+
+void aesniExpandKey( AesContext *ctx, byte const key[ BLOCK_SIZE ] )
+{
+        __m128i keys[ ROUNDS + 1 ];
+        keys[ 0 ] = _mm_loadu_si128( ( __m128i const * ) key );
+        EXPAND( 1, 0x01 );
+        EXPAND( 2, 0x02 );
+        EXPAND( 3, 0x04 );
+        EXPAND( 4, 0x08 );
+        EXPAND( 5, 0x10 );
+        EXPAND( 6, 0x20 );
+        EXPAND( 7, 0x40 );
+        EXPAND( 8, 0x80 );
+        EXPAND( 9, 0x1B );
+        EXPAND( 10, 0x36 );
+
+        // AESDEC wants the subkeys backwards, inner ones through AESIMC
+        int i = 0;
+        for ( i = 0; i < ROUNDS + 1; i++ ) {
+                _mm_storeu_si128( ( __m128i * ) ctx->subkey[ i ], keys[ i ] );
+
+                __m128i dec = keys[ ROUNDS - i ];
+                if ( i != 0 && i != ROUNDS ) {
+                        dec = _mm_aesimc_si128( dec );
+                }
+
+                _mm_storeu_si128( ( __m128i * ) ctx->decSubkey[ i ], dec );
+        }
+}
+
+void aesniEncrypt( AesContext const *ctx, byte data[ BLOCK_SIZE ] )
+{
+        __m128i state = _mm_loadu_si128( ( __m128i const * ) data );
+        state = _mm_xor_si128( state,
+                _mm_loadu_si128( ( __m128i const * ) ctx->subkey[ 0 ] ) );
+
+        int i = 0;
+        for ( i = 1; i < ROUNDS; i++ ) {
+                state = _mm_aesenc_si128( state,
+                        _mm_loadu_si128( ( __m128i const * ) ctx->subkey[ i ] ) );
+        }
+
+        state = _mm_aesenclast_si128( state,
+                _mm_loadu_si128( ( __m128i const * ) ctx->subkey[ ROUNDS ] ) );
+        _mm_storeu_si128( ( __m128i * ) data, state );
+}
+
+void aesniDecrypt( AesContext const *ctx, byte data[ BLOCK_SIZE ] )
+{
+        __m128i state = _mm_loadu_si128( ( __m128i const * ) data );
+        state = _mm_xor_si128( state,
+                _mm_loadu_si128( ( __m128i const * ) ctx->decSubkey[ 0 ] ) );
+
+        int i = 0;
+        for ( i = 1; i < ROUNDS; i++ ) {
+                state = _mm_aesdec_si128( state,
+                        _mm_loadu_si128( ( __m128i const * ) ctx->decSubkey[ i ] ) );
+        }
+
+        state = _mm_aesdeclast_si128( state,
+                _mm_loadu_si128( ( __m128i const * ) ctx->decSubkey[ ROUNDS ] ) );
+        _mm_storeu_si128( ( __m128i * ) data, state );
+}
+
+/**
+        This function loads every subkey of a schedule into registers.
+
+        @param keys The loaded subkeys
+        @param schedule The subkeys to load
+ */
+static void loadKeys( __m128i keys[ ROUNDS + 1 ],
+                        byte const schedule[ ROUNDS + 1 ][ BLOCK_SIZE ] )
+{
+        int r = 0;
+        for ( r = 0; r < ROUNDS + 1; r++ ) {
+                keys[ r ] = _mm_loadu_si128( ( __m128i const * ) schedule[ r ] );
+        }
+}
+
+/**
+        Runs one round instruction over all blocks in flight. The indexes
+        are spelled out so the compiler keeps every block in a register.
+ */
+#define ROUND_ALL( op, key ) { \
+        s[ 0 ] = op( s[ 0 ], key ); \
+        s[ 1 ] = op( s[ 1 ], key ); \
+        s[ 2 ] = op( s[ 2 ], key ); \
+        s[ 3 ] = op( s[ 3 ], key ); \
+        s[ 4 ] = op( s[ 4 ], key ); \
+        s[ 5 ] = op( s[ 5 ], key ); \
+        s[ 6 ] = op( s[ 6 ], key ); \
+        s[ 7 ] = op( s[ 7 ], key ); \
+}
+
+/** Loads block n of the run and adds the first subkey. */
+#define LOAD_BLOCK( n ) s[ n ] = _mm_xor_si128( keys[ 0 ], \
+        _mm_loadu_si128( ( __m128i const * ) ( in + ( n ) * BLOCK_SIZE ) ) )
+
+/** Stores block n of the run. */
+#define STORE_BLOCK( n ) _mm_storeu_si128( \
+        ( __m128i * ) ( out + ( n ) * BLOCK_SIZE ), s[ n ] )
+
+/**
+        This function runs count blocks through one direction of the cipher,
+        INTERLEAVE at a time so the round instructions of independent blocks
+        overlap in the pipeline. The trailing blocks go one at a time.
+
+        @param keys The subkeys in the order they are applied
+        @param in The blocks to transform
+        @param out Where to store the transformed blocks
+        @param count The number of blocks
+        @param decrypt True to use AESDEC rather than AESENC
+ */
+static void runBlocks( __m128i const keys[ ROUNDS + 1 ], byte const *in,
+                        byte *out, size_t count, bool decrypt )
+{
+        int r = 0;
+        __m128i s[ INTERLEAVE ];
+        while ( count >= INTERLEAVE ) {
+                LOAD_BLOCK( 0 );
+                LOAD_BLOCK( 1 );
+                LOAD_BLOCK( 2 );
+                LOAD_BLOCK( 3 );
+                LOAD_BLOCK( 4 );
+                LOAD_BLOCK( 5 );
+                LOAD_BLOCK( 6 );
+                LOAD_BLOCK( 7 );
+
+                if ( decrypt ) {
+                        for ( r = 1; r < ROUNDS; r++ ) {
+                                ROUND_ALL( _mm_aesdec_si128, keys[ r ] );
+                        }
+
+                        ROUND_ALL( _mm_aesdeclast_si128, keys[ ROUNDS ] );
+                } else {
+                        for ( r = 1; r < ROUNDS; r++ ) {
+                                ROUND_ALL( _mm_aesenc_si128, keys[ r ] );
+                        }
+
+                        ROUND_ALL( _mm_aesenclast_si128, keys[ ROUNDS ] );
+                }
+
+                STORE_BLOCK( 0 );
+                STORE_BLOCK( 1 );
+                STORE_BLOCK( 2 );
+                STORE_BLOCK( 3 );
+                STORE_BLOCK( 4 );
+                STORE_BLOCK( 5 );
+                STORE_BLOCK( 6 );
+                STORE_BLOCK( 7 );
+
+                in += INTERLEAVE * BLOCK_SIZE;
+                out += INTERLEAVE * BLOCK_SIZE;
+                count -= INTERLEAVE;
+        }
+
+        while ( count > 0 ) {
+                __m128i x = _mm_xor_si128( keys[ 0 ],
+                        _mm_loadu_si128( ( __m128i const * ) in ) );
+                for ( r = 1; r < ROUNDS; r++ ) {
+                        x = decrypt ? _mm_aesdec_si128( x, keys[ r ] ) :
+                                _mm_aesenc_si128( x, keys[ r ] );
+                }
+
+                x = decrypt ? _mm_aesdeclast_si128( x, keys[ ROUNDS ] ) :
+                        _mm_aesenclast_si128( x, keys[ ROUNDS ] );
+                _mm_storeu_si128( ( __m128i * ) out, x );
+
+                in += BLOCK_SIZE;
+                out += BLOCK_SIZE;
+                count--;
+        }
+}
+
+void aesniEncryptBlocks( AesContext const *ctx, byte const *in, byte *out,
+                        size_t count )
+{
+        __m128i keys[ ROUNDS + 1 ];
+        loadKeys( keys, ctx->subkey );
+        runBlocks( keys, in, out, count, false );
+}
+
+void aesniDecryptBlocks( AesContext const *ctx, byte const *in, byte *out,
+                        size_t count )
+{
+        __m128i keys[ ROUNDS + 1 ];
+        loadKeys( keys, ctx->decSubkey );
+        runBlocks( keys, in, out, count, true );
+}
+
+#else
+
+bool aesniAvailable( void )
+{
+        return false;
+}
+
+void aesniExpandKey( AesContext *ctx, byte const key[ BLOCK_SIZE ] )
+{
+}
+
+void aesniEncrypt( AesContext const *ctx, byte data[ BLOCK_SIZE ] )
+{
+}
+
+void aesniDecrypt( AesContext const *ctx, byte data[ BLOCK_SIZE ] )
+{
+}
+
+void aesniEncryptBlocks( AesContext const *ctx, byte const *in, byte *out,
+                        size_t count )
+{
+}
+
+void aesniDecryptBlocks( AesContext const *ctx, byte const *in, byte *out,
+                        size_t count )
+{
+}
+
+#endif
@@ -0,0 +1,73 @@
+/**
+        @file aesni.h
+        @author James O Kocak (jokocak)
+
+        The header file for the aesni.c component of the program. This
+        component implements the AES rounds and key schedule with the x86
+        AES-NI instructions. It is only used by aes.c, which checks
+        aesniAvailable before binding a context to it.
+ */
+
+#ifndef _AESNI_H_
+#define _AESNI_H_
+
+#include "aes.h"
+
+#endif
+
+/**
+        This function checks, using CPUID, whether the processor supports the
+        AES-NI instructions. The answer is computed once and cached.
+
+        @return True if the AES-NI backend can be used
+ */
+bool aesniAvailable( void );
+
+/**
+        This function expands the given key with AESKEYGENASSIST, filling in
+        the subkey array of ctx and the decSubkey array used by AESDEC.
+
+        @param ctx The context to fill in
+        @param key The key to generate subkeys from
+ */
+void aesniExpandKey( AesContext *ctx, byte const key[ BLOCK_SIZE ] );
+
+/**
+        This function encrypts a 16-byte block of data in place with AESENC.
+
+        @param ctx The expanded key to encrypt with
+        @param data The block of data to encrypt
+ */
+void aesniEncrypt( AesContext const *ctx, byte data[ BLOCK_SIZE ] );
+
+/**
+        This function decrypts a 16-byte block of data in place with AESDEC.
+
+        @param ctx The expanded key to decrypt with
+        @param data The block of data to decrypt
+ */
+void aesniDecrypt( AesContext const *ctx, byte data[ BLOCK_SIZE ] );
+
+/**
+        This function encrypts count consecutive blocks from in to out, which
+        may be the same buffer, keeping eight blocks in flight per round.
+
+        @param ctx The expanded key to encrypt with
+        @param in The blocks to encrypt
+        @param out Where to store the encrypted blocks
+        @param count The number of blocks
+ */
+void aesniEncryptBlocks( AesContext const *ctx, byte const *in, byte *out,
+                        size_t count );
+
+/**
+        This function decrypts count consecutive blocks from in to out, which
+        may be the same buffer, keeping eight blocks in flight per round.
+
+        @param ctx The expanded key to decrypt with
+        @param in The blocks to decrypt
+        @param out Where to store the decrypted blocks
+        @param count The number of blocks
+ */
+void aesniDecryptBlocks( AesContext const *ctx, byte const *in, byte *out,
+                        size_t count );
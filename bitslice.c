@@ -0,0 +1,680 @@
+/**
+        @file bitslice.c
+        @author James O Kocak (jokocak)
+
+        This component implements constant-time AES on eight blocks at once.
+        The 128 bytes of the eight blocks are transposed into eight bit
+        planes of 128 bits, plane p holding bit p of every byte. Within a
+        plane, each 32-bit lane is one column of the state, each byte of a
+        lane is one row, and each bit of that byte belongs to one of the
+        eight blocks. SubBytes is a boolean circuit over the planes, while
+        ShiftRows and mixColumns only move whole lanes and bytes around.
+ */
+
+#include "bitslice.h"
+#include <string.h>
+
+/** Number of bytes handled by one group of bitsliced blocks. */
+#define GROUP_BYTES ( BITSLICE_BLOCKS * BLOCK_SIZE )
+
+/** Number of columns stored in each 64-bit plane word. */
+#define LANES_PER_WORD 2
+
+/** Number of bits in one column lane. */
+#define LANE_BITS 32
+
+/** The row 0 byte of both column lanes in a plane word. */
+#define ROW0 0x000000FF000000FFULL
+
+/** The row 1 byte of both column lanes in a plane word. */
+#define ROW1 ( ROW0 << BBITS )
+
+/** The row 2 byte of both column lanes in a plane word. */
+#define ROW2 ( ROW0 << ( 2 * BBITS ) )
+
+/** The row 3 byte of both column lanes in a plane word. */
+#define ROW3 ( ROW0 << ( 3 * BBITS ) )
+
+/** Bytes that stay in their lane when lanes are rotated by one row. */
+#define ROT1_KEEP 0x00FFFFFF00FFFFFFULL
+
+/** Bytes that stay in their lane when lanes are rotated by two rows. */
+#define ROT2_KEEP 0x0000FFFF0000FFFFULL
+
+/** The eight bit planes of a group of blocks. */
+typedef uint64_t Planes[ BBITS ][ PLANE_WORDS ];
+
+/**
+        This function returns the bit offset, within its plane word, of the
+        byte for the given row and column.
+
+        @param row The row of the state
+        @param col The column of the state
+        @return The shift that selects that byte
+ */
+static int byteShift( int row, int col )
+{
+        return ( col % LANES_PER_WORD ) * LANE_BITS + row * BBITS;
+}
+
+/**
+        This function exchanges the bits of a selected by mask, shifted up by
+        n, with the bits of b selected by mask.
+
+        @param a The word holding the upper bits of each pair
+        @param b The word holding the lower bits of each pair
+        @param mask The bits of b taking part in the exchange
+        @param n The distance between paired bits
+ */
+static void swapMove( uint64_t *a, uint64_t *b, uint64_t mask, int n )
+{
+        uint64_t t = ( ( *a >> n ) ^ *b ) & mask;
+        *b ^= t;
+        *a ^= t << n;
+}
+
+/**
+        This function transposes the block index and the bit index of eight
+        words. On entry word b holds bit p of byte k of block b at 8 * k + p;
+        on exit word p holds it at 8 * k + b. Applying it twice restores the
+        original words.
+
+        @param x The eight words to transpose
+ */
+static void transpose( uint64_t x[ BBITS ] )
+{
+        int i = 0;
+        int base = 0;
+        for ( i = 0; i < BBITS; i += 2 ) {
+                swapMove( &x[ i ], &x[ i + 1 ], 0x5555555555555555ULL, 1 );
+        }
+
+        for ( base = 0; base < BBITS; base += 4 ) {
+                for ( i = base; i < base + 2; i++ ) {
+                        swapMove( &x[ i ], &x[ i + 2 ],
+                                0x3333333333333333ULL, 2 );
+                }
+        }
+
+        for ( i = 0; i < BBITS / 2; i++ ) {
+                swapMove( &x[ i ], &x[ i + 4 ], 0x0F0F0F0F0F0F0F0FULL, 4 );
+        }
+}
+
+/**
+        This function reads eight bytes as a little-endian word.
+
+        @param p The bytes to read
+        @return The word they form
+ */
+static uint64_t loadWord( byte const *p )
+{
+        return ( uint64_t ) p[ 0 ] | ( ( uint64_t ) p[ 1 ] << 8 ) |
+                ( ( uint64_t ) p[ 2 ] << 16 ) | ( ( uint64_t ) p[ 3 ] << 24 ) |
+                ( ( uint64_t ) p[ 4 ] << 32 ) | ( ( uint64_t ) p[ 5 ] << 40 ) |
+                ( ( uint64_t ) p[ 6 ] << 48 ) | ( ( uint64_t ) p[ 7 ] << 56 );
+}
+
+/**
+        This function writes a word as eight little-endian bytes.
+
+        @param p The bytes to write
+        @param x The word to write
+ */
+static void storeWord( byte *p, uint64_t x )
+{
+        p[ 0 ] = ( byte ) x;
+        p[ 1 ] = ( byte ) ( x >> 8 );
+        p[ 2 ] = ( byte ) ( x >> 16 );
+        p[ 3 ] = ( byte ) ( x >> 24 );
+        p[ 4 ] = ( byte ) ( x >> 32 );
+        p[ 5 ] = ( byte ) ( x >> 40 );
+        p[ 6 ] = ( byte ) ( x >> 48 );
+        p[ 7 ] = ( byte ) ( x >> 56 );
+}
+
+/**
+        This function transposes a group of blocks into bit planes. Each plane
+        word covers half of every block, two columns, so byte k of that half
+        lands at bits 8 * k through 8 * k + 7, one bit per block.
+
+        @param q The planes to fill in
+        @param data The BITSLICE_BLOCKS blocks to read
+ */
+static void pack( Planes q, byte const *data )
+{
+        int w = 0;
+        int i = 0;
+        for ( w = 0; w < PLANE_WORDS; w++ ) {
+                uint64_t x[ BBITS ];
+                for ( i = 0; i < BITSLICE_BLOCKS; i++ ) {
+                        x[ i ] = loadWord( data + i * BLOCK_SIZE + w * BBITS );
+                }
+
+                transpose( x );
+                for ( i = 0; i < BBITS; i++ ) {
+                        q[ i ][ w ] = x[ i ];
+                }
+        }
+}
+
+/**
+        This function transposes bit planes back into a group of blocks.
+
+        @param data The BITSLICE_BLOCKS blocks to write
+        @param q The planes to read
+ */
+static void unpack( byte *data, Planes q )
+{
+        int w = 0;
+        int i = 0;
+        for ( w = 0; w < PLANE_WORDS; w++ ) {
+                uint64_t x[ BBITS ];
+                for ( i = 0; i < BBITS; i++ ) {
+                        x[ i ] = q[ i ][ w ];
+                }
+
+                transpose( x );
+                for ( i = 0; i < BITSLICE_BLOCKS; i++ ) {
+                        storeWord( data + i * BLOCK_SIZE + w * BBITS, x[ i ] );
+                }
+        }
+}
+
+/**
+        This function evaluates the sBox on every byte of one plane word,
+        using the 113-gate circuit by Boyar and Peralta. x0 is the most
+        significant bit of each byte.
+
+        @param q The planes to substitute
+        @param w Which word of each plane to work on
+ */
+static void sboxWord( Planes q, int w )
+{
+        uint64_t x0 = q[ 7 ][ w ], x1 = q[ 6 ][ w ], x2 = q[ 5 ][ w ];
+        uint64_t x3 = q[ 4 ][ w ], x4 = q[ 3 ][ w ], x5 = q[ 2 ][ w ];
+        uint64_t x6 = q[ 1 ][ w ], x7 = q[ 0 ][ w ];
+        uint64_t y1, y2, y3, y4, y5, y6, y7, y8, y9, y10, y11;
+        uint64_t y12, y13, y14, y15, y16, y17, y18, y19, y20, y21;
+        uint64_t z0, z1, z2, z3, z4, z5, z6, z7, z8, z9, z10, z11;
+        uint64_t z12, z13, z14, z15, z16, z17;
+        uint64_t t0, t1, t2, t3, t4, t5, t6, t7, t8, t9, t10, t11, t12;
+        uint64_t t13, t14, t15, t16, t17, t18, t19, t20, t21, t22, t23;
+        uint64_t t24, t25, t26, t27, t28, t29, t30, t31, t32, t33, t34;
+        uint64_t t35, t36, t37, t38, t39, t40, t41, t42, t43, t44, t45;
+        uint64_t t46, t47, t48, t49, t50, t51, t52, t53, t54, t55, t56;
+        uint64_t t57, t58, t59, t60, t61, t62, t63, t64, t65, t66, t67;
+        uint64_t s0, s1, s2, s3, s4, s5, s6, s7;
+
+        // Top linear transformation
+        y14 = x3 ^ x5;
+        y13 = x0 ^ x6;
+        y9 = x0 ^ x3;
+        y8 = x0 ^ x5;
+        t0 = x1 ^ x2;
+        y1 = t0 ^ x7;
+        y4 = y1 ^ x3;
+        y12 = y13 ^ y14;
+        y2 = y1 ^ x0;
+        y5 = y1 ^ x6;
+        y3 = y5 ^ y8;
+        t1 = x4 ^ y12;
+        y15 = t1 ^ x5;
+        y20 = t1 ^ x1;
+        y6 = y15 ^ x7;
+        y10 = y15 ^ t0;
+        y11 = y20 ^ y9;
+        y7 = x7 ^ y11;
+        y17 = y10 ^ y11;
+        y19 = y10 ^ y8;
+        y16 = t0 ^ y11;
+        y21 = y13 ^ y16;
+        y18 = x0 ^ y16;
+
+        // Non-linear section, the inversion in GF(2^8)
+        t2 = y12 & y15;
+        t3 = y3 & y6;
+        t4 = t3 ^ t2;
+        t5 = y4 & x7;
+        t6 = t5 ^ t2;
+        t7 = y13 & y16;
+        t8 = y5 & y1;
+        t9 = t8 ^ t7;
+        t10 = y2 & y7;
+        t11 = t10 ^ t7;
+        t12 = y9 & y11;
+        t13 = y14 & y17;
+        t14 = t13 ^ t12;
+        t15 = y8 & y10;
+        t16 = t15 ^ t12;
+        t17 = t4 ^ t14;
+        t18 = t6 ^ t16;
+        t19 = t9 ^ t14;
+        t20 = t11 ^ t16;
+        t21 = t17 ^ y20;
+        t22 = t18 ^ y19;
+        t23 = t19 ^ y21;
+        t24 = t20 ^ y18;
+
+        t25 = t21 ^ t22;
+        t26 = t21 & t23;
+        t27 = t24 ^ t26;
+        t28 = t25 & t27;
+        t29 = t28 ^ t22;
+        t30 = t23 ^ t24;
+        t31 = t22 ^ t26;
+        t32 = t31 & t30;
+        t33 = t32 ^ t24;
+        t34 = t23 ^ t33;
+        t35 = t27 ^ t33;
+        t36 = t24 & t35;
+        t37 = t36 ^ t34;
+        t38 = t27 ^ t36;
+        t39 = t29 & t38;
+        t40 = t25 ^ t39;
+
+        t41 = t40 ^ t37;
+        t42 = t29 ^ t33;
+        t43 = t29 ^ t40;
+        t44 = t33 ^ t37;
+        t45 = t42 ^ t41;
+        z0 = t44 & y15;
+        z1 = t37 & y6;
+        z2 = t33 & x7;
+        z3 = t43 & y16;
+        z4 = t40 & y1;
+        z5 = t29 & y7;
+        z6 = t42 & y11;
+        z7 = t45 & y17;
+        z8 = t41 & y10;
+        z9 = t44 & y12;
+        z10 = t37 & y3;
+        z11 = t33 & y4;
+        z12 = t43 & y13;
+        z13 = t40 & y5;
+        z14 = t29 & y2;
+        z15 = t42 & y9;
+        z16 = t45 & y14;
+        z17 = t41 & y8;
+
+        // Bottom linear transformation, including the affine constant
+        t46 = z15 ^ z16;
+        t47 = z10 ^ z11;
+        t48 = z5 ^ z13;
+        t49 = z9 ^ z10;
+        t50 = z2 ^ z12;
+        t51 = z2 ^ z5;
+        t52 = z7 ^ z8;
+        t53 = z0 ^ z3;
+        t54 = z6 ^ z7;
+        t55 = z16 ^ z17;
+        t56 = z12 ^ t48;
+        t57 = t50 ^ t53;
+        t58 = z4 ^ t46;
+        t59 = z3 ^ t54;
+        t60 = t46 ^ t57;
+        t61 = z14 ^ t57;
+        t62 = t52 ^ t58;
+        t63 = t49 ^ t58;
+        t64 = z4 ^ t59;
+        t65 = t61 ^ t62;
+        t66 = z1 ^ t63;
+        s0 = t59 ^ t63;
+        s6 = t56 ^ ~t62;
+        s7 = t48 ^ ~t60;
+        t67 = t64 ^ t65;
+        s3 = t53 ^ t66;
+        s4 = t51 ^ t66;
+        s5 = t47 ^ t65;
+        s1 = t64 ^ ~s3;
+        s2 = t55 ^ ~t67;
+
+        q[ 7 ][ w ] = s0;
+        q[ 6 ][ w ] = s1;
+        q[ 5 ][ w ] = s2;
+        q[ 4 ][ w ] = s3;
+        q[ 3 ][ w ] = s4;
+        q[ 2 ][ w ] = s5;
+        q[ 1 ][ w ] = s6;
+        q[ 0 ][ w ] = s7;
+}
+
+/**
+        This function runs every byte of the planes through the sBox.
+
+        @param q The planes to substitute
+ */
+static void subBytes( Planes q )
+{
+        int w = 0;
+        for ( w = 0; w < PLANE_WORDS; w++ ) {
+                sboxWord( q, w );
+        }
+}
+
+/**
+        This function applies the inverse of the affine transformation that
+        ends the sBox, bit i becoming bits i + 2, i + 5 and i + 7 exclusive
+        ored, plus the constant 0x05.
+
+        @param q The planes to transform
+ */
+static void invAffine( Planes q )
+{
+        Planes t;
+        int i = 0;
+        int w = 0;
+        for ( i = 0; i < BBITS; i++ ) {
+                for ( w = 0; w < PLANE_WORDS; w++ ) {
+                        t[ i ][ w ] = q[ ( i + 2 ) % BBITS ][ w ] ^
+                                q[ ( i + 5 ) % BBITS ][ w ] ^
+                                q[ ( i + 7 ) % BBITS ][ w ];
+                }
+        }
+
+        for ( w = 0; w < PLANE_WORDS; w++ ) {
+                t[ 0 ][ w ] = ~t[ 0 ][ w ];
+                t[ 2 ][ w ] = ~t[ 2 ][ w ];
+        }
+
+        memcpy( q, t, sizeof( Planes ) );
+}
+
+/**
+        This function runs every byte of the planes through the inverse sBox.
+        Since the sBox is inversion followed by an affine map, undoing the
+        affine map on both sides of the sBox circuit leaves only the
+        inversion, which is its own inverse.
+
+        @param q The planes to substitute
+ */
+static void invSubBytes( Planes q )
+{
+        invAffine( q );
+        subBytes( q );
+        invAffine( q );
+}
+
+/**
+        This function moves the bytes of each row between column lanes. Row r
+        of column c is taken from column c + r for shiftRows and from column
+        c - r for unShiftRows. Rows 1 and 3 come from the two lane pairs
+        straddling the plane words, and row 2 simply swaps the words.
+
+        @param q The planes to shift
+        @param inverse True to undo the shift instead
+ */
+static void shiftLanes( Planes q, bool inverse )
+{
+        int i = 0;
+        for ( i = 0; i < BBITS; i++ ) {
+                uint64_t w0 = q[ i ][ 0 ];
+                uint64_t w1 = q[ i ][ 1 ];
+
+                // Columns ( 1, 2 ) and ( 3, 0 ) as plane words
+                uint64_t a = ( w0 >> LANE_BITS ) | ( w1 << LANE_BITS );
+                uint64_t b = ( w1 >> LANE_BITS ) | ( w0 << LANE_BITS );
+                if ( inverse ) {
+                        uint64_t t = a;
+                        a = b;
+                        b = t;
+                }
+
+                q[ i ][ 0 ] = ( w0 & ROW0 ) | ( a & ROW1 ) | ( w1 & ROW2 ) |
+                        ( b & ROW3 );
+                q[ i ][ 1 ] = ( w1 & ROW0 ) | ( b & ROW1 ) | ( w0 & ROW2 ) |
+                        ( a & ROW3 );
+        }
+}
+
+/**
+        This function rotates every column lane of a plane word so that row
+        r receives the byte from row r + 1.
+
+        @param x The plane word to rotate
+        @return The rotated word
+ */
+static uint64_t rotateRow1( uint64_t x )
+{
+        return ( ( x >> BBITS ) & ROT1_KEEP ) |
+                ( ( x << ( LANE_BITS - BBITS ) ) & ~ROT1_KEEP );
+}
+
+/**
+        This function rotates every column lane of a plane word so that row
+        r receives the byte from row r + 2.
+
+        @param x The plane word to rotate
+        @return The rotated word
+ */
+static uint64_t rotateRow2( uint64_t x )
+{
+        return ( ( x >> ( 2 * BBITS ) ) & ROT2_KEEP ) |
+                ( ( x << ( 2 * BBITS ) ) & ~ROT2_KEEP );
+}
+
+/**
+        This function multiplies every byte of the planes by 0x02, which just
+        renames the planes and folds the top one back in by the AES
+        polynomial.
+
+        @param out The product
+        @param a The planes to multiply
+ */
+static void xtime( Planes out, Planes a )
+{
+        int w = 0;
+        for ( w = 0; w < PLANE_WORDS; w++ ) {
+                uint64_t top = a[ 7 ][ w ];
+                out[ 7 ][ w ] = a[ 6 ][ w ];
+                out[ 6 ][ w ] = a[ 5 ][ w ];
+                out[ 5 ][ w ] = a[ 4 ][ w ];
+                out[ 4 ][ w ] = a[ 3 ][ w ] ^ top;
+                out[ 3 ][ w ] = a[ 2 ][ w ] ^ top;
+                out[ 2 ][ w ] = a[ 1 ][ w ];
+                out[ 1 ][ w ] = a[ 0 ][ w ] ^ top;
+                out[ 0 ][ w ] = top;
+        }
+}
+
+/**
+        This function performs mixColumns on the planes. Each output row is
+        2 * ( a[ r ] ^ a[ r + 1 ] ) ^ a[ r + 1 ] ^ a[ r + 2 ] ^ a[ r + 3 ],
+        so one rotation, one xtime and one double rotation suffice.
+
+        @param q The planes to mix
+ */
+static void mixPlanes( Planes q )
+{
+        Planes sum;
+        Planes doubled;
+        uint64_t next[ BBITS ][ PLANE_WORDS ];
+
+        int i = 0;
+        int w = 0;
+        for ( i = 0; i < BBITS; i++ ) {
+                for ( w = 0; w < PLANE_WORDS; w++ ) {
+                        next[ i ][ w ] = rotateRow1( q[ i ][ w ] );
+                        sum[ i ][ w ] = q[ i ][ w ] ^ next[ i ][ w ];
+                }
+        }
+
+        xtime( doubled, sum );
+        for ( i = 0; i < BBITS; i++ ) {
+                for ( w = 0; w < PLANE_WORDS; w++ ) {
+                        q[ i ][ w ] = doubled[ i ][ w ] ^ next[ i ][ w ] ^
+                                rotateRow2( sum[ i ][ w ] );
+                }
+        }
+}
+
+/**
+        This function performs unMixColumns on the planes. Multiplying each
+        column by ( 0x05, 0x00, 0x04, 0x00 ) first turns unMixColumns into
+        an ordinary mixColumns.
+
+        @param q The planes to unmix
+ */
+static void unMixPlanes( Planes q )
+{
+        Planes t;
+        Planes t2;
+        int i = 0;
+        int w = 0;
+        for ( i = 0; i < BBITS; i++ ) {
+                for ( w = 0; w < PLANE_WORDS; w++ ) {
+                        t[ i ][ w ] = q[ i ][ w ] ^ rotateRow2( q[ i ][ w ] );
+                }
+        }
+
+        xtime( t2, t );
+        xtime( t, t2 );
+        for ( i = 0; i < BBITS; i++ ) {
+                for ( w = 0; w < PLANE_WORDS; w++ ) {
+                        q[ i ][ w ] ^= t[ i ][ w ];
+                }
+        }
+
+        mixPlanes( q );
+}
+
+/**
+        This function adds one bitsliced subkey to the planes.
+
+        @param q The planes to add to
+        @param key The subkey in plane form
+ */
+static void addPlanes( Planes q, uint64_t const key[ BBITS ][ PLANE_WORDS ] )
+{
+        int i = 0;
+        int w = 0;
+        for ( i = 0; i < BBITS; i++ ) {
+                for ( w = 0; w < PLANE_WORDS; w++ ) {
+                        q[ i ][ w ] ^= key[ i ][ w ];
+                }
+        }
+}
+
+void bitsliceExpandKey( AesContext *ctx )
+{
+        // Every block in a group uses the same key, so each bit of a subkey
+        // byte becomes a full byte of ones or zeros in its plane
+        int r = 0;
+        int i = 0;
+        int col = 0;
+        int row = 0;
+        for ( r = 0; r < ROUNDS + 1; r++ ) {
+                memset( ctx->sliceKey[ r ], 0, sizeof( ctx->sliceKey[ r ] ) );
+                for ( col = 0; col < BLOCK_COLS; col++ ) {
+                        for ( row = 0; row < BLOCK_ROWS; row++ ) {
+                                byte k = ctx->subkey[ r ][ col * WORD_SIZE + row ];
+                                for ( i = 0; i < BBITS; i++ ) {
+                                        uint64_t bits = ( uint64_t )
+                                                ( -( ( k >> i ) & 1 ) & 0xFF );
+                                        ctx->sliceKey[ r ][ i ][ col / LANES_PER_WORD ] |=
+                                                bits << byteShift( row, col );
+                                }
+                        }
+                }
+        }
+}
+
+/**
+        This function encrypts one full group of blocks. The output may be the
+        same buffer as the input.
+
+        @param ctx The expanded key to encrypt with
+        @param in The BITSLICE_BLOCKS blocks to encrypt
+        @param out Where to store the encrypted blocks
+ */
+static void encryptGroup( AesContext const *ctx, byte const *in, byte *out )
+{
+        Planes q;
+        pack( q, in );
+
+        addPlanes( q, ctx->sliceKey[ 0 ] );
+        int r = 0;
+        for ( r = 1; r < ROUNDS; r++ ) {
+                subBytes( q );
+                shiftLanes( q, false );
+                mixPlanes( q );
+                addPlanes( q, ctx->sliceKey[ r ] );
+        }
+
+        subBytes( q );
+        shiftLanes( q, false );
+        addPlanes( q, ctx->sliceKey[ ROUNDS ] );
+
+        unpack( out, q );
+}
+
+/**
+        This function decrypts one full group of blocks. The output may be the
+        same buffer as the input.
+
+        @param ctx The expanded key to decrypt with
+        @param in The BITSLICE_BLOCKS blocks to decrypt
+        @param out Where to store the decrypted blocks
+ */
+static void decryptGroup( AesContext const *ctx, byte const *in, byte *out )
+{
+        Planes q;
+        pack( q, in );
+
+        addPlanes( q, ctx->sliceKey[ ROUNDS ] );
+        int r = 0;
+        for ( r = ROUNDS - 1; r > 0; r-- ) {
+                shiftLanes( q, true );
+                invSubBytes( q );
+                addPlanes( q, ctx->sliceKey[ r ] );
+                unMixPlanes( q );
+        }
+
+        shiftLanes( q, true );
+        invSubBytes( q );
+        addPlanes( q, ctx->sliceKey[ 0 ] );
+
+        unpack( out, q );
+}
+
+/**
+        This function runs a group function over count blocks, padding a
+        short last group out to BITSLICE_BLOCKS in a scratch buffer.
+
+        @param ctx The expanded key to use
+        @param in The blocks to transform
+        @param out Where to store the transformed blocks
+        @param count The number of blocks in in
+        @param group The function transforming one full group
+ */
+static void forEachGroup( AesContext const *ctx, byte const *in, byte *out,
+                        size_t count,
+                        void ( *group )( AesContext const *, byte const *,
+                                        byte * ) )
+{
+        while ( count >= BITSLICE_BLOCKS ) {
+                group( ctx, in, out );
+                in += GROUP_BYTES;
+                out += GROUP_BYTES;
+                count -= BITSLICE_BLOCKS;
+        }
+
+        if ( count > 0 ) {
+                byte scratch[ GROUP_BYTES ] = { 0 };
+                memcpy( scratch, in, count * BLOCK_SIZE );
+                group( ctx, scratch, scratch );
+                memcpy( out, scratch, count * BLOCK_SIZE );
+        }
+}
+
+void bitsliceEncrypt( AesContext const *ctx, byte const *in, byte *out,
+                        size_t count )
+{
+        forEachGroup( ctx, in, out, count, encryptGroup );
+}
+
+void bitsliceDecrypt( AesContext const *ctx, byte const *in, byte *out,
+                        size_t count )
+{
+        forEachGroup( ctx, in, out, count, decryptGroup );
+}
@@ -0,0 +1,50 @@
+/**
+        @file bitslice.h
+        @author James O Kocak (jokocak)
+
+        The header file for the bitslice.c component of the program. This
+        component encrypts and decrypts eight blocks at a time by storing
+        them as bit planes and evaluating every step of AES with boolean
+        operations only, so its timing does not depend on the data or key.
+ */
+
+#ifndef _BITSLICE_H_
+#define _BITSLICE_H_
+
+#include "aes.h"
+
+#endif
+
+/**
+        This function converts the subkeys already in ctx into the bit plane
+        form used by the bitsliced rounds, filling in ctx->sliceKey.
+
+        @param ctx The context whose subkeys should be converted
+ */
+void bitsliceExpandKey( AesContext *ctx );
+
+/**
+        This function encrypts count consecutive blocks from in to out, which
+        may be the same buffer. Blocks are processed in groups of
+        BITSLICE_BLOCKS; a short final group is padded internally, so any
+        count is accepted.
+
+        @param ctx The expanded key to encrypt with
+        @param in The blocks to encrypt, count * BLOCK_SIZE bytes
+        @param out Where to store the encrypted blocks
+        @param count The number of blocks in in
+ */
+void bitsliceEncrypt( AesContext const *ctx, byte const *in, byte *out,
+                        size_t count );
+
+/**
+        This function decrypts count consecutive blocks from in to out, in
+        groups of BITSLICE_BLOCKS like bitsliceEncrypt.
+
+        @param ctx The expanded key to decrypt with
+        @param in The blocks to decrypt, count * BLOCK_SIZE bytes
+        @param out Where to store the decrypted blocks
+        @param count The number of blocks in in
+ */
+void bitsliceDecrypt( AesContext const *ctx, byte const *in, byte *out,
+                        size_t count );
@@ -0,0 +1,146 @@
+/**
+        @file cbc.c
+        @author James O Kocak (jokocak)
+
+        This component implements CBC mode. Decryption runs a batch of blocks
+        through aesDecryptBlocks and then chains them, and encryption gathers
+        one block from each of several messages into a batch, so both keep
+        the hardware and bitsliced backends working on many blocks at once.
+ */
+
+#include "cbc.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+        This function XORs two blocks into a third, which may be either of
+        them.
+
+        @param a The first block
+        @param b The second block
+        @param out Where to store the result
+ */
+static void xorBlock( byte const a[ BLOCK_SIZE ], byte const b[ BLOCK_SIZE ],
+                        byte out[ BLOCK_SIZE ] )
+{
+        uint64_t x[ 2 ], y[ 2 ];
+        memcpy( x, a, BLOCK_SIZE );
+        memcpy( y, b, BLOCK_SIZE );
+        x[ 0 ] ^= y[ 0 ];
+        x[ 1 ] ^= y[ 1 ];
+        memcpy( out, x, BLOCK_SIZE );
+}
+
+void cbcEncrypt( AesContext const *ctx, byte chain[ BLOCK_SIZE ],
+                        byte const *in, byte *out, size_t length )
+{
+        size_t b = 0;
+        for ( b = 0; b < length / BLOCK_SIZE; b++ ) {
+                xorBlock( in + b * BLOCK_SIZE, chain, chain );
+                aesEncryptWithContext( ctx, chain );
+                memcpy( out + b * BLOCK_SIZE, chain, BLOCK_SIZE );
+        }
+}
+
+void cbcEncryptStreams( AesContext const *ctx, CbcStream *streams,
+                        size_t count )
+{
+        byte batch[ CBC_LANES * BLOCK_SIZE ];
+        CbcStream *lane[ CBC_LANES ];
+
+        size_t first = 0;
+        for ( first = 0; first < count; first += CBC_LANES ) {
+                size_t group = count - first < CBC_LANES ? count - first :
+                        CBC_LANES;
+                size_t most = 0;
+                size_t s = 0;
+                for ( s = 0; s < group; s++ ) {
+                        if ( streams[ first + s ].blocks > most ) {
+                                most = streams[ first + s ].blocks;
+                        }
+                }
+
+                // Block b of every message still running goes in one batch
+                size_t b = 0;
+                for ( b = 0; b < most; b++ ) {
+                        size_t lanes = 0;
+                        for ( s = 0; s < group; s++ ) {
+                                CbcStream *stream = &streams[ first + s ];
+                                if ( b < stream->blocks ) {
+                                        xorBlock( stream->in + b * BLOCK_SIZE,
+                                                stream->chain,
+                                                batch + lanes * BLOCK_SIZE );
+                                        lane[ lanes++ ] = stream;
+                                }
+                        }
+
+                        aesEncryptBlocks( ctx, batch, batch, lanes );
+
+                        size_t l = 0;
+                        for ( l = 0; l < lanes; l++ ) {
+                                memcpy( lane[ l ]->chain, batch + l * BLOCK_SIZE,
+                                        BLOCK_SIZE );
+                                memcpy( lane[ l ]->out + b * BLOCK_SIZE,
+                                        lane[ l ]->chain, BLOCK_SIZE );
+                        }
+                }
+        }
+}
+
+void cbcDecrypt( AesContext const *ctx, byte const previous[ BLOCK_SIZE ],
+                        byte const *in, byte *out, size_t length )
+{
+        byte batch[ CBC_BATCH * BLOCK_SIZE ];
+        byte chain[ BLOCK_SIZE ];
+        memcpy( chain, previous, BLOCK_SIZE );
+
+        size_t blocks = length / BLOCK_SIZE;
+        while ( blocks > 0 ) {
+                size_t count = blocks < CBC_BATCH ? blocks : CBC_BATCH;
+                aesDecryptBlocks( ctx, in, batch, count );
+
+                // Backwards, so in place each ciphertext block is used
+                // before the plaintext overwrites it
+                byte next[ BLOCK_SIZE ];
+                memcpy( next, in + ( count - 1 ) * BLOCK_SIZE, BLOCK_SIZE );
+                size_t b = 0;
+                for ( b = count - 1; b > 0; b-- ) {
+                        xorBlock( batch + b * BLOCK_SIZE,
+                                in + ( b - 1 ) * BLOCK_SIZE,
+                                out + b * BLOCK_SIZE );
+                }
+
+                xorBlock( batch, chain, out );
+                memcpy( chain, next, BLOCK_SIZE );
+                in += count * BLOCK_SIZE;
+                out += count * BLOCK_SIZE;
+                blocks -= count;
+        }
+}
+
+void cbcEncryptChunk( void *arg, byte const *in, byte *out,
+                        size_t length, off_t offset )
+{
+        CbcChain *chain = ( CbcChain * ) arg;
+        cbcEncrypt( &chain->ctx, chain->chain, in, out, length );
+}
+
+void cbcDecryptChunk( void *arg, byte const *in, byte *out,
+                        size_t length, off_t offset )
+{
+        CbcKey const *key = ( CbcKey const * ) arg;
+        byte previous[ BLOCK_SIZE ];
+        if ( offset == 0 ) {
+                memcpy( previous, key->iv, BLOCK_SIZE );
+        } else if ( key->mapped != NULL ) {
+                memcpy( previous, key->mapped + offset - BLOCK_SIZE,
+                        BLOCK_SIZE );
+        } else if ( readChunkAt( key->input, previous, BLOCK_SIZE,
+                        offset - BLOCK_SIZE ) != BLOCK_SIZE ) {
+                fprintf( stderr, "File changed while reading: %s\n",
+                        key->input->name );
+                exit( EXIT_FAILURE );
+        }
+
+        cbcDecrypt( &key->ctx, previous, in, out, length );
+}
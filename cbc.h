@@ -0,0 +1,154 @@
+/**
+        @file cbc.h
+        @author James O Kocak (jokocak)
+
+        The header file for the cbc.c component of the program. This
+        component implements cipher block chaining (CBC) mode. Encrypting a
+        block needs the ciphertext of the block before it, so one stream is
+        serial; instead, several independent streams can be advanced in
+        lockstep to keep the bulk block functions busy. Decrypting a block
+        needs only the ciphertext around it, so any range of a message can
+        be decrypted on any thread.
+ */
+
+#ifndef _CBC_H_
+#define _CBC_H_
+
+#include "aes.h"
+#include "io.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/** Number of blocks decrypted per call to aesDecryptBlocks. */
+#define CBC_BATCH 64
+
+/**
+        Number of streams cbcEncryptStreams advances at once, enough to fill
+        the widest backend's lanes with one block from each.
+ */
+#define CBC_LANES 16
+
+/** One CBC message for cbcEncryptStreams. */
+typedef struct {
+        /** The plaintext. */
+        byte const *in;
+
+        /** Where to store the ciphertext; may be in. */
+        byte *out;
+
+        /** Number of blocks in in. */
+        size_t blocks;
+
+        /**
+                The block chained into the first one, the IV at the start of
+                a message. It is left holding the last ciphertext block, so a
+                message can be encrypted a piece at a time.
+         */
+        byte chain[ BLOCK_SIZE ];
+} CbcStream;
+
+/**
+        A key and IV, with where decryption finds the ciphertext block before
+        a chunk.
+ */
+typedef struct {
+        /** The expanded key. */
+        AesContext ctx;
+
+        /** The IV. */
+        byte iv[ BLOCK_SIZE ];
+
+        /** The mapped ciphertext, or NULL to read it from input. */
+        byte const *mapped;
+
+        /** The ciphertext file, when it isn't mapped. */
+        ChunkStream *input;
+} CbcKey;
+
+/** One CBC encryption carried from chunk to chunk. */
+typedef struct {
+        /** The expanded key. */
+        AesContext ctx;
+
+        /**
+                The IV at the start of the message, then the last ciphertext
+                block of the chunk before.
+         */
+        byte chain[ BLOCK_SIZE ];
+} CbcChain;
+
+#endif
+
+/**
+        This function encrypts length bytes from in to out in CBC mode, one
+        block after another, which may be the same buffer. length must be a
+        multiple of BLOCK_SIZE.
+
+        @param ctx The expanded key
+        @param chain The IV or the last ciphertext block before in; left
+                     holding the last ciphertext block
+        @param in The bytes to encrypt
+        @param out Where to store the result
+        @param length The number of bytes in in
+ */
+void cbcEncrypt( AesContext const *ctx, byte chain[ BLOCK_SIZE ],
+                        byte const *in, byte *out, size_t length );
+
+/**
+        This function encrypts count independent CBC messages, taking one
+        block from each of up to CBC_LANES messages for every call to
+        aesEncryptBlocks. Messages may have different lengths; the shorter
+        ones drop out as they finish.
+
+        @param ctx The expanded key, shared by every message
+        @param streams The messages
+        @param count The number of messages
+ */
+void cbcEncryptStreams( AesContext const *ctx, CbcStream *streams,
+                        size_t count );
+
+/**
+        This function decrypts length bytes from in to out in CBC mode, which
+        may be the same buffer. Every block is decrypted independently, a
+        batch at a time, so in may start anywhere in a message as long as
+        previous is the ciphertext block before it. length must be a
+        multiple of BLOCK_SIZE.
+
+        @param ctx The expanded key
+        @param previous The IV or the ciphertext block before in
+        @param in The bytes to decrypt
+        @param out Where to store the result
+        @param length The number of bytes in in
+ */
+void cbcDecrypt( AesContext const *ctx, byte const previous[ BLOCK_SIZE ],
+                        byte const *in, byte *out, size_t length );
+
+/**
+        This function encrypts one chunk of a file, matching the pipeline's
+        ChunkFunction. The chunks must come in order on one thread, since
+        each continues from the last ciphertext block of the one before.
+
+        @param arg The CbcChain, whose chain block is updated
+        @param in The chunk's bytes
+        @param out Where to store the result
+        @param length The number of bytes in the chunk
+        @param offset Where the chunk starts in the file, unused
+ */
+void cbcEncryptChunk( void *arg, byte const *in, byte *out,
+                        size_t length, off_t offset );
+
+/**
+        This function decrypts one chunk of a file, matching the pipeline's
+        ChunkFunction. The ciphertext block before the chunk is read from
+        the mapping or the input file, so chunks can be decrypted on any
+        thread and in any order, but not in place.
+
+        @param arg The CbcKey
+        @param in The chunk's bytes
+        @param out Where to store the result
+        @param length The number of bytes in the chunk
+        @param offset Where the chunk starts in the file
+ */
+void cbcDecryptChunk( void *arg, byte const *in, byte *out,
+                        size_t length, off_t offset );
@@ -0,0 +1,71 @@
+/**
+        @file chunker.c
+        @author James O Kocak (jokocak)
+
+        This component implements content-defined chunking with a gear hash:
+        each byte shifts the hash left by one and adds a random 64-bit value
+        chosen by the byte, so the hash only depends on the last 64 bytes.
+ */
+
+#include "chunker.h"
+#include <pthread.h>
+#include <stdint.h>
+
+/** Number of entries in the gear table, one per byte value. */
+#define GEAR_SIZE 256
+
+/** Seed of the generator filling the gear table. */
+#define GEAR_SEED 0x6A09E667F3BCC908ULL
+
+/** Hash bits that must be clear at a cut, giving CHUNK_AVERAGE chunks. */
+#define CUT_MASK ( ( uint64_t ) ( CHUNK_AVERAGE - 1 ) << 48 )
+
+/** Number of bytes the hash depends on, one per bit shifted out. */
+#define HASH_WINDOW 64
+
+/** The random value added for each byte value. */
+static uint64_t gear[ GEAR_SIZE ];
+
+/** Fills the gear table exactly once, even with several threads chunking. */
+static pthread_once_t gearOnce = PTHREAD_ONCE_INIT;
+
+/**
+        This function fills the gear table from splitmix64, so the table is
+        the same on every machine without being written out here. It is
+        run through gearOnce.
+ */
+static void buildGear( void )
+{
+        uint64_t state = GEAR_SEED;
+        int i = 0;
+        for ( i = 0; i < GEAR_SIZE; i++ ) {
+                state += 0x9E3779B97F4A7C15ULL;
+                uint64_t z = state;
+                z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+                z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBULL;
+                gear[ i ] = z ^ ( z >> 31 );
+        }
+}
+
+size_t chunkerNext( byte const *data, size_t length, bool final )
+{
+        pthread_once( &gearOnce, buildGear );
+
+        // No cut is looked for before CHUNK_MIN, and one is forced at
+        // CHUNK_MAX. The hash only needs the window before CHUNK_MIN.
+        size_t limit = length < CHUNK_MAX ? length : CHUNK_MAX;
+        uint64_t hash = 0;
+        size_t i = 0;
+        for ( i = CHUNK_MIN - HASH_WINDOW; i < limit; i++ ) {
+                hash = ( hash << 1 ) + gear[ data[ i ] ];
+                if ( i + 1 >= CHUNK_MIN && ( hash & CUT_MASK ) == 0 ) {
+                        return i + 1;
+                }
+        }
+
+        if ( limit == CHUNK_MAX || final ) {
+                return limit;
+        }
+
+        return 0;
+}
@@ -0,0 +1,42 @@
+/**
+        @file chunker.h
+        @author James O Kocak (jokocak)
+
+        The header file for the chunker.c component of the program. This
+        component cuts data into content-defined chunks: a rolling gear hash
+        runs over the bytes and a chunk ends wherever the hash has its low
+        bits clear. The cut points depend only on the nearby bytes, so an
+        insertion early in a file moves only the chunks around it, and
+        identical runs of data in different files are cut identically.
+ */
+
+#ifndef _CHUNKER_H_
+#define _CHUNKER_H_
+
+#include "field.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Fewest bytes in a chunk, except the last one of the data. */
+#define CHUNK_MIN 2048
+
+/** Average number of bytes in a chunk, a power of two. */
+#define CHUNK_AVERAGE 8192
+
+/** Most bytes in a chunk. */
+#define CHUNK_MAX 65536
+
+#endif
+
+/**
+        This function finds where the chunk starting at data ends. The cut
+        points are part of the stored format of anything chunked, so the
+        hash and its constants must never change.
+
+        @param data The bytes from the start of the chunk
+        @param length The number of bytes available
+        @param final Whether the data ends after length bytes
+        @return The number of bytes in the chunk, or zero if more data is
+                needed to find the end
+ */
+size_t chunkerNext( byte const *data, size_t length, bool final );
@@ -0,0 +1,206 @@
+/**
+        @file clmul.c
+        @author James O Kocak (jokocak)
+
+        This component implements GHASH with the PCLMULQDQ instruction,
+        following Intel's carry-less multiplication white paper. It is
+        compiled on its own with -mpclmul -mssse3 so the rest of the program
+        can still run on processors without these instructions.
+ */
+
+#include "clmul.h"
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+
+#include <cpuid.h>
+#include <pthread.h>
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+
+/** CPUID leaf holding the basic feature flags. */
+#define FEATURE_LEAF 1
+
+/** Runs the CPUID check exactly once, whichever thread asks first. */
+static pthread_once_t checkOnce = PTHREAD_ONCE_INIT;
+
+/** Cached result of the CPUID check. */
+static bool available = false;
+
+/**
+        This function runs the CPUID check into available. It is run
+        through checkOnce.
+ */
+static void check( void )
+{
+        unsigned int eax, ebx, ecx, edx;
+        available = __get_cpuid( FEATURE_LEAF, &eax, &ebx, &ecx, &edx ) &&
+                ( ecx & bit_PCLMUL ) && ( ecx & bit_SSSE3 );
+}
+
+bool clmulAvailable( void )
+{
+        pthread_once( &checkOnce, check );
+        return available;
+}
+
+/**
+        This function loads a block and reverses its bytes, so GCM's first
+        byte lands in the top of the register.
+
+        @param bytes The block to load
+        @return The byte-reversed block
+ */
+static __m128i loadReversed( byte const bytes[ GHASH_BLOCK ] )
+{
+        __m128i order = _mm_set_epi8( 0, 1, 2, 3, 4, 5, 6, 7,
+                        8, 9, 10, 11, 12, 13, 14, 15 );
+        return _mm_shuffle_epi8(
+                        _mm_loadu_si128( ( __m128i const * ) bytes ), order );
+}
+
+/**
+        This function stores a byte-reversed block in GCM's byte order.
+
+        @param bytes Where to store the block
+        @param value The byte-reversed block
+ */
+static void storeReversed( byte bytes[ GHASH_BLOCK ], __m128i value )
+{
+        __m128i order = _mm_set_epi8( 0, 1, 2, 3, 4, 5, 6, 7,
+                        8, 9, 10, 11, 12, 13, 14, 15 );
+        _mm_storeu_si128( ( __m128i * ) bytes,
+                        _mm_shuffle_epi8( value, order ) );
+}
+
+/**
+        This function multiplies two byte-reversed elements without reducing,
+        adding the 256-bit product into low and high. Products can be summed
+        this way and reduced once.
+
+        @param a The first element
+        @param b The second element
+        @param low The low half of the running sum
+        @param high The high half of the running sum
+ */
+static void multiplyInto( __m128i a, __m128i b, __m128i *low, __m128i *high )
+{
+        __m128i lo = _mm_clmulepi64_si128( a, b, 0x00 );
+        __m128i hi = _mm_clmulepi64_si128( a, b, 0x11 );
+        __m128i mid = _mm_xor_si128( _mm_clmulepi64_si128( a, b, 0x10 ),
+                        _mm_clmulepi64_si128( a, b, 0x01 ) );
+        lo = _mm_xor_si128( lo, _mm_slli_si128( mid, 8 ) );
+        hi = _mm_xor_si128( hi, _mm_srli_si128( mid, 8 ) );
+        *low = _mm_xor_si128( *low, lo );
+        *high = _mm_xor_si128( *high, hi );
+}
+
+/**
+        This function reduces a 256-bit product modulo the GCM polynomial.
+        Because the operands were bit-reflected, the product is first
+        shifted left by one bit.
+
+        @param low The low half of the product
+        @param high The high half of the product
+        @return The reduced, byte-reversed element
+ */
+static __m128i reduce( __m128i low, __m128i high )
+{
+        // Shifts the whole 256 bits left by one
+        __m128i lowCarry = _mm_srli_epi32( low, 31 );
+        __m128i highCarry = _mm_srli_epi32( high, 31 );
+        low = _mm_slli_epi32( low, 1 );
+        high = _mm_slli_epi32( high, 1 );
+        __m128i across = _mm_srli_si128( lowCarry, 12 );
+        highCarry = _mm_slli_si128( highCarry, 4 );
+        lowCarry = _mm_slli_si128( lowCarry, 4 );
+        low = _mm_or_si128( low, lowCarry );
+        high = _mm_or_si128( high, highCarry );
+        high = _mm_or_si128( high, across );
+
+        // First phase of the reduction
+        __m128i t = _mm_xor_si128( _mm_slli_epi32( low, 31 ),
+                        _mm_xor_si128( _mm_slli_epi32( low, 30 ),
+                                _mm_slli_epi32( low, 25 ) ) );
+        __m128i spill = _mm_srli_si128( t, 4 );
+        low = _mm_xor_si128( low, _mm_slli_si128( t, 12 ) );
+
+        // Second phase
+        __m128i u = _mm_xor_si128( _mm_srli_epi32( low, 1 ),
+                        _mm_xor_si128( _mm_srli_epi32( low, 2 ),
+                                _mm_srli_epi32( low, 7 ) ) );
+        u = _mm_xor_si128( u, spill );
+        low = _mm_xor_si128( low, u );
+        return _mm_xor_si128( high, low );
+}
+
+void clmulInit( GhashKey *key )
+{
+        byte h[ GHASH_BLOCK ];
+        field128Store( h, key->h );
+        __m128i base = loadReversed( h );
+        __m128i power = base;
+        int i = 0;
+        for ( i = 0; i < GHASH_POWERS; i++ ) {
+                _mm_storeu_si128( ( __m128i * ) key->powers[ i ], power );
+                __m128i low = _mm_setzero_si128();
+                __m128i high = _mm_setzero_si128();
+                multiplyInto( power, base, &low, &high );
+                power = reduce( low, high );
+        }
+}
+
+void clmulUpdate( GhashKey const *key, byte state[ GHASH_BLOCK ],
+                        byte const *data, size_t blocks )
+{
+        __m128i h[ GHASH_POWERS ];
+        int i = 0;
+        for ( i = 0; i < GHASH_POWERS; i++ ) {
+                h[ i ] = _mm_loadu_si128( ( __m128i const * ) key->powers[ i ] );
+        }
+
+        __m128i y = loadReversed( state );
+        for ( ; blocks >= GHASH_POWERS; blocks -= GHASH_POWERS ) {
+                // The first block is multiplied by H^4, the last by H
+                __m128i low = _mm_setzero_si128();
+                __m128i high = _mm_setzero_si128();
+                multiplyInto( _mm_xor_si128( y, loadReversed( data ) ),
+                                h[ 3 ], &low, &high );
+                multiplyInto( loadReversed( data + GHASH_BLOCK ), h[ 2 ],
+                                &low, &high );
+                multiplyInto( loadReversed( data + 2 * GHASH_BLOCK ), h[ 1 ],
+                                &low, &high );
+                multiplyInto( loadReversed( data + 3 * GHASH_BLOCK ), h[ 0 ],
+                                &low, &high );
+                y = reduce( low, high );
+                data += GHASH_POWERS * GHASH_BLOCK;
+        }
+
+        for ( ; blocks > 0; blocks-- ) {
+                __m128i low = _mm_setzero_si128();
+                __m128i high = _mm_setzero_si128();
+                multiplyInto( _mm_xor_si128( y, loadReversed( data ) ),
+                                h[ 0 ], &low, &high );
+                y = reduce( low, high );
+                data += GHASH_BLOCK;
+        }
+
+        storeReversed( state, y );
+}
+
+#else
+
+bool clmulAvailable( void )
+{
+        return false;
+}
+
+void clmulInit( GhashKey *key )
+{
+}
+
+void clmulUpdate( GhashKey const *key, byte state[ GHASH_BLOCK ],
+                        byte const *data, size_t blocks )
+{
+}
+
+#endif
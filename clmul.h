@@ -0,0 +1,45 @@
+/**
+        @file clmul.h
+        @author James O Kocak (jokocak)
+
+        The header file for the clmul.c component of the program. This
+        component implements GHASH with the x86 PCLMULQDQ carry-less multiply
+        instruction. It is only used by ghash.c, which checks clmulAvailable
+        before a key may use it.
+ */
+
+#ifndef _CLMUL_H_
+#define _CLMUL_H_
+
+#include "ghash.h"
+
+#endif
+
+/**
+        This function checks, using CPUID, whether the processor supports
+        PCLMULQDQ and SSSE3. The answer is computed once and cached.
+
+        @return True if the carry-less multiply can be used
+ */
+bool clmulAvailable( void );
+
+/**
+        This function fills in the powers of H the carry-less multiply
+        works with.
+
+        @param key The key, whose h is already set
+ */
+void clmulInit( GhashKey *key );
+
+/**
+        This function absorbs whole blocks into a running hash, four at a
+        time with a single reduction: ( state + X1 ) H^4 + X2 H^3 + X3 H^2
+        + X4 H.
+
+        @param key The hash key
+        @param state The running hash, updated in place
+        @param data The blocks to absorb
+        @param blocks The number of blocks in data
+ */
+void clmulUpdate( GhashKey const *key, byte state[ GHASH_BLOCK ],
+                        byte const *data, size_t blocks );
@@ -0,0 +1,412 @@
+/**
+        @file container.c
+        @author James O Kocak (jokocak)
+
+        This component implements the seekable container. Chunks are the
+        tasks handed to the thread pool; each one is read with pread,
+        sealed or opened with one gcmEncrypt or gcmDecrypt call in a
+        per-thread buffer, and written with pwrite.
+ */
+
+#include "container.h"
+#include "pool.h"
+#include <string.h>
+
+/** Magic bytes starting the header, the last one the format version. */
+static byte const headerMagic[ 8 ] = { 'A', 'E', 'S', 'C', 'H', 'N', 'K', '1' };
+
+/** Magic bytes ending the footer. */
+static byte const footerMagic[ 8 ] = { 'A', 'E', 'S', 'C', 'I', 'D', 'X', '1' };
+
+/** Where the header stores the chunk size. */
+#define CHUNK_SIZE_AT 8
+
+/** Where the header stores the plaintext size. */
+#define PLAIN_SIZE_AT 16
+
+/** Bytes of additional data: the header and the chunk number. */
+#define AAD_SIZE ( CONTAINER_HEADER_SIZE + sizeof( uint64_t ) )
+
+/** Number of bits in a byte. */
+#define BYTE_BITS 8
+
+/** Everything the threads of one containerEncrypt or containerDecrypt share. */
+typedef struct {
+        /** The key. */
+        GcmKey const *key;
+
+        /** The header, authenticated with every chunk. */
+        byte const *header;
+
+        /** The nonce of chunk zero, when encrypting. */
+        byte const *nonce;
+
+        /** The file read from. */
+        ChunkStream *input;
+
+        /** The file written to. */
+        ChunkStream *output;
+
+        /** One record buffer per thread. */
+        byte **buffers;
+
+        /** Bytes of plaintext in every chunk but the last. */
+        size_t chunkSize;
+
+        /** Total bytes of plaintext. */
+        uint64_t plainSize;
+
+        /** Where each record starts, when decrypting. */
+        uint64_t const *offsets;
+
+        /** The first chunk handled, task zero. */
+        size_t firstChunk;
+
+        /** The plaintext range being decrypted. */
+        uint64_t rangeStart, rangeEnd;
+
+        /** Set by any thread whose chunk isn't authentic. */
+        bool failed;
+} ContainerJob;
+
+/**
+        This function stores a number as little-endian bytes.
+
+        @param bytes Where to store the number
+        @param value The number
+        @param size The number of bytes to store
+ */
+static void storeLittle( byte *bytes, uint64_t value, size_t size )
+{
+        size_t i = 0;
+        for ( i = 0; i < size; i++ ) {
+                bytes[ i ] = ( byte ) ( value >> ( BYTE_BITS * i ) );
+        }
+}
+
+/**
+        This function reads little-endian bytes as a number.
+
+        @param bytes The bytes to read
+        @param size The number of bytes
+        @return Their value
+ */
+static uint64_t loadLittle( byte const *bytes, size_t size )
+{
+        uint64_t value = 0;
+        size_t i = size;
+        while ( i-- > 0 ) {
+                value = value << BYTE_BITS | bytes[ i ];
+        }
+
+        return value;
+}
+
+/**
+        This function returns the number of bytes of plaintext in a chunk.
+
+        @param chunkSize Bytes in every chunk but the last
+        @param plainSize Total bytes of plaintext
+        @param chunk The chunk number
+        @return The chunk's length
+ */
+static size_t chunkLength( size_t chunkSize, uint64_t plainSize, size_t chunk )
+{
+        uint64_t left = plainSize - ( uint64_t ) chunk * chunkSize;
+        return left < chunkSize ? ( size_t ) left : chunkSize;
+}
+
+/**
+        This function builds a chunk's additional data: the header, then the
+        chunk number.
+
+        @param aad Where to store the additional data
+        @param header The container's header
+        @param chunk The chunk number
+ */
+static void chunkAad( byte aad[ AAD_SIZE ], byte const *header, size_t chunk )
+{
+        memcpy( aad, header, CONTAINER_HEADER_SIZE );
+        storeLittle( aad + CONTAINER_HEADER_SIZE, chunk, sizeof( uint64_t ) );
+}
+
+/**
+        This function exits when the input turns out shorter than it was.
+
+        @param name The input file
+ */
+static void changedError( char const *name )
+{
+        fprintf( stderr, "File changed while reading: %s\n", name );
+        exit( EXIT_FAILURE );
+}
+
+/**
+        This function gives every thread of a job its own record buffer.
+
+        @param job The job
+        @param threads The number of threads
+ */
+static void allocateBuffers( ContainerJob *job, int threads )
+{
+        job->buffers = ( byte ** ) malloc( threads * sizeof( byte * ) );
+        if ( job->buffers == NULL ) {
+                fprintf( stderr, "Out of memory\n" );
+                exit( EXIT_FAILURE );
+        }
+
+        int w = 0;
+        for ( w = 0; w < threads; w++ ) {
+                job->buffers[ w ] = allocateBuffer( job->chunkSize +
+                                CONTAINER_OVERHEAD );
+        }
+}
+
+/**
+        This function frees the record buffers of a job.
+
+        @param job The job
+        @param threads The number of threads
+ */
+static void freeBuffers( ContainerJob *job, int threads )
+{
+        int w = 0;
+        for ( w = 0; w < threads; w++ ) {
+                free( job->buffers[ w ] );
+        }
+
+        free( job->buffers );
+}
+
+/**
+        This pool task seals one chunk into its record.
+
+        @param arg The ContainerJob
+        @param worker The thread number, selecting the buffer
+        @param chunk The chunk number
+ */
+static void encryptTask( void *arg, int worker, size_t chunk )
+{
+        ContainerJob *job = ( ContainerJob * ) arg;
+        size_t length = chunkLength( job->chunkSize, job->plainSize, chunk );
+        byte *record = job->buffers[ worker ];
+        byte *text = record + GCM_IV_SIZE;
+        if ( readChunkAt( job->input, text, length,
+                        ( off_t ) chunk * job->chunkSize ) != length ) {
+                changedError( job->input->name );
+        }
+
+        // The chunk number is added to the low half of the nonce
+        memcpy( record, job->nonce, GCM_IV_SIZE );
+        uint64_t low = loadLittle( record + GCM_IV_SIZE - sizeof( uint64_t ),
+                        sizeof( uint64_t ) );
+        storeLittle( record + GCM_IV_SIZE - sizeof( uint64_t ), low + chunk,
+                        sizeof( uint64_t ) );
+
+        byte aad[ AAD_SIZE ];
+        chunkAad( aad, job->header, chunk );
+        gcmEncrypt( job->key, record, aad, AAD_SIZE, text, text, length,
+                        text + length );
+
+        off_t at = CONTAINER_HEADER_SIZE +
+                ( off_t ) chunk * ( job->chunkSize + CONTAINER_OVERHEAD );
+        writeChunkAt( job->output, record, length + CONTAINER_OVERHEAD, at );
+}
+
+void containerEncrypt( GcmKey const *key, byte const nonce[ GCM_IV_SIZE ],
+                        ChunkStream *input, char const *outputFile,
+                        int threads )
+{
+        ChunkStream output;
+        openChunkWriter( &output, outputFile );
+
+        byte header[ CONTAINER_HEADER_SIZE ] = { 0 };
+        memcpy( header, headerMagic, sizeof( headerMagic ) );
+        storeLittle( header + CHUNK_SIZE_AT, CONTAINER_CHUNK_SIZE,
+                        sizeof( uint32_t ) );
+        storeLittle( header + PLAIN_SIZE_AT, input->size, sizeof( uint64_t ) );
+        writeChunkAt( &output, header, CONTAINER_HEADER_SIZE, 0 );
+
+        ContainerJob job = { key, header, nonce, input, &output, NULL,
+                CONTAINER_CHUNK_SIZE, input->size };
+        size_t chunks = ( size_t ) ( ( job.plainSize + job.chunkSize - 1 ) /
+                        job.chunkSize );
+        if ( ( size_t ) threads > chunks ) {
+                threads = chunks > 0 ? ( int ) chunks : 1;
+        }
+
+        allocateBuffers( &job, threads );
+        runPool( chunks, threads, encryptTask, &job );
+        freeBuffers( &job, threads );
+
+        // The index and footer follow the last record
+        size_t indexSize = chunks * CONTAINER_ENTRY_SIZE + CONTAINER_FOOTER_SIZE;
+        byte *index = ( byte * ) calloc( indexSize, 1 );
+        if ( index == NULL ) {
+                fprintf( stderr, "Out of memory\n" );
+                exit( EXIT_FAILURE );
+        }
+
+        size_t c = 0;
+        uint64_t at = CONTAINER_HEADER_SIZE;
+        for ( c = 0; c < chunks; c++ ) {
+                size_t length = chunkLength( job.chunkSize, job.plainSize, c );
+                byte *entry = index + c * CONTAINER_ENTRY_SIZE;
+                storeLittle( entry, at, sizeof( uint64_t ) );
+                storeLittle( entry + sizeof( uint64_t ), length,
+                                sizeof( uint32_t ) );
+                at += length + CONTAINER_OVERHEAD;
+        }
+
+        byte *footer = index + chunks * CONTAINER_ENTRY_SIZE;
+        storeLittle( footer, chunks, sizeof( uint64_t ) );
+        memcpy( footer + sizeof( uint64_t ), footerMagic, sizeof( footerMagic ) );
+        writeChunkAt( &output, index, indexSize, ( off_t ) at );
+        free( index );
+
+        closeChunkStream( input );
+        closeChunkStream( &output );
+}
+
+bool containerOpen( Container *container, ChunkStream *input )
+{
+        container->input = input;
+        container->offsets = NULL;
+        byte footer[ CONTAINER_FOOTER_SIZE ];
+        if ( !input->regular ||
+             input->size < CONTAINER_HEADER_SIZE + CONTAINER_FOOTER_SIZE ||
+             readChunkAt( input, container->header, CONTAINER_HEADER_SIZE,
+                        0 ) != CONTAINER_HEADER_SIZE ||
+             readChunkAt( input, footer, CONTAINER_FOOTER_SIZE,
+                        input->size - CONTAINER_FOOTER_SIZE ) !=
+                        CONTAINER_FOOTER_SIZE ||
+             memcmp( container->header, headerMagic,
+                        sizeof( headerMagic ) ) != 0 ||
+             memcmp( footer + sizeof( uint64_t ), footerMagic,
+                        sizeof( footerMagic ) ) != 0 ) {
+                return false;
+        }
+
+        container->chunkSize = loadLittle( container->header + CHUNK_SIZE_AT,
+                        sizeof( uint32_t ) );
+        container->plainSize = loadLittle( container->header + PLAIN_SIZE_AT,
+                        sizeof( uint64_t ) );
+        uint64_t chunks = loadLittle( footer, sizeof( uint64_t ) );
+
+        // The chunk count must match the sizes, and the index fit the file
+        uint64_t room = input->size - CONTAINER_HEADER_SIZE -
+                CONTAINER_FOOTER_SIZE;
+        if ( container->chunkSize == 0 || chunks > room / CONTAINER_ENTRY_SIZE ||
+             chunks != ( container->plainSize + container->chunkSize - 1 ) /
+                        container->chunkSize ) {
+                return false;
+        }
+
+        container->chunks = ( size_t ) chunks;
+        size_t indexSize = container->chunks * CONTAINER_ENTRY_SIZE;
+        off_t indexAt = input->size - CONTAINER_FOOTER_SIZE - indexSize;
+        byte *index = ( byte * ) malloc( indexSize + 1 );
+        container->offsets = ( uint64_t * ) malloc( ( chunks + 1 ) *
+                        sizeof( uint64_t ) );
+        if ( index == NULL || container->offsets == NULL ) {
+                fprintf( stderr, "Out of memory\n" );
+                exit( EXIT_FAILURE );
+        }
+
+        bool ok = readChunkAt( input, index, indexSize, indexAt ) == indexSize;
+
+        // Every record must hold its whole chunk and lie before the index
+        size_t c = 0;
+        for ( c = 0; ok && c < container->chunks; c++ ) {
+                byte const *entry = index + c * CONTAINER_ENTRY_SIZE;
+                uint64_t at = loadLittle( entry, sizeof( uint64_t ) );
+                uint64_t length = loadLittle( entry + sizeof( uint64_t ),
+                                sizeof( uint32_t ) );
+                container->offsets[ c ] = at;
+                ok = length == chunkLength( container->chunkSize,
+                                container->plainSize, c ) &&
+                        at >= CONTAINER_HEADER_SIZE &&
+                        at <= ( uint64_t ) indexAt &&
+                        length + CONTAINER_OVERHEAD <= indexAt - at;
+        }
+
+        free( index );
+        if ( !ok ) {
+                containerClose( container );
+        }
+
+        return ok;
+}
+
+/**
+        This pool task opens one chunk and writes the part of it inside the
+        range.
+
+        @param arg The ContainerJob
+        @param worker The thread number, selecting the buffer
+        @param task The task number, counted from the first chunk
+ */
+static void decryptTask( void *arg, int worker, size_t task )
+{
+        ContainerJob *job = ( ContainerJob * ) arg;
+        size_t chunk = job->firstChunk + task;
+        size_t length = chunkLength( job->chunkSize, job->plainSize, chunk );
+        byte *record = job->buffers[ worker ];
+        byte *text = record + GCM_IV_SIZE;
+        if ( readChunkAt( job->input, record, length + CONTAINER_OVERHEAD,
+                        ( off_t ) job->offsets[ chunk ] ) !=
+                        length + CONTAINER_OVERHEAD ) {
+                changedError( job->input->name );
+        }
+
+        byte aad[ AAD_SIZE ];
+        chunkAad( aad, job->header, chunk );
+        if ( !gcmDecrypt( job->key, record, aad, AAD_SIZE, text, text, length,
+                        text + length ) ) {
+                __atomic_store_n( &job->failed, true, __ATOMIC_RELAXED );
+                return;
+        }
+
+        // Only the part of the chunk inside the range is written
+        uint64_t start = ( uint64_t ) chunk * job->chunkSize;
+        uint64_t end = start + length;
+        uint64_t from = start > job->rangeStart ? start : job->rangeStart;
+        uint64_t to = end < job->rangeEnd ? end : job->rangeEnd;
+        writeChunkAt( job->output, text + ( from - start ), to - from,
+                        ( off_t ) ( from - job->rangeStart ) );
+}
+
+bool containerDecrypt( Container const *container, GcmKey const *key,
+                        uint64_t offset, uint64_t length,
+                        char const *outputFile, int threads )
+{
+        ChunkStream output;
+        openChunkWriter( &output, outputFile );
+
+        ContainerJob job = { key, container->header, NULL, container->input,
+                &output, NULL, container->chunkSize, container->plainSize,
+                container->offsets, 0, offset, offset + length, false };
+        size_t tasks = 0;
+        if ( length > 0 ) {
+                job.firstChunk = offset / job.chunkSize;
+                tasks = ( offset + length - 1 ) / job.chunkSize + 1 -
+                        job.firstChunk;
+        }
+
+        if ( ( size_t ) threads > tasks ) {
+                threads = tasks > 0 ? ( int ) tasks : 1;
+        }
+
+        allocateBuffers( &job, threads );
+        runPool( tasks, threads, decryptTask, &job );
+        freeBuffers( &job, threads );
+
+        closeChunkStream( &output );
+        return !job.failed;
+}
+
+void containerClose( Container *container )
+{
+        free( container->offsets );
+        container->offsets = NULL;
+}
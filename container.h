@@ -0,0 +1,122 @@
+/**
+        @file container.h
+        @author James O Kocak (jokocak)
+
+        The header file for the container.c component of the program. This
+        component reads and writes a seekable container: the plaintext is
+        cut into fixed-size chunks, each sealed with AES-GCM under its own
+        nonce, so any range can be decrypted and authenticated by reading
+        only the chunks it overlaps. The file holds
+
+            a header of CONTAINER_HEADER_SIZE bytes: the magic bytes, the
+            chunk size and the plaintext size, all little-endian;
+            one record per chunk: its nonce, its ciphertext and its tag;
+            an index with one CONTAINER_ENTRY_SIZE entry per chunk, giving
+            where its record starts and how much plaintext it holds;
+            a footer of CONTAINER_FOOTER_SIZE bytes: the number of chunks
+            and the index magic bytes.
+
+        Every chunk authenticates the header and its own number as
+        additional data, so chunks can't be moved, dropped or swapped
+        between files without their tags failing.
+ */
+
+#ifndef _CONTAINER_H_
+#define _CONTAINER_H_
+
+#include "gcm.h"
+#include "io.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Bytes of plaintext in every chunk but the last. */
+#define CONTAINER_CHUNK_SIZE ( 1 << 14 )
+
+/** Number of bytes in the header. */
+#define CONTAINER_HEADER_SIZE 32
+
+/** Number of bytes in one index entry. */
+#define CONTAINER_ENTRY_SIZE 16
+
+/** Number of bytes in the footer. */
+#define CONTAINER_FOOTER_SIZE 16
+
+/** Bytes a record adds to its chunk's plaintext: the nonce and the tag. */
+#define CONTAINER_OVERHEAD ( GCM_IV_SIZE + GCM_TAG_SIZE )
+
+/** A container opened for decryption, its header and index read in. */
+typedef struct {
+        /** The container file. */
+        ChunkStream *input;
+
+        /** The header as stored, authenticated with every chunk. */
+        byte header[ CONTAINER_HEADER_SIZE ];
+
+        /** Bytes of plaintext in every chunk but the last. */
+        size_t chunkSize;
+
+        /** Total bytes of plaintext. */
+        uint64_t plainSize;
+
+        /** Number of chunks. */
+        size_t chunks;
+
+        /** Where each chunk's record starts in the file. */
+        uint64_t *offsets;
+} Container;
+
+#endif
+
+/**
+        This function encrypts a whole regular file into a container, the
+        chunks spread over a pool of threads. Chunk n is sealed under nonce
+        with n added to its last eight bytes, so nonce must be fresh for
+        every file encrypted with the key.
+
+        @param key The key
+        @param nonce The nonce of chunk zero
+        @param input The plaintext file, opened with openChunkReader
+        @param outputFile The container to write
+        @param threads The number of threads to use
+ */
+void containerEncrypt( GcmKey const *key, byte const nonce[ GCM_IV_SIZE ],
+                        ChunkStream *input, char const *outputFile,
+                        int threads );
+
+/**
+        This function reads a container's header, footer and index, and
+        checks that they agree with each other and the file's length. The
+        chunks themselves aren't read until containerDecrypt.
+
+        @param container The container to fill in
+        @param input The container file, opened with openChunkReader
+        @return False if the file isn't a well-formed container
+ */
+bool containerOpen( Container *container, ChunkStream *input );
+
+/**
+        This function decrypts length bytes of plaintext starting at offset,
+        reading, decrypting and authenticating only the chunks they overlap,
+        spread over a pool of threads. The range must lie within the
+        plaintext. The output holds just the range; if any chunk fails to
+        authenticate, what was written must be thrown away.
+
+        @param container The open container
+        @param key The key
+        @param offset Where the range starts in the plaintext
+        @param length The number of bytes in the range
+        @param outputFile The file to write the range to
+        @param threads The number of threads to use
+        @return False if any chunk wasn't authentic
+ */
+bool containerDecrypt( Container const *container, GcmKey const *key,
+                        uint64_t offset, uint64_t length,
+                        char const *outputFile, int threads );
+
+/**
+        This function frees the index of an open container.
+
+        @param container The container
+ */
+void containerClose( Container *container );
@@ -0,0 +1,164 @@
+/**
+        @file counters.c
+        @author James O Kocak (jokocak)
+
+        This component reads the processor's performance counters with the
+        perf_event_open system call, which has no glibc wrapper. The events
+        form one group, read all at once with their ids, and are scaled by
+        the time they were enabled over the time they actually ran.
+ */
+
+/** Exposes syscall under -std=c99. */
+#define _DEFAULT_SOURCE
+
+#include "counters.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+/**
+        Number of words before the values in a group read: the number of
+        events and the times enabled and running.
+ */
+#define READ_HEADER 3
+
+/**
+        Number of words in a group read: the header, then a value and an id
+        for each event.
+ */
+#define READ_WORDS ( READ_HEADER + 2 * COUNTER_COUNT )
+
+/** Each event's perf type, indexed by CounterEvent. */
+static uint32_t const eventTypes[ COUNTER_COUNT ] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+        PERF_TYPE_HARDWARE
+};
+
+/** Each event's perf configuration, indexed by CounterEvent. */
+static uint64_t const eventConfigs[ COUNTER_COUNT ] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+                PERF_COUNT_HW_CACHE_RESULT_MISS << 16,
+        PERF_COUNT_HW_BRANCH_MISSES
+};
+
+/** Names of the events, indexed by CounterEvent. */
+static char const *const eventNames[ COUNTER_COUNT ] = {
+        "cycles", "instructions", "l1dMisses", "branchMisses"
+};
+
+/**
+        This function opens one event for the calling thread on any
+        processor, counting user space only. Only the leader starts
+        disabled; the others follow it.
+
+        @param event The event
+        @param leader The group leader's descriptor, or -1 to lead
+        @return The descriptor, or -1 with errno set
+ */
+static int openEvent( CounterEvent event, int leader )
+{
+        struct perf_event_attr attr;
+        memset( &attr, 0, sizeof( attr ) );
+        attr.size = sizeof( attr );
+        attr.type = eventTypes[ event ];
+        attr.config = eventConfigs[ event ];
+        attr.disabled = leader < 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID |
+                PERF_FORMAT_TOTAL_TIME_ENABLED |
+                PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return ( int ) syscall( SYS_perf_event_open, &attr, 0, -1, leader, 0 );
+}
+
+bool countersOpen( Counters *counters )
+{
+        counters->leader = -1;
+        int firstError = 0;
+        int e = 0;
+        for ( e = 0; e < COUNTER_COUNT; e++ ) {
+                int fd = openEvent( ( CounterEvent ) e, counters->leader );
+                counters->fds[ e ] = fd;
+                if ( fd < 0 || ioctl( fd, PERF_EVENT_IOC_ID,
+                                      &counters->ids[ e ] ) != 0 ) {
+                        firstError = firstError != 0 ? firstError : errno;
+                        if ( fd >= 0 ) {
+                                close( fd );
+                                counters->fds[ e ] = -1;
+                        }
+
+                        continue;
+                }
+
+                if ( counters->leader < 0 ) {
+                        counters->leader = fd;
+                }
+        }
+
+        errno = counters->leader < 0 ? firstError : 0;
+        return counters->leader >= 0;
+}
+
+void countersStart( Counters *counters )
+{
+        ioctl( counters->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP );
+        ioctl( counters->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+}
+
+void countersStop( Counters *counters, CounterValues *values )
+{
+        ioctl( counters->leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP );
+        memset( values, 0, sizeof( *values ) );
+
+        uint64_t words[ READ_WORDS ];
+        ssize_t got = read( counters->leader, words, sizeof( words ) );
+        if ( got < ( ssize_t ) ( READ_HEADER * sizeof( uint64_t ) ) ) {
+                return;
+        }
+
+        // Counts that never ran can't be scaled; those that shared the
+        // processor with other groups are scaled up to the whole time
+        uint64_t enabled = words[ 1 ];
+        uint64_t running = words[ 2 ];
+        if ( running == 0 ) {
+                return;
+        }
+
+        double scale = ( double ) enabled / running;
+        uint64_t n = 0;
+        for ( n = 0; n < words[ 0 ] && n < COUNTER_COUNT; n++ ) {
+                uint64_t value = words[ READ_HEADER + 2 * n ];
+                uint64_t id = words[ READ_HEADER + 2 * n + 1 ];
+                int e = 0;
+                for ( e = 0; e < COUNTER_COUNT; e++ ) {
+                        if ( counters->fds[ e ] >= 0 &&
+                             counters->ids[ e ] == id ) {
+                                values->value[ e ] = value * scale;
+                                values->counted[ e ] = true;
+                        }
+                }
+        }
+}
+
+void countersClose( Counters *counters )
+{
+        int e = 0;
+        for ( e = 0; e < COUNTER_COUNT; e++ ) {
+                if ( counters->fds[ e ] >= 0 ) {
+                        close( counters->fds[ e ] );
+                        counters->fds[ e ] = -1;
+                }
+        }
+
+        counters->leader = -1;
+}
+
+char const *counterName( CounterEvent event )
+{
+        return eventNames[ event ];
+}
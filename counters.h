@@ -0,0 +1,105 @@
+/**
+        @file counters.h
+        @author James O Kocak (jokocak)
+
+        The header file for the counters.c component of the program. This
+        component reads the processor's performance counters through
+        perf_event_open, so the benchmark can say why a kernel is slow and
+        not just how slow: cycles, instructions retired, L1 data cache read
+        misses and mispredicted branches, counted in user space for the
+        calling thread only. The events are opened as one group so they
+        cover exactly the same stretch of code.
+ */
+
+#ifndef _COUNTERS_H_
+#define _COUNTERS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** The events counted. */
+typedef enum {
+        /**
+                Core clock cycles, which unlike the time-stamp counter follow
+                the processor's actual frequency.
+         */
+        COUNTER_CYCLES,
+
+        /** Instructions retired. */
+        COUNTER_INSTRUCTIONS,
+
+        /** Reads that missed the L1 data cache. */
+        COUNTER_L1D_MISSES,
+
+        /** Mispredicted branches. */
+        COUNTER_BRANCH_MISSES,
+
+        /** Number of events; not an event itself. */
+        COUNTER_COUNT
+} CounterEvent;
+
+/** The open counters of one thread. */
+typedef struct {
+        /** The descriptor of the group leader, or -1 if none opened. */
+        int leader;
+
+        /** Each event's descriptor, or -1 if it couldn't be opened. */
+        int fds[ COUNTER_COUNT ];
+
+        /** Each event's id, which matches values read from the group. */
+        uint64_t ids[ COUNTER_COUNT ];
+} Counters;
+
+/** What the counters read between countersStart and countersStop. */
+typedef struct {
+        /**
+                Each event's count, scaled up for any time the kernel had
+                the counters multiplexed away.
+         */
+        double value[ COUNTER_COUNT ];
+
+        /** Whether each event was counted at all. */
+        bool counted[ COUNTER_COUNT ];
+} CounterValues;
+
+#endif
+
+/**
+        This function opens whichever events the processor and kernel allow.
+        Virtual machines and containers often expose none, in which case
+        errno says why.
+
+        @param counters The counters to open
+        @return False if no event could be opened
+ */
+bool countersOpen( Counters *counters );
+
+/**
+        This function zeroes the counters and starts them.
+
+        @param counters The open counters
+ */
+void countersStart( Counters *counters );
+
+/**
+        This function stops the counters and reads them.
+
+        @param counters The open counters
+        @param values Where to store the counts
+ */
+void countersStop( Counters *counters, CounterValues *values );
+
+/**
+        This function closes the counters.
+
+        @param counters The counters to close
+ */
+void countersClose( Counters *counters );
+
+/**
+        This function returns a short name for an event.
+
+        @param event The event to name
+        @return The name of the event
+ */
+char const *counterName( CounterEvent event );
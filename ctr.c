@@ -0,0 +1,143 @@
+/**
+        @file ctr.c
+        @author James O Kocak (jokocak)
+
+        This component implements counter mode. Counter blocks are built a
+        batch at a time and encrypted with aesEncryptBlocks, so the hardware
+        and bitsliced backends work on many independent blocks at once.
+ */
+
+#include "ctr.h"
+#include <string.h>
+
+/** Number of bits in a byte. */
+#define BYTE_BITS 8
+
+/** Number of bytes in each half of a counter block. */
+#define HALF_SIZE 8
+
+/**
+        This function reads eight bytes as a big-endian number.
+
+        @param bytes The bytes to read
+        @return Their value
+ */
+static uint64_t loadBig( byte const bytes[ HALF_SIZE ] )
+{
+        uint64_t value = 0;
+        int i = 0;
+        for ( i = 0; i < HALF_SIZE; i++ ) {
+                value = value << BYTE_BITS | bytes[ i ];
+        }
+
+        return value;
+}
+
+/**
+        This function stores a number as eight big-endian bytes.
+
+        @param bytes Where to store the number
+        @param value The number to store
+ */
+static void storeBig( byte bytes[ HALF_SIZE ], uint64_t value )
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        // One byte swap instead of eight shifts, as this runs per block
+        value = __builtin_bswap64( value );
+        memcpy( bytes, &value, HALF_SIZE );
+#else
+        memcpy( bytes, &value, HALF_SIZE );
+#endif
+}
+
+void ctrAdvance( byte counter[ BLOCK_SIZE ], uint64_t blocks )
+{
+        uint64_t high = loadBig( counter );
+        uint64_t low = loadBig( counter + HALF_SIZE );
+
+        // The carry out of the low half goes into the high half
+        uint64_t sum = low + blocks;
+        if ( sum < low ) {
+                high++;
+        }
+
+        storeBig( counter, high );
+        storeBig( counter + HALF_SIZE, sum );
+}
+
+/**
+        This function XORs length bytes of keystream into in, storing the
+        result in out, a word at a time where it can.
+
+        @param in The bytes to transform
+        @param out Where to store the result
+        @param stream The keystream
+        @param length The number of bytes
+ */
+static void xorStream( byte const *in, byte *out, byte const *stream,
+                        size_t length )
+{
+        size_t i = 0;
+        for ( ; i + sizeof( uint64_t ) <= length; i += sizeof( uint64_t ) ) {
+                uint64_t a, b;
+                memcpy( &a, in + i, sizeof( a ) );
+                memcpy( &b, stream + i, sizeof( b ) );
+                a ^= b;
+                memcpy( out + i, &a, sizeof( a ) );
+        }
+
+        for ( ; i < length; i++ ) {
+                out[ i ] = in[ i ] ^ stream[ i ];
+        }
+}
+
+void ctrCrypt( AesContext const *ctx, byte const iv[ BLOCK_SIZE ],
+                        uint64_t offset, byte const *in, byte *out,
+                        size_t length )
+{
+        // The counter block for the block holding the first byte
+        byte counter[ BLOCK_SIZE ];
+        memcpy( counter, iv, BLOCK_SIZE );
+        ctrAdvance( counter, offset / BLOCK_SIZE );
+        uint64_t high = loadBig( counter );
+        uint64_t low = loadBig( counter + HALF_SIZE );
+        size_t skip = ( size_t ) ( offset % BLOCK_SIZE );
+
+        byte stream[ CTR_BATCH * BLOCK_SIZE ];
+        while ( length > 0 ) {
+                size_t blocks = ( skip + length + BLOCK_SIZE - 1 ) / BLOCK_SIZE;
+                if ( blocks > CTR_BATCH ) {
+                        blocks = CTR_BATCH;
+                }
+
+                size_t b = 0;
+                for ( b = 0; b < blocks; b++ ) {
+                        storeBig( stream + b * BLOCK_SIZE, high );
+                        storeBig( stream + b * BLOCK_SIZE + HALF_SIZE, low );
+                        if ( ++low == 0 ) {
+                                high++;
+                        }
+                }
+
+                aesEncryptBlocks( ctx, stream, stream, blocks );
+
+                // Only the first batch starts partway into a block
+                size_t count = blocks * BLOCK_SIZE - skip;
+                if ( count > length ) {
+                        count = length;
+                }
+
+                xorStream( in, out, stream + skip, count );
+                in += count;
+                out += count;
+                length -= count;
+                skip = 0;
+        }
+}
+
+void ctrChunk( void *arg, byte const *in, byte *out, size_t length,
+                        off_t offset )
+{
+        CtrKey const *key = ( CtrKey const * ) arg;
+        ctrCrypt( &key->ctx, key->iv, ( uint64_t ) offset, in, out, length );
+}
@@ -0,0 +1,79 @@
+/**
+        @file ctr.h
+        @author James O Kocak (jokocak)
+
+        The header file for the ctr.c component of the program. This
+        component implements counter (CTR) mode on top of the bulk block
+        functions in aes.c: a run of counter blocks is encrypted into
+        keystream, which is XORed with the data. Encryption and decryption
+        are the same operation, and any byte of the keystream can be
+        produced without the ones before it.
+ */
+
+#ifndef _CTR_H_
+#define _CTR_H_
+
+#include "aes.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+        Number of counter blocks encrypted per call to aesEncryptBlocks, so
+        every backend gets enough independent blocks to fill its lanes.
+ */
+#define CTR_BATCH 64
+
+/** A key and initial counter block, everything one CTR message needs. */
+typedef struct {
+        /** The expanded key. */
+        AesContext ctx;
+
+        /** The counter block for keystream offset zero. */
+        byte iv[ BLOCK_SIZE ];
+} CtrKey;
+
+#endif
+
+/**
+        This function adds a block count to a counter block, treating all
+        16 bytes as one big-endian number that wraps around.
+
+        @param counter The counter block to advance
+        @param blocks The number of blocks to advance it by
+ */
+void ctrAdvance( byte counter[ BLOCK_SIZE ], uint64_t blocks );
+
+/**
+        This function encrypts or decrypts length bytes from in to out in CTR
+        mode, starting offset bytes into the keystream. Block n of the
+        keystream is the encryption of iv plus n, so a caller may start at
+        any offset and pieces of one message may be handled in any order or
+        on different threads. in and out may be the same buffer but must not
+        otherwise overlap, and length need not be a multiple of BLOCK_SIZE.
+
+        @param ctx The expanded key
+        @param iv The initial counter block, for keystream offset zero
+        @param offset Where in the keystream in starts
+        @param in The bytes to transform
+        @param out Where to store the result
+        @param length The number of bytes in in
+ */
+void ctrCrypt( AesContext const *ctx, byte const iv[ BLOCK_SIZE ],
+                        uint64_t offset, byte const *in, byte *out,
+                        size_t length );
+
+/**
+        This function encrypts or decrypts one chunk of a file in CTR mode,
+        the chunk's offset in the file being its offset in the keystream. It
+        matches the pipeline's ChunkFunction, so chunks can be handled on any
+        thread and in any order.
+
+        @param arg The CtrKey
+        @param in The chunk's bytes
+        @param out Where to store the result
+        @param length The number of bytes in the chunk
+        @param offset Where the chunk starts in the file
+ */
+void ctrChunk( void *arg, byte const *in, byte *out, size_t length,
+                        off_t offset );
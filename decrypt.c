@@ -7,63 +7,111 @@
         and to write out the plaintext output.
  */
 
-// #include "io.c"
-// #include "aes.h"
-// #include "aes.c"
-// #include "field.c"
 #include "io.h"
 #include "aes.h"
+#include "cbc.h"
+#include "container.h"
+#include "ctr.h"
+#include "gcm.h"
+#include "xts.h"
+#include "options.h"
+#include "siv.h"
+#include "pipeline.h"
+#include "pool.h"
+#include "stats.h"
+#include <string.h>
 
-/** The minimum number of arguments */
-#define ARG_COUNT 4
-
-/** The index with which the input file resides in argv */
-#define INPUT_INDEX 2
-
-/** The index with which the key file resides in argv */
-#define KEY_INDEX 1
+/**
+        This function decrypts one chunk of the input. Every chunk holds whole
+        blocks, and ECB needs nothing from the chunk's position.
 
-/** The index with which the output file resides in argv */
-#define OUTPUT_INDEX 3
+        @param arg The expanded key
+        @param in The chunk to decrypt
+        @param out Where to store the result
+        @param length The number of bytes in the chunk
+        @param offset Where the chunk starts, unused
+ */
+static void decryptChunk( void *arg, byte const *in, byte *out,
+                        size_t length, off_t offset )
+{
+        aesDecryptBlocks( ( AesContext const * ) arg, in, out,
+                        length / BLOCK_SIZE );
+}
 
 /**
-        This function serves as a helper function when encrypting more than
-        one block of data.  It reads the index of the current block in
-        inputBytes into the block array from the startIndex to the endIndex.
-
-        @param inputBytes The entire array of bytes from input
-        @param block The array to read the current block into
-        @param startIndex The start index of the current block
-        @param endIndex The end index of the current block
+        This function moves authenticated plaintext from its private file to
+        the output file, or deletes it and exits if it wasn't authentic.
+
+        @param partialFile The private file holding the plaintext
+        @param outputFile The file to move it to
+        @param inputFile The ciphertext file, for the error message
+        @param authentic Whether the plaintext passed authentication
  */
-static void setBlock( byte *inputBytes, byte block[ BLOCK_SIZE ],
-                        int startIndex, int endIndex )
+static void publish( char *partialFile, char const *outputFile,
+                        char const *inputFile, bool authentic )
 {
-        int i;
-        int blockSize = 0;
-        for ( i = startIndex; i <= endIndex; i++ ) {
-                block[ blockSize++ ] = inputBytes[ i ];
+        if ( !authentic ) {
+                remove( partialFile );
+                fprintf( stderr, "Authentication failed: %s\n", inputFile );
+                exit( EXIT_FAILURE );
+        }
+
+        if ( rename( partialFile, outputFile ) != 0 ) {
+                remove( partialFile );
+                fprintf( stderr, "Can't write file: %s\n", outputFile );
+                exit( EXIT_FAILURE );
         }
+
+        free( partialFile );
 }
 
 /**
-        This function serves as a helper function when encrypting multiple
-        blocks of data. This function takes the block array and inserts its
-        contents back into the original inputBytes array after encryption.
-
-        @param inputBytes The entire array of bytes from input
-        @param block The array of encrypted data
-        @param startIndex The start index of the current block
-        @param endIndex The end index of the current block
+        This function decrypts a container, or just the range asked for, and
+        exits.
+
+        @param options The command line
+        @param stream The container file
+        @param keyBytes The 16-byte key
+        @param threads The number of threads to use
  */
-static void setBlockData( byte *inputBytes, byte block[ BLOCK_SIZE ],
-                                int startIndex, int endIndex )
+static void decryptContainer( Options const *options, ChunkStream *stream,
+                        byte *keyBytes, int threads )
 {
-        int i;
-        int blockSize = 0;
-        for ( i = startIndex; i <= endIndex; i++ ) {
-                inputBytes[ i ] = block[ blockSize++ ];
+        Container container;
+        if ( !containerOpen( &container, stream ) ) {
+                fprintf( stderr, "Bad container file: %s\n",
+                        options->inputFile );
+                exit( EXIT_FAILURE );
+        }
+
+        // Without a range, the whole plaintext is wanted
+        uint64_t offset = 0;
+        uint64_t length = container.plainSize;
+        if ( options->hasRange ) {
+                offset = options->rangeOffset;
+                length = options->rangeLength;
+                if ( offset > container.plainSize ||
+                     length > container.plainSize - offset ) {
+                        fprintf( stderr, "Range past end of file: %s\n",
+                                options->inputFile );
+                        exit( EXIT_FAILURE );
+                }
         }
+
+        uint64_t begin = statsBegin();
+        GcmKey key;
+        gcmInitKey( &key, keyBytes );
+        begin = statsEnd( STAGE_EXPAND_KEY, begin, BLOCK_SIZE );
+        char *partialFile = createSibling( options->outputFile );
+        bool authentic = containerDecrypt( &container, &key, offset, length,
+                        partialFile, threads );
+        statsEnd( STAGE_CIPHER, begin, length );
+        containerClose( &container );
+        closeChunkStream( stream );
+        publish( partialFile, options->outputFile, options->inputFile,
+                        authentic );
+        free( keyBytes );
+        exit( EXIT_SUCCESS );
 }
 
 /**
@@ -76,69 +124,177 @@ static void setBlockData( byte *inputBytes, byte block[ BLOCK_SIZE ],
  */
 int main( int argc, char *argv[] )
 {
-        // Checks if correct amount of args
-        if ( argc != ARG_COUNT ) {
+        // Checks if the arguments fit the usage
+        Options options;
+        if ( !parseOptions( &options, argc, argv ) ) {
                 fprintf( stderr,
-                        "usage: encrypt <key-file> <input-file> <output-file>\n" );
+                        "usage: decrypt [options] <key-file> <input-file> <output-file>\n" );
                 exit( EXIT_FAILURE );
         }
 
-        // Reads input file and key file
-        int inputSize;
-        byte *inputBytes = readBinaryFile( argv[ INPUT_INDEX ], &inputSize );
-        int keySize;
-        byte *keyBytes = readBinaryFile( argv[ KEY_INDEX ], &keySize );
+        // Times every stage from here on, if asked to
+        if ( options.stats ) {
+                statsEnable( options.statsFile );
+        }
 
-        // Checks if key is 16 bytes in length
-        if ( keySize != BLOCK_SIZE ) {
-                fprintf( stderr, "Bad key file: %s\n", argv[ KEY_INDEX ] );
-                exit( EXIT_FAILURE );
+        // Opens input file and reads key file
+        ChunkStream stream;
+        FileMapping mapping;
+        off_t inputSize;
+        if ( options.inPlace ) {
+                mapInPlace( &mapping, options.inputFile );
+                inputSize = mapping.size;
+        } else if ( options.useMap ) {
+                mapInput( &mapping, options.inputFile );
+                inputSize = mapping.size;
+        } else {
+                openChunkReader( &stream, options.inputFile,
+                                DEFAULT_CHUNK_SIZE );
+                inputSize = stream.size;
         }
 
-        // Checks if inputSize is a multiple of 16
-        if ( inputSize % BLOCK_SIZE != 0 ) {
-                fprintf( stderr, "Bad ciphertext file length: %s\n",
-                        argv[ INPUT_INDEX ] );
+        uint64_t begin = statsBegin();
+        size_t keySize;
+        byte *keyBytes = readBinaryFile( options.keyFile, &keySize );
+
+        // Checks if key is 16 bytes in length, two different keys for XTS,
+        // or two keys for SIV
+        size_t keyNeeded = options.mode == MODE_XTS ? XTS_KEY_SIZE :
+                options.mode == MODE_SIV ? SIV_KEY_SIZE : BLOCK_SIZE;
+        if ( keySize != keyNeeded || ( options.mode == MODE_XTS &&
+             memcmp( keyBytes, keyBytes + BLOCK_SIZE, BLOCK_SIZE ) == 0 ) ) {
+                fprintf( stderr, "Bad key file: %s\n", options.keyFile );
                 exit( EXIT_FAILURE );
         }
 
-        // Perform AES decryption
-        if ( inputSize == BLOCK_SIZE ) {
-                decryptBlock( inputBytes, keyBytes );
-        } else {
-                // Creates variable to get number of Blocks
-                int numBlocks = inputSize / BLOCK_SIZE;
-
-                // Sets beginning block indexes
-                int startIndex = 0;
-                int endIndex = BLOCK_SIZE - 1;
+        // Reads the IV, 12 bytes for GCM and a whole block otherwise
+        byte iv[ BLOCK_SIZE ];
+        if ( options.ivFile != NULL ) {
+                readIv( options.ivFile, iv, options.mode == MODE_GCM ?
+                                GCM_IV_SIZE : BLOCK_SIZE );
+        }
 
-                // Creates block for use in encryption
-                byte block[ BLOCK_SIZE ];
+        begin = statsEnd( STAGE_READ_KEY, begin, keySize );
 
-                // Encrypts each block of data
-                int i;
-                for ( i = 0; i < numBlocks; i++ ) {
-                        // Gets current block to encrypt
-                        setBlock( inputBytes, block, startIndex, endIndex );
+        // Uses every processor by default
+        int threads = options.jobs > 0 ? options.jobs : defaultThreadCount();
+        if ( options.mode == MODE_CONTAINER ) {
+                decryptContainer( &options, &stream, keyBytes, threads );
+        }
 
-                        // Encrypts the block
-                        decryptBlock( block, keyBytes );
+        // Every SIV record is checked before the plaintext is moved into place
+        if ( options.mode == MODE_SIV ) {
+                SivKey sivKey;
+                sivInitKey( &sivKey, keyBytes );
+                begin = statsEnd( STAGE_EXPAND_KEY, begin, keySize );
+                char *partialFile = createSibling( options.outputFile );
+                bool authentic = sivDecryptFile( &sivKey, &stream, partialFile,
+                                threads );
+                statsEnd( STAGE_CIPHER, begin, inputSize );
+                publish( partialFile, options.outputFile, options.inputFile,
+                                authentic );
+                free( keyBytes );
+                return EXIT_SUCCESS;
+        }
 
-                        // Sets the encrypted block in inputBytes array
-                        setBlockData( inputBytes, block, startIndex, endIndex );
+        // Expands the key once for every block
+        CtrKey key;
+        CbcKey cbcKey;
+        XtsKey xtsKey;
+        GcmKey gcmKey;
+        GcmMessage message;
+        ChunkFunction function = decryptChunk;
+        void *arg = &key.ctx;
+        size_t unit = BLOCK_SIZE;
+        bool lengthOk = inputSize % BLOCK_SIZE == 0;
+        char const *outputFile = options.outputFile;
+        char *partialFile = NULL;
+        byte tag[ GCM_TAG_SIZE ];
+        if ( options.mode == MODE_GCM ) {
+                // The tag is read first, from the end of the input
+                lengthOk = inputSize >= GCM_TAG_SIZE;
+                if ( lengthOk && options.useMap ) {
+                        memcpy( tag, mapping.data + inputSize - GCM_TAG_SIZE,
+                                GCM_TAG_SIZE );
+                } else if ( lengthOk ) {
+                        lengthOk = stream.regular &&
+                                readChunkAt( &stream, tag, GCM_TAG_SIZE,
+                                        inputSize - GCM_TAG_SIZE ) ==
+                                GCM_TAG_SIZE;
+                }
 
-                        // Moves to next block
-                        startIndex += BLOCK_SIZE;
-                        endIndex += BLOCK_SIZE;
+                gcmInitKey( &gcmKey, keyBytes );
+                lengthOk = lengthOk && gcmStart( &message, &gcmKey, iv, NULL,
+                                0, inputSize - GCM_TAG_SIZE );
+                function = gcmDecryptChunk;
+                arg = &message;
+                unit = 1;
+        } else if ( options.mode == MODE_XTS ) {
+                // Every chunk holds whole blocks, but not whole units
+                xtsInitKey( &xtsKey, keyBytes, options.unitSize );
+                function = xtsDecryptChunk;
+                arg = &xtsKey;
+        } else if ( options.mode == MODE_CBC ) {
+                // Each chunk reads the ciphertext block before it
+                if ( !options.useMap && !stream.regular ) {
+                        fprintf( stderr, "CBC needs a regular file: %s\n",
+                                options.inputFile );
+                        exit( EXIT_FAILURE );
                 }
+
+                memcpy( cbcKey.iv, iv, BLOCK_SIZE );
+                aesInitKey( &cbcKey.ctx, keyBytes );
+                cbcKey.mapped = options.useMap ? mapping.data : NULL;
+                cbcKey.input = &stream;
+                function = cbcDecryptChunk;
+                arg = &cbcKey;
+        } else if ( options.mode == MODE_CTR ) {
+                // CTR mode works on any number of bytes, not just whole blocks
+                memcpy( key.iv, iv, BLOCK_SIZE );
+                aesInitKey( &key.ctx, keyBytes );
+                function = ctrChunk;
+                arg = &key;
+                unit = 1;
+                lengthOk = true;
+        } else {
+                aesInitKey( &key.ctx, keyBytes );
         }
 
-        // Write out ciphertext output
-        writeBinaryFile( argv[ OUTPUT_INDEX ], inputBytes, inputSize );
+        statsEnd( STAGE_EXPAND_KEY, begin, keySize );
+
+        // Checks if the input size is a multiple of 16 in ECB, CBC and XTS mode
+        if ( !lengthOk ) {
+                fprintf( stderr, "Bad ciphertext file length: %s\n",
+                        options.inputFile );
+                exit( EXIT_FAILURE );
+        }
+
+        // Unverified plaintext goes to a private file beside the output
+        if ( options.mode == MODE_GCM ) {
+                partialFile = createSibling( options.outputFile );
+                outputFile = partialFile;
+        }
+
+        // Perform AES decryption on every block
+        if ( options.useMap ) {
+                pipelineMapped( &mapping, outputFile, threads,
+                                function, arg );
+        } else if ( options.useRing ) {
+                pipelineRing( &stream, outputFile, threads,
+                                unit, function, arg );
+        } else {
+                pipelineStream( &stream, outputFile, threads,
+                                unit, function, arg );
+        }
+
+        // Only authentic plaintext is moved to the output file
+        if ( partialFile != NULL ) {
+                truncateFile( partialFile, inputSize - GCM_TAG_SIZE );
+                publish( partialFile, options.outputFile, options.inputFile,
+                                gcmVerify( &message, tag ) );
+        }
 
         // Frees memory
-        free( inputBytes );
         free( keyBytes );
 
         // Returns successful exit status
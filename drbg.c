@@ -0,0 +1,134 @@
+/**
+        @file drbg.c
+        @author James O Kocak (jokocak)
+
+        This component implements CTR_DRBG. Every request is a run of CTR
+        keystream from V plus one, produced by ctrCrypt a batch at a time,
+        followed by the update function that derives the next key and V.
+ */
+
+#include "drbg.h"
+#include "ctr.h"
+#include "io.h"
+#include <string.h>
+
+/**
+        This function pads optional input out to seed material: its bytes,
+        then zeros.
+
+        @param material Where to store the seed material
+        @param input The input, or NULL
+        @param length Its length, at most DRBG_SEED_SIZE
+ */
+static void padInput( byte material[ DRBG_SEED_SIZE ], byte const *input,
+                        size_t length )
+{
+        memset( material, 0, DRBG_SEED_SIZE );
+        if ( input != NULL ) {
+                memcpy( material, input, length < DRBG_SEED_SIZE ? length :
+                                DRBG_SEED_SIZE );
+        }
+}
+
+/**
+        This function is CTR_DRBG_Update: two blocks of keystream from V
+        plus one are XORed with the provided data and become the new key
+        and V.
+
+        @param drbg The instance
+        @param provided DRBG_SEED_SIZE bytes of provided data
+ */
+static void update( Drbg *drbg, byte const provided[ DRBG_SEED_SIZE ] )
+{
+        byte temp[ DRBG_SEED_SIZE ];
+        memcpy( temp, provided, DRBG_SEED_SIZE );
+        ctrCrypt( &drbg->ctx, drbg->v, BLOCK_SIZE, temp, temp,
+                        DRBG_SEED_SIZE );
+
+        aesInitKey( &drbg->ctx, temp );
+        memcpy( drbg->v, temp + BLOCK_SIZE, BLOCK_SIZE );
+        memset( temp, 0, sizeof( temp ) );
+}
+
+void drbgInstantiate( Drbg *drbg, byte const entropy[ DRBG_SEED_SIZE ],
+                        byte const *personal, size_t personalLength )
+{
+        byte zero[ BLOCK_SIZE ] = { 0 };
+        aesInitKey( &drbg->ctx, zero );
+        memset( drbg->v, 0, BLOCK_SIZE );
+        drbg->reseedInterval = DRBG_RESEED_INTERVAL;
+        drbgReseed( drbg, entropy, personal, personalLength );
+}
+
+void drbgReseed( Drbg *drbg, byte const entropy[ DRBG_SEED_SIZE ],
+                        byte const *additional, size_t additionalLength )
+{
+        byte material[ DRBG_SEED_SIZE ];
+        padInput( material, additional, additionalLength );
+
+        int i = 0;
+        for ( i = 0; i < DRBG_SEED_SIZE; i++ ) {
+                material[ i ] ^= entropy[ i ];
+        }
+
+        update( drbg, material );
+        memset( material, 0, sizeof( material ) );
+        drbg->reseedCounter = 1;
+}
+
+bool drbgGenerate( Drbg *drbg, byte *out, size_t length,
+                        byte const *additional, size_t additionalLength )
+{
+        if ( drbg->reseedCounter > drbg->reseedInterval ||
+             length > DRBG_MAX_REQUEST ) {
+                return false;
+        }
+
+        byte material[ DRBG_SEED_SIZE ];
+        padInput( material, additional, additionalLength );
+        if ( additional != NULL ) {
+                update( drbg, material );
+        }
+
+        // The output is keystream, CTR mode over zeros, from V plus one
+        memset( out, 0, length );
+        ctrCrypt( &drbg->ctx, drbg->v, BLOCK_SIZE, out, out, length );
+        ctrAdvance( drbg->v, ( length + BLOCK_SIZE - 1 ) / BLOCK_SIZE );
+
+        update( drbg, material );
+        drbg->reseedCounter++;
+        return true;
+}
+
+void drbgRandom( Drbg *drbg, byte *out, size_t length )
+{
+        while ( length > 0 ) {
+                size_t request = length < DRBG_MAX_REQUEST ? length :
+                        DRBG_MAX_REQUEST;
+                if ( !drbgGenerate( drbg, out, request, NULL, 0 ) ) {
+                        byte entropy[ DRBG_SEED_SIZE ];
+                        randomBytes( entropy, DRBG_SEED_SIZE );
+                        drbgReseed( drbg, entropy, NULL, 0 );
+                        memset( entropy, 0, sizeof( entropy ) );
+                        continue;
+                }
+
+                out += request;
+                length -= request;
+        }
+}
+
+Drbg *drbgThread( void )
+{
+        static __thread Drbg drbg;
+        static __thread bool seeded = false;
+        if ( !seeded ) {
+                byte entropy[ DRBG_SEED_SIZE ];
+                randomBytes( entropy, DRBG_SEED_SIZE );
+                drbgInstantiate( &drbg, entropy, NULL, 0 );
+                memset( entropy, 0, sizeof( entropy ) );
+                seeded = true;
+        }
+
+        return &drbg;
+}
@@ -0,0 +1,107 @@
+/**
+        @file drbg.h
+        @author James O Kocak (jokocak)
+
+        The header file for the drbg.c component of the program. This
+        component implements CTR_DRBG from NIST SP 800-90A with AES-128 and
+        no derivation function: the state is a key and a counter block V,
+        output is the encryption of V plus one, plus two and so on, and the
+        key and V are replaced after every request so earlier output can't
+        be recovered from a captured state. Output comes from ctrCrypt's
+        batches, so it runs at the speed of the bulk block functions.
+ */
+
+#ifndef _DRBG_H_
+#define _DRBG_H_
+
+#include "aes.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Number of bytes of seed material: a key and a block, seedlen. */
+#define DRBG_SEED_SIZE ( 2 * BLOCK_SIZE )
+
+/** Most bytes one request may return, 2^19 bits. */
+#define DRBG_MAX_REQUEST 65536
+
+/**
+        Number of requests between reseeds. SP 800-90A allows up to 2^48;
+        a lower bound costs one getrandom call per 64 GiB at most.
+ */
+#define DRBG_RESEED_INTERVAL ( ( uint64_t ) 1 << 20 )
+
+/** The working state of one DRBG instance. */
+typedef struct {
+        /** The current key, expanded. */
+        AesContext ctx;
+
+        /** The counter block, V. */
+        byte v[ BLOCK_SIZE ];
+
+        /** Number of requests since the last seeding, starting at one. */
+        uint64_t reseedCounter;
+
+        /** Requests allowed before a reseed is required. */
+        uint64_t reseedInterval;
+} Drbg;
+
+#endif
+
+/**
+        This function instantiates a DRBG from full-entropy input and an
+        optional personalization string, which separates instances seeded
+        from the same entropy.
+
+        @param drbg The instance to fill in
+        @param entropy DRBG_SEED_SIZE bytes of entropy
+        @param personal The personalization string, or NULL
+        @param personalLength Its length, at most DRBG_SEED_SIZE
+ */
+void drbgInstantiate( Drbg *drbg, byte const entropy[ DRBG_SEED_SIZE ],
+                        byte const *personal, size_t personalLength );
+
+/**
+        This function mixes fresh entropy and optional additional input into
+        a DRBG and resets its reseed counter.
+
+        @param drbg The instance
+        @param entropy DRBG_SEED_SIZE bytes of entropy
+        @param additional Additional input, or NULL
+        @param additionalLength Its length, at most DRBG_SEED_SIZE
+ */
+void drbgReseed( Drbg *drbg, byte const entropy[ DRBG_SEED_SIZE ],
+                        byte const *additional, size_t additionalLength );
+
+/**
+        This function carries out one generate request.
+
+        @param drbg The instance
+        @param out Where to store the bytes
+        @param length The number of bytes, at most DRBG_MAX_REQUEST
+        @param additional Additional input, or NULL
+        @param additionalLength Its length, at most DRBG_SEED_SIZE
+        @return False, with nothing generated, if the instance must be
+                reseeded first or length is too large
+ */
+bool drbgGenerate( Drbg *drbg, byte *out, size_t length,
+                        byte const *additional, size_t additionalLength );
+
+/**
+        This function fills a buffer of any size with generate requests,
+        reseeding from the kernel's generator whenever the counter runs out.
+
+        @param drbg The instance
+        @param out Where to store the bytes
+        @param length The number of bytes
+ */
+void drbgRandom( Drbg *drbg, byte *out, size_t length );
+
+/**
+        This function returns the calling thread's own instance, seeded from
+        the kernel's generator the first time each thread asks, so threads
+        draw random bytes without sharing state or taking locks.
+
+        @return The thread's instance
+ */
+Drbg *drbgThread( void );
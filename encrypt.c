@@ -7,63 +7,35 @@
         and to write out the ciphertext output.
  */
 
-// #include "io.c"
-// #include "aes.h"
-// #include "aes.c"
-#include "field.c"
-#include "io.c"
-#include "aes.c"
-
-/** The minimum number of arguments */
-#define ARG_COUNT 4
-
-/** The index with which the input file resides in argv */
-#define INPUT_INDEX 2
-
-/** The index with which the key file resides in argv */
-#define KEY_INDEX 1
-
-/** The index with which the output file resides in argv */
-#define OUTPUT_INDEX 3
+#include "io.h"
+#include "aes.h"
+#include "cbc.h"
+#include "container.h"
+#include "ctr.h"
+#include "gcm.h"
+#include "xts.h"
+#include "options.h"
+#include "siv.h"
+#include "pipeline.h"
+#include "pool.h"
+#include "stats.h"
+#include <string.h>
 
 /**
-        This function serves as a helper function when encrypting more than
-        one block of data.  It reads the index of the current block in
-        inputBytes into the block array from the startIndex to the endIndex.
-
-        @param inputBytes The entire array of bytes from input
-        @param block The array to read the current block into
-        @param startIndex The start index of the current block
-        @param endIndex The end index of the current block
+        This function encrypts one chunk of the input. Every chunk holds whole
+        blocks, and ECB needs nothing from the chunk's position.
+
+        @param arg The expanded key
+        @param in The chunk to encrypt
+        @param out Where to store the result
+        @param length The number of bytes in the chunk
+        @param offset Where the chunk starts, unused
  */
-static void setBlock( byte *inputBytes, byte block[ BLOCK_SIZE ],
-                        int startIndex, int endIndex )
+static void encryptChunk( void *arg, byte const *in, byte *out,
+                        size_t length, off_t offset )
 {
-        int i;
-        int blockSize = 0;
-        for ( i = startIndex; i <= endIndex; i++ ) {
-                block[ blockSize++ ] = inputBytes[ i ];
-        }
-}
-
-/**
-        This function serves as a helper function when encrypting multiple
-        blocks of data. This function takes the block array and inserts its
-        contents back into the original inputBytes array after encryption.
-
-        @param inputBytes The entire array of bytes from input
-        @param block The array of encrypted data
-        @param startIndex The start index of the current block
-        @param endIndex The end index of the current block
- */
-static void setBlockData( byte *inputBytes, byte block[ BLOCK_SIZE ],
-                                int startIndex, int endIndex )
-{
-        int i;
-        int blockSize = 0;
-        for ( i = startIndex; i <= endIndex; i++ ) {
-                inputBytes[ i ] = block[ blockSize++ ];
-        }
+        aesEncryptBlocks( ( AesContext const * ) arg, in, out,
+                        length / BLOCK_SIZE );
 }
 
 /**
@@ -76,69 +48,177 @@ static void setBlockData( byte *inputBytes, byte block[ BLOCK_SIZE ],
  */
 int main( int argc, char *argv[] )
 {
-        // Checks if correct amount of args
-        if ( argc != ARG_COUNT ) {
+        // Checks if the arguments fit the usage
+        Options options;
+        if ( !parseOptions( &options, argc, argv ) || options.hasRange ) {
                 fprintf( stderr,
-                        "usage: encrypt <key-file> <input-file> <output-file>\n" );
+                        "usage: encrypt [options] <key-file> <input-file> <output-file>\n" );
                 exit( EXIT_FAILURE );
         }
 
-        // Reads input file and key file
-        int inputSize;
-        byte *inputBytes = readBinaryFile( argv[ INPUT_INDEX ], &inputSize );
-        int keySize;
-        byte *keyBytes = readBinaryFile( argv[ KEY_INDEX ], &keySize );
+        // Times every stage from here on, if asked to
+        if ( options.stats ) {
+                statsEnable( options.statsFile );
+        }
 
-        // Checks if key is 16 bytes in length
-        if ( keySize != BLOCK_SIZE ) {
-                fprintf( stderr, "Bad key file: %s\n", argv[ KEY_INDEX ] );
-                exit( EXIT_FAILURE );
+        // Opens input file and reads key file
+        ChunkStream stream;
+        FileMapping mapping;
+        off_t inputSize;
+        if ( options.inPlace ) {
+                mapInPlace( &mapping, options.inputFile );
+                inputSize = mapping.size;
+        } else if ( options.useMap ) {
+                mapInput( &mapping, options.inputFile );
+                inputSize = mapping.size;
+        } else {
+                openChunkReader( &stream, options.inputFile,
+                                DEFAULT_CHUNK_SIZE );
+                inputSize = stream.size;
         }
 
-        // Checks if inputSize is a multiple of 16
-        if ( inputSize % BLOCK_SIZE != 0 ) {
-                fprintf( stderr, "Bad plaintext file length: %s\n",
-                        argv[ INPUT_INDEX ] );
+        uint64_t begin = statsBegin();
+        size_t keySize;
+        byte *keyBytes = readBinaryFile( options.keyFile, &keySize );
+
+        // Checks if key is 16 bytes in length, two different keys for XTS,
+        // or two keys for SIV
+        size_t keyNeeded = options.mode == MODE_XTS ? XTS_KEY_SIZE :
+                options.mode == MODE_SIV ? SIV_KEY_SIZE : BLOCK_SIZE;
+        if ( keySize != keyNeeded || ( options.mode == MODE_XTS &&
+             memcmp( keyBytes, keyBytes + BLOCK_SIZE, BLOCK_SIZE ) == 0 ) ) {
+                fprintf( stderr, "Bad key file: %s\n", options.keyFile );
                 exit( EXIT_FAILURE );
         }
 
-        // Perform AES encryption
-        if ( inputSize == BLOCK_SIZE ) {
-                encryptBlock( inputBytes, keyBytes );
-        } else {
-                // Creates variable to get number of Blocks
-                int numBlocks = inputSize / BLOCK_SIZE;
+        // Reads the IV, 12 bytes for GCM and a whole block otherwise
+        byte iv[ BLOCK_SIZE ];
+        if ( options.ivFile != NULL ) {
+                readIv( options.ivFile, iv, options.mode == MODE_GCM ?
+                                GCM_IV_SIZE : BLOCK_SIZE );
+        }
 
-                // Sets beginning block indexes
-                int startIndex = 0;
-                int endIndex = BLOCK_SIZE - 1;
+        begin = statsEnd( STAGE_READ_KEY, begin, keySize );
 
-                // Creates block for use in encryption
-                byte block[ BLOCK_SIZE ];
+        // Uses every processor by default
+        int threads = options.jobs > 0 ? options.jobs : defaultThreadCount();
 
-                // Encrypts each block of data
-                int i;
-                for ( i = 0; i < numBlocks; i++ ) {
-                        // Gets current block to encrypt
-                        setBlock( inputBytes, block, startIndex, endIndex );
+        // A container seals each chunk on its own, under a fresh nonce
+        if ( options.mode == MODE_CONTAINER ) {
+                if ( !stream.regular ) {
+                        fprintf( stderr, "Container needs a regular file: %s\n",
+                                options.inputFile );
+                        exit( EXIT_FAILURE );
+                }
 
-                        // Encrypts the block
-                        encryptBlock( block, keyBytes );
+                GcmKey containerKey;
+                byte nonce[ GCM_IV_SIZE ];
+                gcmInitKey( &containerKey, keyBytes );
+                randomBytes( nonce, GCM_IV_SIZE );
+                begin = statsEnd( STAGE_EXPAND_KEY, begin, keySize );
+                containerEncrypt( &containerKey, nonce, &stream,
+                                options.outputFile, threads );
+                statsEnd( STAGE_CIPHER, begin, inputSize );
+                free( keyBytes );
+                return EXIT_SUCCESS;
+        }
 
-                        // Sets the encrypted block in inputBytes array
-                        setBlockData( inputBytes, block, startIndex, endIndex );
+        // Equal chunks must give equal records, so SIV takes no nonce
+        if ( options.mode == MODE_SIV ) {
+                SivKey sivKey;
+                sivInitKey( &sivKey, keyBytes );
+                begin = statsEnd( STAGE_EXPAND_KEY, begin, keySize );
+                sivEncryptFile( &sivKey, &stream, options.outputFile,
+                                threads );
+                statsEnd( STAGE_CIPHER, begin, inputSize );
+                free( keyBytes );
+                return EXIT_SUCCESS;
+        }
 
-                        // Moves to next block
-                        startIndex += BLOCK_SIZE;
-                        endIndex += BLOCK_SIZE;
+        // Expands the key once for every block
+        CtrKey key;
+        CbcChain cbcChain;
+        XtsKey xtsKey;
+        GcmKey gcmKey;
+        GcmMessage message;
+        ChunkFunction function = encryptChunk;
+        void *arg = &key.ctx;
+        size_t unit = BLOCK_SIZE;
+        bool lengthOk = inputSize % BLOCK_SIZE == 0;
+        bool serial = false;
+        if ( options.mode == MODE_GCM ) {
+                // The tag weighs every chunk by its distance from the end
+                if ( !options.useMap && !stream.regular ) {
+                        fprintf( stderr, "GCM needs a regular file: %s\n",
+                                options.inputFile );
+                        exit( EXIT_FAILURE );
                 }
+
+                gcmInitKey( &gcmKey, keyBytes );
+                lengthOk = gcmStart( &message, &gcmKey, iv, NULL, 0,
+                                inputSize );
+                function = gcmEncryptChunk;
+                arg = &message;
+                unit = 1;
+        } else if ( options.mode == MODE_XTS ) {
+                // Every chunk holds whole blocks, but not whole units
+                xtsInitKey( &xtsKey, keyBytes, options.unitSize );
+                function = xtsEncryptChunk;
+                arg = &xtsKey;
+        } else if ( options.mode == MODE_CBC ) {
+                // Each chunk continues the chain, so they go in order
+                memcpy( cbcChain.chain, iv, BLOCK_SIZE );
+                aesInitKey( &cbcChain.ctx, keyBytes );
+                function = cbcEncryptChunk;
+                arg = &cbcChain;
+                serial = true;
+        } else if ( options.mode == MODE_CTR ) {
+                // CTR mode works on any number of bytes, not just whole blocks
+                memcpy( key.iv, iv, BLOCK_SIZE );
+                aesInitKey( &key.ctx, keyBytes );
+                function = ctrChunk;
+                arg = &key;
+                unit = 1;
+                lengthOk = true;
+        } else {
+                aesInitKey( &key.ctx, keyBytes );
+        }
+
+        statsEnd( STAGE_EXPAND_KEY, begin, keySize );
+
+        // Checks if the input size is a multiple of 16 in ECB, CBC and XTS mode
+        if ( !lengthOk ) {
+                fprintf( stderr, "Bad plaintext file length: %s\n",
+                        options.inputFile );
+                exit( EXIT_FAILURE );
+        }
+
+        // Perform AES encryption on every block, on one thread if chained
+        if ( serial ) {
+                threads = 1;
         }
 
-        // Write out ciphertext output
-        writeBinaryFile( argv[ OUTPUT_INDEX ], inputBytes, inputSize );
+        if ( options.useMap ) {
+                pipelineMapped( &mapping, options.outputFile, threads,
+                                function, arg );
+        } else if ( options.useRing && !serial ) {
+                pipelineRing( &stream, options.outputFile, threads,
+                                unit, function, arg );
+        } else {
+                pipelineStream( &stream, options.outputFile, threads,
+                                unit, function, arg );
+        }
+
+        // The tag goes after the ciphertext
+        if ( options.mode == MODE_GCM ) {
+                byte tag[ GCM_TAG_SIZE ];
+                gcmFinish( &message, tag );
+                begin = statsBegin();
+                appendBinaryFile( options.outputFile, tag, GCM_TAG_SIZE );
+                statsEnd( STAGE_WRITE, begin, GCM_TAG_SIZE );
+        }
 
         // Frees memory
-        free( inputBytes );
         free( keyBytes );
 
         // Returns successful exit status
@@ -10,6 +10,7 @@
 #define _FIELD_H_
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <math.h>
 
 /** Type used for our field, an unsigned byte. */
@@ -18,6 +19,37 @@ typedef unsigned char byte;
 /** Number of bits in a byte. */
 #define BBITS 8
 
+/** Number of elements in the field. */
+#define FIELD_SIZE 256
+
+/** Ways fieldMul can compute a product, selected with fieldSetStrategy. */
+typedef enum {
+        /** Shift and exclusive or loop, reducing by the AES polynomial. */
+        FIELD_BITWISE,
+
+        /** Two logarithm lookups and one antilogarithm lookup. */
+        FIELD_LOG_TABLE,
+
+        /** A single lookup in a precomputed 256x256 product table. */
+        FIELD_FULL_TABLE
+} FieldStrategy;
+
+/** Number of bytes in an element of GF(2^128). */
+#define FIELD128_BYTES 16
+
+/**
+        An element of GF(2^128) with the bit order GCM uses: the first bit of
+        the first byte is the coefficient of x^0, so hi holds the first eight
+        bytes read big-endian and lo the last eight.
+ */
+typedef struct {
+        /** Coefficients of x^0 through x^63, x^0 in the top bit. */
+        uint64_t hi;
+
+        /** Coefficients of x^64 through x^127, x^64 in the top bit. */
+        uint64_t lo;
+} Field128;
+
 #endif
 
 /**
@@ -44,10 +76,84 @@ byte fieldSub( byte a, byte b );
 /**
         This function performs the multiplication operation in the 8-bit Galois
         field used by AES. Both a and b are multiplied and the result is
-        returned.
+        returned, using whichever strategy was chosen with fieldSetStrategy.
 
         @param a The first byte to multiply
         @param b The second byte to multiply
         @return The result of the multiplication of a and b
  */
 byte fieldMul( byte a, byte b );
+
+/**
+        This function multiplies a and b using the original shift and
+        exclusive or loop, regardless of the selected strategy. It serves as
+        the reference the table strategies are checked against.
+
+        @param a The first byte to multiply
+        @param b The second byte to multiply
+        @return The result of the multiplication of a and b
+ */
+byte fieldMulBitwise( byte a, byte b );
+
+/**
+        This function selects the strategy fieldMul uses from now on. Picking
+        FIELD_FULL_TABLE builds the 64 KB product table the first time it is
+        selected. The default strategy is FIELD_LOG_TABLE.
+
+        @param strategy The strategy to use for multiplication
+ */
+void fieldSetStrategy( FieldStrategy strategy );
+
+/**
+        This function returns the strategy fieldMul is currently using.
+
+        @return The current multiplication strategy
+ */
+FieldStrategy fieldGetStrategy( void );
+
+/**
+        This function reads a GF(2^128) element from its 16-byte form.
+
+        @param bytes The element's bytes
+        @return The element
+ */
+Field128 field128Load( byte const bytes[ FIELD128_BYTES ] );
+
+/**
+        This function writes a GF(2^128) element in its 16-byte form.
+
+        @param bytes Where to store the element's bytes
+        @param a The element
+ */
+void field128Store( byte bytes[ FIELD128_BYTES ], Field128 a );
+
+/**
+        This function multiplies a GF(2^128) element by x, reducing by the
+        GCM polynomial x^128 + x^7 + x^2 + x + 1. In GCM's bit order this is
+        a shift right by one.
+
+        @param a The element
+        @return a times x
+ */
+Field128 field128MulX( Field128 a );
+
+/**
+        This function multiplies two GF(2^128) elements with the shift and
+        exclusive or loop of NIST SP 800-38D. It is slow, and serves as the
+        reference the GHASH strategies are checked against.
+
+        @param a The first element to multiply
+        @param b The second element to multiply
+        @return The product of a and b
+ */
+Field128 field128Mul( Field128 a, Field128 b );
+
+/**
+        This function raises a GF(2^128) element to a power by repeated
+        squaring.
+
+        @param a The element
+        @param exponent The power, zero giving one
+        @return a to the given power
+ */
+Field128 field128Pow( Field128 a, uint64_t exponent );
@@ -6,11 +6,16 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 
 #include "field.h"
 
 /** Number of tests we should have, if they're all turned on. */
-#define EXPECTED_TOTAL 10
+#define EXPECTED_TOTAL 20
+
+/** Number of times each strategy multiplies every pair in the benchmark. */
+#define BENCH_PASSES 8
 
 /** Total number or tests we tried. */
 static int totalTests = 0;
@@ -80,6 +85,90 @@ int main()
     TestCase( c == 0xF3 );
   }
 
+  ////////////////////////////////////////////////////////////////////////
+  // Test every fieldMul() strategy against the bitwise routine
+
+  {
+    static const FieldStrategy strategies[] =
+      { FIELD_BITWISE, FIELD_LOG_TABLE, FIELD_FULL_TABLE };
+    int count = sizeof( strategies ) / sizeof( strategies[ 0 ] );
+
+    TestCase( fieldGetStrategy() == FIELD_LOG_TABLE );
+
+    for ( int s = 0; s < count; s++ ) {
+      fieldSetStrategy( strategies[ s ] );
+      TestCase( fieldGetStrategy() == strategies[ s ] );
+
+      int mismatches = 0;
+      for ( int a = 0; a < FIELD_SIZE; a++ )
+        for ( int b = 0; b < FIELD_SIZE; b++ )
+          if ( fieldMul( a, b ) != fieldMulBitwise( a, b ) )
+            mismatches += 1;
+      TestCase( mismatches == 0 );
+    }
+
+    fieldSetStrategy( FIELD_LOG_TABLE );
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // Test the GF(2^128) functions: one is the identity, multiplying by x
+  // agrees with field128MulX, and powers are repeated products
+
+  {
+    byte bytes[ FIELD128_BYTES ] = {
+      0x66, 0xE9, 0x4B, 0xD4, 0xEF, 0x8A, 0x2C, 0x3B,
+      0x88, 0x4C, 0xFA, 0x59, 0xCA, 0x34, 0x2B, 0x2E };
+    Field128 a = field128Load( bytes );
+    Field128 one = { 0x8000000000000000ULL, 0 };
+    Field128 x = { 0x4000000000000000ULL, 0 };
+
+    byte stored[ FIELD128_BYTES ];
+    Field128 product = field128Mul( a, one );
+    field128Store( stored, product );
+    TestCase( memcmp( stored, bytes, FIELD128_BYTES ) == 0 );
+
+    Field128 shifted = field128MulX( a );
+    product = field128Mul( x, a );
+    TestCase( product.hi == shifted.hi && product.lo == shifted.lo );
+
+    Field128 cube = field128Pow( a, 3 );
+    product = field128Mul( field128Mul( a, a ), a );
+    TestCase( product.hi == cube.hi && product.lo == cube.lo );
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // Microbenchmark of the fieldMul() strategies (informational only)
+
+  {
+    static const FieldStrategy strategies[] =
+      { FIELD_BITWISE, FIELD_LOG_TABLE, FIELD_FULL_TABLE };
+    static const char *names[] = { "bitwise", "log table", "full table" };
+    int count = sizeof( strategies ) / sizeof( strategies[ 0 ] );
+
+    for ( int s = 0; s < count; s++ ) {
+      fieldSetStrategy( strategies[ s ] );
+
+      // Accumulate the products so the loop can't be optimized away.
+      volatile byte sink = 0;
+      byte acc = 0;
+      clock_t start = clock();
+      for ( int p = 0; p < BENCH_PASSES; p++ )
+        for ( int a = 0; a < FIELD_SIZE; a++ )
+          for ( int b = 0; b < FIELD_SIZE; b++ )
+            acc ^= fieldMul( a, b ^ acc );
+      clock_t end = clock();
+      sink = acc;
+      (void) sink;
+
+      double seconds = ( double ) ( end - start ) / CLOCKS_PER_SEC;
+      double calls = ( double ) BENCH_PASSES * FIELD_SIZE * FIELD_SIZE;
+      printf( "fieldMul %-10s %8.2f ns/call\n", names[ s ],
+              seconds * 1e9 / calls );
+    }
+
+    fieldSetStrategy( FIELD_LOG_TABLE );
+  }
+
   // Once you move the #ifdef DISABLE_TESTS to here, you've enabled
   // all the tests.
 #ifdef DISABLE_TESTS
@@ -0,0 +1,256 @@
+/**
+        @file gcm.c
+        @author James O Kocak (jokocak)
+
+        This component implements AES-GCM. Data is handled a CTR_BATCH of
+        blocks at a time: the keystream for the batch is generated and
+        applied, and the batch's ciphertext is hashed while it is still in
+        the cache, so the data is only streamed through memory once.
+ */
+
+#include "gcm.h"
+#include "ctr.h"
+#include <string.h>
+
+/** Number of bits in a byte. */
+#define BYTE_BITS 8
+
+/**
+        This function absorbs bytes into a running hash. The bytes start
+        phase bytes into a block, and the rest of the first and last block
+        count as zeros, so pieces that share a block each hash only their
+        own part of it.
+
+        @param key The hash key
+        @param state The running hash
+        @param data The bytes to absorb
+        @param length The number of bytes in data
+        @param phase Where in its block the first byte is
+ */
+static void hashBytes( GhashKey const *key, byte state[ GHASH_BLOCK ],
+                        byte const *data, size_t length, size_t phase )
+{
+        byte block[ GHASH_BLOCK ];
+        if ( length == 0 ) {
+                return;
+        }
+
+        if ( phase != 0 || length < GHASH_BLOCK ) {
+                size_t take = GHASH_BLOCK - phase;
+                if ( take > length ) {
+                        take = length;
+                }
+
+                memset( block, 0, GHASH_BLOCK );
+                memcpy( block + phase, data, take );
+                ghashUpdate( key, state, block, 1 );
+                data += take;
+                length -= take;
+        }
+
+        size_t blocks = length / GHASH_BLOCK;
+        ghashUpdate( key, state, data, blocks );
+        data += blocks * GHASH_BLOCK;
+        length -= blocks * GHASH_BLOCK;
+
+        if ( length > 0 ) {
+                memset( block, 0, GHASH_BLOCK );
+                memcpy( block, data, length );
+                ghashUpdate( key, state, block, 1 );
+        }
+}
+
+/**
+        This function encrypts or decrypts one piece of a message and adds
+        its share of the hash to the message's sum. A piece ending at block
+        j hashes to the sum of C_i H^( j - i + 1 ) over its blocks, and
+        multiplying that by H^( n - 1 - j ), n being the message's block
+        count, gives the terms those blocks contribute to the full GHASH
+        before its final multiplication by H, which gcmFinish does with the
+        length block.
+
+        @param message The message
+        @param in The piece's bytes
+        @param out Where to store the result
+        @param length The number of bytes in the piece
+        @param offset Where the piece starts in the message
+        @param decrypting Whether in holds the ciphertext to hash
+ */
+static void cryptPiece( GcmMessage *message, byte const *in, byte *out,
+                        size_t length, uint64_t offset, bool decrypting )
+{
+        // Anything past the message, like a stored tag, passes through
+        size_t inside = offset >= message->length ? 0 :
+                message->length - offset < length ?
+                ( size_t ) ( message->length - offset ) : length;
+        if ( inside < length && in != out ) {
+                memcpy( out + inside, in + inside, length - inside );
+        }
+
+        if ( inside == 0 ) {
+                return;
+        }
+
+        GcmKey const *key = message->key;
+        byte state[ GHASH_BLOCK ] = { 0 };
+        size_t done = 0;
+        while ( done < inside ) {
+                // Batches after the first start on a block boundary
+                size_t phase = ( size_t ) ( ( offset + done ) % BLOCK_SIZE );
+                size_t step = CTR_BATCH * BLOCK_SIZE - phase;
+                if ( step > inside - done ) {
+                        step = inside - done;
+                }
+
+                if ( decrypting ) {
+                        hashBytes( &key->ghash, state, in + done, step, phase );
+                }
+
+                ctrCrypt( &key->ctx, message->counter, offset + done,
+                                in + done, out + done, step );
+                if ( !decrypting ) {
+                        hashBytes( &key->ghash, state, out + done, step,
+                                        phase );
+                }
+
+                done += step;
+        }
+
+        uint64_t blocks = ( message->length + BLOCK_SIZE - 1 ) / BLOCK_SIZE;
+        uint64_t last = ( offset + inside - 1 ) / BLOCK_SIZE;
+        Field128 share = field128Mul( field128Load( state ),
+                        field128Pow( key->ghash.h, blocks - 1 - last ) );
+
+        // Addition is exclusive or, so pieces may add in any order
+        __atomic_fetch_xor( &message->sum[ 0 ], share.hi, __ATOMIC_RELAXED );
+        __atomic_fetch_xor( &message->sum[ 1 ], share.lo, __ATOMIC_RELAXED );
+}
+
+void gcmInitKey( GcmKey *key, byte const keyBytes[ BLOCK_SIZE ] )
+{
+        aesInitKey( &key->ctx, keyBytes );
+
+        byte h[ GHASH_BLOCK ] = { 0 };
+        aesEncryptWithContext( &key->ctx, h );
+        ghashInit( &key->ghash, h );
+}
+
+bool gcmStart( GcmMessage *message, GcmKey const *key,
+                        byte const iv[ GCM_IV_SIZE ], byte const *aad,
+                        size_t aadLength, uint64_t length )
+{
+        if ( length > GCM_MAX_BYTES ) {
+                return false;
+        }
+
+        // A 96-bit IV is followed by a 32-bit count starting at one
+        message->key = key;
+        memset( message->mask, 0, GCM_TAG_SIZE );
+        memcpy( message->mask, iv, GCM_IV_SIZE );
+        message->mask[ GCM_TAG_SIZE - 1 ] = 1;
+        memcpy( message->counter, message->mask, BLOCK_SIZE );
+        ctrAdvance( message->counter, 1 );
+        aesEncryptWithContext( &key->ctx, message->mask );
+
+        memset( message->aadHash, 0, GHASH_BLOCK );
+        hashBytes( &key->ghash, message->aadHash, aad, aadLength, 0 );
+        message->aadLength = aadLength;
+        message->length = length;
+        message->sum[ 0 ] = message->sum[ 1 ] = 0;
+        return true;
+}
+
+void gcmEncryptPiece( GcmMessage *message, byte const *in, byte *out,
+                        size_t length, uint64_t offset )
+{
+        cryptPiece( message, in, out, length, offset, false );
+}
+
+void gcmDecryptPiece( GcmMessage *message, byte const *in, byte *out,
+                        size_t length, uint64_t offset )
+{
+        cryptPiece( message, in, out, length, offset, true );
+}
+
+void gcmFinish( GcmMessage const *message, byte tag[ GCM_TAG_SIZE ] )
+{
+        // The data hash comes after the AAD, so the AAD's terms move up
+        GhashKey const *ghash = &message->key->ghash;
+        uint64_t blocks = ( message->length + BLOCK_SIZE - 1 ) / BLOCK_SIZE;
+        Field128 s = field128Mul( field128Load( message->aadHash ),
+                        field128Pow( ghash->h, blocks ) );
+        s.hi ^= message->sum[ 0 ];
+        s.lo ^= message->sum[ 1 ];
+
+        // The last block holds both lengths in bits
+        byte lengths[ GHASH_BLOCK ];
+        Field128 bits = { message->aadLength * BYTE_BITS,
+                message->length * BYTE_BITS };
+        field128Store( lengths, bits );
+        field128Store( tag, s );
+        ghashUpdate( ghash, tag, lengths, 1 );
+
+        int i = 0;
+        for ( i = 0; i < GCM_TAG_SIZE; i++ ) {
+                tag[ i ] ^= message->mask[ i ];
+        }
+}
+
+bool gcmVerify( GcmMessage const *message, byte const tag[ GCM_TAG_SIZE ] )
+{
+        byte expected[ GCM_TAG_SIZE ];
+        gcmFinish( message, expected );
+
+        // Looks at every byte so timing doesn't show where they differ
+        byte difference = 0;
+        int i = 0;
+        for ( i = 0; i < GCM_TAG_SIZE; i++ ) {
+                difference |= expected[ i ] ^ tag[ i ];
+        }
+
+        return difference == 0;
+}
+
+void gcmEncrypt( GcmKey const *key, byte const iv[ GCM_IV_SIZE ],
+                        byte const *aad, size_t aadLength, byte const *in,
+                        byte *out, size_t length, byte tag[ GCM_TAG_SIZE ] )
+{
+        GcmMessage message;
+        gcmStart( &message, key, iv, aad, aadLength, length );
+        gcmEncryptPiece( &message, in, out, length, 0 );
+        gcmFinish( &message, tag );
+}
+
+bool gcmDecrypt( GcmKey const *key, byte const iv[ GCM_IV_SIZE ],
+                        byte const *aad, size_t aadLength, byte const *in,
+                        byte *out, size_t length,
+                        byte const tag[ GCM_TAG_SIZE ] )
+{
+        GcmMessage message;
+        if ( !gcmStart( &message, key, iv, aad, aadLength, length ) ) {
+                return false;
+        }
+
+        gcmDecryptPiece( &message, in, out, length, 0 );
+        if ( !gcmVerify( &message, tag ) ) {
+                memset( out, 0, length );
+                return false;
+        }
+
+        return true;
+}
+
+void gcmEncryptChunk( void *arg, byte const *in, byte *out,
+                        size_t length, off_t offset )
+{
+        // The message is only shared for its sum, which is added atomically
+        gcmEncryptPiece( ( GcmMessage * ) arg, in, out, length,
+                        ( uint64_t ) offset );
+}
+
+void gcmDecryptChunk( void *arg, byte const *in, byte *out,
+                        size_t length, off_t offset )
+{
+        gcmDecryptPiece( ( GcmMessage * ) arg, in, out, length,
+                        ( uint64_t ) offset );
+}
@@ -0,0 +1,202 @@
+/**
+        @file gcm.h
+        @author James O Kocak (jokocak)
+
+        The header file for the gcm.c component of the program. This
+        component implements AES-GCM authenticated encryption: CTR mode for
+        confidentiality and GHASH over the ciphertext for the tag, both done
+        in the same pass over the data.
+ */
+
+#ifndef _GCM_H_
+#define _GCM_H_
+
+#include "aes.h"
+#include "ghash.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/** Number of bytes in a GCM IV, the only length this component accepts. */
+#define GCM_IV_SIZE 12
+
+/** Number of bytes in a GCM tag. */
+#define GCM_TAG_SIZE 16
+
+/** Longest message one IV may encrypt, 2^39 - 256 bits. */
+#define GCM_MAX_BYTES ( ( ( uint64_t ) 1 << 36 ) - 32 )
+
+/** An expanded key: the AES context and the GHASH key derived from it. */
+typedef struct {
+        /** The expanded AES key. */
+        AesContext ctx;
+
+        /** The hash key, the encryption of a zero block. */
+        GhashKey ghash;
+} GcmKey;
+
+/**
+        One message being encrypted or decrypted. The message may be handled
+        as pieces, in any order and on any number of threads: each piece
+        hashes its own ciphertext and adds its share of the hash into sum,
+        weighted by how far it is from the end of the message.
+ */
+typedef struct {
+        /** The key. */
+        GcmKey const *key;
+
+        /** The first counter block used for data. */
+        byte counter[ BLOCK_SIZE ];
+
+        /** The encryption of the IV's own counter block, masking the tag. */
+        byte mask[ GCM_TAG_SIZE ];
+
+        /** GHASH of the additional authenticated data on its own. */
+        byte aadHash[ GHASH_BLOCK ];
+
+        /** Number of bytes of additional authenticated data. */
+        uint64_t aadLength;
+
+        /** Number of bytes in the message. */
+        uint64_t length;
+
+        /** Sum of every piece's share of the hash, as hi and lo words. */
+        uint64_t sum[ 2 ];
+} GcmMessage;
+
+#endif
+
+/**
+        This function expands a key and derives its GHASH key.
+
+        @param key The key to fill in
+        @param keyBytes The 16-byte AES key
+ */
+void gcmInitKey( GcmKey *key, byte const keyBytes[ BLOCK_SIZE ] );
+
+/**
+        This function starts a message of a known length.
+
+        @param message The message to fill in
+        @param key The key, which must outlive the message
+        @param iv The 12-byte IV, never to be reused with this key
+        @param aad Additional data to authenticate but not encrypt
+        @param aadLength The number of bytes in aad
+        @param length The number of bytes the message will hold
+        @return False if length is over GCM_MAX_BYTES
+ */
+bool gcmStart( GcmMessage *message, GcmKey const *key,
+                        byte const iv[ GCM_IV_SIZE ], byte const *aad,
+                        size_t aadLength, uint64_t length );
+
+/**
+        This function encrypts one piece of a message from in to out, which
+        may be the same buffer, and hashes the ciphertext. Every byte of the
+        message must be encrypted exactly once before gcmFinish. Bytes past
+        the end of the message are copied through unchanged.
+
+        @param message The message
+        @param in The piece's plaintext
+        @param out Where to store its ciphertext
+        @param length The number of bytes in the piece
+        @param offset Where the piece starts in the message
+ */
+void gcmEncryptPiece( GcmMessage *message, byte const *in, byte *out,
+                        size_t length, uint64_t offset );
+
+/**
+        This function hashes one piece of ciphertext and decrypts it from in
+        to out, like gcmEncryptPiece. The plaintext must not be used until
+        gcmVerify has accepted the whole message.
+
+        @param message The message
+        @param in The piece's ciphertext
+        @param out Where to store its plaintext
+        @param length The number of bytes in the piece
+        @param offset Where the piece starts in the message
+ */
+void gcmDecryptPiece( GcmMessage *message, byte const *in, byte *out,
+                        size_t length, uint64_t offset );
+
+/**
+        This function computes the tag once every piece has been handled.
+
+        @param message The message
+        @param tag Where to store the tag
+ */
+void gcmFinish( GcmMessage const *message, byte tag[ GCM_TAG_SIZE ] );
+
+/**
+        This function checks a received tag against the message's, taking the
+        same time wherever they differ.
+
+        @param message The message, every piece handled
+        @param tag The tag that came with the ciphertext
+        @return True if the tags match
+ */
+bool gcmVerify( GcmMessage const *message, byte const tag[ GCM_TAG_SIZE ] );
+
+/**
+        This function encrypts a whole message in one call.
+
+        @param key The key
+        @param iv The 12-byte IV
+        @param aad Additional data to authenticate
+        @param aadLength The number of bytes in aad
+        @param in The plaintext
+        @param out Where to store the ciphertext, possibly in
+        @param length The number of bytes in in, at most GCM_MAX_BYTES
+        @param tag Where to store the tag
+ */
+void gcmEncrypt( GcmKey const *key, byte const iv[ GCM_IV_SIZE ],
+                        byte const *aad, size_t aadLength, byte const *in,
+                        byte *out, size_t length, byte tag[ GCM_TAG_SIZE ] );
+
+/**
+        This function decrypts and verifies a whole message in one call. If
+        the tag doesn't match, out is cleared so no unauthenticated plaintext
+        escapes.
+
+        @param key The key
+        @param iv The 12-byte IV
+        @param aad Additional data to authenticate
+        @param aadLength The number of bytes in aad
+        @param in The ciphertext
+        @param out Where to store the plaintext, possibly in
+        @param length The number of bytes in in
+        @param tag The tag that came with the ciphertext
+        @return False if the message isn't authentic
+ */
+bool gcmDecrypt( GcmKey const *key, byte const iv[ GCM_IV_SIZE ],
+                        byte const *aad, size_t aadLength, byte const *in,
+                        byte *out, size_t length,
+                        byte const tag[ GCM_TAG_SIZE ] );
+
+/**
+        This function encrypts one chunk of a file, matching the pipeline's
+        ChunkFunction. The argument is a GcmMessage, whose sum every chunk
+        adds to.
+
+        @param arg The GcmMessage
+        @param in The chunk's bytes
+        @param out Where to store the result
+        @param length The number of bytes in the chunk
+        @param offset Where the chunk starts in the file
+ */
+void gcmEncryptChunk( void *arg, byte const *in, byte *out,
+                        size_t length, off_t offset );
+
+/**
+        This function decrypts one chunk of a file, matching the pipeline's
+        ChunkFunction. A tag stored after the ciphertext is copied through
+        and left for the caller to cut off.
+
+        @param arg The GcmMessage
+        @param in The chunk's bytes
+        @param out Where to store the result
+        @param length The number of bytes in the chunk
+        @param offset Where the chunk starts in the file
+ */
+void gcmDecryptChunk( void *arg, byte const *in, byte *out,
+                        size_t length, off_t offset );
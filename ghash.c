@@ -0,0 +1,246 @@
+/**
+        @file ghash.c
+        @author James O Kocak (jokocak)
+
+        This component computes GHASH. The table strategies use Shoup's
+        method: the element is consumed a nibble or a byte at a time, from
+        the highest powers of x down, multiplying the running product by x^4
+        or x^8 between lookups. The multiplication by x^k shifts bits out of
+        the bottom, and a small table, shared by every key, folds them back
+        in reduced.
+ */
+
+#include "ghash.h"
+#include "clmul.h"
+#include <string.h>
+
+/** Number of bits in a nibble. */
+#define NIBBLE_BITS 4
+
+/** Mask selecting the low nibble of a byte. */
+#define NIBBLE_MASK 0x0F
+
+/** Number of bits in each half of an element. */
+#define HALF_BITS 64
+
+/** Whether the reduction tables have been filled in yet. */
+static bool reductionReady = false;
+
+/** What the four bits shifted out by a multiply by x^4 reduce to. */
+static uint64_t reduce4[ TABLE4_SIZE ];
+
+/** What the eight bits shifted out by a multiply by x^8 reduce to. */
+static uint64_t reduce8[ TABLE8_SIZE ];
+
+/**
+        This function fills in the reduction tables. Bits shifted out of the
+        bottom of an element are all that is left of it after the shift, so
+        multiplying an element holding only those bits gives their
+        reduction.
+ */
+static void buildReduction( void )
+{
+        int r = 0;
+        int i = 0;
+        for ( r = 0; r < TABLE8_SIZE; r++ ) {
+                Field128 a = { 0, ( uint64_t ) r };
+                for ( i = 0; i < BBITS; i++ ) {
+                        a = field128MulX( a );
+
+                        // Four shifts are enough for a nibble
+                        if ( i == NIBBLE_BITS - 1 && r < TABLE4_SIZE ) {
+                                reduce4[ r ] = a.hi;
+                        }
+                }
+
+                reduce8[ r ] = a.hi;
+        }
+
+        reductionReady = true;
+}
+
+/**
+        This function fills in a table of the multiples of H by every value
+        of bits bits, the top bit of the value standing for x^0.
+
+        @param table The table to fill in, 2^bits entries
+        @param h The hash key
+        @param bits The number of bits in each index
+ */
+static void buildMultiples( Field128 *table, Field128 h, int bits )
+{
+        int size = 1 << bits;
+        int i = 0;
+        int j = 0;
+
+        // Single bits first, each a shift of the one above it
+        table[ 0 ].hi = table[ 0 ].lo = 0;
+        for ( i = size / 2; i > 0; i /= 2 ) {
+                table[ i ] = h;
+                h = field128MulX( h );
+        }
+
+        // Every other index is a sum of single bits
+        for ( i = 2; i < size; i *= 2 ) {
+                for ( j = 1; j < i; j++ ) {
+                        table[ i + j ].hi = table[ i ].hi ^ table[ j ].hi;
+                        table[ i + j ].lo = table[ i ].lo ^ table[ j ].lo;
+                }
+        }
+}
+
+/**
+        This function multiplies an element by x^bits with a reduction
+        table, bits being four or eight.
+
+        @param a The element
+        @param bits The number of bits to shift by
+        @param reduction The reduction table for that shift
+        @return a times x^bits
+ */
+static Field128 shiftDown( Field128 a, int bits, uint64_t const *reduction )
+{
+        uint64_t out = a.lo & ( ( 1u << bits ) - 1 );
+        a.lo = a.lo >> bits | a.hi << ( HALF_BITS - bits );
+        a.hi = a.hi >> bits ^ reduction[ out ];
+        return a;
+}
+
+/**
+        This function returns byte i of an element in GCM's byte order.
+
+        @param a The element
+        @param i The byte's index, from zero to 15
+        @return The byte
+ */
+static byte byteAt( Field128 a, int i )
+{
+        uint64_t half = i < GHASH_BLOCK / 2 ? a.hi : a.lo;
+        int shift = GHASH_BLOCK / 2 - 1 - i % ( GHASH_BLOCK / 2 );
+        return ( byte ) ( half >> shift * BBITS );
+}
+
+/**
+        This function multiplies an element by H a nibble at a time.
+
+        @param key The hash key
+        @param a The element
+        @return a times H
+ */
+static Field128 multiply4( GhashKey const *key, Field128 a )
+{
+        Field128 product = { 0, 0 };
+        int i = 0;
+        for ( i = GHASH_BLOCK - 1; i >= 0; i-- ) {
+                byte b = byteAt( a, i );
+
+                // The low nibble holds the higher powers of x
+                product = shiftDown( product, NIBBLE_BITS, reduce4 );
+                product.hi ^= key->table4[ b & NIBBLE_MASK ].hi;
+                product.lo ^= key->table4[ b & NIBBLE_MASK ].lo;
+                product = shiftDown( product, NIBBLE_BITS, reduce4 );
+                product.hi ^= key->table4[ b >> NIBBLE_BITS ].hi;
+                product.lo ^= key->table4[ b >> NIBBLE_BITS ].lo;
+        }
+
+        return product;
+}
+
+/**
+        This function multiplies an element by H a byte at a time.
+
+        @param key The hash key
+        @param a The element
+        @return a times H
+ */
+static Field128 multiply8( GhashKey const *key, Field128 a )
+{
+        Field128 product = { 0, 0 };
+        int i = 0;
+        for ( i = GHASH_BLOCK - 1; i >= 0; i-- ) {
+                byte b = byteAt( a, i );
+                product = shiftDown( product, BBITS, reduce8 );
+                product.hi ^= key->table8[ b ].hi;
+                product.lo ^= key->table8[ b ].lo;
+        }
+
+        return product;
+}
+
+bool ghashStrategyAvailable( GhashStrategy strategy )
+{
+        switch ( strategy ) {
+                case GHASH_BITWISE:
+                case GHASH_TABLE4:
+                case GHASH_TABLE8:
+                        return true;
+
+                case GHASH_CLMUL:
+                        return clmulAvailable();
+
+                default:
+                        return false;
+        }
+}
+
+GhashStrategy ghashBestStrategy( void )
+{
+        return clmulAvailable() ? GHASH_CLMUL : GHASH_TABLE8;
+}
+
+void ghashInit( GhashKey *key, byte const h[ GHASH_BLOCK ] )
+{
+        ghashInitWithStrategy( key, h, ghashBestStrategy() );
+}
+
+bool ghashInitWithStrategy( GhashKey *key, byte const h[ GHASH_BLOCK ],
+                        GhashStrategy strategy )
+{
+        if ( !ghashStrategyAvailable( strategy ) ) {
+                return false;
+        }
+
+        if ( !reductionReady ) {
+                buildReduction();
+        }
+
+        // Only the chosen strategy's tables are built
+        memset( key, 0, sizeof( *key ) );
+        key->strategy = strategy;
+        key->h = field128Load( h );
+        if ( strategy == GHASH_TABLE4 ) {
+                buildMultiples( key->table4, key->h, NIBBLE_BITS );
+        } else if ( strategy == GHASH_TABLE8 ) {
+                buildMultiples( key->table8, key->h, BBITS );
+        } else if ( strategy == GHASH_CLMUL ) {
+                clmulInit( key );
+        }
+
+        return true;
+}
+
+void ghashUpdate( GhashKey const *key, byte state[ GHASH_BLOCK ],
+                        byte const *data, size_t blocks )
+{
+        if ( key->strategy == GHASH_CLMUL ) {
+                clmulUpdate( key, state, data, blocks );
+                return;
+        }
+
+        Field128 y = field128Load( state );
+        size_t b = 0;
+        for ( b = 0; b < blocks; b++ ) {
+                Field128 x = field128Load( data + b * GHASH_BLOCK );
+                y.hi ^= x.hi;
+                y.lo ^= x.lo;
+                if ( key->strategy == GHASH_TABLE8 ) {
+                        y = multiply8( key, y );
+                } else if ( key->strategy == GHASH_TABLE4 ) {
+                        y = multiply4( key, y );
+                } else {
+                        y = field128Mul( y, key->h );
+                }
+        }
+
+        field128Store( state, y );
+}
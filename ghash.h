@@ -0,0 +1,129 @@
+/**
+        @file ghash.h
+        @author James O Kocak (jokocak)
+
+        The header file for the ghash.c component of the program. This
+        component computes GHASH, the GF(2^128) polynomial hash GCM
+        authenticates with, under one hash key H. The multiplications by H
+        can use the carry-less multiply instruction or tables built from H.
+ */
+
+#ifndef _GHASH_H_
+#define _GHASH_H_
+
+#include "field.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Number of bytes in a GHASH block, the same as an AES block. */
+#define GHASH_BLOCK 16
+
+/** Number of powers of H kept for the carry-less multiply, H to H^4. */
+#define GHASH_POWERS 4
+
+/** Number of entries in the 4-bit table, one per nibble value. */
+#define TABLE4_SIZE 16
+
+/** Number of entries in the 8-bit table, one per byte value. */
+#define TABLE8_SIZE 256
+
+/** Ways GHASH can multiply by H, chosen when the key is set up. */
+typedef enum {
+        /** The shift and exclusive or loop of field128Mul. */
+        GHASH_BITWISE,
+
+        /**
+                Shoup's method with 16 multiples of H, four bits of the
+                block per lookup and 256 bytes of table.
+         */
+        GHASH_TABLE4,
+
+        /**
+                Shoup's method with 256 multiples of H, eight bits per
+                lookup and 4 KB of table.
+         */
+        GHASH_TABLE8,
+
+        /**
+                The PCLMULQDQ instruction, four blocks per reduction. Only
+                available when CPUID reports PCLMULQDQ and SSSE3.
+         */
+        GHASH_CLMUL,
+
+        /** Number of strategies; not a strategy itself. */
+        GHASH_STRATEGY_COUNT
+} GhashStrategy;
+
+/**
+        The hash key H and whatever the chosen strategy precomputes from it.
+        It is filled in once by ghashInit and only read afterwards, so any
+        number of threads may hash with it at once.
+ */
+typedef struct {
+        /** The strategy multiplying by H. */
+        GhashStrategy strategy;
+
+        /** The hash key. */
+        Field128 h;
+
+        /** Multiples of H by every nibble, for GHASH_TABLE4. */
+        Field128 table4[ TABLE4_SIZE ];
+
+        /** Multiples of H by every byte, for GHASH_TABLE8. */
+        Field128 table8[ TABLE8_SIZE ];
+
+        /**
+                H to H^4 as byte-reversed 16-byte values, for GHASH_CLMUL.
+                powers[ i ] holds H^( i + 1 ).
+         */
+        byte powers[ GHASH_POWERS ][ GHASH_BLOCK ];
+} GhashKey;
+
+#endif
+
+/**
+        This function reports whether a strategy can run on this machine.
+        Everything but GHASH_CLMUL is always available.
+
+        @param strategy The strategy to check
+        @return True if keys can use the strategy
+ */
+bool ghashStrategyAvailable( GhashStrategy strategy );
+
+/**
+        This function returns the fastest strategy available on this machine.
+
+        @return The strategy ghashInit uses
+ */
+GhashStrategy ghashBestStrategy( void );
+
+/**
+        This function sets up a key for the fastest strategy available.
+
+        @param key The key to fill in
+        @param h The hash key, normally the encryption of a zero block
+ */
+void ghashInit( GhashKey *key, byte const h[ GHASH_BLOCK ] );
+
+/**
+        This function sets up a key for the requested strategy.
+
+        @param key The key to fill in
+        @param h The hash key
+        @param strategy The strategy to use
+        @return False if the strategy isn't available
+ */
+bool ghashInitWithStrategy( GhashKey *key, byte const h[ GHASH_BLOCK ],
+                        GhashStrategy strategy );
+
+/**
+        This function absorbs whole blocks into a running hash: for each
+        block X the state becomes ( state + X ) times H.
+
+        @param key The hash key
+        @param state The running hash, updated in place
+        @param data The blocks to absorb
+        @param blocks The number of blocks in data
+ */
+void ghashUpdate( GhashKey const *key, byte state[ GHASH_BLOCK ],
+                        byte const *data, size_t blocks );
@@ -1,41 +1,107 @@
 /**
         @file io.c
         @author James O Kocak (jokocak)
-        
+
         This component handles the reading and writing of information from
         binary files.
  */
 
+/**
+        Exposes fileno, fstat, posix_memalign, mmap, mkstemp, truncate and
+        syscall under -std=c99.
+ */
+#define _DEFAULT_SOURCE
+
 #include "io.h"
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+/**
+        This function prints an error naming a file and exits.
 
-byte *readBinaryFile( char const *filename, int *size )
+        @param message What went wrong
+        @param filename The file it went wrong with
+ */
+static void fileError( char const *message, char const *filename )
 {
-        // Creates file pointer to Binary file for reading
-        FILE *read = fopen( filename, "rb" );
+        fprintf( stderr, "%s: %s\n", message, filename );
+        exit( EXIT_FAILURE );
+}
 
-        // Checks if file exists
-        if ( read == NULL ) {
-                fprintf( stderr, "Can't open file: %s\n", filename );
-                exit( EXIT_FAILURE );
+/**
+        This function opens a file, exiting with "Can't open file" if that
+        fails.
+
+        @param filename The file to open
+        @param mode The fopen mode
+        @return The open file
+ */
+static FILE *openFile( char const *filename, char const *mode )
+{
+        FILE *file = fopen( filename, mode );
+        if ( file == NULL ) {
+                fileError( "Can't open file", filename );
+        }
+
+        return file;
+}
+
+/**
+        This function finds the size of an open file from its metadata
+        rather than by reading it.
+
+        @param fd The open file
+        @param filename The file's name, for error messages
+        @return The number of bytes in the file
+ */
+static off_t descriptorSize( int fd, char const *filename )
+{
+        struct stat info;
+        if ( fstat( fd, &info ) != 0 ) {
+                fileError( "Can't read file", filename );
         }
 
-        // Count number of bytes in file so no reallocation is required
-        int capacity = 0;
-        while ( fgetc( read ) != EOF ) {
-                capacity++;
+        return info.st_size;
+}
+
+/**
+        This function checks whether an open file is a regular file rather
+        than a pipe or device, whose size says nothing about its length.
+
+        @param fd The open file
+        @return True for a regular file
+ */
+static bool descriptorRegular( int fd )
+{
+        struct stat info;
+        return fstat( fd, &info ) == 0 && S_ISREG( info.st_mode );
+}
+
+byte *readBinaryFile( char const *filename, size_t *size )
+{
+        // Creates file pointer to Binary file for reading
+        FILE *read = openFile( filename, "rb" );
+
+        // Asks for the size up front so no reallocation is required
+        off_t length = descriptorSize( fileno( read ), filename );
+        if ( ( uintmax_t ) length > SIZE_MAX ) {
+                fileError( "File too large", filename );
         }
 
-        // Rewinds to start of file for fread
-        rewind( read );
+        size_t capacity = ( size_t ) length;
 
         // Dynamically allocates array of bytes
         byte *bytes = ( byte * ) malloc( capacity * sizeof( byte ) );
 
         // Records number of bytes in file into the size field
-        fread( bytes, sizeof( byte ), capacity, read );
-
-        // Records size of file
-        *size = capacity;
+        *size = fread( bytes, sizeof( byte ), capacity, read );
 
         // Closes reader
         fclose( read );
@@ -44,7 +110,20 @@ byte *readBinaryFile( char const *filename, int *size )
         return bytes;
 }
 
-void writeBinaryFile( char const *filename, byte *data, int size )
+void readIv( char const *filename, byte *iv, size_t size )
+{
+        size_t ivSize;
+        byte *bytes = readBinaryFile( filename, &ivSize );
+        if ( ivSize != size ) {
+                fprintf( stderr, "Bad IV file: %s\n", filename );
+                exit( EXIT_FAILURE );
+        }
+
+        memcpy( iv, bytes, size );
+        free( bytes );
+}
+
+void writeBinaryFile( char const *filename, byte const *data, size_t size )
 {
         // Creates file pointer for writing in Binary
         FILE *ptr = fopen( filename, "wb" );
@@ -55,3 +134,424 @@ void writeBinaryFile( char const *filename, byte *data, int size )
         // Closes writer
         fclose( ptr );
 }
+
+void appendBinaryFile( char const *filename, byte const *data, size_t size )
+{
+        FILE *ptr = openFile( filename, "ab" );
+        if ( fwrite( data, sizeof( byte ), size, ptr ) != size ||
+             fclose( ptr ) != 0 ) {
+                fileError( "Can't write file", filename );
+        }
+}
+
+char *createSibling( char const *filename )
+{
+        // mkstemp replaces the six Xs with a unique suffix
+        static char const suffix[] = ".XXXXXX";
+        size_t length = strlen( filename );
+        char *name = ( char * ) malloc( length + sizeof( suffix ) );
+        if ( name == NULL ) {
+                fprintf( stderr, "Out of memory\n" );
+                exit( EXIT_FAILURE );
+        }
+
+        memcpy( name, filename, length );
+        memcpy( name + length, suffix, sizeof( suffix ) );
+        int fd = mkstemp( name );
+        if ( fd < 0 ) {
+                fileError( "Can't open file", filename );
+        }
+
+        close( fd );
+        return name;
+}
+
+void truncateFile( char const *filename, off_t size )
+{
+        if ( truncate( filename, size ) != 0 ) {
+                fileError( "Can't write file", filename );
+        }
+}
+
+void randomBytes( byte *buffer, size_t length )
+{
+        // getrandom may return fewer bytes than asked, or be interrupted
+        size_t done = 0;
+        while ( done < length ) {
+                long count = syscall( SYS_getrandom, buffer + done,
+                                length - done, 0 );
+                if ( count < 0 && errno == EINTR ) {
+                        continue;
+                }
+
+                if ( count <= 0 ) {
+                        fprintf( stderr, "Can't read random bytes\n" );
+                        exit( EXIT_FAILURE );
+                }
+
+                done += count;
+        }
+}
+
+byte *allocateBuffer( size_t size )
+{
+        void *buffer = NULL;
+        if ( posix_memalign( &buffer, BUFFER_ALIGN, size ) != 0 ) {
+                fprintf( stderr, "Out of memory\n" );
+                exit( EXIT_FAILURE );
+        }
+
+        return ( byte * ) buffer;
+}
+
+void openChunkReader( ChunkStream *stream, char const *filename,
+                        size_t chunkSize )
+{
+        stream->file = openFile( filename, "rb" );
+        stream->name = filename;
+        stream->size = descriptorSize( fileno( stream->file ), filename );
+        stream->regular = descriptorRegular( fileno( stream->file ) );
+        stream->chunkSize = chunkSize;
+        stream->buffer = allocateBuffer( chunkSize );
+
+        // Our buffer already batches reads, so stdio's would be a copy
+        setvbuf( stream->file, NULL, _IONBF, 0 );
+}
+
+size_t readChunk( ChunkStream *stream )
+{
+        size_t count = fread( stream->buffer, sizeof( byte ),
+                        stream->chunkSize, stream->file );
+        if ( count < stream->chunkSize && ferror( stream->file ) ) {
+                fileError( "Can't read file", stream->name );
+        }
+
+        return count;
+}
+
+size_t readChunkAfter( ChunkStream *stream, size_t kept )
+{
+        size_t count = fread( stream->buffer + kept, sizeof( byte ),
+                        stream->chunkSize - kept, stream->file );
+        if ( count < stream->chunkSize - kept && ferror( stream->file ) ) {
+                fileError( "Can't read file", stream->name );
+        }
+
+        return kept + count;
+}
+
+void openChunkWriter( ChunkStream *stream, char const *filename )
+{
+        stream->file = openFile( filename, "wb" );
+        stream->name = filename;
+        stream->size = 0;
+        stream->regular = descriptorRegular( fileno( stream->file ) );
+        stream->chunkSize = 0;
+        stream->buffer = NULL;
+        setvbuf( stream->file, NULL, _IONBF, 0 );
+}
+
+void writeChunk( ChunkStream *stream, byte const *data, size_t size )
+{
+        if ( fwrite( data, sizeof( byte ), size, stream->file ) != size ) {
+                fileError( "Can't write file", stream->name );
+        }
+
+        stream->size += size;
+}
+
+size_t readChunkAt( ChunkStream *stream, byte *buffer, size_t length,
+                        off_t offset )
+{
+        // pread may stop early, so keep going until the end of the file
+        size_t done = 0;
+        while ( done < length ) {
+                ssize_t count = pread( fileno( stream->file ), buffer + done,
+                                length - done, offset + done );
+                if ( count < 0 && errno == EINTR ) {
+                        continue;
+                }
+
+                if ( count < 0 ) {
+                        fileError( "Can't read file", stream->name );
+                }
+
+                if ( count == 0 ) {
+                        break;
+                }
+
+                done += count;
+        }
+
+        return done;
+}
+
+void writeChunkAt( ChunkStream *stream, byte const *data, size_t length,
+                        off_t offset )
+{
+        size_t done = 0;
+        while ( done < length ) {
+                ssize_t count = pwrite( fileno( stream->file ), data + done,
+                                length - done, offset + done );
+                if ( count < 0 && errno == EINTR ) {
+                        continue;
+                }
+
+                if ( count <= 0 ) {
+                        fileError( "Can't write file", stream->name );
+                }
+
+                done += count;
+        }
+}
+
+void closeChunkStream( ChunkStream *stream )
+{
+        if ( fclose( stream->file ) != 0 ) {
+                fileError( "Can't write file", stream->name );
+        }
+
+        free( stream->buffer );
+        stream->file = NULL;
+        stream->buffer = NULL;
+}
+
+/**
+        This function maps the first size bytes of an open file. Empty files
+        are left unmapped.
+
+        @param mapping The mapping to fill in
+        @param filename The file's name, for error messages
+        @param fd The open file
+        @param size The number of bytes to map
+        @param writable Whether the mapping may be written
+ */
+static void mapFile( FileMapping *mapping, char const *filename, int fd,
+                        off_t size, bool writable )
+{
+        if ( ( uintmax_t ) size > SIZE_MAX ) {
+                fileError( "File too large", filename );
+        }
+
+        mapping->fd = fd;
+        mapping->size = ( size_t ) size;
+        mapping->data = NULL;
+        if ( mapping->size == 0 ) {
+                return;
+        }
+
+        int protection = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+        void *data = mmap( NULL, mapping->size, protection, MAP_SHARED, fd, 0 );
+        if ( data == MAP_FAILED ) {
+                fileError( "Can't map file", filename );
+        }
+
+        madvise( data, mapping->size, MADV_SEQUENTIAL );
+        mapping->data = ( byte * ) data;
+}
+
+/**
+        This function opens a file descriptor, exiting with "Can't open file"
+        if that fails.
+
+        @param filename The file to open
+        @param flags The open flags
+        @return The file descriptor
+ */
+static int openDescriptor( char const *filename, int flags )
+{
+        int fd = open( filename, flags, 0666 );
+        if ( fd < 0 ) {
+                fileError( "Can't open file", filename );
+        }
+
+        return fd;
+}
+
+void mapInput( FileMapping *mapping, char const *filename )
+{
+        int fd = openDescriptor( filename, O_RDONLY );
+        mapFile( mapping, filename, fd, descriptorSize( fd, filename ), false );
+}
+
+void mapOutput( FileMapping *mapping, char const *filename, size_t size )
+{
+        int fd = openDescriptor( filename, O_RDWR | O_CREAT | O_TRUNC );
+        if ( size > 0 && posix_fallocate( fd, 0, ( off_t ) size ) != 0 ) {
+                fileError( "Can't write file", filename );
+        }
+
+        mapFile( mapping, filename, fd, ( off_t ) size, true );
+}
+
+void mapInPlace( FileMapping *mapping, char const *filename )
+{
+        int fd = openDescriptor( filename, O_RDWR );
+        mapFile( mapping, filename, fd, descriptorSize( fd, filename ), true );
+}
+
+void unmapFile( FileMapping *mapping )
+{
+        if ( mapping->data != NULL ) {
+                munmap( mapping->data, mapping->size );
+        }
+
+        close( mapping->fd );
+        mapping->data = NULL;
+        mapping->fd = -1;
+}
+
+/**
+        This function maps one of the areas an io_uring shares with us.
+
+        @param fd The ring
+        @param size The number of bytes to map
+        @param offset Which area, one of the IORING_OFF_ values
+        @return The mapping, or NULL if it failed
+ */
+static void *mapRingArea( int fd, size_t size, off_t offset )
+{
+        void *area = mmap( NULL, size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, offset );
+        return area == MAP_FAILED ? NULL : area;
+}
+
+bool openIoRing( IoRing *ring, unsigned entries )
+{
+        struct io_uring_params params;
+        memset( &params, 0, sizeof( params ) );
+        ring->fd = ( int ) syscall( __NR_io_uring_setup, entries, &params );
+        if ( ring->fd < 0 ) {
+                return false;
+        }
+
+        // Newer kernels share one mapping between the two rings
+        ring->sqRingSize = params.sq_off.array +
+                params.sq_entries * sizeof( unsigned );
+        ring->cqRingSize = params.cq_off.cqes +
+                params.cq_entries * sizeof( struct io_uring_cqe );
+        bool single = ( params.features & IORING_FEAT_SINGLE_MMAP ) != 0;
+        if ( single && ring->cqRingSize > ring->sqRingSize ) {
+                ring->sqRingSize = ring->cqRingSize;
+        }
+
+        ring->sqesSize = params.sq_entries * sizeof( struct io_uring_sqe );
+        ring->sqRing = mapRingArea( ring->fd, ring->sqRingSize,
+                        IORING_OFF_SQ_RING );
+        ring->cqRing = single ? ring->sqRing : mapRingArea( ring->fd,
+                        ring->cqRingSize, IORING_OFF_CQ_RING );
+        ring->sqes = mapRingArea( ring->fd, ring->sqesSize, IORING_OFF_SQES );
+        if ( ring->sqRing == NULL || ring->cqRing == NULL ||
+             ring->sqes == NULL ) {
+                closeIoRing( ring );
+                return false;
+        }
+
+        byte *sq = ( byte * ) ring->sqRing;
+        ring->sqHead = ( unsigned * ) ( sq + params.sq_off.head );
+        ring->sqTail = ( unsigned * ) ( sq + params.sq_off.tail );
+        ring->sqMask = ( unsigned * ) ( sq + params.sq_off.ring_mask );
+        ring->sqArray = ( unsigned * ) ( sq + params.sq_off.array );
+
+        byte *cq = ( byte * ) ring->cqRing;
+        ring->cqHead = ( unsigned * ) ( cq + params.cq_off.head );
+        ring->cqTail = ( unsigned * ) ( cq + params.cq_off.tail );
+        ring->cqMask = ( unsigned * ) ( cq + params.cq_off.ring_mask );
+        ring->cqes = cq + params.cq_off.cqes;
+        ring->unsubmitted = 0;
+        return true;
+}
+
+/**
+        This function fills in the next submission queue entry and publishes
+        it to the kernel, which only sees it at the next io_uring_enter.
+
+        @param ring The ring to queue on
+        @param opcode IORING_OP_READ or IORING_OP_WRITE
+        @param fd The file to read or write
+        @param buffer The bytes to transfer
+        @param length The number of bytes
+        @param offset Where in the file to transfer them
+        @param tag A number handed back with the completion
+ */
+static void queueRing( IoRing *ring, int opcode, int fd, void const *buffer,
+                        size_t length, off_t offset, size_t tag )
+{
+        unsigned tail = *ring->sqTail;
+        unsigned index = tail & *ring->sqMask;
+        struct io_uring_sqe *sqe = ( struct io_uring_sqe * ) ring->sqes + index;
+        memset( sqe, 0, sizeof( *sqe ) );
+        sqe->opcode = ( __u8 ) opcode;
+        sqe->fd = fd;
+        sqe->addr = ( __u64 ) ( uintptr_t ) buffer;
+        sqe->len = ( __u32 ) length;
+        sqe->off = ( __u64 ) offset;
+        sqe->user_data = ( __u64 ) tag;
+        ring->sqArray[ index ] = index;
+
+        // The entry must be complete before the kernel sees the new tail
+        __atomic_store_n( ring->sqTail, tail + 1, __ATOMIC_RELEASE );
+        ring->unsubmitted++;
+}
+
+void queueRingRead( IoRing *ring, ChunkStream *stream, byte *buffer,
+                        size_t length, off_t offset, size_t tag )
+{
+        queueRing( ring, IORING_OP_READ, fileno( stream->file ), buffer,
+                        length, offset, tag );
+}
+
+void queueRingWrite( IoRing *ring, ChunkStream *stream, byte const *data,
+                        size_t length, off_t offset, size_t tag )
+{
+        queueRing( ring, IORING_OP_WRITE, fileno( stream->file ), data,
+                        length, offset, tag );
+}
+
+long waitIoRing( IoRing *ring, size_t *tag )
+{
+        unsigned head = *ring->cqHead;
+        while ( ring->unsubmitted > 0 ||
+                head == __atomic_load_n( ring->cqTail, __ATOMIC_ACQUIRE ) ) {
+                // One call both submits the queue and waits for a completion
+                long done = syscall( __NR_io_uring_enter, ring->fd,
+                                ring->unsubmitted, 1, IORING_ENTER_GETEVENTS,
+                                NULL, 0 );
+                if ( done < 0 && errno != EINTR ) {
+                        fprintf( stderr, "Can't submit I/O: %s\n",
+                                strerror( errno ) );
+                        exit( EXIT_FAILURE );
+                }
+
+                if ( done > 0 ) {
+                        ring->unsubmitted -= ( unsigned ) done;
+                }
+        }
+
+        struct io_uring_cqe *cqe = ( struct io_uring_cqe * ) ring->cqes +
+                ( head & *ring->cqMask );
+        *tag = ( size_t ) cqe->user_data;
+        long result = cqe->res;
+
+        // Hands the entry back only once it has been read
+        __atomic_store_n( ring->cqHead, head + 1, __ATOMIC_RELEASE );
+        return result;
+}
+
+void closeIoRing( IoRing *ring )
+{
+        if ( ring->sqes != NULL ) {
+                munmap( ring->sqes, ring->sqesSize );
+        }
+
+        if ( ring->cqRing != NULL && ring->cqRing != ring->sqRing ) {
+                munmap( ring->cqRing, ring->cqRingSize );
+        }
+
+        if ( ring->sqRing != NULL ) {
+                munmap( ring->sqRing, ring->sqRingSize );
+        }
+
+        close( ring->fd );
+        ring->fd = -1;
+}
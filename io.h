@@ -1,29 +1,141 @@
 /**
         @file io.h
         @author James O Kocak (jokocak)
-        
+
         The header file for the io.c component of the program. This file
         contains all the includes and documentation for the provided functions.
  */
 
+#ifndef _IO_H_
+#define _IO_H_
+
 #include "field.h"
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <sys/types.h>
+
+/**
+        Number of bytes moved per chunk by the programs. It is a multiple of
+        every block size we use, so chunks always hold whole blocks.
+ */
+#define DEFAULT_CHUNK_SIZE ( 1 << 20 )
+
+/** Alignment of chunk buffers, one cache line. */
+#define BUFFER_ALIGN 64
+
+/**
+        Fails to compile unless off_t is 64 bits, so files over 2 GB can't be
+        truncated by a build that forgot -D_FILE_OFFSET_BITS=64.
+ */
+typedef char LargeFileCheck[ sizeof( off_t ) >= 8 ? 1 : -1 ];
+
+/**
+        A file read or written a chunk at a time. Readers own one aligned
+        buffer of chunkSize bytes that every readChunk call refills, so a
+        whole file passes through in bounded memory. Writers have no buffer
+        of their own and write straight from the caller's.
+ */
+typedef struct {
+        /** The open file. */
+        FILE *file;
+
+        /** The file's name, for error messages. */
+        char const *name;
+
+        /** The chunk buffer, or NULL for a writer. */
+        byte *buffer;
+
+        /** Capacity of the buffer in bytes. */
+        size_t chunkSize;
+
+        /** Size of the file when it was opened, for readers. */
+        off_t size;
+
+        /** Whether the file is a regular file, so a reader's size is its length. */
+        bool regular;
+} ChunkStream;
+
+/**
+        A file mapped into memory, so the block functions can read and write
+        the page cache directly.
+ */
+typedef struct {
+        /** The file descriptor behind the mapping. */
+        int fd;
+
+        /** The mapped bytes, or NULL for an empty file. */
+        byte *data;
+
+        /** Number of bytes mapped. */
+        size_t size;
+} FileMapping;
+
+/**
+        An io_uring instance: a submission and a completion queue shared
+        with the kernel, so many reads and writes can be in flight while
+        the caller encrypts. It is driven with raw system calls and needs no
+        library; the kernel's structures are kept behind void pointers so
+        only io.c sees them.
+ */
+typedef struct {
+        /** The ring's file descriptor. */
+        int fd;
+
+        /** The submission queue's head, tail, mask and index array. */
+        unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+
+        /** The submission queue entries. */
+        void *sqes;
+
+        /** The completion queue's head, tail and mask. */
+        unsigned *cqHead, *cqTail, *cqMask;
+
+        /** The completion queue entries. */
+        void *cqes;
+
+        /** The mapped submission ring and its size. */
+        void *sqRing;
+        size_t sqRingSize;
+
+        /** The mapped completion ring and its size, which may be sqRing. */
+        void *cqRing;
+        size_t cqRingSize;
+
+        /** Size of the mapped submission queue entries. */
+        size_t sqesSize;
+
+        /** Entries queued but not yet handed to the kernel. */
+        unsigned unsubmitted;
+} IoRing;
+
+#endif
 
 /**
         This function reads the contents of the binary file with the given
         name. It returns a pointer to a dynamically allocated array of bytes
-        containing the entire file contents. The size parameter is an integer
-        that is passed by reference to this function. The function fills in
-        this integer with the total size of the file, how many bytes are in the
-        returned array.
+        containing the entire file contents. The size parameter is passed by
+        reference to this function. The function fills it in with the total
+        size of the file, how many bytes are in the returned array. It is
+        meant for small files such as keys; large inputs should go through a
+        ChunkStream.
 
         @param filename The file to read from
         @param size The number of bytes that are in the array after reading is
                         complete
         @return An array of the bytes read from the file
  */
-byte *readBinaryFile( char const *filename, int *size );
+byte *readBinaryFile( char const *filename, size_t *size );
+
+/**
+        This function reads an IV file, exiting with "Bad IV file" unless it
+        holds exactly size bytes.
+
+        @param filename The file to read
+        @param iv Where to store the IV
+        @param size The number of bytes the IV must have
+ */
+void readIv( char const *filename, byte *iv, size_t size );
 
 /**
         This function writes the contents of the given data array, in binary,
@@ -34,4 +146,235 @@ byte *readBinaryFile( char const *filename, int *size );
         @param data The array of bytes
         @param size The amount of bytes in the array
  */
-void writeBinaryFile( char const *filename, byte *data, int size );
+void writeBinaryFile( char const *filename, byte const *data, size_t size );
+
+/**
+        This function appends the contents of the given data array to the
+        end of the file with the given name.
+
+        @param filename The file to append to
+        @param data The array of bytes
+        @param size The amount of bytes in the array
+ */
+void appendBinaryFile( char const *filename, byte const *data, size_t size );
+
+/**
+        This function creates an empty file, readable only by its owner, in
+        the same directory as filename, so it can later be renamed over
+        filename without crossing file systems.
+
+        @param filename The file the new one will stand in for
+        @return The new file's name, released with free
+ */
+char *createSibling( char const *filename );
+
+/**
+        This function cuts a file down to the given size.
+
+        @param filename The file to truncate
+        @param size The number of bytes to keep
+ */
+void truncateFile( char const *filename, off_t size );
+
+/**
+        This function fills a buffer with bytes from the kernel's random
+        number generator, suitable for keys and nonces. It exits if the
+        generator can't be read.
+
+        @param buffer Where to store the bytes
+        @param length The number of bytes
+ */
+void randomBytes( byte *buffer, size_t length );
+
+/**
+        This function allocates a buffer aligned to BUFFER_ALIGN bytes, so it
+        can be handed to the vector block functions and reused across
+        chunks. The program exits if memory runs out.
+
+        @param size The number of bytes to allocate
+        @return The buffer, released with free
+ */
+byte *allocateBuffer( size_t size );
+
+/**
+        This function opens a file for reading in chunks and records its
+        size. The program exits with "Can't open file" if it can't be opened.
+
+        @param stream The stream to fill in
+        @param filename The file to read from
+        @param chunkSize The number of bytes each readChunk call returns
+ */
+void openChunkReader( ChunkStream *stream, char const *filename,
+                        size_t chunkSize );
+
+/**
+        This function reads the next chunk into the stream's buffer. Every
+        chunk is full except the last, and a return of zero means the whole
+        file has been read.
+
+        @param stream The stream to read from
+        @return The number of bytes now in the buffer
+ */
+size_t readChunk( ChunkStream *stream );
+
+/**
+        This function keeps the first kept bytes of the stream's buffer and
+        fills the rest from the file, for callers that carry an unfinished
+        piece over from one chunk to the next. The buffer is only short of
+        full at the end of the file.
+
+        @param stream The stream to read from
+        @param kept The number of bytes at the start of the buffer to keep
+        @return The number of bytes now in the buffer, counting kept
+ */
+size_t readChunkAfter( ChunkStream *stream, size_t kept );
+
+/**
+        This function creates or truncates a file for writing in chunks. The
+        program exits with "Can't open file" if it can't be created.
+
+        @param stream The stream to fill in
+        @param filename The file to write to
+ */
+void openChunkWriter( ChunkStream *stream, char const *filename );
+
+/**
+        This function appends size bytes from data to the file.
+
+        @param stream The stream to write to
+        @param data The bytes to write
+        @param size The number of bytes in data
+ */
+void writeChunk( ChunkStream *stream, byte const *data, size_t size );
+
+/**
+        This function reads up to length bytes at the given offset without
+        moving the stream's position, so several threads may read one stream
+        at once, each into its own buffer. It only returns short at the end
+        of the file.
+
+        @param stream The stream to read from
+        @param buffer Where to store the bytes
+        @param length The number of bytes wanted
+        @param offset Where in the file to start
+        @return The number of bytes read
+ */
+size_t readChunkAt( ChunkStream *stream, byte *buffer, size_t length,
+                        off_t offset );
+
+/**
+        This function writes length bytes at the given offset without moving
+        the stream's position, so several threads may write one stream at
+        once.
+
+        @param stream The stream to write to
+        @param data The bytes to write
+        @param length The number of bytes in data
+        @param offset Where in the file to put them
+ */
+void writeChunkAt( ChunkStream *stream, byte const *data, size_t length,
+                        off_t offset );
+
+/**
+        This function closes a reader or writer and frees its buffer. For
+        writers it also reports data that could not be flushed.
+
+        @param stream The stream to close
+ */
+void closeChunkStream( ChunkStream *stream );
+
+/**
+        This function maps a whole file read-only and advises the kernel that
+        it will be read sequentially. The program exits with "Can't open
+        file" if it can't be opened.
+
+        @param mapping The mapping to fill in
+        @param filename The file to map
+ */
+void mapInput( FileMapping *mapping, char const *filename );
+
+/**
+        This function creates or truncates a file, reserves size bytes of
+        disk for it so a full disk is reported here rather than as a fault
+        mid-write, and maps it for writing.
+
+        @param mapping The mapping to fill in
+        @param filename The file to create
+        @param size The number of bytes the file will hold
+ */
+void mapOutput( FileMapping *mapping, char const *filename, size_t size );
+
+/**
+        This function maps an existing file for reading and writing, so it
+        can be transformed in place.
+
+        @param mapping The mapping to fill in
+        @param filename The file to map
+ */
+void mapInPlace( FileMapping *mapping, char const *filename );
+
+/**
+        This function unmaps a file and closes it. Changes to a writable
+        mapping reach the file through the page cache.
+
+        @param mapping The mapping to release
+ */
+void unmapFile( FileMapping *mapping );
+
+/**
+        This function sets up an io_uring with room for entries requests in
+        flight. Kernels without io_uring, and sandboxes that forbid it, make
+        it return false so the caller can fall back to pread and pwrite.
+
+        @param ring The ring to fill in
+        @param entries The number of requests that may be in flight
+        @return False if io_uring is unavailable
+ */
+bool openIoRing( IoRing *ring, unsigned entries );
+
+/**
+        This function queues a read of length bytes at offset into buffer.
+        Nothing reaches the kernel until waitIoRing is called.
+
+        @param ring The ring to queue on
+        @param stream The stream to read from
+        @param buffer Where to store the bytes
+        @param length The number of bytes wanted
+        @param offset Where in the file to start
+        @param tag A number handed back with the completion
+ */
+void queueRingRead( IoRing *ring, ChunkStream *stream, byte *buffer,
+                        size_t length, off_t offset, size_t tag );
+
+/**
+        This function queues a write of length bytes from data at offset.
+        Nothing reaches the kernel until waitIoRing is called.
+
+        @param ring The ring to queue on
+        @param stream The stream to write to
+        @param data The bytes to write, left untouched until completion
+        @param length The number of bytes in data
+        @param offset Where in the file to put them
+        @param tag A number handed back with the completion
+ */
+void queueRingWrite( IoRing *ring, ChunkStream *stream, byte const *data,
+                        size_t length, off_t offset, size_t tag );
+
+/**
+        This function submits everything queued and waits for one request to
+        finish. Like pread and pwrite, a request may finish short, and the
+        caller queues the rest again.
+
+        @param ring The ring to wait on
+        @param tag Where to store the finished request's tag
+        @return The bytes transferred, or a negated errno value
+ */
+long waitIoRing( IoRing *ring, size_t *tag );
+
+/**
+        This function unmaps a ring and closes it. Every request must have
+        completed.
+
+        @param ring The ring to close
+ */
+void closeIoRing( IoRing *ring );
@@ -0,0 +1,113 @@
+/**
+        @file keystore.c
+        @author James O Kocak (jokocak)
+
+        This component keeps aesd's expanded keys in an open-addressed table
+        behind a mutex, with a reference count on each key. Keys are never
+        removed, so a probe stops at the first free slot.
+ */
+
+#include "keystore.h"
+#include "io.h"
+#include <stdlib.h>
+#include <string.h>
+
+/** Knuth's multiplier, spreading consecutive IDs over the table. */
+#define HASH_MULTIPLIER 2654435761u
+
+/**
+        This function finds the slot holding an ID, or the free slot where it
+        would go. The caller holds the lock.
+
+        @param store The store
+        @param id The key's ID
+        @return The slot, or NULL if the ID isn't there and the table is full
+ */
+static KeySlot *findSlot( KeyStore *store, uint32_t id )
+{
+        size_t start = ( uint32_t ) ( id * HASH_MULTIPLIER ) % KEYSTORE_SLOTS;
+        size_t i = 0;
+        for ( i = 0; i < KEYSTORE_SLOTS; i++ ) {
+                KeySlot *slot = &store->slots[ ( start + i ) % KEYSTORE_SLOTS ];
+                if ( slot->key == NULL || slot->id == id ) {
+                        return slot;
+                }
+        }
+
+        return NULL;
+}
+
+/**
+        This function drops one reference to a key, clearing and freeing it
+        if that was the last.
+
+        @param key The key, or NULL
+ */
+static void dropKey( StoredKey *key )
+{
+        if ( key != NULL && __atomic_sub_fetch( &key->references, 1,
+                                                __ATOMIC_ACQ_REL ) == 0 ) {
+                memset( key, 0, sizeof( StoredKey ) );
+                free( key );
+        }
+}
+
+void keystoreInit( KeyStore *store )
+{
+        memset( store->slots, 0, sizeof( store->slots ) );
+        pthread_mutex_init( &store->lock, NULL );
+}
+
+bool keystorePut( KeyStore *store, uint32_t id,
+                        byte const keyBytes[ BLOCK_SIZE ] )
+{
+        // The schedule and hash tables are built before anyone has to wait
+        StoredKey *key = ( StoredKey * ) allocateBuffer( sizeof( StoredKey ) );
+        gcmInitKey( &key->key, keyBytes );
+        key->references = 1;
+
+        pthread_mutex_lock( &store->lock );
+        KeySlot *slot = findSlot( store, id );
+        StoredKey *old = NULL;
+        if ( slot != NULL ) {
+                old = slot->key;
+                slot->id = id;
+                slot->key = key;
+        }
+
+        pthread_mutex_unlock( &store->lock );
+
+        // The table's reference to the old key goes; users keep theirs
+        dropKey( slot != NULL ? old : key );
+        return slot != NULL;
+}
+
+GcmKey const *keystoreAcquire( KeyStore *store, uint32_t id )
+{
+        // The table's own reference keeps the count above zero here
+        pthread_mutex_lock( &store->lock );
+        KeySlot *slot = findSlot( store, id );
+        StoredKey *key = slot != NULL ? slot->key : NULL;
+        if ( key != NULL ) {
+                __atomic_add_fetch( &key->references, 1, __ATOMIC_RELAXED );
+        }
+
+        pthread_mutex_unlock( &store->lock );
+        return key != NULL ? &key->key : NULL;
+}
+
+void keystoreRelease( GcmKey const *key )
+{
+        dropKey( ( StoredKey * ) key );
+}
+
+void keystoreClose( KeyStore *store )
+{
+        int i = 0;
+        for ( i = 0; i < KEYSTORE_SLOTS; i++ ) {
+                dropKey( store->slots[ i ].key );
+                store->slots[ i ].key = NULL;
+        }
+
+        pthread_mutex_destroy( &store->lock );
+}
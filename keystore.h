@@ -0,0 +1,99 @@
+/**
+        @file keystore.h
+        @author James O Kocak (jokocak)
+
+        The header file for the keystore.c component of the program. This
+        component holds aesd's expanded keys under 32-bit IDs, so a request
+        pays for a table lookup instead of a key schedule. Each key is kept
+        as a GCM key, whose AES context also serves ECB and CTR. The lock
+        only covers finding a key: each key counts the requests using it,
+        so replacing it never waits for them, and the old key is cleared
+        and freed when the last one lets it go.
+ */
+
+#ifndef _KEYSTORE_H_
+#define _KEYSTORE_H_
+
+#include "gcm.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Number of slots in the table, and so the most keys it holds. */
+#define KEYSTORE_SLOTS 1024
+
+/** An expanded key and the number of references to it. */
+typedef struct {
+        /** The key; first, so a pointer to it is a pointer to this. */
+        GcmKey key;
+
+        /** One for the table while the key is in it, one per user. */
+        uint32_t references;
+} StoredKey;
+
+/** One slot of the table. */
+typedef struct {
+        /** The key's ID. */
+        uint32_t id;
+
+        /** The key, or NULL if the slot is free. */
+        StoredKey *key;
+} KeySlot;
+
+/** The keys, in an open-addressed table probed linearly. */
+typedef struct {
+        /** The slots. */
+        KeySlot slots[ KEYSTORE_SLOTS ];
+
+        /** Guards the slots, only while a key is found or swapped. */
+        pthread_mutex_t lock;
+} KeyStore;
+
+#endif
+
+/**
+        This function starts an empty store.
+
+        @param store The store
+ */
+void keystoreInit( KeyStore *store );
+
+/**
+        This function expands a key and keeps it under an ID, replacing any
+        key already there. Requests still using the old key finish with it.
+        It may be called from any thread.
+
+        @param store The store
+        @param id The key's ID
+        @param keyBytes The 16-byte AES key
+        @return False if the store is full
+ */
+bool keystorePut( KeyStore *store, uint32_t id,
+                        byte const keyBytes[ BLOCK_SIZE ] );
+
+/**
+        This function finds a key and takes a reference to it, so it stays
+        usable until keystoreRelease even if it's replaced meanwhile. No
+        lock is held on return.
+
+        @param store The store
+        @param id The key's ID
+        @return The key, or NULL if there's none
+ */
+GcmKey const *keystoreAcquire( KeyStore *store, uint32_t id );
+
+/**
+        This function drops the reference keystoreAcquire took, freeing the
+        key if it has been replaced and this was the last use.
+
+        @param key The key
+ */
+void keystoreRelease( GcmKey const *key );
+
+/**
+        This function clears and frees every key. No key may still be in
+        use.
+
+        @param store The store
+ */
+void keystoreClose( KeyStore *store );
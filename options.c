@@ -0,0 +1,242 @@
+/**
+        @file options.c
+        @author James O Kocak (jokocak)
+
+        This component parses the command line shared by encrypt and
+        decrypt.
+ */
+
+#include "options.h"
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+/** Number of file names needed when writing a separate output file. */
+#define FILE_COUNT 3
+
+/** Base for numbers on the command line. */
+#define DECIMAL 10
+
+/** The stats option when it names a file for the JSON report. */
+#define STATS_PREFIX "--stats="
+
+/** Bits a K, M or G suffix shifts a size by for each step. */
+#define KIBI_BITS 10
+
+/** XTS data unit size of a disk sector. */
+#define SECTOR_UNIT 512
+
+/** XTS data unit size of an advanced-format sector. */
+#define PAGE_UNIT 4096
+
+bool parseCount( char const *text, int *value )
+{
+        if ( text == NULL || *text == '\0' ) {
+                return false;
+        }
+
+        char *end;
+        long count = strtol( text, &end, DECIMAL );
+        if ( *end != '\0' || count < 1 || count > INT_MAX ) {
+                return false;
+        }
+
+        *value = ( int ) count;
+        return true;
+}
+
+bool parseSize( char const *text, uint64_t *value )
+{
+        // strtoull would accept signs and spaces, so digits are checked first
+        if ( text == NULL || *text < '0' || *text > '9' ) {
+                return false;
+        }
+
+        char *end;
+        errno = 0;
+        uint64_t count = strtoull( text, &end, DECIMAL );
+        char const *suffixes = "KMG";
+        char const *suffix = *end != '\0' ? strchr( suffixes, *end ) : NULL;
+        int shift = 0;
+        if ( suffix != NULL ) {
+                shift = ( int ) ( suffix - suffixes + 1 ) * KIBI_BITS;
+                end++;
+        }
+
+        if ( *end != '\0' || errno != 0 || count > UINT64_MAX >> shift ) {
+                return false;
+        }
+
+        *value = count << shift;
+        return true;
+}
+
+/**
+        This function parses a range written as OFFSET:LEN, two unsigned
+        decimal numbers.
+
+        @param text The text to parse, possibly NULL
+        @param offset Where to store the offset
+        @param length Where to store the length
+        @return False if text isn't a range that fits in 64 bits
+ */
+static bool parseRange( char const *text, uint64_t *offset, uint64_t *length )
+{
+        // strtoull would accept signs and spaces, so digits are checked first
+        if ( text == NULL || *text < '0' || *text > '9' ) {
+                return false;
+        }
+
+        char *end;
+        errno = 0;
+        *offset = strtoull( text, &end, DECIMAL );
+        if ( *end != ':' || end[ 1 ] < '0' || end[ 1 ] > '9' ) {
+                return false;
+        }
+
+        *length = strtoull( end + 1, &end, DECIMAL );
+        return *end == '\0' && errno == 0 && *offset <= UINT64_MAX - *length;
+}
+
+/**
+        This function records the mode a flag asks for, refusing a second
+        flag that asks for a different one, so no flag is silently ignored.
+
+        @param options The options being filled in
+        @param mode The mode the flag asks for
+        @param chosen Whether a flag has chosen a mode yet, set here
+        @return False if another mode was already chosen
+ */
+static bool chooseMode( Options *options, CipherMode mode, bool *chosen )
+{
+        if ( *chosen && options->mode != mode ) {
+                return false;
+        }
+
+        options->mode = mode;
+        *chosen = true;
+        return true;
+}
+
+bool parseOptions( Options *options, int argc, char *argv[] )
+{
+        options->mode = MODE_ECB;
+        options->ivFile = NULL;
+        options->unitSize = 0;
+        options->hasRange = false;
+        options->rangeOffset = 0;
+        options->rangeLength = 0;
+        options->useMap = false;
+        options->useRing = false;
+        options->inPlace = false;
+        options->jobs = 0;
+        options->stats = false;
+        options->statsFile = NULL;
+
+        // Sorts the arguments into options and file names
+        char const *files[ FILE_COUNT ];
+        int fileCount = 0;
+        bool chosen = false;
+        int i = 0;
+        for ( i = 1; i < argc; i++ ) {
+                if ( strcmp( argv[ i ], "--mmap" ) == 0 ) {
+                        options->useMap = true;
+                } else if ( strcmp( argv[ i ], "--io-uring" ) == 0 ) {
+                        options->useRing = true;
+                } else if ( strcmp( argv[ i ], "--in-place" ) == 0 ) {
+                        options->inPlace = true;
+                        options->useMap = true;
+                } else if ( strcmp( argv[ i ], "--ctr" ) == 0 ||
+                            strcmp( argv[ i ], "--cbc" ) == 0 ||
+                            strcmp( argv[ i ], "--gcm" ) == 0 ) {
+                        CipherMode mode = strcmp( argv[ i ], "--ctr" ) == 0 ?
+                                MODE_CTR : strcmp( argv[ i ], "--cbc" ) == 0 ?
+                                MODE_CBC : MODE_GCM;
+
+                        // The file name is the next argument
+                        options->ivFile = argv[ ++i ];
+                        if ( options->ivFile == NULL ||
+                             !chooseMode( options, mode, &chosen ) ) {
+                                return false;
+                        }
+                } else if ( strcmp( argv[ i ], "--container" ) == 0 ) {
+                        if ( !chooseMode( options, MODE_CONTAINER, &chosen ) ) {
+                                return false;
+                        }
+                } else if ( strcmp( argv[ i ], "--siv" ) == 0 ) {
+                        if ( !chooseMode( options, MODE_SIV, &chosen ) ) {
+                                return false;
+                        }
+                } else if ( strcmp( argv[ i ], "--range" ) == 0 ) {
+                        // A range only makes sense within a container
+                        options->hasRange = true;
+                        if ( !chooseMode( options, MODE_CONTAINER, &chosen ) ||
+                             !parseRange( argv[ ++i ], &options->rangeOffset,
+                                          &options->rangeLength ) ) {
+                                return false;
+                        }
+                } else if ( strcmp( argv[ i ], "--xts" ) == 0 ) {
+                        // Only the two common sector sizes are accepted
+                        if ( !chooseMode( options, MODE_XTS, &chosen ) ||
+                             !parseCount( argv[ ++i ], &options->unitSize ) ||
+                             ( options->unitSize != SECTOR_UNIT &&
+                               options->unitSize != PAGE_UNIT ) ) {
+                                return false;
+                        }
+                } else if ( strcmp( argv[ i ], "-j" ) == 0 ||
+                            strcmp( argv[ i ], "--jobs" ) == 0 ) {
+                        // The count is the next argument
+                        if ( !parseCount( argv[ ++i ], &options->jobs ) ) {
+                                return false;
+                        }
+                } else if ( strncmp( argv[ i ], "-j", 2 ) == 0 ) {
+                        if ( !parseCount( argv[ i ] + 2, &options->jobs ) ) {
+                                return false;
+                        }
+                } else if ( strcmp( argv[ i ], "--stats" ) == 0 ) {
+                        options->stats = true;
+                } else if ( strncmp( argv[ i ], STATS_PREFIX,
+                                     strlen( STATS_PREFIX ) ) == 0 &&
+                            argv[ i ][ strlen( STATS_PREFIX ) ] != '\0' ) {
+                        options->stats = true;
+                        options->statsFile = argv[ i ] + strlen( STATS_PREFIX );
+                } else if ( strncmp( argv[ i ], "--", 2 ) == 0 ||
+                            fileCount == FILE_COUNT ) {
+                        return false;
+                } else {
+                        files[ fileCount++ ] = argv[ i ];
+                }
+        }
+
+        // io_uring streams, so it has nothing to do with mappings
+        if ( options->useRing && options->useMap ) {
+                return false;
+        }
+
+        // The tag makes GCM output longer than its input, and CBC decryption
+        // needs ciphertext that in place would already be overwritten
+        if ( ( options->mode == MODE_GCM || options->mode == MODE_CBC ) &&
+             options->inPlace ) {
+                return false;
+        }
+
+        // Containers and SIV records are a different size from their
+        // plaintext and are read and written a chunk at a time
+        if ( ( options->mode == MODE_CONTAINER || options->mode == MODE_SIV ) &&
+             ( options->useMap || options->useRing ) ) {
+                return false;
+        }
+
+        // In place there is no output file
+        int needed = options->inPlace ? FILE_COUNT - 1 : FILE_COUNT;
+        if ( fileCount != needed ) {
+                return false;
+        }
+
+        options->keyFile = files[ 0 ];
+        options->inputFile = files[ 1 ];
+        options->outputFile = options->inPlace ? NULL : files[ 2 ];
+        return true;
+}
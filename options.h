@@ -0,0 +1,149 @@
+/**
+        @file options.h
+        @author James O Kocak (jokocak)
+
+        The header file for the options.c component of the program. This
+        component parses the command line shared by encrypt and decrypt.
+ */
+
+#ifndef _OPTIONS_H_
+#define _OPTIONS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Modes of operation the programs can use. */
+typedef enum {
+        /** Each block encrypted on its own; the input must be whole blocks. */
+        MODE_ECB,
+
+        /** Counter mode, for inputs of any length. */
+        MODE_CTR,
+
+        /** Cipher block chaining; encryption runs on one thread. */
+        MODE_CBC,
+
+        /** Counter mode with a GHASH tag stored after the ciphertext. */
+        MODE_GCM,
+
+        /** XTS, each data unit encrypted on its own under a 32-byte key. */
+        MODE_XTS,
+
+        /** A seekable container of chunks, each sealed with GCM. */
+        MODE_CONTAINER,
+
+        /** Content-defined chunks, each sealed with deterministic AES-SIV. */
+        MODE_SIV
+} CipherMode;
+
+/** The command line of encrypt or decrypt, once parsed. */
+typedef struct {
+        /** The file holding the key. */
+        char const *keyFile;
+
+        /** The file to read. */
+        char const *inputFile;
+
+        /** The file to write, or NULL when transforming in place. */
+        char const *outputFile;
+
+        /** The mode of operation. */
+        CipherMode mode;
+
+        /** The file holding the IV, or NULL for ECB and XTS. */
+        char const *ivFile;
+
+        /** Bytes in each XTS data unit. */
+        int unitSize;
+
+        /** Whether only part of a container's plaintext is wanted. */
+        bool hasRange;
+
+        /** Where the wanted part starts in the plaintext. */
+        uint64_t rangeOffset;
+
+        /** Number of bytes in the wanted part. */
+        uint64_t rangeLength;
+
+        /** Whether to go through memory mappings instead of streaming. */
+        bool useMap;
+
+        /** Whether to stream through io_uring instead of pread and pwrite. */
+        bool useRing;
+
+        /** Whether to overwrite the input file with its own result. */
+        bool inPlace;
+
+        /** Number of threads to use, or zero for one per processor. */
+        int jobs;
+
+        /** Whether to time each stage and report it when done. */
+        bool stats;
+
+        /** The file to write the stats to as JSON, or NULL for stderr. */
+        char const *statsFile;
+} Options;
+
+#endif
+
+/**
+        This function parses the arguments of encrypt or decrypt. Options may
+        come before or between the file names:
+
+            --ctr IV-FILE
+                        use CTR mode, counting up from the 16-byte block in
+                        IV-FILE, instead of ECB; any input length is allowed
+            --cbc IV-FILE
+                        use CBC with the 16-byte IV in IV-FILE; can't be
+                        used in place
+            --gcm IV-FILE
+                        use GCM with the 12-byte IV in IV-FILE; the tag
+                        follows the ciphertext, and can't be used in place
+            --xts SIZE  use XTS with SIZE-byte data units, 512 or 4096; the
+                        key file holds the data key and then the tweak key
+            --container write or read a seekable container of chunks,
+                        each sealed with GCM under its own nonce
+            --siv       cut the input into content-defined chunks and seal
+                        each with AES-SIV under a 32-byte key, so equal
+                        chunks give equal ciphertext
+            --range OFFSET:LEN
+                        decrypt only LEN bytes of a container's plaintext,
+                        starting at OFFSET, reading only the chunks needed
+            --mmap      map the input and output files instead of streaming
+            --in-place  map the input file and overwrite it; no output file
+            --io-uring  keep several reads and writes in flight with io_uring;
+                        can't be combined with --mmap or --in-place
+            -j N, --jobs N
+                        use N threads instead of one per processor
+            --stats, --stats=FILE
+                        time each stage and report bytes, time and MB/s per
+                        stage, CPU time and peak memory on stderr, or as
+                        JSON in FILE
+
+        At most one mode may be chosen; --range chooses --container.
+
+        @param options The options to fill in
+        @param argc The number of arguments
+        @param argv An array of the arguments
+        @return False if the arguments don't fit the usage
+ */
+bool parseOptions( Options *options, int argc, char *argv[] );
+
+/**
+        This function parses a positive decimal count.
+
+        @param text The text to parse, possibly NULL
+        @param value Where to store the count
+        @return False if text isn't a positive number that fits in an int
+ */
+bool parseCount( char const *text, int *value );
+
+/**
+        This function parses a byte count, a decimal number optionally
+        followed by K, M or G for binary multiples.
+
+        @param text The text to parse, possibly NULL
+        @param value Where to store the count
+        @return False if text isn't a count that fits in 64 bits
+ */
+bool parseSize( char const *text, uint64_t *value );
@@ -0,0 +1,430 @@
+/**
+        @file pipeline.c
+        @author James O Kocak (jokocak)
+
+        This component moves a whole input file through a chunk function and
+        into the output. The file is cut into chunks, which are the tasks
+        handed to the thread pool.
+ */
+
+/** Exposes fileno and lseek under -std=c99. */
+#define _DEFAULT_SOURCE
+
+#include "pipeline.h"
+#include "pool.h"
+#include "stats.h"
+#include <errno.h>
+#include <unistd.h>
+
+/** One pipelineStream or pipelineMapped call, shared by its threads. */
+typedef struct {
+        /** The function transforming each chunk. */
+        ChunkFunction function;
+
+        /** Its argument. */
+        void *arg;
+
+        /** The input stream, for pipelineStream. */
+        ChunkStream *input;
+
+        /** The output stream, for pipelineStream. */
+        ChunkStream *output;
+
+        /** One chunk buffer per thread, for pipelineStream. */
+        byte **buffers;
+
+        /** The input bytes, for pipelineMapped. */
+        byte const *from;
+
+        /** The output bytes, for pipelineMapped. */
+        byte *to;
+
+        /** Total number of bytes to transform. */
+        off_t size;
+
+        /** Bytes in every chunk but the last. */
+        size_t chunkSize;
+} Job;
+
+/** One of the buffers circulating through pipelineRing. */
+typedef struct {
+        /** The chunk's bytes. */
+        byte *buffer;
+
+        /** Where the chunk starts in the file. */
+        off_t offset;
+
+        /** Number of bytes in the chunk. */
+        size_t length;
+
+        /** Number of bytes read or written so far. */
+        size_t done;
+
+        /** Whether the chunk is being written rather than read. */
+        bool writing;
+} RingSlot;
+
+/** A chunk split across the pool by pipelineRing. */
+typedef struct {
+        /** The function transforming each piece. */
+        ChunkFunction function;
+
+        /** Its argument. */
+        void *arg;
+
+        /** The chunk being transformed. */
+        RingSlot const *slot;
+
+        /** Bytes in every piece but the last. */
+        size_t pieceSize;
+} Split;
+
+/**
+        This function returns the number of chunks in a job.
+
+        @param job The job
+        @return The number of chunks, counting a short last one
+ */
+static size_t chunkCount( Job const *job )
+{
+        return ( size_t ) ( ( job->size + job->chunkSize - 1 ) /
+                        job->chunkSize );
+}
+
+/**
+        This function returns the length of one chunk of a file.
+
+        @param job The job
+        @param chunk The chunk number
+        @return The number of bytes in the chunk
+ */
+static size_t chunkLength( Job const *job, size_t chunk )
+{
+        off_t left = job->size - ( off_t ) ( chunk * job->chunkSize );
+        return left < ( off_t ) job->chunkSize ? ( size_t ) left :
+                job->chunkSize;
+}
+
+/**
+        This function reports an input that changed size while being read.
+
+        @param name The input file
+ */
+static void changedError( char const *name )
+{
+        fprintf( stderr, "File changed while reading: %s\n", name );
+        exit( EXIT_FAILURE );
+}
+
+/**
+        This pool task reads one chunk with pread, transforms it in the
+        thread's buffer and writes it back with pwrite.
+
+        @param arg The Job
+        @param worker The thread number, selecting the buffer
+        @param chunk The chunk number
+ */
+static void streamChunk( void *arg, int worker, size_t chunk )
+{
+        Job *job = ( Job * ) arg;
+        off_t offset = ( off_t ) chunk * job->chunkSize;
+        size_t length = chunkLength( job, chunk );
+        byte *buffer = job->buffers[ worker ];
+
+        uint64_t begin = statsBegin();
+        if ( readChunkAt( job->input, buffer, length, offset ) != length ) {
+                changedError( job->input->name );
+        }
+
+        begin = statsEnd( STAGE_READ, begin, length );
+        job->function( job->arg, buffer, buffer, length, offset );
+        begin = statsEnd( STAGE_CIPHER, begin, length );
+        writeChunkAt( job->output, buffer, length, offset );
+        statsEnd( STAGE_WRITE, begin, length );
+}
+
+/**
+        This pool task transforms one chunk of a mapping.
+
+        @param arg The Job
+        @param worker The thread number, unused
+        @param chunk The chunk number
+ */
+static void mappedChunk( void *arg, int worker, size_t chunk )
+{
+        Job *job = ( Job * ) arg;
+        size_t offset = chunk * job->chunkSize;
+        size_t length = chunkLength( job, chunk );
+
+        // Pages are read and written as the function touches them
+        uint64_t begin = statsBegin();
+        job->function( job->arg, job->from + offset, job->to + offset,
+                        length, ( off_t ) offset );
+        statsEnd( STAGE_CIPHER, begin, length );
+}
+
+void pipelineStream( ChunkStream *input, char const *outputFile, int threads,
+                        size_t unit, ChunkFunction function, void *arg )
+{
+        ChunkStream output;
+        openChunkWriter( &output, outputFile );
+
+        // One thread reads in order, and so must anything given a pipe,
+        // which has no offsets to read or write at
+        if ( threads <= 1 || !input->regular || !output.regular ) {
+                off_t offset = 0;
+                size_t length;
+                uint64_t begin = statsBegin();
+                while ( ( length = readChunk( input ) ) > 0 ) {
+                        if ( length % unit != 0 ) {
+                                changedError( input->name );
+                        }
+
+                        begin = statsEnd( STAGE_READ, begin, length );
+                        function( arg, input->buffer, input->buffer, length,
+                                offset );
+                        begin = statsEnd( STAGE_CIPHER, begin, length );
+                        writeChunk( &output, input->buffer, length );
+                        begin = statsEnd( STAGE_WRITE, begin, length );
+                        offset += length;
+                }
+
+                closeChunkStream( input );
+                closeChunkStream( &output );
+                return;
+        }
+
+        Job job = { function, arg, input, &output, NULL, NULL, NULL,
+                input->size, input->chunkSize };
+        size_t chunks = chunkCount( &job );
+        if ( ( size_t ) threads > chunks ) {
+                threads = chunks > 0 ? ( int ) chunks : 1;
+        }
+
+        // The reader's own buffer serves the calling thread
+        job.buffers = ( byte ** ) malloc( threads * sizeof( byte * ) );
+        if ( job.buffers == NULL ) {
+                fprintf( stderr, "Out of memory\n" );
+                exit( EXIT_FAILURE );
+        }
+
+        int w = 0;
+        job.buffers[ 0 ] = input->buffer;
+        for ( w = 1; w < threads; w++ ) {
+                job.buffers[ w ] = allocateBuffer( job.chunkSize );
+        }
+
+        runPool( chunks, threads, streamChunk, &job );
+
+        // Nothing may have been added after the measured size
+        byte extra;
+        if ( readChunkAt( input, &extra, 1, input->size ) != 0 ) {
+                changedError( input->name );
+        }
+
+        for ( w = 1; w < threads; w++ ) {
+                free( job.buffers[ w ] );
+        }
+
+        free( job.buffers );
+        closeChunkStream( input );
+        closeChunkStream( &output );
+}
+
+void pipelineMapped( FileMapping *input, char const *outputFile, int threads,
+                        ChunkFunction function, void *arg )
+{
+        FileMapping output = *input;
+        if ( outputFile != NULL ) {
+                mapOutput( &output, outputFile, input->size );
+        }
+
+        Job job = { function, arg, NULL, NULL, NULL, input->data, output.data,
+                ( off_t ) input->size, DEFAULT_CHUNK_SIZE };
+        runPool( chunkCount( &job ), threads, mappedChunk, &job );
+
+        if ( outputFile != NULL ) {
+                unmapFile( &output );
+        }
+
+        unmapFile( input );
+}
+
+/**
+        This pool task transforms one piece of a chunk read through the ring.
+
+        @param arg The Split
+        @param worker The thread number, unused
+        @param piece The piece number
+ */
+static void splitPiece( void *arg, int worker, size_t piece )
+{
+        Split *split = ( Split * ) arg;
+        size_t start = piece * split->pieceSize;
+        size_t length = split->slot->length - start;
+        if ( length > split->pieceSize ) {
+                length = split->pieceSize;
+        }
+
+        byte *bytes = split->slot->buffer + start;
+        split->function( split->arg, bytes, bytes, length,
+                        split->slot->offset + ( off_t ) start );
+}
+
+/**
+        This function points a free slot at the next chunk of the input.
+
+        @param slot The slot to fill in
+        @param next Where the next chunk starts, advanced past it
+        @param input The input stream
+ */
+static void claimChunk( RingSlot *slot, off_t *next, ChunkStream const *input )
+{
+        off_t left = input->size - *next;
+        slot->offset = *next;
+        slot->length = left < ( off_t ) input->chunkSize ? ( size_t ) left :
+                input->chunkSize;
+        slot->done = 0;
+        slot->writing = false;
+        *next += slot->length;
+}
+
+/**
+        This function queues whatever part of a slot's chunk hasn't been
+        read or written yet.
+
+        @param ring The ring to queue on
+        @param slots Every slot, so the tag can be the slot's number
+        @param tag The slot's number
+        @param input The input stream
+        @param output The output stream
+ */
+static void queueSlot( IoRing *ring, RingSlot *slots, size_t tag,
+                        ChunkStream *input, ChunkStream *output )
+{
+        RingSlot *slot = &slots[ tag ];
+        byte *rest = slot->buffer + slot->done;
+        size_t left = slot->length - slot->done;
+        off_t offset = slot->offset + ( off_t ) slot->done;
+        if ( slot->writing ) {
+                queueRingWrite( ring, output, rest, left, offset, tag );
+        } else {
+                queueRingRead( ring, input, rest, left, offset, tag );
+        }
+}
+
+void pipelineRing( ChunkStream *input, char const *outputFile, int threads,
+                        size_t unit, ChunkFunction function, void *arg )
+{
+        // Reads at an offset need a regular file, not a pipe
+        IoRing ring;
+        if ( lseek( fileno( input->file ), 0, SEEK_CUR ) < 0 ||
+             !openIoRing( &ring, 2 * RING_CHUNKS ) ) {
+                pipelineStream( input, outputFile, threads, unit, function,
+                                arg );
+                return;
+        }
+
+        ChunkStream output;
+        openChunkWriter( &output, outputFile );
+
+        // The reader's own buffer is the first slot
+        RingSlot slots[ RING_CHUNKS ];
+        size_t s = 0;
+        for ( s = 0; s < RING_CHUNKS; s++ ) {
+                slots[ s ].buffer = s == 0 ? input->buffer :
+                        allocateBuffer( input->chunkSize );
+        }
+
+        // One pool serves every chunk, so no thread is started per chunk
+        ThreadPool *pool = poolCreate( threads );
+        off_t next = 0;
+        int active = 0;
+        for ( s = 0; s < RING_CHUNKS && next < input->size; s++ ) {
+                claimChunk( &slots[ s ], &next, input );
+                queueSlot( &ring, slots, s, input, &output );
+                active++;
+        }
+
+        while ( active > 0 ) {
+                // Waiting counts toward whichever transfer finished
+                size_t tag;
+                uint64_t begin = statsBegin();
+                long result = waitIoRing( &ring, &tag );
+                RingSlot *slot = &slots[ tag ];
+                statsEnd( slot->writing ? STAGE_WRITE : STAGE_READ, begin,
+                                result > 0 ? ( uint64_t ) result : 0 );
+                if ( result == -EINTR || result == -EAGAIN ) {
+                        queueSlot( &ring, slots, tag, input, &output );
+                        continue;
+                }
+
+                if ( slot->writing && result <= 0 ) {
+                        fprintf( stderr, "Can't write file: %s\n",
+                                outputFile );
+                        exit( EXIT_FAILURE );
+                }
+
+                if ( result < 0 ) {
+                        fprintf( stderr, "Can't read file: %s\n",
+                                input->name );
+                        exit( EXIT_FAILURE );
+                }
+
+                // Reaching the end early means the input shrank
+                if ( result == 0 ) {
+                        changedError( input->name );
+                }
+
+                slot->done += ( size_t ) result;
+                if ( slot->done < slot->length ) {
+                        queueSlot( &ring, slots, tag, input, &output );
+                        continue;
+                }
+
+                if ( !slot->writing ) {
+                        // Transfers already queued carry on in the kernel
+                        // meanwhile, but none are queued until it's done
+                        // Pieces are whole units, so a short chunk may
+                        // need fewer than threads of them
+                        size_t units = slot->length / unit;
+                        size_t pieceSize = ( units + threads - 1 ) /
+                                threads * unit;
+                        size_t pieces = ( slot->length + pieceSize - 1 ) /
+                                pieceSize;
+                        Split split = { function, arg, slot, pieceSize };
+                        begin = statsBegin();
+                        poolRun( pool, pieces, splitPiece, &split );
+                        statsEnd( STAGE_CIPHER, begin, slot->length );
+
+                        slot->writing = true;
+                        slot->done = 0;
+                        queueSlot( &ring, slots, tag, input, &output );
+                        continue;
+                }
+
+                // The slot is free again, so read the next chunk into it
+                active--;
+                if ( next < input->size ) {
+                        claimChunk( slot, &next, input );
+                        queueSlot( &ring, slots, tag, input, &output );
+                        active++;
+                }
+        }
+
+        closeIoRing( &ring );
+        poolDestroy( pool );
+
+        // Nothing may have been added after the measured size
+        byte extra;
+        if ( readChunkAt( input, &extra, 1, input->size ) != 0 ) {
+                changedError( input->name );
+        }
+
+        for ( s = 1; s < RING_CHUNKS; s++ ) {
+                free( slots[ s ].buffer );
+        }
+
+        closeChunkStream( input );
+        closeChunkStream( &output );
+}
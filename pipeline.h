@@ -0,0 +1,92 @@
+/**
+        @file pipeline.h
+        @author James O Kocak (jokocak)
+
+        The header file for the pipeline.c component of the program. This
+        component moves a whole input file through a chunk function and
+        into the output, on one thread or on a pool of them.
+ */
+
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include "io.h"
+
+/**
+        Number of chunk buffers pipelineRing circulates, enough for a read,
+        a transform and a write to be under way at once with one to spare.
+ */
+#define RING_CHUNKS 4
+
+/**
+        A function transforming one chunk of a file. in and out may be the
+        same buffer. Chunks may be transformed in any order and at the same
+        time on different threads, so any state the argument carries
+        between chunks must either be shared safely or be used only by a
+        serial pipeline.
+
+        @param arg The argument given to the pipeline
+        @param in The chunk's bytes
+        @param out Where to store the transformed bytes
+        @param length The number of bytes in the chunk
+        @param offset Where the chunk starts in the file
+ */
+typedef void ( *ChunkFunction )( void *arg, byte const *in, byte *out,
+                        size_t length, off_t offset );
+
+#endif
+
+/**
+        This function streams an input file through a chunk function into a
+        new output file, one chunk of the reader's size at a time. With one
+        thread, or when either file isn't a regular file, the input is read
+        sequentially, so pipes work too. Otherwise every thread reads its
+        chunks with pread into a buffer of its own and writes them back with
+        pwrite at the same offset, so the output comes out in order without
+        a merge step. Every chunk must hold a multiple
+        of unit bytes; if the input changes size while it is being read the
+        program exits.
+
+        @param input The open input file, closed when done
+        @param outputFile The file to write
+        @param threads The number of threads to use
+        @param unit The number of bytes every chunk must be a multiple of
+        @param function The function transforming each chunk
+        @param arg The argument passed to the function
+ */
+void pipelineStream( ChunkStream *input, char const *outputFile, int threads,
+                        size_t unit, ChunkFunction function, void *arg );
+
+/**
+        This function runs a chunk function from a mapped input into a mapped
+        output, or within the input when outputFile is NULL. Threads take
+        DEFAULT_CHUNK_SIZE chunks of the mapping as in pipelineStream.
+
+        @param input The mapped input file, unmapped when done
+        @param outputFile The file to write, or NULL to work in place
+        @param threads The number of threads to use
+        @param function The function transforming each chunk
+        @param arg The argument passed to the function
+ */
+void pipelineMapped( FileMapping *input, char const *outputFile, int threads,
+                        ChunkFunction function, void *arg );
+
+/**
+        This function streams an input file through a chunk function like
+        pipelineStream, but drives the reads and writes through io_uring so
+        the disk keeps working while the chunk function runs. RING_CHUNKS
+        buffers circulate: while one chunk is transformed, the next ones are
+        being read and the previous ones written. With more than one thread
+        each chunk is split across the pool. Where io_uring is unavailable,
+        or the input can't be read at an offset, it falls back to
+        pipelineStream.
+
+        @param input The open input file, closed when done
+        @param outputFile The file to write
+        @param threads The number of threads to use
+        @param unit The number of bytes every chunk must be a multiple of
+        @param function The function transforming each chunk
+        @param arg The argument passed to the function
+ */
+void pipelineRing( ChunkStream *input, char const *outputFile, int threads,
+                        size_t unit, ChunkFunction function, void *arg );
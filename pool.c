@@ -0,0 +1,343 @@
+/**
+        @file pool.c
+        @author James O Kocak (jokocak)
+
+        This component runs numbered tasks on a pool of POSIX threads. Every
+        thread owns a range of task numbers behind its own lock, so threads
+        only contend when one of them steals. A pool made with poolCreate
+        keeps its threads waiting between runs, for callers that run many
+        small batches.
+ */
+
+/** Exposes sysconf's processor count under -std=c99. */
+#define _DEFAULT_SOURCE
+
+#include "pool.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/** Bytes in a cache line, used to keep ranges on separate lines. */
+#define CACHE_LINE 64
+
+/** The tasks a thread has not started yet, from next up to end. */
+typedef struct {
+        /** Guards next and end. */
+        pthread_mutex_t lock;
+
+        /** The first task not taken yet. */
+        size_t next;
+
+        /** One past the last task in the range. */
+        size_t end;
+
+        /** Keeps neighbouring ranges off this cache line. */
+        char padding[ CACHE_LINE ];
+} TaskRange;
+
+/** A pool of threads kept between runs, and the run in progress. */
+struct ThreadPool {
+        /** One range per thread. */
+        TaskRange *ranges;
+
+        /** The number of threads, counting the one calling poolRun. */
+        int threads;
+
+        /** The number of threads taking part in the current run. */
+        int active;
+
+        /** The function running one task of the current run. */
+        PoolTask task;
+
+        /** The argument for every task of the current run. */
+        void *arg;
+
+        /** One Worker per thread. */
+        struct Worker *workers;
+
+        /** The helper threads, from index one; the caller is thread zero. */
+        pthread_t *ids;
+
+        /** Guards generation, running and stopping. */
+        pthread_mutex_t lock;
+
+        /** Signalled when a run starts or the helpers should stop. */
+        pthread_cond_t start;
+
+        /** Signalled when the last helper finishes its part of a run. */
+        pthread_cond_t finished;
+
+        /** Counts the runs started, so a helper can tell a new one. */
+        unsigned long generation;
+
+        /** Number of helpers still working on the current run. */
+        int running;
+
+        /** Whether the helpers should exit. */
+        bool stopping;
+};
+
+/** What one thread needs to know: the pool and its own number. */
+typedef struct Worker {
+        /** The shared pool. */
+        ThreadPool *pool;
+
+        /** This thread's number. */
+        int worker;
+} Worker;
+
+/**
+        This function takes the next task from the front of a range.
+
+        @param range The range to take from
+        @param task Where to store the task number
+        @return False if the range was empty
+ */
+static bool takeFront( TaskRange *range, size_t *task )
+{
+        pthread_mutex_lock( &range->lock );
+        bool found = range->next < range->end;
+        if ( found ) {
+                *task = range->next++;
+        }
+
+        pthread_mutex_unlock( &range->lock );
+        return found;
+}
+
+/**
+        This function steals the back half of another thread's range. The
+        first stolen task is returned to run now and the rest become the
+        thief's own range.
+
+        @param pool The pool
+        @param thief The number of the stealing thread
+        @param task Where to store the task to run
+        @return False if every other range was empty
+ */
+static bool steal( ThreadPool *pool, int thief, size_t *task )
+{
+        int i = 0;
+        for ( i = 1; i < pool->active; i++ ) {
+                TaskRange *victim = &pool->ranges[ ( thief + i ) % pool->active ];
+
+                pthread_mutex_lock( &victim->lock );
+                size_t left = victim->end - victim->next;
+                size_t start = victim->end - ( left + 1 ) / 2;
+                size_t end = victim->end;
+                victim->end = start;
+                pthread_mutex_unlock( &victim->lock );
+
+                if ( left > 0 ) {
+                        // Nobody steals from an empty range, so this is safe
+                        TaskRange *own = &pool->ranges[ thief ];
+                        pthread_mutex_lock( &own->lock );
+                        own->next = start + 1;
+                        own->end = end;
+                        pthread_mutex_unlock( &own->lock );
+
+                        *task = start;
+                        return true;
+                }
+        }
+
+        return false;
+}
+
+/**
+        This function runs one thread's part of a run: its own tasks, then
+        whatever it can steal until there is nothing left anywhere.
+
+        @param self The Worker describing this thread
+ */
+static void work( Worker *self )
+{
+        ThreadPool *pool = self->pool;
+        size_t task;
+        while ( takeFront( &pool->ranges[ self->worker ], &task ) ||
+                steal( pool, self->worker, &task ) ) {
+                pool->task( pool->arg, self->worker, task );
+        }
+}
+
+/**
+        This function is the body of every helper thread: it waits for each
+        run, takes part if the run needs it, and exits when the pool is
+        destroyed.
+
+        @param arg The Worker describing this thread
+        @return Nothing
+ */
+static void *helperMain( void *arg )
+{
+        Worker *self = ( Worker * ) arg;
+        ThreadPool *pool = self->pool;
+        unsigned long seen = 0;
+        pthread_mutex_lock( &pool->lock );
+        while ( true ) {
+                while ( !pool->stopping && pool->generation == seen ) {
+                        pthread_cond_wait( &pool->start, &pool->lock );
+                }
+
+                if ( pool->stopping ) {
+                        break;
+                }
+
+                seen = pool->generation;
+                bool joining = self->worker < pool->active;
+                pthread_mutex_unlock( &pool->lock );
+                if ( joining ) {
+                        work( self );
+                }
+
+                pthread_mutex_lock( &pool->lock );
+                if ( joining && --pool->running == 0 ) {
+                        pthread_cond_signal( &pool->finished );
+                }
+        }
+
+        pthread_mutex_unlock( &pool->lock );
+        return NULL;
+}
+
+int defaultThreadCount( void )
+{
+        long count = sysconf( _SC_NPROCESSORS_ONLN );
+        return count > 0 ? ( int ) count : 1;
+}
+
+ThreadPool *poolCreate( int threads )
+{
+        ThreadPool *pool = ( ThreadPool * ) calloc( 1, sizeof( ThreadPool ) );
+        if ( threads < 1 ) {
+                threads = 1;
+        }
+
+        if ( pool != NULL ) {
+                pool->threads = threads;
+                pool->ranges = ( TaskRange * ) malloc( threads *
+                                sizeof( TaskRange ) );
+                pool->workers = ( Worker * ) malloc( threads *
+                                sizeof( Worker ) );
+                pool->ids = ( pthread_t * ) malloc( threads *
+                                sizeof( pthread_t ) );
+        }
+
+        if ( pool == NULL || pool->ranges == NULL || pool->workers == NULL ||
+             pool->ids == NULL ) {
+                fprintf( stderr, "Out of memory\n" );
+                exit( EXIT_FAILURE );
+        }
+
+        pthread_mutex_init( &pool->lock, NULL );
+        pthread_cond_init( &pool->start, NULL );
+        pthread_cond_init( &pool->finished, NULL );
+        int w = 0;
+        for ( w = 0; w < threads; w++ ) {
+                pthread_mutex_init( &pool->ranges[ w ].lock, NULL );
+                pool->workers[ w ].pool = pool;
+                pool->workers[ w ].worker = w;
+        }
+
+        // The thread calling poolRun works as thread zero
+        for ( w = 1; w < threads; w++ ) {
+                if ( pthread_create( &pool->ids[ w ], NULL, helperMain,
+                                &pool->workers[ w ] ) != 0 ) {
+                        fprintf( stderr, "Can't start thread\n" );
+                        exit( EXIT_FAILURE );
+                }
+        }
+
+        return pool;
+}
+
+void poolRun( ThreadPool *pool, size_t taskCount, PoolTask task, void *arg )
+{
+        // Never more threads than tasks
+        int active = pool->threads;
+        if ( ( size_t ) active > taskCount ) {
+                active = taskCount > 0 ? ( int ) taskCount : 1;
+        }
+
+        size_t i = 0;
+        if ( active <= 1 ) {
+                for ( i = 0; i < taskCount; i++ ) {
+                        task( arg, 0, i );
+                }
+
+                return;
+        }
+
+        // Deals out contiguous shares so each thread reads sequentially
+        int w = 0;
+        for ( w = 0; w < active; w++ ) {
+                pool->ranges[ w ].next = taskCount * w / active;
+                pool->ranges[ w ].end = taskCount * ( w + 1 ) / active;
+        }
+
+        pthread_mutex_lock( &pool->lock );
+        pool->active = active;
+        pool->task = task;
+        pool->arg = arg;
+        pool->running = active - 1;
+        pool->generation++;
+        pthread_cond_broadcast( &pool->start );
+        pthread_mutex_unlock( &pool->lock );
+
+        work( &pool->workers[ 0 ] );
+
+        pthread_mutex_lock( &pool->lock );
+        while ( pool->running > 0 ) {
+                pthread_cond_wait( &pool->finished, &pool->lock );
+        }
+
+        pthread_mutex_unlock( &pool->lock );
+}
+
+void poolDestroy( ThreadPool *pool )
+{
+        pthread_mutex_lock( &pool->lock );
+        pool->stopping = true;
+        pthread_cond_broadcast( &pool->start );
+        pthread_mutex_unlock( &pool->lock );
+
+        int w = 0;
+        for ( w = 1; w < pool->threads; w++ ) {
+                pthread_join( pool->ids[ w ], NULL );
+        }
+
+        for ( w = 0; w < pool->threads; w++ ) {
+                pthread_mutex_destroy( &pool->ranges[ w ].lock );
+        }
+
+        pthread_cond_destroy( &pool->finished );
+        pthread_cond_destroy( &pool->start );
+        pthread_mutex_destroy( &pool->lock );
+        free( pool->ids );
+        free( pool->workers );
+        free( pool->ranges );
+        free( pool );
+}
+
+void runPool( size_t taskCount, int threads, PoolTask task, void *arg )
+{
+        // Never more threads than tasks, so none are started for nothing
+        if ( ( size_t ) threads > taskCount ) {
+                threads = taskCount > 0 ? ( int ) taskCount : 1;
+        }
+
+        size_t i = 0;
+        if ( threads <= 1 ) {
+                for ( i = 0; i < taskCount; i++ ) {
+                        task( arg, 0, i );
+                }
+
+                return;
+        }
+
+        ThreadPool *pool = poolCreate( threads );
+        poolRun( pool, taskCount, task, arg );
+        poolDestroy( pool );
+}
@@ -0,0 +1,81 @@
+/**
+        @file pool.h
+        @author James O Kocak (jokocak)
+
+        The header file for the pool.c component of the program. This
+        component runs numbered tasks on a pool of threads that steal work
+        from each other, so uneven tasks still keep every thread busy. The
+        threads are started for one run, or kept for many.
+ */
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <stddef.h>
+
+/**
+        A task run by the pool. Tasks with different numbers may run at the
+        same time on different threads.
+
+        @param arg The argument given to runPool
+        @param worker The number of the thread running the task, from zero
+                        to one less than the thread count
+        @param task The number of the task to run
+ */
+typedef void ( *PoolTask )( void *arg, int worker, size_t task );
+
+/** A pool of threads kept between runs; its insides are pool.c's own. */
+typedef struct ThreadPool ThreadPool;
+
+#endif
+
+/**
+        This function returns the number of processors online, the default
+        number of threads.
+
+        @return The number of processors, at least one
+ */
+int defaultThreadCount( void );
+
+/**
+        This function runs tasks zero to taskCount - 1 on the given number of
+        threads and returns once all have finished. Each thread starts with
+        a contiguous share of the tasks and takes them in order; a thread
+        that runs out steals the back half of another thread's share. With
+        one thread everything runs on the calling thread, in order.
+
+        @param taskCount The number of tasks
+        @param threads The number of threads to use
+        @param task The function running one task
+        @param arg The argument passed to every task
+ */
+void runPool( size_t taskCount, int threads, PoolTask task, void *arg );
+
+/**
+        This function starts a pool whose threads wait between runs, so a
+        caller running many batches pays for starting them only once.
+
+        @param threads The number of threads, counting the one that will
+                        call poolRun
+        @return The pool
+ */
+ThreadPool *poolCreate( int threads );
+
+/**
+        This function runs tasks zero to taskCount - 1 on a pool, the same
+        way runPool does, and returns once all have finished. Only one run
+        may be in progress on a pool at a time.
+
+        @param pool The pool
+        @param taskCount The number of tasks
+        @param task The function running one task
+        @param arg The argument passed to every task
+ */
+void poolRun( ThreadPool *pool, size_t taskCount, PoolTask task, void *arg );
+
+/**
+        This function stops a pool's threads and frees it.
+
+        @param pool The pool
+ */
+void poolDestroy( ThreadPool *pool );
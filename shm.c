@@ -0,0 +1,332 @@
+/**
+        @file shm.c
+        @author James O Kocak (jokocak)
+
+        This component creates, hands over and maps aesd's shared rings, and
+        moves entries through them with atomic loads and stores on the
+        indexes. Both sides work the layout out from the entry count and the
+        data size alone, so the daemon trusts nothing else in the header.
+ */
+
+/** Exposes memfd_create and the file seals, which are Linux's own. */
+#define _GNU_SOURCE
+
+#include "shm.h"
+#include "wire.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/** Bytes in a page; the data area starts on a page boundary. */
+#define SHM_PAGE 4096
+
+/** The seal the daemon insists on, so the region can't shrink under it. */
+#define REQUIRED_SEALS F_SEAL_SHRINK
+
+/**
+        This function rounds a size up to a multiple of a power of two.
+
+        @param size The size
+        @param multiple The power of two
+        @return The rounded size
+ */
+static uint64_t roundUp( uint64_t size, uint64_t multiple )
+{
+        return ( size + multiple - 1 ) & ~( multiple - 1 );
+}
+
+/** Where the parts of a region start. */
+typedef struct {
+        /** The submission ring. */
+        uint64_t submissions;
+
+        /** The completion ring. */
+        uint64_t completions;
+
+        /** The data area. */
+        uint64_t data;
+} Layout;
+
+/**
+        This function works out where the parts of a region start.
+
+        @param entries Number of entries in each ring
+        @return Where the parts start
+ */
+static Layout layOut( uint32_t entries )
+{
+        Layout layout;
+        layout.submissions = roundUp( sizeof( ShmHeader ), SHM_CACHE_LINE );
+        layout.completions = roundUp( layout.submissions +
+                        ( uint64_t ) entries * sizeof( ShmSubmission ),
+                        SHM_CACHE_LINE );
+        layout.data = roundUp( layout.completions + ( uint64_t ) entries *
+                        sizeof( ShmCompletion ), SHM_PAGE );
+        return layout;
+}
+
+/**
+        This function points a view at the parts of its mapped region.
+
+        @param ring The view, whose base and entries are set
+ */
+static void point( ShmRing *ring )
+{
+        Layout layout = layOut( ring->entries );
+        ring->header = ( ShmHeader * ) ring->base;
+        ring->submissions = ( ShmSubmission * ) ( ring->base +
+                        layout.submissions );
+        ring->completions = ( ShmCompletion * ) ( ring->base +
+                        layout.completions );
+        ring->data = ring->base + layout.data;
+}
+
+/**
+        This function returns the size of a region.
+
+        @param entries Number of entries in each ring
+        @param dataSize Number of bytes in the data area
+        @return The size of the region
+ */
+static uint64_t regionSize( uint32_t entries, uint64_t dataSize )
+{
+        return layOut( entries ).data + dataSize;
+}
+
+/**
+        This function checks an entry count.
+
+        @param entries The number of entries
+        @return False unless it is a power of two of at most SHM_MAX_ENTRIES
+ */
+static bool goodEntries( uint32_t entries )
+{
+        return entries > 0 && entries <= SHM_MAX_ENTRIES &&
+                ( entries & ( entries - 1 ) ) == 0;
+}
+
+bool shmCreate( ShmRing *ring, uint32_t entries, uint64_t dataSize )
+{
+        memset( ring, 0, sizeof( *ring ) );
+        ring->memfd = ring->submitFd = ring->completeFd = -1;
+        if ( !goodEntries( entries ) ) {
+                errno = EINVAL;
+                return false;
+        }
+
+        ring->entries = entries;
+        ring->dataSize = dataSize;
+        ring->size = regionSize( entries, dataSize );
+        ring->memfd = memfd_create( "aesd-ring", MFD_CLOEXEC |
+                        MFD_ALLOW_SEALING );
+        ring->submitFd = eventfd( 0, EFD_CLOEXEC );
+        ring->completeFd = eventfd( 0, EFD_CLOEXEC );
+        if ( ring->memfd < 0 || ring->submitFd < 0 || ring->completeFd < 0 ||
+             ftruncate( ring->memfd, ring->size ) != 0 ||
+             fcntl( ring->memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW |
+                    F_SEAL_SEAL ) != 0 ) {
+                int error = errno;
+                shmClose( ring );
+                errno = error;
+                return false;
+        }
+
+        void *base = mmap( NULL, ring->size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, ring->memfd, 0 );
+        if ( base == MAP_FAILED ) {
+                int error = errno;
+                shmClose( ring );
+                errno = error;
+                return false;
+        }
+
+        ring->base = ( byte * ) base;
+        point( ring );
+        ring->header->magic = SHM_MAGIC;
+        ring->header->entries = entries;
+        ring->header->dataSize = dataSize;
+        return true;
+}
+
+int shmAttach( ShmRing *ring, int fd )
+{
+        WireRequest request;
+        memset( &request, 0, sizeof( request ) );
+        request.op = WIRE_ATTACH;
+        int fds[ SHM_FD_COUNT ] = { ring->memfd, ring->submitFd,
+                                    ring->completeFd };
+        WireResponse response;
+        if ( !wireCallPassing( fd, &request, fds, SHM_FD_COUNT, &response ) ) {
+                return -1;
+        }
+
+        return response.status;
+}
+
+bool shmSubmit( ShmRing *ring, ShmSubmission const *entry )
+{
+        uint32_t head = __atomic_load_n( &ring->header->submitHead.value,
+                        __ATOMIC_ACQUIRE );
+        if ( ring->submitIndex - head >= ring->entries ) {
+                return false;
+        }
+
+        ring->submissions[ ring->submitIndex & ( ring->entries - 1 ) ] =
+                *entry;
+        ring->submitIndex++;
+        __atomic_store_n( &ring->header->submitTail.value, ring->submitIndex,
+                        __ATOMIC_RELEASE );
+        return true;
+}
+
+void shmNotify( ShmRing *ring )
+{
+        uint64_t one = 1;
+        if ( write( ring->submitFd, &one, sizeof( one ) ) < 0 ) {
+                return;
+        }
+}
+
+bool shmReap( ShmRing *ring, ShmCompletion *entry )
+{
+        uint32_t tail = __atomic_load_n( &ring->header->completeTail.value,
+                        __ATOMIC_ACQUIRE );
+        if ( tail == ring->completeIndex ) {
+                return false;
+        }
+
+        *entry = ring->completions[ ring->completeIndex &
+                        ( ring->entries - 1 ) ];
+        ring->completeIndex++;
+        __atomic_store_n( &ring->header->completeHead.value,
+                        ring->completeIndex, __ATOMIC_RELEASE );
+        return true;
+}
+
+void shmWait( ShmRing *ring )
+{
+        // The daemon may have made the eventfd non-blocking, so wait in poll
+        struct pollfd ready = { ring->completeFd, POLLIN, 0 };
+        uint64_t count;
+        while ( poll( &ready, 1, -1 ) < 0 && errno == EINTR ) {
+                continue;
+        }
+
+        if ( read( ring->completeFd, &count, sizeof( count ) ) < 0 ) {
+                return;
+        }
+}
+
+bool shmMap( ShmRing *ring, int const fds[ SHM_FD_COUNT ] )
+{
+        memset( ring, 0, sizeof( *ring ) );
+        ring->memfd = fds[ 0 ];
+        ring->submitFd = fds[ 1 ];
+        ring->completeFd = fds[ 2 ];
+        fcntl( ring->submitFd, F_SETFL, fcntl( ring->submitFd, F_GETFL ) |
+                        O_NONBLOCK );
+        fcntl( ring->completeFd, F_SETFL, fcntl( ring->completeFd, F_GETFL ) |
+                        O_NONBLOCK );
+
+        // The header is read once, through pread, so it can't change
+        // between being checked and being used
+        struct stat status;
+        ShmHeader header;
+        int seals = fcntl( ring->memfd, F_GET_SEALS );
+        if ( seals < 0 || ( seals & REQUIRED_SEALS ) != REQUIRED_SEALS ||
+             fstat( ring->memfd, &status ) != 0 ||
+             pread( ring->memfd, &header, sizeof( header ), 0 ) !=
+             ( ssize_t ) sizeof( header ) || header.magic != SHM_MAGIC ||
+             !goodEntries( header.entries ) ||
+             header.dataSize > ( uint64_t ) status.st_size ||
+             regionSize( header.entries, header.dataSize ) >
+             ( uint64_t ) status.st_size ) {
+                shmClose( ring );
+                return false;
+        }
+
+        ring->entries = header.entries;
+        ring->dataSize = header.dataSize;
+        ring->size = regionSize( header.entries, header.dataSize );
+        void *base = mmap( NULL, ring->size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, ring->memfd, 0 );
+        if ( base == MAP_FAILED ) {
+                shmClose( ring );
+                return false;
+        }
+
+        ring->base = ( byte * ) base;
+        point( ring );
+        ring->submitIndex = __atomic_load_n( &ring->header->submitHead.value,
+                        __ATOMIC_ACQUIRE );
+        ring->completeIndex = __atomic_load_n(
+                        &ring->header->completeTail.value, __ATOMIC_ACQUIRE );
+        return true;
+}
+
+bool shmTake( ShmRing *ring, ShmSubmission *entry )
+{
+        uint32_t tail = __atomic_load_n( &ring->header->submitTail.value,
+                        __ATOMIC_ACQUIRE );
+        uint32_t waiting = tail - ring->submitIndex;
+        if ( waiting == 0 || waiting > ring->entries ) {
+                return false;
+        }
+
+        memcpy( entry, &ring->submissions[ ring->submitIndex &
+                        ( ring->entries - 1 ) ], sizeof( *entry ) );
+        ring->submitIndex++;
+        __atomic_store_n( &ring->header->submitHead.value, ring->submitIndex,
+                        __ATOMIC_RELEASE );
+        return true;
+}
+
+uint32_t shmUnreaped( ShmRing const *ring )
+{
+        uint32_t head = __atomic_load_n( &ring->header->completeHead.value,
+                        __ATOMIC_ACQUIRE );
+        uint32_t unreaped = ring->completeIndex - head;
+        return unreaped > ring->entries ? ring->entries : unreaped;
+}
+
+void shmComplete( ShmRing *ring, ShmCompletion const *entry )
+{
+        memcpy( &ring->completions[ ring->completeIndex &
+                        ( ring->entries - 1 ) ], entry, sizeof( *entry ) );
+        ring->completeIndex++;
+        __atomic_store_n( &ring->header->completeTail.value,
+                        ring->completeIndex, __ATOMIC_RELEASE );
+}
+
+void shmSignal( ShmRing *ring )
+{
+        // Only a counter at its limit refuses, and that wakes the client
+        // anyway
+        uint64_t one = 1;
+        if ( write( ring->completeFd, &one, sizeof( one ) ) < 0 ) {
+                return;
+        }
+}
+
+void shmClose( ShmRing *ring )
+{
+        if ( ring->base != NULL ) {
+                munmap( ring->base, ring->size );
+                ring->base = NULL;
+        }
+
+        int *fds[ SHM_FD_COUNT ] = { &ring->memfd, &ring->submitFd,
+                                     &ring->completeFd };
+        int f = 0;
+        for ( f = 0; f < SHM_FD_COUNT; f++ ) {
+                if ( *fds[ f ] >= 0 ) {
+                        close( *fds[ f ] );
+                        *fds[ f ] = -1;
+                }
+        }
+}
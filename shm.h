@@ -0,0 +1,293 @@
+/**
+        @file shm.h
+        @author James O Kocak (jokocak)
+
+        The header file for the shm.c component of the program. This
+        component is aesd's shared-memory transport, for payloads too large
+        to copy through a socket. The client creates a sealed memfd holding
+        a submission ring, a completion ring and a data area, and hands it
+        to the daemon with two eventfds, one to ring for submissions and one
+        the daemon rings for completions. Each request names a range of the
+        data area, which the daemon encrypts or decrypts in place, so no
+        payload byte passes through the kernel.
+
+        Each ring has one producer and one consumer and needs no locks: the
+        producer fills an entry and then publishes its new tail with a
+        release store, and the consumer reads the tail with an acquire load
+        before the entry. The indexes count up forever and are masked to
+        find a slot. Each side keeps its own copy of the indexes it
+        advances, and the daemon copies each entry out before checking it,
+        so a client scribbling on the region can only spoil its own results.
+
+        Region:   header, one cache line per index
+                  submission ring, entries * sizeof( ShmSubmission )
+                  completion ring, entries * sizeof( ShmCompletion )
+                  data area, from the next page boundary
+ */
+
+#ifndef _SHM_H_
+#define _SHM_H_
+
+#include "aes.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Bytes in a cache line, used to keep the indexes on separate lines. */
+#define SHM_CACHE_LINE 64
+
+/** "AES1" as a little-endian word, marking the region and its layout. */
+#define SHM_MAGIC 0x31534541
+
+/** Most entries a ring may have; the number must be a power of two. */
+#define SHM_MAX_ENTRIES 4096
+
+/** Number of descriptors handed to the daemon: memfd and two eventfds. */
+#define SHM_FD_COUNT 3
+
+/** One index of a ring, alone on its cache line. */
+typedef struct {
+        /** The index. */
+        uint32_t value;
+
+        /** Keeps the next index off this cache line. */
+        char padding[ SHM_CACHE_LINE - sizeof( uint32_t ) ];
+} ShmIndex;
+
+/** The start of the region. */
+typedef struct {
+        /** SHM_MAGIC. */
+        uint32_t magic;
+
+        /** Number of entries in each ring. */
+        uint32_t entries;
+
+        /** Number of bytes in the data area. */
+        uint64_t dataSize;
+
+        /** Keeps the indexes off this cache line. */
+        char padding[ SHM_CACHE_LINE - 2 * sizeof( uint32_t ) -
+                sizeof( uint64_t ) ];
+
+        /** The next submission the daemon will take. */
+        ShmIndex submitHead;
+
+        /** The next submission slot the client will fill. */
+        ShmIndex submitTail;
+
+        /** The next completion the client will take. */
+        ShmIndex completeHead;
+
+        /** The next completion slot the daemon will fill. */
+        ShmIndex completeTail;
+} ShmHeader;
+
+/** A request, naming a range of the data area. */
+typedef struct {
+        /** Where the payload starts in the data area. */
+        uint64_t offset;
+
+        /**
+                Number of payload bytes. For GCM encryption, the tag is
+                written just after them, so the range needs GCM_TAG_SIZE
+                more bytes of room.
+         */
+        uint32_t length;
+
+        /** A number of the client's choosing, echoed in the completion. */
+        uint32_t tag;
+
+        /** The key to use. */
+        uint32_t keyId;
+
+        /** The operation, WIRE_ENCRYPT or WIRE_DECRYPT. */
+        byte op;
+
+        /** The mode, a WireMode. */
+        byte mode;
+
+        /** Unused; zero. */
+        byte reserved[ 2 ];
+
+        /** The IV or initial counter block. */
+        byte iv[ BLOCK_SIZE ];
+} ShmSubmission;
+
+/** The outcome of a request, whose result is in place. */
+typedef struct {
+        /** The tag of the request. */
+        uint32_t tag;
+
+        /** Number of result bytes at the request's offset. */
+        uint32_t length;
+
+        /** The status, a WireStatus. */
+        byte status;
+
+        /** Unused; zero. */
+        byte reserved[ 7 ];
+} ShmCompletion;
+
+/** One side's view of a region. */
+typedef struct {
+        /** The memfd holding the region. */
+        int memfd;
+
+        /** The eventfd the client writes after submitting. */
+        int submitFd;
+
+        /** The eventfd the daemon writes after completing. */
+        int completeFd;
+
+        /** The mapped region. */
+        byte *base;
+
+        /** Number of bytes mapped. */
+        size_t size;
+
+        /** The header, at the start of the region. */
+        ShmHeader *header;
+
+        /** The submission ring. */
+        ShmSubmission *submissions;
+
+        /** The completion ring. */
+        ShmCompletion *completions;
+
+        /** The data area. */
+        byte *data;
+
+        /** Number of bytes in the data area. */
+        uint64_t dataSize;
+
+        /** Number of entries in each ring. */
+        uint32_t entries;
+
+        /**
+                This side's copy of the submission index it advances: the
+                tail for the client, the head for the daemon.
+         */
+        uint32_t submitIndex;
+
+        /**
+                This side's copy of the completion index it advances: the
+                head for the client, the tail for the daemon.
+         */
+        uint32_t completeIndex;
+} ShmRing;
+
+#endif
+
+/**
+        This function creates a region for a client, with its eventfds. The
+        memfd is sealed against shrinking, so the daemon can't be made to
+        fault on its mapping.
+
+        @param ring Where to store the client's view
+        @param entries Number of entries in each ring, a power of two of at
+                most SHM_MAX_ENTRIES
+        @param dataSize Number of bytes in the data area
+        @return False with errno set if the region couldn't be made
+ */
+bool shmCreate( ShmRing *ring, uint32_t entries, uint64_t dataSize );
+
+/**
+        This function hands a client's region to the daemon over a connected
+        socket and waits for it to be accepted.
+
+        @param ring The client's view
+        @param fd The connected socket
+        @return The daemon's status, or -1 if there was no response
+ */
+int shmAttach( ShmRing *ring, int fd );
+
+/**
+        This function queues a request. The daemon isn't told until
+        shmNotify.
+
+        @param ring The client's view
+        @param entry The request
+        @return False if the submission ring is full
+ */
+bool shmSubmit( ShmRing *ring, ShmSubmission const *entry );
+
+/**
+        This function tells the daemon there are requests to take. It is
+        also needed after taking completions, if the daemon had stopped
+        taking requests for want of completion slots.
+
+        @param ring The client's view
+ */
+void shmNotify( ShmRing *ring );
+
+/**
+        This function takes the next completion, if there is one.
+
+        @param ring The client's view
+        @param entry Where to store the completion
+        @return False if there was none
+ */
+bool shmReap( ShmRing *ring, ShmCompletion *entry );
+
+/**
+        This function waits until the daemon says it has completed more
+        requests.
+
+        @param ring The client's view
+ */
+void shmWait( ShmRing *ring );
+
+/**
+        This function maps a region handed to the daemon, checking its seals,
+        size and layout. The eventfds are made non-blocking, so a client
+        can't stall the daemon through them.
+
+        @param ring Where to store the daemon's view
+        @param fds The memfd, the submission eventfd and the completion
+                eventfd, owned by the view from now on, even on failure
+        @return False if the region isn't usable
+ */
+bool shmMap( ShmRing *ring, int const fds[ SHM_FD_COUNT ] );
+
+/**
+        This function takes the next request for the daemon, copying it out
+        of the region before anything looks at it.
+
+        @param ring The daemon's view
+        @param entry Where to store the request
+        @return False if there was none, or the client's tail is nonsense
+ */
+bool shmTake( ShmRing *ring, ShmSubmission *entry );
+
+/**
+        This function returns how many completions the client hasn't taken
+        yet, counting the ring as full if the client's head is nonsense.
+
+        @param ring The daemon's view
+        @return The number of completions waiting
+ */
+uint32_t shmUnreaped( ShmRing const *ring );
+
+/**
+        This function publishes a completion. The caller makes sure there's
+        a free slot.
+
+        @param ring The daemon's view
+        @param entry The completion
+ */
+void shmComplete( ShmRing *ring, ShmCompletion const *entry );
+
+/**
+        This function tells the client there are completions to take.
+
+        @param ring The daemon's view
+ */
+void shmSignal( ShmRing *ring );
+
+/**
+        This function unmaps a region and closes its descriptors, on either
+        side.
+
+        @param ring The view
+ */
+void shmClose( ShmRing *ring );
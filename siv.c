@@ -0,0 +1,726 @@
+/**
+        @file siv.c
+        @author James O Kocak (jokocak)
+
+        This component implements AES-CMAC, S2V and AES-SIV. CMAC chains
+        every block of a message through the cipher, so cmacStreams gathers
+        block n of up to SIV_LANES messages into one batch for
+        aesEncryptBlocks, the way cbcEncryptStreams does, and the CTR half
+        runs through ctrCrypt's batches.
+ */
+
+#include "siv.h"
+#include "chunker.h"
+#include "ctr.h"
+#include "pool.h"
+#include <string.h>
+
+/** The constant XORed in when doubling shifts a one out, R_128 of RFC 4493. */
+#define DOUBLE_CONSTANT 0x87
+
+/** The byte padding a short last block starts with. */
+#define PAD_BYTE 0x80
+
+/** Mask clearing the bits of the synthetic IV that CTR mode ignores. */
+#define CTR_CLEAR 0x7F
+
+/** The byte of the synthetic IV holding bit 63, cleared for CTR mode. */
+#define CLEAR_HIGH 8
+
+/** The byte of the synthetic IV holding bit 31, cleared for CTR mode. */
+#define CLEAR_LOW 12
+
+/** Number of bytes in a record's length field. */
+#define LENGTH_SIZE 4
+
+/** Number of bits in a byte. */
+#define BYTE_BITS 8
+
+/** Number of bytes in each of the trailer's count and length fields. */
+#define TOTAL_SIZE 8
+
+/** Everything the threads of one sivEncryptFile or sivDecryptFile share. */
+typedef struct {
+        /** The key. */
+        SivKey const *key;
+
+        /** The messages, handled SIV_LANES at a time. */
+        SivMessage *messages;
+
+        /** The number of messages. */
+        size_t count;
+} SivJob;
+
+/**
+        This function XORs two blocks into a third, which may be either of
+        them.
+
+        @param a The first block
+        @param b The second block
+        @param out Where to store the result
+ */
+static void xorBlock( byte const a[ BLOCK_SIZE ], byte const b[ BLOCK_SIZE ],
+                        byte out[ BLOCK_SIZE ] )
+{
+        uint64_t x[ 2 ], y[ 2 ];
+        memcpy( x, a, BLOCK_SIZE );
+        memcpy( y, b, BLOCK_SIZE );
+        x[ 0 ] ^= y[ 0 ];
+        x[ 1 ] ^= y[ 1 ];
+        memcpy( out, x, BLOCK_SIZE );
+}
+
+/**
+        This function multiplies a block by x in GF(2^128), as CMAC and S2V
+        define it: a one-bit left shift of the big-endian block, reduced
+        when a bit falls off the top.
+
+        @param block The block to double in place
+ */
+static void doubleBlock( byte block[ BLOCK_SIZE ] )
+{
+        byte carry = block[ 0 ] >> ( BYTE_BITS - 1 );
+        int i = 0;
+        for ( i = 0; i < BLOCK_SIZE - 1; i++ ) {
+                block[ i ] = ( byte ) ( block[ i ] << 1 |
+                                block[ i + 1 ] >> ( BYTE_BITS - 1 ) );
+        }
+
+        block[ BLOCK_SIZE - 1 ] = ( byte ) ( block[ BLOCK_SIZE - 1 ] << 1 ) ^
+                ( carry ? DOUBLE_CONSTANT : 0 );
+}
+
+/**
+        This function compares two IVs, taking the same time wherever they
+        differ.
+
+        @param a The first IV
+        @param b The second IV
+        @return True if they are equal
+ */
+static bool sameIv( byte const a[ SIV_IV_SIZE ], byte const b[ SIV_IV_SIZE ] )
+{
+        byte difference = 0;
+        int i = 0;
+        for ( i = 0; i < SIV_IV_SIZE; i++ ) {
+                difference |= a[ i ] ^ b[ i ];
+        }
+
+        return difference == 0;
+}
+
+void cmacInitKey( CmacKey *key, byte const keyBytes[ BLOCK_SIZE ] )
+{
+        aesInitKey( &key->ctx, keyBytes );
+        memset( key->k1, 0, BLOCK_SIZE );
+        aesEncryptWithContext( &key->ctx, key->k1 );
+        doubleBlock( key->k1 );
+        memcpy( key->k2, key->k1, BLOCK_SIZE );
+        doubleBlock( key->k2 );
+}
+
+/**
+        This function builds block n of a message as CMAC feeds it to the
+        cipher: xorEnd applied, and the last block padded if short and
+        combined with its subkey. The running MAC isn't XORed in yet.
+
+        @param key The CMAC key
+        @param stream The message
+        @param n The block number
+        @param blocks The number of blocks in the message
+        @param block Where to store the block
+ */
+static void cmacBlock( CmacKey const *key, CmacStream const *stream, size_t n,
+                        size_t blocks, byte block[ BLOCK_SIZE ] )
+{
+        size_t start = n * BLOCK_SIZE;
+        size_t have = stream->length - start < BLOCK_SIZE ?
+                stream->length - start : BLOCK_SIZE;
+        memset( block, 0, BLOCK_SIZE );
+        if ( have > 0 ) {
+                memcpy( block, stream->data + start, have );
+        }
+
+        // Only the last sixteen bytes of the message take xorEnd
+        if ( stream->length >= BLOCK_SIZE ) {
+                size_t tail = stream->length - BLOCK_SIZE;
+                size_t i = 0;
+                for ( i = 0; i < have; i++ ) {
+                        if ( start + i >= tail ) {
+                                block[ i ] ^= stream->xorEnd[ start + i - tail ];
+                        }
+                }
+        }
+
+        if ( n == blocks - 1 ) {
+                if ( have == BLOCK_SIZE ) {
+                        xorBlock( block, key->k1, block );
+                } else {
+                        block[ have ] = PAD_BYTE;
+                        xorBlock( block, key->k2, block );
+                }
+        }
+}
+
+void cmacStreams( CmacKey const *key, CmacStream *streams, size_t count )
+{
+        byte batch[ SIV_LANES * BLOCK_SIZE ];
+        CmacStream *lane[ SIV_LANES ];
+        size_t blocks[ SIV_LANES ];
+
+        size_t first = 0;
+        for ( first = 0; first < count; first += SIV_LANES ) {
+                size_t group = count - first < SIV_LANES ? count - first :
+                        SIV_LANES;
+                size_t most = 0;
+                size_t s = 0;
+                for ( s = 0; s < group; s++ ) {
+                        // An empty message is one padded block
+                        CmacStream *stream = &streams[ first + s ];
+                        blocks[ s ] = stream->length == 0 ? 1 :
+                                ( stream->length + BLOCK_SIZE - 1 ) / BLOCK_SIZE;
+                        if ( blocks[ s ] > most ) {
+                                most = blocks[ s ];
+                        }
+
+                        memset( stream->mac, 0, BLOCK_SIZE );
+                }
+
+                // Block n of every message still running goes in one batch
+                size_t n = 0;
+                for ( n = 0; n < most; n++ ) {
+                        size_t lanes = 0;
+                        for ( s = 0; s < group; s++ ) {
+                                CmacStream *stream = &streams[ first + s ];
+                                if ( n >= blocks[ s ] ) {
+                                        continue;
+                                }
+
+                                // Blocks clear of the last two are used as they are
+                                byte *slot = batch + lanes * BLOCK_SIZE;
+                                if ( ( n + 2 ) * BLOCK_SIZE <= stream->length ) {
+                                        xorBlock( stream->data + n * BLOCK_SIZE,
+                                                stream->mac, slot );
+                                } else {
+                                        cmacBlock( key, stream, n, blocks[ s ],
+                                                slot );
+                                        xorBlock( slot, stream->mac, slot );
+                                }
+
+                                lane[ lanes++ ] = stream;
+                        }
+
+                        aesEncryptBlocks( &key->ctx, batch, batch, lanes );
+
+                        size_t l = 0;
+                        for ( l = 0; l < lanes; l++ ) {
+                                memcpy( lane[ l ]->mac, batch + l * BLOCK_SIZE,
+                                        BLOCK_SIZE );
+                        }
+                }
+        }
+}
+
+void cmac( CmacKey const *key, byte const *data, size_t length,
+                        byte mac[ BLOCK_SIZE ] )
+{
+        CmacStream stream = { data, length, { 0 } };
+        cmacStreams( key, &stream, 1 );
+        memcpy( mac, stream.mac, BLOCK_SIZE );
+}
+
+void sivInitKey( SivKey *key, byte const keyBytes[ SIV_KEY_SIZE ] )
+{
+        cmacInitKey( &key->mac, keyBytes );
+        aesInitKey( &key->ctr, keyBytes + BLOCK_SIZE );
+
+        byte zero[ BLOCK_SIZE ] = { 0 };
+        cmac( &key->mac, zero, BLOCK_SIZE, key->zero );
+}
+
+/**
+        This function sets up the last CMAC of S2V over a plaintext, given
+        the running value D from the strings before it: a plaintext of a
+        block or more has D XORed into its end, and a shorter one is padded
+        and XORed with D doubled.
+
+        @param d The running S2V value
+        @param in The plaintext
+        @param length The number of bytes in in
+        @param stream The CMAC message to fill in
+        @param padded Storage for a short plaintext's single block
+ */
+static void s2vFinal( byte const d[ BLOCK_SIZE ], byte const *in,
+                        size_t length, CmacStream *stream,
+                        byte padded[ BLOCK_SIZE ] )
+{
+        if ( length >= BLOCK_SIZE ) {
+                stream->data = in;
+                stream->length = length;
+                memcpy( stream->xorEnd, d, BLOCK_SIZE );
+                return;
+        }
+
+        memcpy( padded, d, BLOCK_SIZE );
+        doubleBlock( padded );
+        byte block[ BLOCK_SIZE ] = { 0 };
+        if ( length > 0 ) {
+                memcpy( block, in, length );
+        }
+
+        block[ length ] = PAD_BYTE;
+        xorBlock( padded, block, padded );
+        stream->data = padded;
+        stream->length = BLOCK_SIZE;
+        memset( stream->xorEnd, 0, BLOCK_SIZE );
+}
+
+/**
+        This function encrypts or decrypts in CTR mode from a synthetic IV,
+        whose two marked bits are cleared first so the counter can't carry
+        between its 32-bit words.
+
+        @param key The key
+        @param iv The synthetic IV
+        @param in The bytes to transform
+        @param out Where to store the result
+        @param length The number of bytes in in
+ */
+static void sivCtr( SivKey const *key, byte const iv[ SIV_IV_SIZE ],
+                        byte const *in, byte *out, size_t length )
+{
+        byte counter[ BLOCK_SIZE ];
+        memcpy( counter, iv, BLOCK_SIZE );
+        counter[ CLEAR_HIGH ] &= CTR_CLEAR;
+        counter[ CLEAR_LOW ] &= CTR_CLEAR;
+        ctrCrypt( &key->ctr, counter, 0, in, out, length );
+}
+
+/**
+        This function computes S2V over optional additional data and a
+        plaintext.
+
+        @param key The key
+        @param aad The additional data, or NULL for none
+        @param aadLength The number of bytes in aad
+        @param in The plaintext
+        @param length The number of bytes in in
+        @param iv Where to store the synthetic IV
+ */
+static void s2v( SivKey const *key, byte const *aad, size_t aadLength,
+                        byte const *in, size_t length,
+                        byte iv[ SIV_IV_SIZE ] )
+{
+        byte d[ BLOCK_SIZE ];
+        memcpy( d, key->zero, BLOCK_SIZE );
+        if ( aad != NULL ) {
+                byte mac[ BLOCK_SIZE ];
+                cmac( &key->mac, aad, aadLength, mac );
+                doubleBlock( d );
+                xorBlock( d, mac, d );
+        }
+
+        CmacStream stream;
+        byte padded[ BLOCK_SIZE ];
+        s2vFinal( d, in, length, &stream, padded );
+        cmacStreams( &key->mac, &stream, 1 );
+        memcpy( iv, stream.mac, SIV_IV_SIZE );
+}
+
+void sivEncrypt( SivKey const *key, byte const *aad, size_t aadLength,
+                        byte const *in, byte *out, size_t length,
+                        byte iv[ SIV_IV_SIZE ] )
+{
+        // The IV is taken before the plaintext may be overwritten
+        s2v( key, aad, aadLength, in, length, iv );
+        sivCtr( key, iv, in, out, length );
+}
+
+bool sivDecrypt( SivKey const *key, byte const *aad, size_t aadLength,
+                        byte const *in, byte *out, size_t length,
+                        byte const iv[ SIV_IV_SIZE ] )
+{
+        sivCtr( key, iv, in, out, length );
+
+        byte check[ SIV_IV_SIZE ];
+        s2v( key, aad, aadLength, out, length, check );
+        if ( !sameIv( check, iv ) ) {
+                memset( out, 0, length );
+                return false;
+        }
+
+        return true;
+}
+
+void sivEncryptStreams( SivKey const *key, SivMessage *messages,
+                        size_t count )
+{
+        CmacStream streams[ SIV_LANES ];
+        byte padded[ SIV_LANES ][ BLOCK_SIZE ];
+
+        size_t first = 0;
+        for ( first = 0; first < count; first += SIV_LANES ) {
+                size_t group = count - first < SIV_LANES ? count - first :
+                        SIV_LANES;
+                size_t m = 0;
+                for ( m = 0; m < group; m++ ) {
+                        SivMessage const *message = &messages[ first + m ];
+                        s2vFinal( key->zero, message->in, message->length,
+                                &streams[ m ], padded[ m ] );
+                }
+
+                cmacStreams( &key->mac, streams, group );
+                for ( m = 0; m < group; m++ ) {
+                        SivMessage *message = &messages[ first + m ];
+                        memcpy( message->iv, streams[ m ].mac, SIV_IV_SIZE );
+                        sivCtr( key, message->iv, message->in, message->out,
+                                message->length );
+                }
+        }
+}
+
+void sivDecryptStreams( SivKey const *key, SivMessage *messages,
+                        size_t count )
+{
+        CmacStream streams[ SIV_LANES ];
+        byte padded[ SIV_LANES ][ BLOCK_SIZE ];
+
+        size_t first = 0;
+        for ( first = 0; first < count; first += SIV_LANES ) {
+                size_t group = count - first < SIV_LANES ? count - first :
+                        SIV_LANES;
+                size_t m = 0;
+                for ( m = 0; m < group; m++ ) {
+                        SivMessage const *message = &messages[ first + m ];
+                        sivCtr( key, message->iv, message->in, message->out,
+                                message->length );
+                        s2vFinal( key->zero, message->out, message->length,
+                                &streams[ m ], padded[ m ] );
+                }
+
+                cmacStreams( &key->mac, streams, group );
+                for ( m = 0; m < group; m++ ) {
+                        SivMessage *message = &messages[ first + m ];
+                        message->authentic = sameIv( streams[ m ].mac,
+                                        message->iv );
+                        if ( !message->authentic ) {
+                                memset( message->out, 0, message->length );
+                        }
+                }
+        }
+}
+
+/**
+        This pool task encrypts one group of chunks and stores their IVs in
+        their records.
+
+        @param arg The SivJob
+        @param worker The thread number, unused
+        @param group The group number
+ */
+static void encryptGroup( void *arg, int worker, size_t group )
+{
+        SivJob *job = ( SivJob * ) arg;
+        size_t first = group * SIV_LANES;
+        size_t count = job->count - first < SIV_LANES ? job->count - first :
+                SIV_LANES;
+        sivEncryptStreams( job->key, job->messages + first, count );
+
+        size_t m = 0;
+        for ( m = first; m < first + count; m++ ) {
+                memcpy( job->messages[ m ].out - SIV_IV_SIZE,
+                        job->messages[ m ].iv, SIV_IV_SIZE );
+        }
+}
+
+/**
+        This pool task decrypts and verifies one group of records.
+
+        @param arg The SivJob
+        @param worker The thread number, unused
+        @param group The group number
+ */
+static void decryptGroup( void *arg, int worker, size_t group )
+{
+        SivJob *job = ( SivJob * ) arg;
+        size_t first = group * SIV_LANES;
+        size_t count = job->count - first < SIV_LANES ? job->count - first :
+                SIV_LANES;
+        sivDecryptStreams( job->key, job->messages + first, count );
+}
+
+/** What a SIV file's trailer covers: every record's IV, and the totals. */
+typedef struct {
+        /** The synthetic IVs of the records so far, in file order. */
+        byte *ivs;
+
+        /** Number of records so far. */
+        size_t count;
+
+        /** Number of IVs ivs has room for. */
+        size_t capacity;
+
+        /** Number of plaintext bytes in the records so far. */
+        uint64_t length;
+} SivTally;
+
+/**
+        This function adds a batch of records, in file order, to a tally.
+
+        @param tally The tally
+        @param messages The records' messages
+        @param count The number of messages
+ */
+static void tallyRecords( SivTally *tally, SivMessage const *messages,
+                        size_t count )
+{
+        if ( tally->count + count > tally->capacity ) {
+                size_t capacity = tally->capacity > 0 ? tally->capacity : 64;
+                while ( capacity < tally->count + count ) {
+                        capacity *= 2;
+                }
+
+                byte *ivs = ( byte * ) realloc( tally->ivs,
+                                capacity * SIV_IV_SIZE );
+                if ( ivs == NULL ) {
+                        fprintf( stderr, "Out of memory\n" );
+                        exit( EXIT_FAILURE );
+                }
+
+                tally->ivs = ivs;
+                tally->capacity = capacity;
+        }
+
+        size_t m = 0;
+        for ( m = 0; m < count; m++ ) {
+                memcpy( tally->ivs + ( tally->count + m ) * SIV_IV_SIZE,
+                        messages[ m ].iv, SIV_IV_SIZE );
+                tally->length += messages[ m ].length;
+        }
+
+        tally->count += count;
+}
+
+/**
+        This function computes the trailer's MAC: S2V with the record count
+        and the total length, eight bytes little-endian each, as additional
+        data, and the records' IVs in order as the plaintext. The additional
+        data keeps it apart from every record's own IV.
+
+        @param key The key
+        @param tally Every record of the file
+        @param mac Where to store the MAC
+ */
+static void trailerMac( SivKey const *key, SivTally const *tally,
+                        byte mac[ SIV_IV_SIZE ] )
+{
+        byte totals[ 2 * TOTAL_SIZE ];
+        int b = 0;
+        for ( b = 0; b < TOTAL_SIZE; b++ ) {
+                totals[ b ] = ( byte ) ( ( uint64_t ) tally->count >>
+                                ( BYTE_BITS * b ) );
+                totals[ TOTAL_SIZE + b ] = ( byte ) ( tally->length >>
+                                ( BYTE_BITS * b ) );
+        }
+
+        s2v( key, totals, sizeof( totals ), tally->ivs,
+                        tally->count * SIV_IV_SIZE, mac );
+}
+
+/**
+        This function allocates room for the messages one buffer can hold.
+
+        @param count The most messages
+        @return The array
+ */
+static SivMessage *allocateMessages( size_t count )
+{
+        SivMessage *messages = ( SivMessage * ) malloc( count *
+                        sizeof( SivMessage ) );
+        if ( messages == NULL ) {
+                fprintf( stderr, "Out of memory\n" );
+                exit( EXIT_FAILURE );
+        }
+
+        return messages;
+}
+
+void sivEncryptFile( SivKey const *key, ChunkStream *input,
+                        char const *outputFile, int threads )
+{
+        ChunkStream output;
+        openChunkWriter( &output, outputFile );
+
+        // Every chunk but the last of the file holds at least CHUNK_MIN bytes
+        size_t capacity = input->chunkSize;
+        size_t most = capacity / CHUNK_MIN + 1;
+        SivMessage *messages = allocateMessages( most );
+        byte *records = allocateBuffer( capacity + most * SIV_RECORD_HEADER );
+
+        // One pool serves every buffer, so no thread is started per buffer
+        ThreadPool *pool = poolCreate( threads );
+        SivTally tally = { NULL, 0, 0, 0 };
+        byte *buffer = input->buffer;
+        size_t filled = readChunkAfter( input, 0 );
+        bool final = filled < capacity;
+        while ( true ) {
+                // Cut as many chunks as the buffer holds, laying out a record
+                // for each
+                size_t count = 0;
+                size_t pos = 0;
+                size_t at = 0;
+                size_t cut;
+                while ( ( cut = chunkerNext( buffer + pos, filled - pos,
+                                final ) ) > 0 ) {
+                        SivMessage *message = &messages[ count++ ];
+                        int b = 0;
+                        for ( b = 0; b < LENGTH_SIZE; b++ ) {
+                                records[ at + b ] = ( byte ) ( cut >>
+                                                ( BYTE_BITS * b ) );
+                        }
+
+                        message->in = buffer + pos;
+                        message->out = records + at + SIV_RECORD_HEADER;
+                        message->length = cut;
+                        pos += cut;
+                        at += SIV_RECORD_HEADER + cut;
+                }
+
+                SivJob job = { key, messages, count };
+                poolRun( pool, ( count + SIV_LANES - 1 ) / SIV_LANES,
+                                encryptGroup, &job );
+                tallyRecords( &tally, messages, count );
+                writeChunk( &output, records, at );
+                if ( final ) {
+                        break;
+                }
+
+                // The unfinished chunk moves to the front to be continued
+                size_t kept = filled - pos;
+                memmove( buffer, buffer + pos, kept );
+                filled = readChunkAfter( input, kept );
+                final = filled < capacity;
+        }
+
+        // The trailer ties the records to their order and number
+        byte trailer[ SIV_RECORD_HEADER ];
+        int b = 0;
+        for ( b = 0; b < LENGTH_SIZE; b++ ) {
+                trailer[ b ] = ( byte ) ( SIV_TRAILER_MARK >>
+                                ( BYTE_BITS * b ) );
+        }
+
+        trailerMac( key, &tally, trailer + LENGTH_SIZE );
+        writeChunk( &output, trailer, SIV_RECORD_HEADER );
+
+        poolDestroy( pool );
+        free( tally.ivs );
+        free( records );
+        free( messages );
+        closeChunkStream( input );
+        closeChunkStream( &output );
+}
+
+bool sivDecryptFile( SivKey const *key, ChunkStream *input,
+                        char const *outputFile, int threads )
+{
+        ChunkStream output;
+        openChunkWriter( &output, outputFile );
+
+        size_t capacity = input->chunkSize;
+        size_t most = capacity / SIV_RECORD_HEADER + 1;
+        SivMessage *messages = allocateMessages( most );
+        byte *plain = allocateBuffer( capacity );
+
+        ThreadPool *pool = poolCreate( threads );
+        SivTally tally = { NULL, 0, 0, 0 };
+        byte *buffer = input->buffer;
+        size_t kept = 0;
+        bool ok = true;
+        while ( ok ) {
+                size_t filled = readChunkAfter( input, kept );
+                bool final = filled < capacity;
+
+                // Every whole record in the buffer becomes a message, up to
+                // the trailer
+                size_t count = 0;
+                size_t pos = 0;
+                size_t at = 0;
+                bool ended = false;
+                byte expected[ SIV_IV_SIZE ];
+                while ( filled - pos >= SIV_RECORD_HEADER ) {
+                        size_t length = 0;
+                        int b = LENGTH_SIZE;
+                        while ( b-- > 0 ) {
+                                length = length << BYTE_BITS |
+                                        buffer[ pos + b ];
+                        }
+
+                        if ( length == SIV_TRAILER_MARK ) {
+                                memcpy( expected, buffer + pos + LENGTH_SIZE,
+                                        SIV_IV_SIZE );
+                                pos += SIV_RECORD_HEADER;
+                                ended = true;
+                                break;
+                        }
+
+                        if ( length > CHUNK_MAX ) {
+                                ok = false;
+                                break;
+                        }
+
+                        if ( filled - pos - SIV_RECORD_HEADER < length ) {
+                                break;
+                        }
+
+                        SivMessage *message = &messages[ count++ ];
+                        memcpy( message->iv, buffer + pos + LENGTH_SIZE,
+                                SIV_IV_SIZE );
+                        message->in = buffer + pos + SIV_RECORD_HEADER;
+                        message->out = plain + at;
+                        message->length = length;
+                        pos += SIV_RECORD_HEADER + length;
+                        at += length;
+                }
+
+                SivJob job = { key, messages, count };
+                poolRun( pool, ( count + SIV_LANES - 1 ) / SIV_LANES,
+                                decryptGroup, &job );
+                tallyRecords( &tally, messages, count );
+
+                size_t m = 0;
+                for ( m = 0; m < count; m++ ) {
+                        ok = ok && messages[ m ].authentic;
+                }
+
+                // A full buffer may end with the file, so check for more
+                if ( ended && !final && pos == filled ) {
+                        final = readChunkAfter( input, 0 ) == 0;
+                }
+
+                // The trailer must end the file, and nothing may follow it
+                if ( !ok || ended != final || ( ended && pos != filled ) ) {
+                        ok = false;
+                        break;
+                }
+
+                writeChunk( &output, plain, at );
+                if ( ended ) {
+                        byte mac[ SIV_IV_SIZE ];
+                        trailerMac( key, &tally, mac );
+                        ok = sameIv( mac, expected );
+                        break;
+                }
+
+                kept = filled - pos;
+                memmove( buffer, buffer + pos, kept );
+        }
+
+        poolDestroy( pool );
+        free( tally.ivs );
+        free( plain );
+        free( messages );
+        closeChunkStream( input );
+        closeChunkStream( &output );
+        return ok;
+}
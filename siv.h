@@ -0,0 +1,235 @@
+/**
+        @file siv.h
+        @author James O Kocak (jokocak)
+
+        The header file for the siv.c component of the program. This
+        component implements AES-SIV (RFC 5297): the synthetic IV is an
+        AES-CMAC based hash (S2V) of the additional data and the plaintext,
+        and the plaintext is encrypted in CTR mode starting from it. The
+        same key and plaintext always give the same ciphertext, so a store
+        can deduplicate encrypted chunks without seeing them. CMAC is serial
+        within a message, so SIV_LANES messages are hashed in lockstep to
+        keep the bulk block functions busy.
+ */
+
+#ifndef _SIV_H_
+#define _SIV_H_
+
+#include "aes.h"
+#include "io.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Number of bytes in a SIV key: the CMAC key, then the CTR key. */
+#define SIV_KEY_SIZE ( 2 * BLOCK_SIZE )
+
+/** Number of bytes in the synthetic IV, which is also the tag. */
+#define SIV_IV_SIZE BLOCK_SIZE
+
+/** Number of messages hashed at once, one block from each per batch. */
+#define SIV_LANES 16
+
+/**
+        Number of bytes before each chunk's ciphertext in a SIV file: its
+        length, four bytes little-endian, then its synthetic IV.
+ */
+#define SIV_RECORD_HEADER ( 4 + SIV_IV_SIZE )
+
+/**
+        The length field of the trailer record ending a SIV file. Instead of
+        an IV and a chunk, it holds a MAC over the number of records, the
+        total plaintext length and every record's IV in order, so records
+        can't be dropped, repeated or reordered without notice.
+ */
+#define SIV_TRAILER_MARK 0xFFFFFFFFu
+
+/** A CMAC key: the expanded AES key and the two subkeys derived from it. */
+typedef struct {
+        /** The expanded key. */
+        AesContext ctx;
+
+        /** Subkey XORed into a last block that is full. */
+        byte k1[ BLOCK_SIZE ];
+
+        /** Subkey XORed into a last block that was padded. */
+        byte k2[ BLOCK_SIZE ];
+} CmacKey;
+
+/** A SIV key, both halves expanded. */
+typedef struct {
+        /** The key S2V is computed with. */
+        CmacKey mac;
+
+        /** The key the plaintext is encrypted with. */
+        AesContext ctr;
+
+        /** The CMAC of a zero block, where S2V starts. */
+        byte zero[ BLOCK_SIZE ];
+} SivKey;
+
+/** One message for cmacStreams. */
+typedef struct {
+        /** The bytes to authenticate. */
+        byte const *data;
+
+        /** Number of bytes in data. */
+        size_t length;
+
+        /**
+                Sixteen bytes XORed into the last sixteen bytes of data as it
+                is read, zero for plain CMAC. S2V uses it for xorend.
+         */
+        byte xorEnd[ BLOCK_SIZE ];
+
+        /** Where the MAC is left. */
+        byte mac[ BLOCK_SIZE ];
+} CmacStream;
+
+/** One message for sivEncryptStreams or sivDecryptStreams. */
+typedef struct {
+        /** The plaintext or ciphertext. */
+        byte const *in;
+
+        /** Where to store the result; may be in. */
+        byte *out;
+
+        /** Number of bytes in in. */
+        size_t length;
+
+        /** The synthetic IV, filled in by encryption and read by decryption. */
+        byte iv[ SIV_IV_SIZE ];
+
+        /** Whether decryption found the message authentic. */
+        bool authentic;
+} SivMessage;
+
+#endif
+
+/**
+        This function expands a CMAC key and derives its subkeys.
+
+        @param key The key to fill in
+        @param keyBytes The 16-byte AES key
+ */
+void cmacInitKey( CmacKey *key, byte const keyBytes[ BLOCK_SIZE ] );
+
+/**
+        This function computes the AES-CMAC (RFC 4493) of count independent
+        messages, taking one block from each of up to SIV_LANES messages
+        for every call to aesEncryptBlocks. Messages may have different
+        lengths; the shorter ones drop out as they finish.
+
+        @param key The CMAC key, shared by every message
+        @param streams The messages
+        @param count The number of messages
+ */
+void cmacStreams( CmacKey const *key, CmacStream *streams, size_t count );
+
+/**
+        This function computes the AES-CMAC of one message.
+
+        @param key The CMAC key
+        @param data The bytes to authenticate
+        @param length The number of bytes in data
+        @param mac Where to store the MAC
+ */
+void cmac( CmacKey const *key, byte const *data, size_t length,
+                        byte mac[ BLOCK_SIZE ] );
+
+/**
+        This function expands both halves of a SIV key.
+
+        @param key The key to fill in
+        @param keyBytes The CMAC key followed by the CTR key
+ */
+void sivInitKey( SivKey *key, byte const keyBytes[ SIV_KEY_SIZE ] );
+
+/**
+        This function encrypts one message with at most one string of
+        additional data.
+
+        @param key The key
+        @param aad The additional data, or NULL for none
+        @param aadLength The number of bytes in aad
+        @param in The plaintext
+        @param out Where to store the ciphertext, possibly in
+        @param length The number of bytes in in
+        @param iv Where to store the synthetic IV
+ */
+void sivEncrypt( SivKey const *key, byte const *aad, size_t aadLength,
+                        byte const *in, byte *out, size_t length,
+                        byte iv[ SIV_IV_SIZE ] );
+
+/**
+        This function decrypts and verifies one message. If it isn't
+        authentic, out is cleared so no unauthenticated plaintext escapes.
+
+        @param key The key
+        @param aad The additional data, or NULL for none
+        @param aadLength The number of bytes in aad
+        @param in The ciphertext
+        @param out Where to store the plaintext, possibly in
+        @param length The number of bytes in in
+        @param iv The synthetic IV that came with the ciphertext
+        @return False if the message isn't authentic
+ */
+bool sivDecrypt( SivKey const *key, byte const *aad, size_t aadLength,
+                        byte const *in, byte *out, size_t length,
+                        byte const iv[ SIV_IV_SIZE ] );
+
+/**
+        This function encrypts count messages without additional data,
+        computing their synthetic IVs in lockstep with cmacStreams. Equal
+        plaintexts get equal IVs and ciphertexts.
+
+        @param key The key
+        @param messages The messages, whose iv fields are filled in
+        @param count The number of messages
+ */
+void sivEncryptStreams( SivKey const *key, SivMessage *messages,
+                        size_t count );
+
+/**
+        This function decrypts and verifies count messages without additional
+        data, setting each one's authentic field and clearing the output of
+        those that fail.
+
+        @param key The key
+        @param messages The messages
+        @param count The number of messages
+ */
+void sivDecryptStreams( SivKey const *key, SivMessage *messages,
+                        size_t count );
+
+/**
+        This function cuts a file into content-defined chunks and encrypts
+        each one with SIV, writing a record for each: its length, its
+        synthetic IV and its ciphertext. Equal chunks give equal records, so
+        a store can deduplicate them. A trailer record ends the file. Groups
+        of chunks are spread over a pool of threads.
+
+        @param key The key
+        @param input The plaintext, opened with openChunkReader with a chunk
+                     size of at least CHUNK_MAX
+        @param outputFile The file to write
+        @param threads The number of threads to use
+ */
+void sivEncryptFile( SivKey const *key, ChunkStream *input,
+                        char const *outputFile, int threads );
+
+/**
+        This function decrypts a file written by sivEncryptFile, checking
+        each record and then the trailer, so records missing, repeated or
+        out of order fail authentication as well. On failure, what was
+        written must be thrown away.
+
+        @param key The key
+        @param input The records, opened with openChunkReader with a chunk
+                     size of at least CHUNK_MAX plus SIV_RECORD_HEADER
+        @param outputFile The file to write
+        @param threads The number of threads to use
+        @return False if any record was malformed or not authentic
+ */
+bool sivDecryptFile( SivKey const *key, ChunkStream *input,
+                        char const *outputFile, int threads );
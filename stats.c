@@ -0,0 +1,175 @@
+/**
+        @file stats.c
+        @author James O Kocak (jokocak)
+
+        This component times the stages of one run of encrypt or decrypt.
+        The totals are kept with atomic adds, since pool threads finish
+        chunks at the same time, and are reported when the program exits.
+ */
+
+/** Exposes clock_gettime and getrusage under -std=c99. */
+#define _DEFAULT_SOURCE
+
+#include "stats.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/resource.h>
+
+/** Nanoseconds in a second. */
+#define NS_PER_SECOND 1000000000ULL
+
+/** Microseconds in a second. */
+#define US_PER_SECOND 1000000.0
+
+/** Bytes in a megabyte, for MB/s. */
+#define BYTES_PER_MB 1000000.0
+
+/** Names of the stages in the report, indexed by Stage. */
+static char const *const stageNames[ STAGE_COUNT ] = {
+        "readKey", "expandKey", "read", "cipher", "write"
+};
+
+/** Whether stats are being kept. */
+static bool enabled = false;
+
+/** Where the JSON report goes, or NULL for a table on standard error. */
+static char const *reportFile = NULL;
+
+/** When the run started. */
+static uint64_t runStart;
+
+/** Number of times each stage ran. */
+static uint64_t stageCalls[ STAGE_COUNT ];
+
+/** Bytes each stage handled. */
+static uint64_t stageBytes[ STAGE_COUNT ];
+
+/** Nanoseconds each stage took, summed over every thread. */
+static uint64_t stageNs[ STAGE_COUNT ];
+
+/**
+        This function reads the monotonic clock.
+
+        @return Nanoseconds since some fixed point
+ */
+static uint64_t readNanos( void )
+{
+        struct timespec now;
+        clock_gettime( CLOCK_MONOTONIC, &now );
+        return ( uint64_t ) now.tv_sec * NS_PER_SECOND + now.tv_nsec;
+}
+
+/**
+        This function turns a rusage time into seconds.
+
+        @param time The time
+        @return The time in seconds
+ */
+static double seconds( struct timeval time )
+{
+        return time.tv_sec + time.tv_usec / US_PER_SECOND;
+}
+
+/**
+        This function returns a stage's throughput.
+
+        @param stage The stage
+        @return Megabytes per second, or zero if the stage took no time
+ */
+static double megabytesPerSecond( int stage )
+{
+        return stageNs[ stage ] > 0 ? stageBytes[ stage ] / BYTES_PER_MB /
+                ( ( double ) stageNs[ stage ] / NS_PER_SECOND ) : 0;
+}
+
+/**
+        This function reports the stats, registered with atexit. A JSON file
+        that can't be written is only complained about, since the run itself
+        has already finished.
+ */
+static void report( void )
+{
+        double wall = ( double ) ( readNanos() - runStart ) / NS_PER_SECOND;
+        struct rusage usage;
+        getrusage( RUSAGE_SELF, &usage );
+        double user = seconds( usage.ru_utime );
+        double system = seconds( usage.ru_stime );
+
+        FILE *out = stderr;
+        if ( reportFile != NULL ) {
+                out = fopen( reportFile, "w" );
+                if ( out == NULL ) {
+                        fprintf( stderr, "Can't write file: %s\n",
+                                reportFile );
+                        return;
+                }
+
+                fprintf( out, "{\n  \"stages\": {" );
+        } else {
+                fprintf( out, "%-10s %8s %14s %12s %12s\n", "stage", "calls",
+                        "bytes", "seconds", "MB/s" );
+        }
+
+        int s = 0;
+        for ( s = 0; s < STAGE_COUNT; s++ ) {
+                double taken = ( double ) stageNs[ s ] / NS_PER_SECOND;
+                if ( reportFile != NULL ) {
+                        fprintf( out, "%s\n    \"%s\": { \"calls\": %llu, "
+                                "\"bytes\": %llu, \"seconds\": %.6f, "
+                                "\"mbPerSecond\": %.1f }", s > 0 ? "," : "",
+                                stageNames[ s ],
+                                ( unsigned long long ) stageCalls[ s ],
+                                ( unsigned long long ) stageBytes[ s ], taken,
+                                megabytesPerSecond( s ) );
+                } else {
+                        fprintf( out, "%-10s %8llu %14llu %12.6f %12.1f\n",
+                                stageNames[ s ],
+                                ( unsigned long long ) stageCalls[ s ],
+                                ( unsigned long long ) stageBytes[ s ], taken,
+                                megabytesPerSecond( s ) );
+                }
+        }
+
+        if ( reportFile != NULL ) {
+                fprintf( out, "\n  },\n  \"wallSeconds\": %.6f,\n"
+                        "  \"cpuSeconds\": %.6f,\n  \"userSeconds\": %.6f,\n"
+                        "  \"systemSeconds\": %.6f,\n  \"peakRssKiB\": %ld\n}\n",
+                        wall, user + system, user, system, usage.ru_maxrss );
+                if ( fclose( out ) != 0 ) {
+                        fprintf( stderr, "Can't write file: %s\n",
+                                reportFile );
+                }
+        } else {
+                fprintf( out, "wall %.6f s, cpu %.6f s (user %.6f s, system "
+                        "%.6f s), peak RSS %ld KiB\n", wall, user + system,
+                        user, system, usage.ru_maxrss );
+        }
+}
+
+void statsEnable( char const *jsonFile )
+{
+        reportFile = jsonFile;
+        runStart = readNanos();
+        enabled = true;
+        atexit( report );
+}
+
+uint64_t statsBegin( void )
+{
+        return enabled ? readNanos() : 0;
+}
+
+uint64_t statsEnd( Stage stage, uint64_t begin, uint64_t bytes )
+{
+        if ( !enabled ) {
+                return 0;
+        }
+
+        uint64_t now = readNanos();
+        __atomic_fetch_add( &stageCalls[ stage ], 1, __ATOMIC_RELAXED );
+        __atomic_fetch_add( &stageBytes[ stage ], bytes, __ATOMIC_RELAXED );
+        __atomic_fetch_add( &stageNs[ stage ], now - begin, __ATOMIC_RELAXED );
+        return now;
+}
@@ -0,0 +1,71 @@
+/**
+        @file stats.h
+        @author James O Kocak (jokocak)
+
+        The header file for the stats.c component of the program. This
+        component times the stages of one run of encrypt or decrypt, for
+        --stats. Each stage adds up the bytes it handled and the monotonic
+        time it took on every thread. When stats aren't enabled, statsBegin
+        and statsEnd return at once without reading the clock.
+ */
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdint.h>
+
+/** The stages of a run that are timed. */
+typedef enum {
+        /** Reading the key file and the IV file. */
+        STAGE_READ_KEY,
+
+        /** Expanding the key and setting up the mode. */
+        STAGE_EXPAND_KEY,
+
+        /** Reading the input. */
+        STAGE_READ,
+
+        /**
+                Transforming the input. Containers and SIV files are read and
+                written by the cipher itself, so their I/O counts here too.
+         */
+        STAGE_CIPHER,
+
+        /** Writing the output. */
+        STAGE_WRITE,
+
+        /** Number of stages; not a stage itself. */
+        STAGE_COUNT
+} Stage;
+
+#endif
+
+/**
+        This function starts the clock for the whole run and arranges for the
+        stats to be reported when the program exits: as a table on standard
+        error, or as JSON in a file.
+
+        @param jsonFile The file to write JSON to, or NULL for standard error
+ */
+void statsEnable( char const *jsonFile );
+
+/**
+        This function marks the start of a stage.
+
+        @return The monotonic time in nanoseconds, or zero if stats aren't
+                enabled
+ */
+uint64_t statsBegin( void );
+
+/**
+        This function adds the time since begin and a number of bytes to a
+        stage. Stages can be chained by passing what one call returns as
+        the next one's begin. It may be called from any thread.
+
+        @param stage The stage
+        @param begin What statsBegin or the last statsEnd returned
+        @param bytes The number of bytes the stage handled
+        @return The monotonic time in nanoseconds, or zero if stats aren't
+                enabled
+ */
+uint64_t statsEnd( Stage stage, uint64_t begin, uint64_t bytes );
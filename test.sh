@@ -208,6 +208,115 @@ if [ -x encrypt ]; then
     
     args=(key-08.dat)
     testEncrypt 08 1
+
+    args=(--mmap key-06.dat plain-06.dat)
+    testEncrypt 06 0
+
+    args=(--mmap key-07.dat plain-07.dat)
+    testEncrypt 07 1
+
+    args=(-j 4 key-06.dat plain-06.dat)
+    testEncrypt 06 0
+
+    args=(-j4 --mmap key-06.dat plain-06.dat)
+    testEncrypt 06 0
+
+    args=(-j 0 key-06.dat plain-06.dat)
+    testEncrypt 08 1
+
+    args=(--io-uring key-06.dat plain-06.dat)
+    testEncrypt 06 0
+
+    args=(--io-uring -j 2 key-07.dat plain-07.dat)
+    testEncrypt 07 1
+
+    args=(--io-uring --mmap key-06.dat plain-06.dat)
+    testEncrypt 08 1
+
+    # CTR mode accepts a length that isn't a multiple of 16.
+    args=(--ctr iv-10.dat key-01.dat plain-10.dat)
+    testEncrypt 10 0
+
+    args=(-j 3 --mmap --ctr iv-10.dat key-01.dat plain-10.dat)
+    testEncrypt 10 0
+
+    # GCM appends a 16-byte tag to the ciphertext.
+    args=(--gcm iv-11.dat key-01.dat plain-11.dat)
+    testEncrypt 11 0
+
+    args=(-j 2 --io-uring --gcm iv-11.dat key-01.dat plain-11.dat)
+    testEncrypt 11 0
+
+    args=(--in-place --gcm iv-11.dat key-01.dat)
+    testEncrypt 08 1
+
+    # CBC encryption is serial whatever the thread count.
+    args=(-j 4 --cbc iv-10.dat key-01.dat plain-15.dat)
+    testEncrypt 15 0
+
+    args=(-j 4 --io-uring --cbc iv-10.dat key-01.dat plain-25.dat)
+    testEncrypt 25 0
+
+    args=(--in-place --cbc iv-10.dat key-01.dat)
+    testEncrypt 08 1
+
+    # XTS takes a 32-byte key and a data unit of 512 or 4096 bytes.
+    args=(--xts 512 key-13.dat plain-13.dat)
+    testEncrypt 13 0
+
+    args=(-j 3 --mmap --xts 512 key-13.dat plain-13.dat)
+    testEncrypt 13 0
+
+    args=(--xts 512 key-01.dat plain-13.dat)
+    testEncrypt 14 1
+
+    args=(--xts 1024 key-13.dat plain-13.dat)
+    testEncrypt 08 1
+
+    # A container gets a fresh nonce every time, so it is checked by
+    # decrypting it again.
+    echo "Encrypt Test 16 container"
+    rm -f output.dat container.dat
+    echo "   ./encrypt -j 2 --container key-01.dat plain-16.dat container.dat"
+    ./encrypt -j 2 --container key-01.dat plain-16.dat container.dat
+    if checkStatus 0 $? &&
+       ./decrypt --container key-01.dat container.dat output.dat &&
+       checkFile "Plaintext output" plain-16.dat output.dat
+    then
+	echo "Encrypt Test 16 container PASS"
+    fi
+    rm -f container.dat
+
+    args=(--range 0:16 key-01.dat plain-16.dat)
+    testEncrypt 08 1
+
+    # SIV is deterministic, so repeated chunks give repeated records.
+    args=(-j 2 --siv key-13.dat plain-20.dat)
+    testEncrypt 20 0
+
+    # Stats written to a file leave the output and stderr alone.
+    rm -f stats.json
+    args=(--stats=stats.json key-01.dat plain-01.dat)
+    if testEncrypt 01 0; then
+	if ! grep -q "\"cipher\": { \"calls\": 1, \"bytes\": $(stat -c %s plain-01.dat)," stats.json ||
+	   ! grep -q '"peakRssKiB"' stats.json; then
+	    fail "FAILED - --stats didn't record the cipher stage"
+	else
+	    echo "Encrypt Test 01 stats PASS"
+	fi
+    fi
+    rm -f stats.json
+
+    # In place, the input file itself becomes the ciphertext.
+    echo "Encrypt Test 05 in place"
+    cp plain-05.dat output.dat
+    echo "   ./encrypt --in-place key-05.dat output.dat"
+    ./encrypt --in-place key-05.dat output.dat
+    if checkStatus 0 $? &&
+       checkFile "Ciphertext output" cipher-05.dat output.dat
+    then
+	echo "Encrypt Test 05 in place PASS"
+    fi
 else
     fail "Since your encrypt program didn't compile, it couldn't be tested"
 fi
@@ -237,10 +346,241 @@ if [ -x decrypt ]; then
     
     args=(key-09.dat cipher-09.dat)
     testDecrypt 09 1
+
+    args=(--mmap key-06.dat cipher-06.dat)
+    testDecrypt 06 0
+
+    args=(--jobs 3 key-06.dat cipher-06.dat)
+    testDecrypt 06 0
+
+    args=(--io-uring -j 2 key-06.dat cipher-06.dat)
+    testDecrypt 06 0
+
+    args=(--ctr iv-10.dat key-01.dat cipher-10.dat)
+    testDecrypt 10 0
+
+    args=(--gcm iv-11.dat key-01.dat cipher-11.dat)
+    testDecrypt 11 0
+
+    args=(--mmap --gcm iv-11.dat key-01.dat cipher-11.dat)
+    testDecrypt 11 0
+
+    args=(--xts 512 key-13.dat cipher-13.dat)
+    testDecrypt 13 0
+
+    args=(--cbc iv-10.dat key-01.dat cipher-15.dat)
+    testDecrypt 15 0
+
+    args=(-j 3 --io-uring --cbc iv-10.dat key-01.dat cipher-15.dat)
+    testDecrypt 15 0
+
+    # Five blocks don't split evenly across four threads.
+    args=(-j 4 --io-uring --cbc iv-10.dat key-01.dat cipher-25.dat)
+    testDecrypt 25 0
+
+    args=(--io-uring -j 2 --xts 512 key-13.dat cipher-13.dat)
+    testDecrypt 13 0
+
+    args=(-j 2 --container key-01.dat cipher-16.dat)
+    testDecrypt 16 0
+
+    # A range reads only the chunks it overlaps.
+    args=(--range 20000:5000 key-01.dat cipher-16.dat)
+    testDecrypt 17 0
+
+    args=(--range 39000:1001 key-01.dat cipher-16.dat)
+    testDecrypt 19 1
+
+    args=(--container key-01.dat cipher-18.dat)
+    testDecrypt 18 1
+
+    # A range can't be combined with another mode.
+    args=(--range 0:10 --ctr iv-10.dat key-01.dat cipher-18.dat)
+    testDecrypt 24 1
+
+    args=(--siv key-13.dat cipher-20.dat)
+    testDecrypt 20 0
+
+    args=(--siv key-13.dat cipher-21.dat)
+    testDecrypt 21 1
+
+    # The trailer catches records dropped from the end or swapped.
+    args=(--siv key-13.dat cipher-22.dat)
+    testDecrypt 22 1
+
+    args=(--siv key-13.dat cipher-23.dat)
+    testDecrypt 23 1
+
+    # A damaged tag must leave no output file behind.
+    args=(--gcm iv-11.dat key-01.dat cipher-12.dat)
+    testDecrypt 12 1
+    if [ -e output.dat ] || ls output.dat.* >/dev/null 2>&1; then
+	fail "FAILED - unauthenticated plaintext was written"
+    fi
+
+    echo "Decrypt Test 05 in place"
+    cp cipher-05.dat output.dat
+    echo "   ./decrypt --in-place key-05.dat output.dat"
+    ./decrypt --in-place key-05.dat output.dat
+    if checkStatus 0 $? &&
+       checkFile "Plaintext output" plain-05.dat output.dat
+    then
+	echo "Decrypt Test 05 in place PASS"
+    fi
+
+    # Several threads still read a pipe in order.
+    echo "Decrypt Test 06 from a pipe"
+    rm -f output.dat
+    echo "   cat cipher-06.dat | ./decrypt -j 2 key-06.dat /dev/stdin output.dat"
+    cat cipher-06.dat | ./decrypt -j 2 key-06.dat /dev/stdin output.dat
+    if checkStatus 0 $? &&
+       checkFile "Plaintext output" plain-06.dat output.dat
+    then
+	echo "Decrypt Test 06 from a pipe PASS"
+    fi
 else
     fail "Since your decrypt program didn't compile, it couldn't be tested"
 fi
 
+# Round trip a sparse file past 4 GB, so every size and offset on the
+# way has to be 64 bits wide.  Encryption runs on several threads and
+# decryption goes through the mappings.  Marker blocks just past 2 GB and at the
+# very end catch data landing at a wrapped offset.
+echo
+echo "Running large file test"
+
+if [ -x encrypt ] && [ -x decrypt ]; then
+    rm -f large-plain.dat large-cipher.dat large-output.dat
+    truncate -s 4G large-plain.dat
+    printf 'marker block 2GB' |
+      dd of=large-plain.dat bs=1 seek=2147483648 conv=notrunc 2>/dev/null
+    printf 'the very last 32 bytes, at 4 GB.' >> large-plain.dat
+
+    echo "   ./encrypt -j 4 key-01.dat large-plain.dat large-cipher.dat"
+    ./encrypt -j 4 key-01.dat large-plain.dat large-cipher.dat
+    checkStatus 0 $? || FAIL=1
+
+    echo "   ./decrypt --mmap key-01.dat large-cipher.dat large-output.dat"
+    ./decrypt --mmap key-01.dat large-cipher.dat large-output.dat
+    checkStatus 0 $? || FAIL=1
+
+    if [ "$(stat -c %s large-cipher.dat)" != "$(stat -c %s large-plain.dat)" ]; then
+	fail "FAILED - large ciphertext size doesn't match the plaintext"
+    elif ! cmp -s large-plain.dat large-output.dat; then
+	fail "FAILED - large file doesn't round trip"
+    else
+	echo "Large file test PASS"
+    fi
+
+    rm -f large-plain.dat large-cipher.dat large-output.dat
+else
+    fail "Since encrypt or decrypt didn't compile, the large file couldn't be tested"
+fi
+
+# Tests for the aesgen program.
+echo
+echo "Running aesgen tests"
+
+if [ -x aesgen ]; then
+    # A seeded run gives the same bytes however many threads make them.
+    echo "   ./aesgen -j 1 --seed key-13.dat 3000001 output.dat"
+    ./aesgen -j 1 --seed key-13.dat 3000001 output.dat
+    checkStatus 0 $? || FAIL=1
+    echo "   ./aesgen -j 3 --seed key-13.dat 3000001 /dev/stdout"
+    ./aesgen -j 3 --seed key-13.dat 3000001 /dev/stdout > gen-output.dat
+    checkStatus 0 $? || FAIL=1
+
+    if [ "$(stat -c %s output.dat)" != 3000001 ]; then
+	fail "FAILED - aesgen didn't write the requested number of bytes"
+    elif ! cmp -s output.dat gen-output.dat; then
+	fail "FAILED - seeded aesgen output depends on the thread count"
+    else
+	echo "aesgen seeded test PASS"
+    fi
+
+    echo "   ./aesgen --seed key-01.dat 16 output.dat"
+    ./aesgen --seed key-01.dat 16 output.dat 2> stderr.txt
+    checkStatus 1 $? || FAIL=1
+
+    rm -f gen-output.dat
+else
+    fail "Since your aesgen program didn't compile, it couldn't be tested"
+fi
+
+# A short benchmark run should give one JSON result per size, with or
+# without hardware counters to read.
+echo
+echo "Running aesBench smoke test"
+make aesBench
+
+if [ -x aesBench ]; then
+    echo "   ./aesBench --counters --max-size 64 --reps 3 --filter ctrCrypt"
+    ./aesBench --counters --max-size 64 --reps 3 --filter ctrCrypt > output.dat 2> stderr.txt
+    checkStatus 0 $? || FAIL=1
+
+    if [ "$(grep -c '"name": "ctrCrypt"' output.dat)" != 2 ] ||
+       ! grep -q '"counters": \(true\|false\),' output.dat ||
+       ! tail -n 1 output.dat | grep -q '^}$'; then
+	fail "FAILED - aesBench didn't write the expected JSON"
+    else
+	echo "aesBench smoke test PASS"
+    fi
+else
+    fail "Since your aesBench program didn't compile, it couldn't be tested"
+fi
+
+# The daemon should give the same results as encrypt, refuse forged
+# GCM ciphertext, and remove its socket when told to stop.
+echo
+echo "Running aesd tests"
+make aesd aesc aesload
+
+if [ -x aesd ] && [ -x aesc ] && [ -x aesload ]; then
+    rm -f aesd.sock
+    ./aesd -j 2 --key 1=key-01.dat --key 6=key-06.dat aesd.sock &
+    DAEMON=$!
+    # The socket appears before the daemon listens on it
+    for i in $(seq 50); do
+	./aesc aesd.sock encrypt 6 plain-06.dat /dev/null 2>/dev/null && break
+	sleep 0.1
+    done
+
+    echo "   ./aesc aesd.sock encrypt 6 plain-06.dat output.dat"
+    ./aesc aesd.sock encrypt 6 plain-06.dat output.dat
+    checkStatus 0 $? && checkFile "aesd ECB output" cipher-06.dat output.dat
+
+    echo "   ./aesc --ctr iv-10.dat aesd.sock encrypt 1 plain-10.dat output.dat"
+    ./aesc --ctr iv-10.dat aesd.sock encrypt 1 plain-10.dat output.dat
+    checkStatus 0 $? && checkFile "aesd CTR output" cipher-10.dat output.dat
+
+    echo "   ./aesc --gcm iv-11.dat aesd.sock decrypt 1 cipher-11.dat output.dat"
+    ./aesc --gcm iv-11.dat aesd.sock decrypt 1 cipher-11.dat output.dat
+    checkStatus 0 $? && checkFile "aesd GCM output" plain-11.dat output.dat
+
+    echo "   ./aesc --gcm iv-11.dat aesd.sock decrypt 1 cipher-12.dat output.dat"
+    ./aesc --gcm iv-11.dat aesd.sock decrypt 1 cipher-12.dat output.dat 2> stderr.txt
+    checkStatus 1 $?
+
+    echo "   ./aesload -n 200 -c 2 --size 64K --no-compare aesd.sock"
+    ./aesload -n 200 -c 2 --size 64K --no-compare aesd.sock > /dev/null
+    checkStatus 0 $?
+
+    echo "   ./aesload -n 20 -c 2 --size 1M --mode gcm --shm --no-compare aesd.sock"
+    ./aesload -n 20 -c 2 --size 1M --mode gcm --shm --no-compare aesd.sock > /dev/null
+    checkStatus 0 $?
+
+    kill $DAEMON
+    wait $DAEMON
+    if [ -e aesd.sock ]; then
+	fail "FAILED - aesd didn't remove its socket"
+	rm -f aesd.sock
+    else
+	echo "aesd test PASS"
+    fi
+else
+    fail "Since your aesd programs didn't compile, they couldn't be tested"
+fi
+
 if [ $FAIL -ne 0 ]; then
   echo "FAILING TESTS!"
   exit 13
@@ -0,0 +1,252 @@
+/**
+        @file vaes.c
+        @author James O Kocak (jokocak)
+
+        This component implements bulk AES with the VAES instructions on
+        512-bit registers. Each register holds four blocks, and four
+        registers are kept in flight so sixteen independent blocks share
+        every round. Only the kernels are built for AVX-512 and VAES, through
+        VAES_TARGET, so nothing the compiler emits for the feature check can
+        use instructions the check is there to rule out.
+ */
+
+#include "vaes.h"
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+
+#include <cpuid.h>
+#include <pthread.h>
+#include <immintrin.h>
+
+/** CPUID leaf holding the basic feature flags. */
+#define FEATURE_LEAF 1
+
+/** CPUID leaf holding the extended feature flags. */
+#define EXTENDED_LEAF 7
+
+/** CPUID ECX bit for the VAES instructions. */
+#define VAES_BIT ( 1u << 9 )
+
+/** CPUID EBX bit for the AVX-512 foundation instructions. */
+#define AVX512F_BIT ( 1u << 16 )
+
+/** CPUID ECX bit saying the OS has enabled XGETBV. */
+#define OSXSAVE_BIT ( 1u << 27 )
+
+/** XCR0 bits for the SSE, AVX, mask and both halves of the ZMM state. */
+#define ZMM_STATE 0xE6
+
+/** Number of blocks in one 512-bit register. */
+#define LANE_BLOCKS 4
+
+/** Number of registers encrypted side by side. */
+#define INTERLEAVE 4
+
+/** Bytes in one register of blocks. */
+#define LANE_BYTES ( LANE_BLOCKS * BLOCK_SIZE )
+
+/** Number of 64-bit mask bits covering one block. */
+#define MASK_BITS_PER_BLOCK 2
+
+/** Builds a function for AVX-512 and VAES, which the rest of the file isn't. */
+#define VAES_TARGET __attribute__ (( target( "avx512f,vaes" ) ))
+
+/** Runs the feature check exactly once, whichever thread asks first. */
+static pthread_once_t checkOnce = PTHREAD_ONCE_INIT;
+
+/** Cached result of the feature check. */
+static bool available = false;
+
+/**
+        This function runs the feature check into available. It is run
+        through checkOnce.
+ */
+static void check( void )
+{
+        unsigned int eax, ebx, ecx, edx;
+        bool ok = __get_cpuid( FEATURE_LEAF, &eax, &ebx, &ecx, &edx ) &&
+                ( ecx & bit_AES ) && ( ecx & OSXSAVE_BIT );
+
+        // The OS must save the opmask and 512-bit register state
+        if ( ok ) {
+                unsigned int lo, hi;
+                __asm__ volatile ( "xgetbv" : "=a" ( lo ), "=d" ( hi )
+                                        : "c" ( 0 ) );
+                ok = ( lo & ZMM_STATE ) == ZMM_STATE;
+        }
+
+        if ( ok ) {
+                ok = __get_cpuid_count( EXTENDED_LEAF, 0,
+                                &eax, &ebx, &ecx, &edx ) &&
+                        ( ebx & AVX512F_BIT ) && ( ecx & VAES_BIT );
+        }
+
+        available = ok;
+}
+
+bool vaesAvailable( void )
+{
+        pthread_once( &checkOnce, check );
+        return available;
+}
+
+/**
+        This function broadcasts every subkey of a schedule to all four
+        lanes of a register.
+
+        @param keys The broadcast subkeys
+        @param schedule The subkeys to broadcast
+ */
+VAES_TARGET static void broadcastKeys( __m512i keys[ ROUNDS + 1 ],
+                        byte const schedule[ ROUNDS + 1 ][ BLOCK_SIZE ] )
+{
+        int r = 0;
+        for ( r = 0; r < ROUNDS + 1; r++ ) {
+                keys[ r ] = _mm512_broadcast_i32x4(
+                        _mm_loadu_si128( ( __m128i const * ) schedule[ r ] ) );
+        }
+}
+
+/**
+        This function returns the load and store mask for the first count
+        blocks of a register.
+
+        @param count The number of blocks, less than LANE_BLOCKS
+        @return The mask, two bits per block
+ */
+VAES_TARGET static __mmask8 blockMask( size_t count )
+{
+        return ( __mmask8 ) ( ( 1u << ( count * MASK_BITS_PER_BLOCK ) ) - 1 );
+}
+
+/**
+        Runs one round instruction over all interleaved registers. The
+        indexes are spelled out so the compiler keeps them in registers.
+ */
+#define ROUND_ALL( op, key ) { \
+        s[ 0 ] = op( s[ 0 ], key ); \
+        s[ 1 ] = op( s[ 1 ], key ); \
+        s[ 2 ] = op( s[ 2 ], key ); \
+        s[ 3 ] = op( s[ 3 ], key ); \
+}
+
+/** Loads register n of the run and adds the first subkey. */
+#define LOAD_LANES( n ) s[ n ] = _mm512_xor_si512( keys[ 0 ], \
+        _mm512_loadu_si512( in + ( n ) * LANE_BYTES ) )
+
+/** Stores register n of the run. */
+#define STORE_LANES( n ) _mm512_storeu_si512( out + ( n ) * LANE_BYTES, s[ n ] )
+
+VAES_TARGET void vaesEncryptBlocks( AesContext const *ctx, byte const *in,
+                        byte *out, size_t count )
+{
+        __m512i keys[ ROUNDS + 1 ];
+        broadcastKeys( keys, ctx->subkey );
+
+        int r = 0;
+        __m512i s[ INTERLEAVE ];
+        while ( count >= LANE_BLOCKS * INTERLEAVE ) {
+                LOAD_LANES( 0 );
+                LOAD_LANES( 1 );
+                LOAD_LANES( 2 );
+                LOAD_LANES( 3 );
+
+                for ( r = 1; r < ROUNDS; r++ ) {
+                        ROUND_ALL( _mm512_aesenc_epi128, keys[ r ] );
+                }
+
+                ROUND_ALL( _mm512_aesenclast_epi128, keys[ ROUNDS ] );
+                STORE_LANES( 0 );
+                STORE_LANES( 1 );
+                STORE_LANES( 2 );
+                STORE_LANES( 3 );
+
+                in += LANE_BYTES * INTERLEAVE;
+                out += LANE_BYTES * INTERLEAVE;
+                count -= LANE_BLOCKS * INTERLEAVE;
+        }
+
+        // The rest go one register at a time, the last one masked
+        while ( count > 0 ) {
+                size_t now = count < LANE_BLOCKS ? count : LANE_BLOCKS;
+                __mmask8 mask = blockMask( now );
+                __m512i x = _mm512_maskz_loadu_epi64( mask, in );
+                x = _mm512_xor_si512( x, keys[ 0 ] );
+                for ( r = 1; r < ROUNDS; r++ ) {
+                        x = _mm512_aesenc_epi128( x, keys[ r ] );
+                }
+
+                x = _mm512_aesenclast_epi128( x, keys[ ROUNDS ] );
+                _mm512_mask_storeu_epi64( out, mask, x );
+
+                in += now * BLOCK_SIZE;
+                out += now * BLOCK_SIZE;
+                count -= now;
+        }
+}
+
+VAES_TARGET void vaesDecryptBlocks( AesContext const *ctx, byte const *in,
+                        byte *out, size_t count )
+{
+        __m512i keys[ ROUNDS + 1 ];
+        broadcastKeys( keys, ctx->decSubkey );
+
+        int r = 0;
+        __m512i s[ INTERLEAVE ];
+        while ( count >= LANE_BLOCKS * INTERLEAVE ) {
+                LOAD_LANES( 0 );
+                LOAD_LANES( 1 );
+                LOAD_LANES( 2 );
+                LOAD_LANES( 3 );
+
+                for ( r = 1; r < ROUNDS; r++ ) {
+                        ROUND_ALL( _mm512_aesdec_epi128, keys[ r ] );
+                }
+
+                ROUND_ALL( _mm512_aesdeclast_epi128, keys[ ROUNDS ] );
+                STORE_LANES( 0 );
+                STORE_LANES( 1 );
+                STORE_LANES( 2 );
+                STORE_LANES( 3 );
+
+                in += LANE_BYTES * INTERLEAVE;
+                out += LANE_BYTES * INTERLEAVE;
+                count -= LANE_BLOCKS * INTERLEAVE;
+        }
+
+        while ( count > 0 ) {
+                size_t now = count < LANE_BLOCKS ? count : LANE_BLOCKS;
+                __mmask8 mask = blockMask( now );
+                __m512i x = _mm512_maskz_loadu_epi64( mask, in );
+                x = _mm512_xor_si512( x, keys[ 0 ] );
+                for ( r = 1; r < ROUNDS; r++ ) {
+                        x = _mm512_aesdec_epi128( x, keys[ r ] );
+                }
+
+                x = _mm512_aesdeclast_epi128( x, keys[ ROUNDS ] );
+                _mm512_mask_storeu_epi64( out, mask, x );
+
+                in += now * BLOCK_SIZE;
+                out += now * BLOCK_SIZE;
+                count -= now;
+        }
+}
+
+#else
+
+bool vaesAvailable( void )
+{
+        return false;
+}
+
+void vaesEncryptBlocks( AesContext const *ctx, byte const *in, byte *out,
+                        size_t count )
+{
+}
+
+void vaesDecryptBlocks( AesContext const *ctx, byte const *in, byte *out,
+                        size_t count )
+{
+}
+
+#endif
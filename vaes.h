@@ -0,0 +1,49 @@
+/**
+        @file vaes.h
+        @author James O Kocak (jokocak)
+
+        The header file for the vaes.c component of the program. This
+        component runs four blocks through each AES round instruction using
+        the VAES extension on 512-bit AVX-512 registers. It only handles bulk
+        requests; single blocks on a VAES context go through aesni.c.
+ */
+
+#ifndef _VAES_H_
+#define _VAES_H_
+
+#include "aes.h"
+
+#endif
+
+/**
+        This function checks, using CPUID and XGETBV, whether the processor
+        supports VAES and AVX-512 and the operating system saves the 512-bit
+        registers. The answer is computed once and cached.
+
+        @return True if the VAES backend can be used
+ */
+bool vaesAvailable( void );
+
+/**
+        This function encrypts count consecutive blocks from in to out, which
+        may be the same buffer.
+
+        @param ctx The expanded key to encrypt with
+        @param in The blocks to encrypt
+        @param out Where to store the encrypted blocks
+        @param count The number of blocks
+ */
+void vaesEncryptBlocks( AesContext const *ctx, byte const *in, byte *out,
+                        size_t count );
+
+/**
+        This function decrypts count consecutive blocks from in to out, which
+        may be the same buffer.
+
+        @param ctx The expanded key to decrypt with
+        @param in The blocks to decrypt
+        @param out Where to store the decrypted blocks
+        @param count The number of blocks
+ */
+void vaesDecryptBlocks( AesContext const *ctx, byte const *in, byte *out,
+                        size_t count );
@@ -0,0 +1,381 @@
+/**
+        @file vperm.c
+        @author James O Kocak (jokocak)
+
+        This component implements constant-time AES on a single block with
+        the SSSE3 byte shuffle instruction. Every table here has only 16
+        entries and lives in a register, so no memory access depends on the
+        data. The sBox is computed by mapping each byte into GF(2^4)[u] /
+        ( u^2 + 2u + 2 ), with the high nibble as the coefficient of u,
+        inverting it there with nibble-indexed shuffles, and mapping the
+        result back. ShiftRows and the row rotations of mixColumns are each
+        a single shuffle of the whole state.
+
+        The inversion follows Hamburg, "Accelerating AES with Vector Permute
+        Instructions": with i the high nibble, k the low nibble and j = i ^ k,
+        the values j + 1 / ( 1 / i + 2 / k ) and i + 1 / ( 1 / j + 2 / k )
+        determine the two coordinates of the inverse.
+ */
+
+#include "vperm.h"
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+
+#include <cpuid.h>
+#include <tmmintrin.h>
+
+/** Number of bytes in a vector register, and entries in a shuffle table. */
+#define VECTOR_BYTES 16
+
+/** CPUID leaf holding the basic feature flags. */
+#define FEATURE_LEAF 1
+
+/** Mask selecting the low nibble of every byte. */
+#define NIBBLE_MASK 0x0F
+
+/** The constant added by the affine map at the end of the sBox. */
+#define SBOX_CONSTANT 0x63
+
+/**
+        Inverse of each element of GF(2^4) under x^4 + x + 1. The inverse of
+        zero is 0x80, which makes the shuffle that consumes it produce zero.
+ */
+static const byte inverse[ VECTOR_BYTES ] = {
+        0x80, 0x01, 0x09, 0x0E, 0x0D, 0x0B, 0x07, 0x06,
+        0x0F, 0x02, 0x0C, 0x05, 0x0A, 0x04, 0x03, 0x08
+};
+
+/** The value 2 / k for each nibble k, again with 0x80 for zero. */
+static const byte divideA[ VECTOR_BYTES ] = {
+        0x80, 0x02, 0x01, 0x0F, 0x09, 0x05, 0x0E, 0x0C,
+        0x0D, 0x04, 0x0B, 0x0A, 0x07, 0x08, 0x06, 0x03
+};
+
+/** Maps the low nibble of an AES byte into the tower field. */
+static const byte encodeLo[ VECTOR_BYTES ] = {
+        0x00, 0x01, 0x1C, 0x1D, 0x2D, 0x2C, 0x31, 0x30,
+        0x27, 0x26, 0x3B, 0x3A, 0x0A, 0x0B, 0x16, 0x17
+};
+
+/** Maps the high nibble of an AES byte into the tower field. */
+static const byte encodeHi[ VECTOR_BYTES ] = {
+        0x00, 0x86, 0xFD, 0x7B, 0x8E, 0x08, 0x73, 0xF5,
+        0x77, 0xF1, 0x8A, 0x0C, 0xF9, 0x7F, 0x04, 0x82
+};
+
+/**
+        Contribution of the first inversion output to the sBox result,
+        including the linear part of the affine map.
+ */
+static const byte sboxOutI[ VECTOR_BYTES ] = {
+        0x00, 0xCB, 0xD7, 0xB0, 0x21, 0x8D, 0x67, 0xAC,
+        0x7B, 0x5A, 0xEA, 0x3D, 0x46, 0xF6, 0x91, 0x1C
+};
+
+/** Contribution of the second inversion output to the sBox result. */
+static const byte sboxOutJ[ VECTOR_BYTES ] = {
+        0x00, 0x9F, 0x61, 0x16, 0xC2, 0x2A, 0x77, 0xE8,
+        0x89, 0x4B, 0x5D, 0x3C, 0xB5, 0xA3, 0xD4, 0xFE
+};
+
+/**
+        Maps the low nibble of a byte through the inverse affine map into
+        the tower field; the affine constant is folded in here.
+ */
+static const byte decodeLo[ VECTOR_BYTES ] = {
+        0x2C, 0x99, 0xF0, 0x45, 0xF7, 0x42, 0x2B, 0x9E,
+        0x38, 0x8D, 0xE4, 0x51, 0xE3, 0x56, 0x3F, 0x8A
+};
+
+/** Maps the high nibble of a byte through the inverse affine map. */
+static const byte decodeHi[ VECTOR_BYTES ] = {
+        0x00, 0xA7, 0xA8, 0x0F, 0xED, 0x4A, 0x45, 0xE2,
+        0xD1, 0x76, 0x79, 0xDE, 0x3C, 0x9B, 0x94, 0x33
+};
+
+/** Contribution of the first inversion output to the inverse sBox. */
+static const byte invOutI[ VECTOR_BYTES ] = {
+        0x00, 0x3B, 0xE4, 0xC8, 0x03, 0x14, 0x2C, 0x17,
+        0xF3, 0xF0, 0x38, 0xDC, 0x2F, 0xE7, 0xCB, 0xDF
+};
+
+/** Contribution of the second inversion output to the inverse sBox. */
+static const byte invOutJ[ VECTOR_BYTES ] = {
+        0x00, 0x24, 0x91, 0x19, 0x23, 0x8F, 0x88, 0xAC,
+        0x3D, 0x1E, 0x07, 0x96, 0xAB, 0xB2, 0x3A, 0xB5
+};
+
+/** Products of the low nibble with 0x02. */
+static const byte times2Lo[ VECTOR_BYTES ] = {
+        0x00, 0x02, 0x04, 0x06, 0x08, 0x0A, 0x0C, 0x0E,
+        0x10, 0x12, 0x14, 0x16, 0x18, 0x1A, 0x1C, 0x1E
+};
+
+/** Products of the high nibble with 0x02, reduced by the AES polynomial. */
+static const byte times2Hi[ VECTOR_BYTES ] = {
+        0x00, 0x20, 0x40, 0x60, 0x80, 0xA0, 0xC0, 0xE0,
+        0x1B, 0x3B, 0x5B, 0x7B, 0x9B, 0xBB, 0xDB, 0xFB
+};
+
+/** Products of the low nibble with 0x04. */
+static const byte times4Lo[ VECTOR_BYTES ] = {
+        0x00, 0x04, 0x08, 0x0C, 0x10, 0x14, 0x18, 0x1C,
+        0x20, 0x24, 0x28, 0x2C, 0x30, 0x34, 0x38, 0x3C
+};
+
+/** Products of the high nibble with 0x04, reduced by the AES polynomial. */
+static const byte times4Hi[ VECTOR_BYTES ] = {
+        0x00, 0x40, 0x80, 0xC0, 0x1B, 0x5B, 0x9B, 0xDB,
+        0x36, 0x76, 0xB6, 0xF6, 0x2D, 0x6D, 0xAD, 0xED
+};
+
+/** Shuffle performing shiftRows on a block in its one-dimensional order. */
+static const byte shiftRowsMask[ VECTOR_BYTES ] = {
+        0x00, 0x05, 0x0A, 0x0F, 0x04, 0x09, 0x0E, 0x03,
+        0x08, 0x0D, 0x02, 0x07, 0x0C, 0x01, 0x06, 0x0B
+};
+
+/** Shuffle performing unShiftRows. */
+static const byte unShiftRowsMask[ VECTOR_BYTES ] = {
+        0x00, 0x0D, 0x0A, 0x07, 0x04, 0x01, 0x0E, 0x0B,
+        0x08, 0x05, 0x02, 0x0F, 0x0C, 0x09, 0x06, 0x03
+};
+
+/** Shuffle giving row r of each column the byte from row r + 1. */
+static const byte rotate1Mask[ VECTOR_BYTES ] = {
+        0x01, 0x02, 0x03, 0x00, 0x05, 0x06, 0x07, 0x04,
+        0x09, 0x0A, 0x0B, 0x08, 0x0D, 0x0E, 0x0F, 0x0C
+};
+
+/** Shuffle giving row r of each column the byte from row r + 2. */
+static const byte rotate2Mask[ VECTOR_BYTES ] = {
+        0x02, 0x03, 0x00, 0x01, 0x06, 0x07, 0x04, 0x05,
+        0x0A, 0x0B, 0x08, 0x09, 0x0E, 0x0F, 0x0C, 0x0D
+};
+
+/** Whether the CPUID check has run yet. */
+static bool checked = false;
+
+/** Cached result of the CPUID check. */
+static bool available = false;
+
+bool vpermAvailable( void )
+{
+        if ( !checked ) {
+                unsigned int eax, ebx, ecx, edx;
+                available = __get_cpuid( FEATURE_LEAF, &eax, &ebx, &ecx, &edx ) &&
+                        ( ecx & bit_SSSE3 );
+                checked = true;
+        }
+
+        return available;
+}
+
+/**
+        This function loads a 16-entry table into a register.
+
+        @param table The table to load
+        @return The table as a vector
+ */
+static __m128i load( byte const table[ VECTOR_BYTES ] )
+{
+        return _mm_loadu_si128( ( __m128i const * ) table );
+}
+
+/**
+        This function looks up every byte of index in a 16-entry table.
+        Bytes of index with the top bit set give zero.
+
+        @param table The table to look in
+        @param index The indexes, one per byte
+        @return The looked up values
+ */
+static __m128i lookup( byte const table[ VECTOR_BYTES ], __m128i index )
+{
+        return _mm_shuffle_epi8( load( table ), index );
+}
+
+/**
+        This function returns the high nibble of every byte.
+
+        @param x The bytes to split
+        @return The high nibbles, shifted down
+ */
+static __m128i highNibbles( __m128i x )
+{
+        return _mm_and_si128( _mm_srli_epi32( x, 4 ),
+                _mm_set1_epi8( NIBBLE_MASK ) );
+}
+
+/**
+        This function returns the low nibble of every byte.
+
+        @param x The bytes to split
+        @return The low nibbles
+ */
+static __m128i lowNibbles( __m128i x )
+{
+        return _mm_and_si128( x, _mm_set1_epi8( NIBBLE_MASK ) );
+}
+
+/**
+        This function applies a map that is linear over the bits of a byte,
+        given by its values on the low and the high nibble.
+
+        @param x The bytes to map
+        @param lo The map on the low nibble
+        @param hi The map on the high nibble
+        @return The mapped bytes
+ */
+static __m128i linearMap( __m128i x, byte const lo[ VECTOR_BYTES ],
+                                byte const hi[ VECTOR_BYTES ] )
+{
+        return _mm_xor_si128( lookup( lo, lowNibbles( x ) ),
+                lookup( hi, highNibbles( x ) ) );
+}
+
+/**
+        This function inverts every byte in the tower field and maps the two
+        coordinates of the inverse out through the given tables.
+
+        @param e The bytes to invert, already in the tower field
+        @param outI The output map for the first coordinate
+        @param outJ The output map for the second coordinate
+        @return The mapped inverses
+ */
+static __m128i invert( __m128i e, byte const outI[ VECTOR_BYTES ],
+                        byte const outJ[ VECTOR_BYTES ] )
+{
+        __m128i i = highNibbles( e );
+        __m128i k = lowNibbles( e );
+        __m128i j = _mm_xor_si128( i, k );
+        __m128i ak = lookup( divideA, k );
+
+        __m128i iak = _mm_xor_si128( lookup( inverse, i ), ak );
+        __m128i jak = _mm_xor_si128( lookup( inverse, j ), ak );
+        __m128i io = _mm_xor_si128( lookup( inverse, iak ), j );
+        __m128i jo = _mm_xor_si128( lookup( inverse, jak ), i );
+
+        return _mm_xor_si128( lookup( outI, io ), lookup( outJ, jo ) );
+}
+
+/**
+        This function runs every byte of the state through the sBox.
+
+        @param x The state
+        @return The substituted state
+ */
+static __m128i subBytes( __m128i x )
+{
+        __m128i y = invert( linearMap( x, encodeLo, encodeHi ),
+                sboxOutI, sboxOutJ );
+        return _mm_xor_si128( y, _mm_set1_epi8( SBOX_CONSTANT ) );
+}
+
+/**
+        This function runs every byte of the state through the inverse sBox.
+
+        @param x The state
+        @return The substituted state
+ */
+static __m128i invSubBytes( __m128i x )
+{
+        return invert( linearMap( x, decodeLo, decodeHi ), invOutI, invOutJ );
+}
+
+/**
+        This function performs mixColumns on the state. Each output row is
+        2 * ( a[ r ] ^ a[ r + 1 ] ) ^ a[ r + 1 ] ^ a[ r + 2 ] ^ a[ r + 3 ].
+
+        @param a The state
+        @return The mixed state
+ */
+static __m128i mixColumns128( __m128i a )
+{
+        __m128i next = _mm_shuffle_epi8( a, load( rotate1Mask ) );
+        __m128i sum = _mm_xor_si128( a, next );
+        __m128i out = _mm_xor_si128( linearMap( sum, times2Lo, times2Hi ),
+                next );
+        return _mm_xor_si128( out,
+                _mm_shuffle_epi8( sum, load( rotate2Mask ) ) );
+}
+
+/**
+        This function performs unMixColumns on the state, by first multiplying
+        each column by ( 0x05, 0x00, 0x04, 0x00 ) and then mixing.
+
+        @param a The state
+        @return The unmixed state
+ */
+static __m128i unMixColumns128( __m128i a )
+{
+        __m128i pair = _mm_xor_si128( a,
+                _mm_shuffle_epi8( a, load( rotate2Mask ) ) );
+        a = _mm_xor_si128( a, linearMap( pair, times4Lo, times4Hi ) );
+        return mixColumns128( a );
+}
+
+/**
+        This function loads one subkey.
+
+        @param ctx The expanded key
+        @param round The round the subkey belongs to
+        @return The subkey as a vector
+ */
+static __m128i subkey( AesContext const *ctx, int round )
+{
+        return _mm_loadu_si128( ( __m128i const * ) ctx->subkey[ round ] );
+}
+
+void vpermEncrypt( AesContext const *ctx, byte data[ BLOCK_SIZE ] )
+{
+        __m128i shift = load( shiftRowsMask );
+        __m128i state = _mm_loadu_si128( ( __m128i const * ) data );
+        state = _mm_xor_si128( state, subkey( ctx, 0 ) );
+
+        int i = 0;
+        for ( i = 1; i < ROUNDS; i++ ) {
+                state = _mm_shuffle_epi8( subBytes( state ), shift );
+                state = mixColumns128( state );
+                state = _mm_xor_si128( state, subkey( ctx, i ) );
+        }
+
+        state = _mm_shuffle_epi8( subBytes( state ), shift );
+        state = _mm_xor_si128( state, subkey( ctx, ROUNDS ) );
+        _mm_storeu_si128( ( __m128i * ) data, state );
+}
+
+void vpermDecrypt( AesContext const *ctx, byte data[ BLOCK_SIZE ] )
+{
+        __m128i shift = load( unShiftRowsMask );
+        __m128i state = _mm_loadu_si128( ( __m128i const * ) data );
+        state = _mm_xor_si128( state, subkey( ctx, ROUNDS ) );
+
+        int i = 0;
+        for ( i = ROUNDS - 1; i > 0; i-- ) {
+                state = invSubBytes( _mm_shuffle_epi8( state, shift ) );
+                state = _mm_xor_si128( state, subkey( ctx, i ) );
+                state = unMixColumns128( state );
+        }
+
+        state = invSubBytes( _mm_shuffle_epi8( state, shift ) );
+        state = _mm_xor_si128( state, subkey( ctx, 0 ) );
+        _mm_storeu_si128( ( __m128i * ) data, state );
+}
+
+#else
+
+bool vpermAvailable( void )
+{
+        return false;
+}
+
+void vpermEncrypt( AesContext const *ctx, byte data[ BLOCK_SIZE ] )
+{
+}
+
+void vpermDecrypt( AesContext const *ctx, byte data[ BLOCK_SIZE ] )
+{
+}
+
+#endif
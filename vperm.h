@@ -0,0 +1,40 @@
+/**
+        @file vperm.h
+        @author James O Kocak (jokocak)
+
+        The header file for the vperm.c component of the program. This
+        component implements constant-time, table-free AES on one block at a
+        time with SSSE3 byte shuffles, for serial modes that cannot batch
+        blocks for the bitsliced rounds.
+ */
+
+#ifndef _VPERM_H_
+#define _VPERM_H_
+
+#include "aes.h"
+
+#endif
+
+/**
+        This function checks, using CPUID, whether the processor supports the
+        SSSE3 shuffle instruction. The answer is computed once and cached.
+
+        @return True if the vector permute backend can be used
+ */
+bool vpermAvailable( void );
+
+/**
+        This function encrypts a 16-byte block of data in place.
+
+        @param ctx The expanded key to encrypt with
+        @param data The block of data to encrypt
+ */
+void vpermEncrypt( AesContext const *ctx, byte data[ BLOCK_SIZE ] );
+
+/**
+        This function decrypts a 16-byte block of data in place.
+
+        @param ctx The expanded key to decrypt with
+        @param data The block of data to decrypt
+ */
+void vpermDecrypt( AesContext const *ctx, byte data[ BLOCK_SIZE ] );
@@ -0,0 +1,308 @@
+/**
+        @file wire.c
+        @author James O Kocak (jokocak)
+
+        This component frames aesd's requests and responses and makes
+        blocking calls over a Unix socket for its clients.
+ */
+
+/** Exposes sendmsg's MSG_NOSIGNAL and sockaddr_un under -std=c99. */
+#define _DEFAULT_SOURCE
+
+#include "wire.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+/** Number of bits in a byte. */
+#define BYTE_BITS 8
+
+/** Where the operation is in a request header. */
+#define OP_AT 12
+
+/** Where the mode is in a request header. */
+#define MODE_AT 13
+
+/** Where the reserved bytes are in a request header. */
+#define RESERVED_AT 14
+
+/** Where the IV is in a request header. */
+#define IV_AT 16
+
+/** Where the status is in a response header. */
+#define STATUS_AT 8
+
+/** Descriptions of the statuses, indexed by WireStatus. */
+static char const *const statusNames[ WIRE_STATUS_COUNT ] = {
+        "OK", "Bad request", "Unknown key", "Bad length",
+        "Authentication failed", "Request too large", "Too many keys",
+        "Bad shared ring"
+};
+
+/**
+        This function stores a 32-bit number as little-endian bytes.
+
+        @param bytes Where to store the number
+        @param value The number
+ */
+static void storeWord( byte *bytes, uint32_t value )
+{
+        size_t i = 0;
+        for ( i = 0; i < sizeof( value ); i++ ) {
+                bytes[ i ] = ( byte ) ( value >> ( BYTE_BITS * i ) );
+        }
+}
+
+/**
+        This function reads little-endian bytes as a 32-bit number.
+
+        @param bytes The bytes to read
+        @return Their value
+ */
+static uint32_t loadWord( byte const *bytes )
+{
+        uint32_t value = 0;
+        size_t i = sizeof( value );
+        while ( i-- > 0 ) {
+                value = value << BYTE_BITS | bytes[ i ];
+        }
+
+        return value;
+}
+
+void wirePackRequest( byte bytes[ WIRE_REQUEST_SIZE ],
+                        WireRequest const *request )
+{
+        memset( bytes, 0, WIRE_REQUEST_SIZE );
+        storeWord( bytes, request->length );
+        storeWord( bytes + sizeof( uint32_t ), request->tag );
+        storeWord( bytes + 2 * sizeof( uint32_t ), request->keyId );
+        bytes[ OP_AT ] = request->op;
+        bytes[ MODE_AT ] = request->mode;
+        memcpy( bytes + IV_AT, request->iv, BLOCK_SIZE );
+}
+
+bool wireUnpackRequest( WireRequest *request,
+                        byte const bytes[ WIRE_REQUEST_SIZE ] )
+{
+        request->length = loadWord( bytes );
+        request->tag = loadWord( bytes + sizeof( uint32_t ) );
+        request->keyId = loadWord( bytes + 2 * sizeof( uint32_t ) );
+        request->op = bytes[ OP_AT ];
+        request->mode = bytes[ MODE_AT ];
+        memcpy( request->iv, bytes + IV_AT, BLOCK_SIZE );
+        return request->op >= WIRE_LOAD_KEY && request->op <= WIRE_ATTACH &&
+                request->mode < WIRE_MODE_COUNT &&
+                bytes[ RESERVED_AT ] == 0 && bytes[ RESERVED_AT + 1 ] == 0;
+}
+
+void wirePackResponse( byte bytes[ WIRE_RESPONSE_SIZE ],
+                        WireResponse const *response )
+{
+        memset( bytes, 0, WIRE_RESPONSE_SIZE );
+        storeWord( bytes, response->length );
+        storeWord( bytes + sizeof( uint32_t ), response->tag );
+        bytes[ STATUS_AT ] = response->status;
+}
+
+void wireUnpackResponse( WireResponse *response,
+                        byte const bytes[ WIRE_RESPONSE_SIZE ] )
+{
+        response->length = loadWord( bytes );
+        response->tag = loadWord( bytes + sizeof( uint32_t ) );
+        response->status = bytes[ STATUS_AT ];
+}
+
+char const *wireStatusName( WireStatus status )
+{
+        return status < WIRE_STATUS_COUNT ? statusNames[ status ] :
+                "Unknown status";
+}
+
+bool wireParseKeyId( char const *text, uint32_t *id )
+{
+        if ( text == NULL || *text < '0' || *text > '9' ) {
+                return false;
+        }
+
+        char *end = NULL;
+        errno = 0;
+        unsigned long long value = strtoull( text, &end, 10 );
+        if ( *end != '\0' || errno != 0 || value > UINT32_MAX ) {
+                return false;
+        }
+
+        *id = ( uint32_t ) value;
+        return true;
+}
+
+int wireConnect( char const *path )
+{
+        struct sockaddr_un address;
+        memset( &address, 0, sizeof( address ) );
+        address.sun_family = AF_UNIX;
+        if ( strlen( path ) >= sizeof( address.sun_path ) ) {
+                errno = ENAMETOOLONG;
+                return -1;
+        }
+
+        strcpy( address.sun_path, path );
+        int fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+        if ( fd < 0 ) {
+                return -1;
+        }
+
+        if ( connect( fd, ( struct sockaddr * ) &address,
+                      sizeof( address ) ) != 0 ) {
+                int error = errno;
+                close( fd );
+                errno = error;
+                return -1;
+        }
+
+        return fd;
+}
+
+/**
+        This function reads exactly the given number of bytes from a socket.
+
+        @param fd The socket
+        @param data Where to store the bytes
+        @param length The number of bytes
+        @return False if the connection closed or failed first
+ */
+static bool receiveAll( int fd, byte *data, size_t length )
+{
+        while ( length > 0 ) {
+                ssize_t got = recv( fd, data, length, 0 );
+                if ( got < 0 && errno == EINTR ) {
+                        continue;
+                }
+
+                if ( got <= 0 ) {
+                        return false;
+                }
+
+                data += got;
+                length -= got;
+        }
+
+        return true;
+}
+
+/**
+        This function sends a request header and its payload, with any
+        descriptors passed alongside the first byte.
+
+        @param fd The connected socket
+        @param request The request header
+        @param payload The request's payload
+        @param fds The descriptors to pass
+        @param fdCount The number of descriptors, at most WIRE_MAX_FDS
+        @return False if the connection failed
+ */
+static bool sendRequest( int fd, WireRequest const *request,
+                        byte const *payload, int const *fds, int fdCount )
+{
+        byte header[ WIRE_REQUEST_SIZE ];
+        wirePackRequest( header, request );
+        struct iovec parts[ 2 ] = {
+                { header, WIRE_REQUEST_SIZE },
+                { ( void * ) payload, request->length }
+        };
+
+        struct msghdr message;
+        memset( &message, 0, sizeof( message ) );
+        message.msg_iov = parts;
+        message.msg_iovlen = 2;
+        union {
+                struct cmsghdr align;
+                char bytes[ CMSG_SPACE( WIRE_MAX_FDS * sizeof( int ) ) ];
+        } control;
+        if ( fdCount > 0 ) {
+                memset( &control, 0, sizeof( control ) );
+                message.msg_control = control.bytes;
+                message.msg_controllen = CMSG_SPACE( fdCount * sizeof( int ) );
+                struct cmsghdr *rights = CMSG_FIRSTHDR( &message );
+                rights->cmsg_level = SOL_SOCKET;
+                rights->cmsg_type = SCM_RIGHTS;
+                rights->cmsg_len = CMSG_LEN( fdCount * sizeof( int ) );
+                memcpy( CMSG_DATA( rights ), fds, fdCount * sizeof( int ) );
+        }
+
+        // A full socket buffer takes the request in pieces; the
+        // descriptors only go with the first
+        while ( message.msg_iovlen > 0 ) {
+                ssize_t sent = sendmsg( fd, &message, MSG_NOSIGNAL );
+                if ( sent < 0 && errno == EINTR ) {
+                        continue;
+                }
+
+                if ( sent < 0 ) {
+                        return false;
+                }
+
+                message.msg_control = NULL;
+                message.msg_controllen = 0;
+                while ( message.msg_iovlen > 0 &&
+                        ( size_t ) sent >= message.msg_iov->iov_len ) {
+                        sent -= message.msg_iov->iov_len;
+                        message.msg_iov++;
+                        message.msg_iovlen--;
+                }
+
+                if ( message.msg_iovlen > 0 ) {
+                        message.msg_iov->iov_base =
+                                ( byte * ) message.msg_iov->iov_base + sent;
+                        message.msg_iov->iov_len -= sent;
+                }
+        }
+
+        return true;
+}
+
+/**
+        This function sends a request and waits for its response.
+
+        @param fd The connected socket
+        @param request The request header
+        @param payload The request's payload
+        @param fds The descriptors to pass
+        @param fdCount The number of descriptors
+        @param response Where to store the response header
+        @param reply Where to store the response's payload
+        @param capacity The number of bytes reply can hold
+        @return False if the connection failed or the response didn't fit
+ */
+static bool exchange( int fd, WireRequest const *request, byte const *payload,
+                        int const *fds, int fdCount, WireResponse *response,
+                        byte *reply, size_t capacity )
+{
+        byte answer[ WIRE_RESPONSE_SIZE ];
+        if ( !sendRequest( fd, request, payload, fds, fdCount ) ||
+             !receiveAll( fd, answer, WIRE_RESPONSE_SIZE ) ) {
+                return false;
+        }
+
+        wireUnpackResponse( response, answer );
+        return response->length <= capacity &&
+                receiveAll( fd, reply, response->length );
+}
+
+bool wireCall( int fd, WireRequest const *request, byte const *payload,
+                        WireResponse *response, byte *reply,
+                        size_t capacity )
+{
+        return exchange( fd, request, payload, NULL, 0, response, reply,
+                        capacity );
+}
+
+bool wireCallPassing( int fd, WireRequest const *request, int const *fds,
+                        int fdCount, WireResponse *response )
+{
+        return exchange( fd, request, NULL, fds, fdCount, response, NULL, 0 );
+}
@@ -0,0 +1,253 @@
+/**
+        @file wire.h
+        @author James O Kocak (jokocak)
+
+        The header file for the wire.c component of the program. This
+        component frames the requests aesd answers over its Unix socket and
+        the responses it sends back, and makes blocking calls for clients.
+        Every request is a 32-byte header followed by its payload; every
+        response is a 12-byte header followed by its payload. Numbers are
+        little-endian. A request's tag is echoed in its response, so a client
+        can match them up. Descriptors can travel with a header as
+        SCM_RIGHTS, which is how a shared ring is handed over.
+
+        Request header:    0  payload length
+                           4  tag
+                           8  key ID
+                          12  operation
+                          13  mode
+                          14  zero
+                          16  IV or initial counter block
+
+        Response header:   0  payload length
+                           4  tag
+                           8  status
+                           9  zero
+ */
+
+#ifndef _WIRE_H_
+#define _WIRE_H_
+
+#include "aes.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Bytes in a request header. */
+#define WIRE_REQUEST_SIZE 32
+
+/** Bytes in a response header. */
+#define WIRE_RESPONSE_SIZE 12
+
+/**
+        Most payload bytes one request may carry. The daemon holds each
+        request whole, so this bounds its memory per connection.
+ */
+#define WIRE_MAX_PAYLOAD ( 64 << 20 )
+
+/** Most descriptors one request may pass. */
+#define WIRE_MAX_FDS 4
+
+/** What a request asks for. */
+typedef enum {
+        /** Expand the 16-byte key in the payload and keep it under the ID. */
+        WIRE_LOAD_KEY = 1,
+
+        /** Encrypt the payload. */
+        WIRE_ENCRYPT,
+
+        /** Decrypt the payload. */
+        WIRE_DECRYPT,
+
+        /**
+                Take the shared ring whose memfd and eventfds come with the
+                header, as described in shm.h. There is no payload.
+         */
+        WIRE_ATTACH
+} WireOp;
+
+/** The mode a request encrypts or decrypts with. */
+typedef enum {
+        /** Blocks on their own; the payload is a multiple of 16 bytes. */
+        WIRE_ECB,
+
+        /** CTR mode from the IV; any payload length. */
+        WIRE_CTR,
+
+        /**
+                GCM with the first 12 bytes of the IV. Encrypting appends the
+                tag to the payload; decrypting checks and removes it.
+         */
+        WIRE_GCM,
+
+        /** Number of modes; not a mode itself. */
+        WIRE_MODE_COUNT
+} WireMode;
+
+/** How a request turned out. */
+typedef enum {
+        /** The response payload holds the result. */
+        WIRE_OK,
+
+        /** The header had an unknown operation or mode. */
+        WIRE_BAD_REQUEST,
+
+        /** No key has been loaded under the ID. */
+        WIRE_UNKNOWN_KEY,
+
+        /** The payload length doesn't suit the operation or mode. */
+        WIRE_BAD_LENGTH,
+
+        /** A GCM tag didn't match. */
+        WIRE_AUTH_FAILED,
+
+        /**
+                The payload was over WIRE_MAX_PAYLOAD. The daemon closes the
+                connection after saying so. From a shared ring, it means a
+                GCM payload was too large for the daemon to copy in order to
+                verify it; the ring stays up.
+         */
+        WIRE_TOO_LARGE,
+
+        /** The daemon holds as many keys as it can. */
+        WIRE_KEYS_FULL,
+
+        /**
+                The shared ring's descriptors were missing, or its region
+                wasn't sealed or laid out properly, or the connection already
+                has one.
+         */
+        WIRE_BAD_RING,
+
+        /** Number of statuses; not a status itself. */
+        WIRE_STATUS_COUNT
+} WireStatus;
+
+/** A request header. */
+typedef struct {
+        /** Number of payload bytes after the header. */
+        uint32_t length;
+
+        /** A number of the client's choosing, echoed in the response. */
+        uint32_t tag;
+
+        /** The key to use, or to load. */
+        uint32_t keyId;
+
+        /** The operation, a WireOp. */
+        byte op;
+
+        /** The mode, a WireMode. */
+        byte mode;
+
+        /** The IV or initial counter block. */
+        byte iv[ BLOCK_SIZE ];
+} WireRequest;
+
+/** A response header. */
+typedef struct {
+        /** Number of payload bytes after the header. */
+        uint32_t length;
+
+        /** The tag of the request answered. */
+        uint32_t tag;
+
+        /** The status, a WireStatus. */
+        byte status;
+} WireResponse;
+
+#endif
+
+/**
+        This function stores a request header in its wire form.
+
+        @param bytes Where to store the header
+        @param request The header
+ */
+void wirePackRequest( byte bytes[ WIRE_REQUEST_SIZE ],
+                        WireRequest const *request );
+
+/**
+        This function reads a request header from its wire form.
+
+        @param request Where to store the header
+        @param bytes The header's bytes
+        @return False if the operation or mode is unknown or the reserved
+                bytes aren't zero
+ */
+bool wireUnpackRequest( WireRequest *request,
+                        byte const bytes[ WIRE_REQUEST_SIZE ] );
+
+/**
+        This function stores a response header in its wire form.
+
+        @param bytes Where to store the header
+        @param response The header
+ */
+void wirePackResponse( byte bytes[ WIRE_RESPONSE_SIZE ],
+                        WireResponse const *response );
+
+/**
+        This function reads a response header from its wire form.
+
+        @param response Where to store the header
+        @param bytes The header's bytes
+ */
+void wireUnpackResponse( WireResponse *response,
+                        byte const bytes[ WIRE_RESPONSE_SIZE ] );
+
+/**
+        This function describes a status for error messages.
+
+        @param status The status
+        @return A short description
+ */
+char const *wireStatusName( WireStatus status );
+
+/**
+        This function parses a key ID, a decimal number of at most 32 bits.
+
+        @param text The text to parse, which must hold only the number
+        @param id Where to store the ID
+        @return False if the text isn't a key ID
+ */
+bool wireParseKeyId( char const *text, uint32_t *id );
+
+/**
+        This function connects to the daemon listening on a socket.
+
+        @param path The socket's path
+        @return The connected socket, or -1 with errno set
+ */
+int wireConnect( char const *path );
+
+/**
+        This function sends one request and waits for its response. The
+        header and payload go out in a single system call where the socket
+        takes them.
+
+        @param fd The connected socket
+        @param request The request header
+        @param payload The request's payload
+        @param response Where to store the response header
+        @param reply Where to store the response's payload
+        @param capacity The number of bytes reply can hold
+        @return False if the connection failed or the response didn't fit
+ */
+bool wireCall( int fd, WireRequest const *request, byte const *payload,
+                        WireResponse *response, byte *reply,
+                        size_t capacity );
+
+/**
+        This function sends one request with descriptors passed alongside
+        its header, and waits for a response with no payload.
+
+        @param fd The connected socket
+        @param request The request header, with no payload
+        @param fds The descriptors to pass
+        @param fdCount The number of descriptors, at most WIRE_MAX_FDS
+        @param response Where to store the response header
+        @return False if the connection failed or the response had a payload
+ */
+bool wireCallPassing( int fd, WireRequest const *request, int const *fds,
+                        int fdCount, WireResponse *response );
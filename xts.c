@@ -0,0 +1,164 @@
+/**
+        @file xts.c
+        @author James O Kocak (jokocak)
+
+        This component implements XTS-AES. For each data unit the tweaks of
+        all its blocks are generated first, then the unit is whitened,
+        encrypted with one bulk call so the backends can interleave its
+        blocks, and whitened again.
+ */
+
+#include "xts.h"
+#include <string.h>
+
+#if defined( __SSE2__ )
+#include <emmintrin.h>
+#endif
+
+/** Number of bits in a byte. */
+#define BYTE_BITS 8
+
+/** What x^128 reduces to in XTS's GF(2^128), x^7 + x^2 + x + 1. */
+#define XTS_REDUCER 0x87
+
+void xtsInitKey( XtsKey *key, byte const keyBytes[ XTS_KEY_SIZE ],
+                        size_t unitSize )
+{
+        aesInitKey( &key->data, keyBytes );
+        aesInitKey( &key->tweak, keyBytes + BLOCK_SIZE );
+        key->unitSize = unitSize;
+}
+
+void xtsTweaks( byte const tweak[ BLOCK_SIZE ], byte *tweaks, size_t count )
+{
+        size_t i = 0;
+#if defined( __SSE2__ )
+        // XTS stores the element little-endian, so doubling is a left shift
+        __m128i t = _mm_loadu_si128( ( __m128i const * ) tweak );
+        __m128i carries = _mm_set_epi32( 1, 1, 1, XTS_REDUCER );
+        for ( i = 0; i < count; i++ ) {
+                _mm_storeu_si128( ( __m128i * ) ( tweaks + i * BLOCK_SIZE ), t );
+
+                // Each lane's top bit moves to the next lane up, the top
+                // lane's wrapping round as the reduction
+                __m128i top = _mm_srai_epi32( t, 31 );
+                top = _mm_and_si128( _mm_shuffle_epi32( top, 0x93 ), carries );
+                t = _mm_xor_si128( _mm_slli_epi32( t, 1 ), top );
+        }
+#else
+        byte t[ BLOCK_SIZE ];
+        memcpy( t, tweak, BLOCK_SIZE );
+        for ( i = 0; i < count; i++ ) {
+                memcpy( tweaks + i * BLOCK_SIZE, t, BLOCK_SIZE );
+
+                int carry = t[ BLOCK_SIZE - 1 ] >> ( BYTE_BITS - 1 );
+                int j = 0;
+                for ( j = BLOCK_SIZE - 1; j > 0; j-- ) {
+                        t[ j ] = ( byte ) ( t[ j ] << 1 | t[ j - 1 ] >>
+                                ( BYTE_BITS - 1 ) );
+                }
+
+                t[ 0 ] = ( byte ) ( t[ 0 ] << 1 ^ ( carry ? XTS_REDUCER : 0 ) );
+        }
+#endif
+}
+
+/**
+        This function XORs tweaks into blocks.
+
+        @param in The blocks
+        @param out Where to store the result
+        @param tweaks The tweaks, one per block
+        @param length The number of bytes
+ */
+static void whiten( byte const *in, byte *out, byte const *tweaks,
+                        size_t length )
+{
+        size_t i = 0;
+        for ( i = 0; i < length; i += sizeof( uint64_t ) ) {
+                uint64_t a, b;
+                memcpy( &a, in + i, sizeof( a ) );
+                memcpy( &b, tweaks + i, sizeof( b ) );
+                a ^= b;
+                memcpy( out + i, &a, sizeof( a ) );
+        }
+}
+
+/**
+        This function encrypts or decrypts the blocks from in to out, one
+        data unit, or the part of one the range covers, at a time.
+
+        @param key The XTS key
+        @param offset Where in the data in starts
+        @param in The bytes to transform
+        @param out Where to store the result
+        @param length The number of bytes
+        @param decrypting Whether to decrypt rather than encrypt
+ */
+static void xtsCrypt( XtsKey const *key, uint64_t offset, byte const *in,
+                        byte *out, size_t length, bool decrypting )
+{
+        byte tweaks[ XTS_MAX_UNIT ];
+        while ( length > 0 ) {
+                // The unit's number, little-endian, encrypted with the tweak key
+                uint64_t unit = offset / key->unitSize;
+                size_t first = ( size_t ) ( offset % key->unitSize ) / BLOCK_SIZE;
+                byte tweak[ BLOCK_SIZE ] = { 0 };
+                int i = 0;
+                for ( i = 0; i < ( int ) sizeof( unit ); i++ ) {
+                        tweak[ i ] = ( byte ) ( unit >> i * BYTE_BITS );
+                }
+
+                aesEncryptWithContext( &key->tweak, tweak );
+
+                // Tweaks for the blocks before the range are skipped over
+                size_t blocks = key->unitSize / BLOCK_SIZE - first;
+                size_t span = blocks * BLOCK_SIZE;
+                if ( span > length ) {
+                        span = length;
+                }
+
+                xtsTweaks( tweak, tweaks, first + span / BLOCK_SIZE );
+                byte const *own = tweaks + first * BLOCK_SIZE;
+                whiten( in, out, own, span );
+                if ( decrypting ) {
+                        aesDecryptBlocks( &key->data, out, out,
+                                        span / BLOCK_SIZE );
+                } else {
+                        aesEncryptBlocks( &key->data, out, out,
+                                        span / BLOCK_SIZE );
+                }
+
+                whiten( out, out, own, span );
+                in += span;
+                out += span;
+                offset += span;
+                length -= span;
+        }
+}
+
+void xtsEncrypt( XtsKey const *key, uint64_t offset, byte const *in,
+                        byte *out, size_t length )
+{
+        xtsCrypt( key, offset, in, out, length, false );
+}
+
+void xtsDecrypt( XtsKey const *key, uint64_t offset, byte const *in,
+                        byte *out, size_t length )
+{
+        xtsCrypt( key, offset, in, out, length, true );
+}
+
+void xtsEncryptChunk( void *arg, byte const *in, byte *out,
+                        size_t length, off_t offset )
+{
+        xtsCrypt( ( XtsKey const * ) arg, ( uint64_t ) offset, in, out,
+                        length, false );
+}
+
+void xtsDecryptChunk( void *arg, byte const *in, byte *out,
+                        size_t length, off_t offset )
+{
+        xtsCrypt( ( XtsKey const * ) arg, ( uint64_t ) offset, in, out,
+                        length, true );
+}
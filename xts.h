@@ -0,0 +1,120 @@
+/**
+        @file xts.h
+        @author James O Kocak (jokocak)
+
+        The header file for the xts.c component of the program. This
+        component implements XTS-AES (IEEE 1619) for sector-addressed
+        storage: the data is cut into data units, normally disk sectors,
+        and each unit is encrypted on its own under a tweak derived from its
+        number, so any unit can be read or written without its neighbours.
+ */
+
+#ifndef _XTS_H_
+#define _XTS_H_
+
+#include "aes.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/** Number of bytes in an XTS key: the data key, then the tweak key. */
+#define XTS_KEY_SIZE ( 2 * BLOCK_SIZE )
+
+/** Data unit size of a classic disk sector. */
+#define XTS_UNIT_512 512
+
+/** Data unit size of an advanced-format sector or a page. */
+#define XTS_UNIT_4096 4096
+
+/** Largest data unit, which bounds the tweak buffer. */
+#define XTS_MAX_UNIT XTS_UNIT_4096
+
+/** The two expanded keys and the data unit size. */
+typedef struct {
+        /** The key the data is encrypted with. */
+        AesContext data;
+
+        /** The key the unit numbers are encrypted with. */
+        AesContext tweak;
+
+        /** Number of bytes in each data unit. */
+        size_t unitSize;
+} XtsKey;
+
+#endif
+
+/**
+        This function expands both halves of an XTS key.
+
+        @param key The key to fill in
+        @param keyBytes The data key followed by the tweak key
+        @param unitSize The number of bytes in a data unit, a multiple of
+                        BLOCK_SIZE no larger than XTS_MAX_UNIT
+ */
+void xtsInitKey( XtsKey *key, byte const keyBytes[ XTS_KEY_SIZE ],
+                        size_t unitSize );
+
+/**
+        This function fills in count consecutive tweaks, each the one before
+        it multiplied by x in GF(2^128), the first being tweak itself. On
+        SSE2 each doubling is four 32-bit lane shifts with the carries
+        rotated in from the neighbouring lane.
+
+        @param tweak The first tweak
+        @param tweaks Where to store the tweaks, count * BLOCK_SIZE bytes
+        @param count The number of tweaks
+ */
+void xtsTweaks( byte const tweak[ BLOCK_SIZE ], byte *tweaks, size_t count );
+
+/**
+        This function encrypts length bytes from in to out, starting offset
+        bytes into the data, which may be the same buffer. offset and length
+        must be multiples of BLOCK_SIZE, but needn't line up with the data
+        units, and only the units they overlap are touched.
+
+        @param key The XTS key
+        @param offset Where in the data in starts
+        @param in The bytes to encrypt
+        @param out Where to store the result
+        @param length The number of bytes
+ */
+void xtsEncrypt( XtsKey const *key, uint64_t offset, byte const *in,
+                        byte *out, size_t length );
+
+/**
+        This function decrypts length bytes from in to out, like xtsEncrypt.
+
+        @param key The XTS key
+        @param offset Where in the data in starts
+        @param in The bytes to decrypt
+        @param out Where to store the result
+        @param length The number of bytes
+ */
+void xtsDecrypt( XtsKey const *key, uint64_t offset, byte const *in,
+                        byte *out, size_t length );
+
+/**
+        This function encrypts one chunk of a file, matching the pipeline's
+        ChunkFunction. The chunk's offset picks its data units.
+
+        @param arg The XtsKey
+        @param in The chunk's bytes
+        @param out Where to store the result
+        @param length The number of bytes in the chunk
+        @param offset Where the chunk starts in the file
+ */
+void xtsEncryptChunk( void *arg, byte const *in, byte *out,
+                        size_t length, off_t offset );
+
+/**
+        This function decrypts one chunk of a file, matching the pipeline's
+        ChunkFunction.
+
+        @param arg The XtsKey
+        @param in The chunk's bytes
+        @param out Where to store the result
+        @param length The number of bytes in the chunk
+        @param offset Where the chunk starts in the file
+ */
+void xtsDecryptChunk( void *arg, byte const *in, byte *out,
+                        size_t length, off_t offset );